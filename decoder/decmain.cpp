@@ -44,6 +44,8 @@
 
 int verbose = 0;
 int skip = 0;
+int resilient = 0;
+const char *timing_log = NULL;
 
 const char *chroma2string (dirac_chroma_t chroma)
 {
@@ -87,6 +89,55 @@ static int WritePicData (dirac_decoder_t *decoder, FILE *fp)
 
 
 
+/* The timing log is JSON if its name ends in .json, and CSV otherwise */
+static int TimingLogIsJson (const char *name)
+{
+    size_t len = strlen(name);
+    return len >= 5 && strcmp(name + len - 5, ".json") == 0;
+}
+
+static void WriteTimingHeader (FILE *fp, int json)
+{
+    static const char *names[TIMING_NUM_STAGES] = DIRAC_TIMING_STAGE_NAMES;
+    int i;
+
+    if (json)
+    {
+        fprintf (fp, "[");
+        return;
+    }
+    fprintf (fp, "frame");
+    for (i = 0; i < TIMING_NUM_STAGES; i++)
+        fprintf (fp, ",%s", names[i]);
+    fprintf (fp, ",total\n");
+}
+
+/* Write the time in ms spent in each stage of decoding a frame */
+static void WriteTimingRecord (FILE *fp, int json, int first, int frame_num,
+                               const dirac_stage_times_t *times)
+{
+    static const char *names[TIMING_NUM_STAGES] = DIRAC_TIMING_STAGE_NAMES;
+    double total = 0.0;
+    int i;
+
+    if (json)
+        fprintf (fp, "%s\n  {\"frame\": %d", first ? "" : ",", frame_num);
+    else
+        fprintf (fp, "%d", frame_num);
+    for (i = 0; i < TIMING_NUM_STAGES; i++)
+    {
+        total += times->seconds[i];
+        if (json)
+            fprintf (fp, ", \"%s\": %.3f", names[i], 1000.0*times->seconds[i]);
+        else
+            fprintf (fp, ",%.3f", 1000.0*times->seconds[i]);
+    }
+    if (json)
+        fprintf (fp, ", \"total\": %.3f}", 1000.0*total);
+    else
+        fprintf (fp, ",%.3f\n", 1000.0*total);
+}
+
 static void FreeFrameBuffer (dirac_decoder_t *decoder)
 {
     assert (decoder != NULL);
@@ -107,9 +158,13 @@ static void DecodeDirac (const char *iname, const char *oname)
     dirac_decoder_t *decoder = NULL;
     FILE *ifp;
     FILE *fpdata;
+    FILE *fptiming = NULL;
+    int timing_json = 0;
     unsigned char buffer[8192];
     int bytes = 0;
     int num_frames = 0;
+    int flushing = 0;
+    int flushed = 0;
     char infile_name[FILENAME_MAX];
     char outfile_hdr[FILENAME_MAX];
     char outfile_data[FILENAME_MAX];
@@ -132,11 +187,26 @@ static void DecodeDirac (const char *iname, const char *oname)
         return;
     }
 
+    if (timing_log)
+    {
+        if ((fptiming = fopen (timing_log, "w")) == NULL)
+        {
+            perror(timing_log);
+            fclose(fpdata);
+            fclose(ifp);
+            return;
+        }
+        timing_json = TimingLogIsJson(timing_log);
+        WriteTimingHeader(fptiming, timing_json);
+    }
+
     /* initialise the decoder */
     decoder = dirac_decoder_init(verbose);
 
     assert (decoder != NULL);
 
+    if (resilient)
+        dirac_set_resilient(decoder, 1);
 
     start_t=clock();
     do
@@ -154,6 +224,17 @@ static void DecodeDirac (const char *iname, const char *oname)
             bytes = fread (buffer, 1, sizeof(buffer), ifp);
             if (bytes)
                 dirac_buffer (decoder, buffer, buffer + bytes);
+            else if (resilient)
+            {
+                /*
+                * At the end of a damaged stream, output the pictures the
+                * parser still holds
+                */
+                flushing = !flushed;
+                if (flushing)
+                    dirac_flush (decoder);
+                flushed = 1;
+            }
             break;
 
         case STATE_SEQUENCE:
@@ -212,6 +293,13 @@ static void DecodeDirac (const char *iname, const char *oname)
             {
                 fprintf (stdout, "\nFRAME_AVAIL : frame_num=%d",
                     decoder->frame_num);
+                if (resilient)
+                    fprintf (stdout, " units_dropped=%d bytes_skipped=%d decode_errors=%d missing_refs=%d concealed=%d",
+                        decoder->frame_errors.units_dropped,
+                        decoder->frame_errors.bytes_skipped,
+                        decoder->frame_errors.decode_errors,
+                        decoder->frame_errors.missing_refs,
+                        decoder->frame_errors.concealed);
             }
             /* picture available for display */
             if (!WritePicData(decoder, fpdata))
@@ -219,6 +307,9 @@ static void DecodeDirac (const char *iname, const char *oname)
                 perror("Write failed");
                 goto cleanup;
             }
+            if (fptiming)
+                WriteTimingRecord(fptiming, timing_json, num_frames == 1,
+                                  decoder->frame_num, &decoder->frame_times);
             break;
 
         case STATE_INVALID:
@@ -229,7 +320,7 @@ static void DecodeDirac (const char *iname, const char *oname)
         default:
             continue;
         }
-    } while (bytes > 0 && state != STATE_INVALID);
+    } while ((bytes > 0 || flushing) && state != STATE_INVALID);
 cleanup:
     stop_t=clock();
 
@@ -237,6 +328,27 @@ cleanup:
         fprintf (stdout, "\nTime per frame: %g",
                 (double)(stop_t-start_t)/(double)(CLOCKS_PER_SEC*num_frames));
 
+    if (resilient && (decoder->total_errors.units_dropped ||
+                      decoder->total_errors.bytes_skipped ||
+                      decoder->total_errors.decode_errors ||
+                      decoder->total_errors.missing_refs ||
+                      decoder->total_errors.concealed))
+    {
+        fprintf (stderr, "Errors in %s: %d units dropped, %d bytes skipped, %d decode errors, "
+                 "%d pictures with missing references, %d pictures concealed\n", iname,
+                 decoder->total_errors.units_dropped,
+                 decoder->total_errors.bytes_skipped,
+                 decoder->total_errors.decode_errors,
+                 decoder->total_errors.missing_refs,
+                 decoder->total_errors.concealed);
+    }
+
+    if (fptiming)
+    {
+        if (timing_json)
+            fprintf (fptiming, "\n]\n");
+        fclose(fptiming);
+    }
     fclose(fpdata);
     fclose(ifp);
 
@@ -248,10 +360,12 @@ cleanup:
 static void printUsage(const char *str)
 {
     fprintf (stderr, "DIRAC wavelet video decoder.\n");
-    fprintf (stderr, "Usage: %s [-h|-help] [-v|-verbose] [-s|-skip] input-file output-file \\\n"
+    fprintf (stderr, "Usage: %s [-h|-help] [-v|-verbose] [-s|-skip] [-r|-resilient] [-timing_log file] input-file output-file \\\n"
                    "\t-h|-help     Display help message\n"
                    "\t-v|-verbose  Verbose mode\n"
                    "\t-s|-skip     Skip decoding L2 frames\n"
+                   "\t-r|-resilient Conceal errors in a damaged stream rather than stopping\n"
+                   "\t-timing_log  Write per-frame stage times in ms to file (JSON if it ends in .json, else CSV)\n"
                    "\tinput-file   dirac file name excluding extension\n"
                    "\touput-file   decoded output file excluding extension\n",
                    str);
@@ -283,6 +397,16 @@ extern int main (int argc, char **argv)
             {
                 skip = 1;
             }
+            else if (strcmp (argv[i], "-r") == 0 ||
+                strcmp (argv[i], "-resilient")== 0)
+            {
+                resilient = 1;
+            }
+            else if (strcmp (argv[i], "-timing_log") == 0 && i+1 < argc)
+            {
+                timing_log = argv[++i];
+                offset++;
+            }
             else if (strcmp (argv[i], "-h") == 0 ||
                 strcmp (argv[i], "-help")== 0)
             {
@@ -51,6 +51,7 @@
 #include <cassert>
 #include <string>
 #include <libdirac_encoder/dirac_encoder.h>
+#include <libdirac_common/stage_timer.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -94,6 +95,7 @@ static void display_help()
     cout << "\nDC4K24           bool    false          Use DIGITAL CINEMA 4K compression presets";
     cout << "\nfull_search     ulong ulong  0UL 0UL         Use full search motion estimation";
     cout << "\ncombined_me       bool    false         Use a combination of all 3 components to do ME";
+    cout << "\nfast_me           bool    false         Use fast predictive motion estimation, for real-time encoding";
     cout << "\nwidth             ulong   Preset        Width of frame";
     cout << "\nheight            ulong   Preset        Length of frame";
     cout << "\nheight            ulong   Preset        Length of frame";
@@ -112,7 +114,11 @@ static void display_help()
     cout << "\ncpd               ulong   0UL           Perceptual weighting - vertical cycles per deg.";
     cout << "\nqf                float   0.0F          Overall quality factor (>0, typically: 7=medium, 9=high)";
     cout << "\ntargetrate        ulong   0UL           Target Bit Rate in Kbps";
-    cout << "\nlossless          bool    false         Lossless coding (overrides qf)";
+    cout << "\npass              ulong   0UL           Two-pass encoding: 1 - gather statistics only, 2 - encode to targetrate using them";
+    cout << "\nstats             string  dirac_2pass.log  Statistics file for two-pass encoding";
+    cout << "\nvbv_size          ulong   0UL           Decoder buffer size in Kbits for constant bit rate (needs targetrate)";
+    cout << "\nvbv_delay         ulong   0UL           Initial decoder buffer delay in ms (0 - start at 90% full)";
+    cout << "\nlossless          bool    false         Lossless coding (overrides qf; filters default to LEGALL5_3, mv_prec to 1/2)";
     cout << "\niwlt_filter       string  DD13_7         Intra frame Transform Filter (DD9_7 LEGALL5_3 DD13_7 HAAR0 HAAR1 FIDELITY DAUB9_7)";
     cout << "\nrwlt_filter       string  DD13_7     Inter frame Transform Filter (DD9_7 LEGALL5_3 DD13_7 HAAR0 HAAR1 FIDELITY DAUB9_7)";
     cout << "\nwlt_depth         ulong   4             Transform Depth";
@@ -122,6 +128,9 @@ static void display_help()
     cout << "\nprefilter         string/int NO_PF 0    Prefilter input giving filter name (NO_PF, CWM, RECTLP, DIAGLP) and strength (0-10)";
     cout << "\nuse_vlc           bool    false         Use VLC for entropy coding of coefficients";
     cout << "\nlocal             bool    false         Write diagnostics & locally decoded video";
+    cout << "\ntiming_log        string  [ none ]      Write per-picture stage times in ms (JSON if name ends in .json, else CSV)";
+    cout << "\nstats_log         string  [ none ]      Write per-picture coding statistics as JSON";
+    cout << "\nquality_regions   ulong ulong 1 1       Also measure quality in a grid of regions across and down the picture";
     cout << "\nverbose           bool    false         Verbose mode";
     cout << "\nh|help            bool    false         Display help message";
     cout << "\ninput             string  [ required ]  Input file name";
@@ -327,6 +336,164 @@ bool WriteDiagnosticsData (std::ofstream &fdata, dirac_encoder_t *encoder)
     return ret_stat;
 }
 
+// The timing log is JSON if its name ends in .json, and CSV otherwise
+bool TimingLogIsJson(const std::string& name)
+{
+    return name.length() >= 5 && name.compare(name.length()-5, 5, ".json") == 0;
+}
+
+void WriteTimingHeader(std::ofstream &ftiming, bool json)
+{
+    static const char* names[TIMING_NUM_STAGES] = DIRAC_TIMING_STAGE_NAMES;
+
+    if (json)
+    {
+        ftiming << "[";
+        return;
+    }
+    ftiming << "picture";
+    for (int i=0; i<TIMING_NUM_STAGES; ++i)
+        ftiming << "," << names[i];
+    ftiming << ",total" << std::endl;
+}
+
+// Write the time in ms spent in each stage of coding a picture
+void WriteTimingRecord(std::ofstream &ftiming, bool json, bool first,
+                       int pnum, const dirac_stage_times_t& times)
+{
+    static const char* names[TIMING_NUM_STAGES] = DIRAC_TIMING_STAGE_NAMES;
+    double total = 0.0;
+
+    if (json)
+        ftiming << (first ? "" : ",") << "\n  {\"picture\": " << pnum;
+    else
+        ftiming << pnum;
+    for (int i=0; i<TIMING_NUM_STAGES; ++i)
+    {
+        total += times.seconds[i];
+        if (json)
+            ftiming << ", \"" << names[i] << "\": " << 1000.0*times.seconds[i];
+        else
+            ftiming << "," << 1000.0*times.seconds[i];
+    }
+    if (json)
+        ftiming << ", \"total\": " << 1000.0*total << "}";
+    else
+        ftiming << "," << 1000.0*total << std::endl;
+}
+
+// The per-picture statistics log, written by the encoder's statistics callback
+struct StatsLog
+{
+    std::ofstream *file;
+    bool first;
+};
+
+// Write a number in JSON, which has no infinities (e.g. the PSNR of a
+// lossless picture)
+void WriteJsonNumber(std::ofstream &fstats, double val)
+{
+    if (val == val && std::fabs(val) <= std::numeric_limits<double>::max())
+        fstats << val;
+    else
+        fstats << "null";
+}
+
+// Write an array of values from the subbands of each component
+void WriteBandArray(std::ofstream &fstats, const char *name,
+                    const dirac_enc_picture_stats_t *stats, int field)
+{
+    fstats << ", \"" << name << "\": [";
+    for (int c=0; c<3; ++c)
+    {
+        fstats << (c ? ", [" : "[");
+        for (int b=0; b<stats->num_bands; ++b)
+        {
+            const dirac_band_stats_t &band = stats->bands[c][b];
+            fstats << (b ? ", " : "");
+            if (field == 0)
+                fstats << band.qindex;
+            else if (field == 1)
+                fstats << band.bits;
+            else
+                fstats << band.skipped;
+        }
+        fstats << "]";
+    }
+    fstats << "]";
+}
+
+// Write an array of values from the regions of each component, in raster order
+void WriteRegionArray(std::ofstream &fstats, const char *name,
+                      const dirac_enc_picture_stats_t *stats,
+                      const double *const values[3])
+{
+    const int num_regions = stats->region_xnum*stats->region_ynum;
+
+    fstats << ", \"" << name << "\": [";
+    for (int c=0; c<3; ++c)
+    {
+        fstats << (c ? ", [" : "[");
+        for (int r=0; r<num_regions; ++r)
+        {
+            fstats << (r ? ", " : "");
+            WriteJsonNumber(fstats, values[c][r]);
+        }
+        fstats << "]";
+    }
+    fstats << "]";
+}
+
+// Statistics callback: write the statistics of a picture as a JSON object
+void WriteStatsRecord(const dirac_enc_picture_stats_t *stats, void *user_data)
+{
+    static const char* names[TIMING_NUM_STAGES] = DIRAC_TIMING_STAGE_NAMES;
+    StatsLog *log = (StatsLog *)user_data;
+    std::ofstream &fstats = *log->file;
+
+    fstats << (log->first ? "" : ",") << "\n  {\"picture\": " << stats->pnum;
+    fstats << ", \"intra\": " << (stats->ptype == INTRA_PICTURE ? "true" : "false");
+    fstats << ", \"ref\": " << (stats->rtype == REFERENCE_PICTURE ? "true" : "false");
+    fstats << ", \"qf\": " << stats->qf;
+    fstats << ", \"bits\": " << stats->bits.pic_bits;
+    fstats << ", \"mv_bits\": " << stats->bits.mv_bits;
+    fstats << ", \"comp_bits\": [" << stats->bits.ycomp_bits << ", "
+           << stats->bits.ucomp_bits << ", " << stats->bits.vcomp_bits << "]";
+    WriteBandArray(fstats, "qindex", stats, 0);
+    WriteBandArray(fstats, "band_bits", stats, 1);
+    WriteBandArray(fstats, "skipped", stats, 2);
+    fstats << ", \"intra_ratio\": " << stats->intra_ratio;
+    fstats << ", \"mean_sad\": " << stats->mean_sad;
+    fstats << ", \"mean_mvcost\": " << stats->mean_mvcost;
+    fstats << ", \"mean_block_cost\": " << stats->mean_block_cost;
+    fstats << ", \"buffer_fill\": " << stats->buffer_fill;
+    fstats << ", \"psnr\": [";
+    for (int c=0; c<3; ++c)
+    {
+        fstats << (c ? ", " : "");
+        WriteJsonNumber(fstats, stats->psnr[c]);
+    }
+    fstats << "], \"ssim\": [";
+    for (int c=0; c<3; ++c)
+    {
+        fstats << (c ? ", " : "");
+        fstats << stats->ssim[c];
+    }
+    fstats << "]";
+    if (stats->region_xnum > 0)
+    {
+        WriteRegionArray(fstats, "region_psnr", stats, stats->region_psnr);
+        WriteRegionArray(fstats, "region_ssim", stats, stats->region_ssim);
+    }
+    fstats << ", \"times_ms\": {";
+    for (int i=0; i<TIMING_NUM_STAGES; ++i)
+        fstats << (i ? ", \"" : "\"") << names[i] << "\": "
+               << 1000.0*stats->times.seconds[i];
+    fstats << "}}";
+
+    log->first = false;
+}
+
 bool ReadPicData (std::ifstream &fdata, unsigned char *buffer, int frame_size)
 {
     bool ret_stat = true;
@@ -518,6 +685,8 @@ void display_codec_params(dirac_encoder_context_t &enc_ctx)
         std::cout << " xbsep=" << enc_ctx.enc_params.xbsep;
         std::cout << " ybsep=" << enc_ctx.enc_params.ybsep << std::endl;
         std::cout << " \tMV Precision=" << MvPrecisionToString(enc_ctx.enc_params.mv_precision) << std::endl;
+        std::cout << " \tMotion Search=" << (enc_ctx.enc_params.full_search ? "Full" :
+                      (enc_ctx.enc_params.me_search == ME_SEARCH_PREDICTIVE ? "Fast Predictive" : "Hierarchical")) << std::endl;
         std::cout << " \tInter Frame Transform Filter=" << TransformFilterToString(enc_ctx.enc_params.inter_wlt_filter) << std::endl;
     }
     else
@@ -530,6 +699,11 @@ void display_codec_params(dirac_encoder_context_t &enc_ctx)
     std::cout << " \tField coding=" << (enc_ctx.enc_params.picture_coding_mode == 1? "true" : "false") << std::endl;
     std::cout << " \tLossless Coding=" << (enc_ctx.enc_params.lossless ? "true" : "false") << std::endl;
     std::cout << " \tEntropy Coding=" << (enc_ctx.enc_params.using_ac ? "Arithmetic Coding" : "Variable Length Coding") << std::endl;
+    if (enc_ctx.enc_params.rc_pass != 0)
+        std::cout << " \tTwo-pass encoding, pass " << enc_ctx.enc_params.rc_pass << std::endl;
+    if (enc_ctx.enc_params.vbv_size != 0)
+        std::cout << " \tDecoder buffer=" << enc_ctx.enc_params.vbv_size << " Kbits, delay="
+                  << enc_ctx.enc_params.vbv_delay << " ms" << std::endl;
 }
 
 int start_pos = 0;
@@ -537,6 +711,8 @@ int end_pos = -1;
 bool verbose = false;
 bool nolocal = true;
 int fields_factor = 1;
+std::string timing_log;
+std::string stats_log;
 
 bool parse_command_line(dirac_encoder_context_t& enc_ctx, int argc, char **argv)
 {
@@ -673,6 +849,12 @@ bool parse_command_line(dirac_encoder_context_t& enc_ctx, int argc, char **argv)
     // initialise the encoder context
     dirac_encoder_context_init (&enc_ctx, preset);
 
+    // Whether the wavelet filters have been chosen explicitly
+    bool intra_filter_set = false;
+    bool inter_filter_set = false;
+    // Whether the motion vector precision has been chosen explicitly
+    bool mv_prec_set = false;
+
     //now go over again and override video format presets with other values
     for(int i=1; i < argc; )
     {
@@ -824,6 +1006,11 @@ bool parse_command_line(dirac_encoder_context_t& enc_ctx, int argc, char **argv)
             parsed[i] = true;
 
         }
+        else if ( strcmp(argv[i], "-fast_me") == 0 )
+        {
+            parsed[i] = true;
+            enc_ctx.enc_params.me_search = ME_SEARCH_PREDICTIVE;
+        }
         else if ( strcmp(argv[i], "-combined_me") == 0 )
         {
             parsed[i] = true;
@@ -836,6 +1023,34 @@ bool parse_command_line(dirac_encoder_context_t& enc_ctx, int argc, char **argv)
             enc_ctx.enc_params.trate = strtoul(argv[i],NULL,10);
             parsed[i] = true;
         }
+        else if ( strcmp(argv[i], "-pass") == 0 )
+        {
+            parsed[i] = true;
+            i++;
+            enc_ctx.enc_params.rc_pass = strtoul(argv[i],NULL,10);
+            parsed[i] = true;
+        }
+        else if ( strcmp(argv[i], "-stats") == 0 )
+        {
+            parsed[i] = true;
+            i++;
+            enc_ctx.enc_params.rc_stats_file = argv[i];
+            parsed[i] = true;
+        }
+        else if ( strcmp(argv[i], "-vbv_size") == 0 )
+        {
+            parsed[i] = true;
+            i++;
+            enc_ctx.enc_params.vbv_size = strtoul(argv[i],NULL,10);
+            parsed[i] = true;
+        }
+        else if ( strcmp(argv[i], "-vbv_delay") == 0 )
+        {
+            parsed[i] = true;
+            i++;
+            enc_ctx.enc_params.vbv_delay = strtoul(argv[i],NULL,10);
+            parsed[i] = true;
+        }
         else if ( strcmp(argv[i], "-lossless") == 0 )
         {
             parsed[i] = true;
@@ -912,6 +1127,30 @@ bool parse_command_line(dirac_encoder_context_t& enc_ctx, int argc, char **argv)
             parsed[i] = true;
             nolocal = false;
         }
+        else if ( strcmp(argv[i], "-timing_log") == 0 )
+        {
+            parsed[i] = true;
+            i++;
+            timing_log = argv[i];
+            parsed[i] = true;
+        }
+        else if ( strcmp(argv[i], "-stats_log") == 0 )
+        {
+            parsed[i] = true;
+            i++;
+            stats_log = argv[i];
+            parsed[i] = true;
+        }
+        else if ( strcmp(argv[i], "-quality_regions") == 0 )
+        {
+            parsed[i] = true;
+            i++;
+            enc_ctx.enc_params.quality_regions_x = strtoul(argv[i],NULL,10);
+            parsed[i] = true;
+            i++;
+            enc_ctx.enc_params.quality_regions_y = strtoul(argv[i],NULL,10);
+            parsed[i] = true;
+        }
         else if ( strcmp(argv[i], "-start") == 0 )
         {
             parsed[i] = true;
@@ -1001,6 +1240,7 @@ bool parse_command_line(dirac_encoder_context_t& enc_ctx, int argc, char **argv)
             else
                 parsed[i] = true;
             enc_ctx.enc_params.intra_wlt_filter = wf;
+            intra_filter_set = true;
         }
         else if ( strcmp(argv[i], "-rwlt_filter") == 0 )
         {
@@ -1012,10 +1252,12 @@ bool parse_command_line(dirac_encoder_context_t& enc_ctx, int argc, char **argv)
             else
                 parsed[i] = true;
             enc_ctx.enc_params.inter_wlt_filter = wf;
+            inter_filter_set = true;
         }
         else if ( strcmp(argv[i], "-mv_prec") == 0 )
         {
             parsed[i]=true;
+            mv_prec_set = true;
             ++i;
             if(strcmp(argv[i], "1/2")==0)
             {
@@ -1041,6 +1283,20 @@ bool parse_command_line(dirac_encoder_context_t& enc_ctx, int argc, char **argv)
         i++;
     }//opt
 
+    // Lossless coding is faster with the LeGall (5,3) filter, for much the
+    // same compression, so use it unless another filter has been chosen.
+    // Likewise half-pel motion estimation saves about a tenth of the coding
+    // time for under 1% more data, unless a precision has been chosen.
+    if (enc_ctx.enc_params.lossless)
+    {
+        if (!intra_filter_set)
+            enc_ctx.enc_params.intra_wlt_filter = LEGALL5_3;
+        if (!inter_filter_set)
+            enc_ctx.enc_params.inter_wlt_filter = LEGALL5_3;
+        if (!mv_prec_set)
+            enc_ctx.enc_params.mv_precision = MV_PRECISION_HALF_PIXEL;
+    }
+
     // FIXME: currently only supporting vlc coding for iframe-only
     // sequences
     if (enc_ctx.enc_params.num_L1 != 0 && enc_ctx.enc_params.using_ac == 0)
@@ -1158,6 +1414,39 @@ int main (int argc, char* argv[])
         outimt = new std::ofstream(output_name_imt.c_str(),std::ios::out | std::ios::binary);
     }
 
+    // open the per-picture timing log
+    std::ofstream *outtiming = NULL;
+    const bool timing_json = TimingLogIsJson(timing_log);
+    bool first_timing = true;
+
+    if (timing_log.length() != 0)
+    {
+        outtiming = new std::ofstream(timing_log.c_str(), std::ios::out);
+        if (!*outtiming)
+        {
+            std::cerr << "Can't open timing log file: " << timing_log << std::endl;
+            return EXIT_FAILURE;
+        }
+        outtiming->setf(std::ios::fixed);
+        outtiming->precision(3);
+        WriteTimingHeader(*outtiming, timing_json);
+    }
+
+    // open the per-picture statistics log
+    StatsLog stats_log_data = { NULL, true };
+
+    if (stats_log.length() != 0)
+    {
+        stats_log_data.file = new std::ofstream(stats_log.c_str(), std::ios::out);
+        if (!*stats_log_data.file)
+        {
+            std::cerr << "Can't open statistics log file: " << stats_log << std::endl;
+            return EXIT_FAILURE;
+        }
+        stats_log_data.file->precision(6);
+        *stats_log_data.file << "[";
+    }
+
    /********************************************************************/
     //do the work!!
 
@@ -1197,6 +1486,10 @@ int main (int argc, char* argv[])
         return EXIT_FAILURE;
     }
 
+    if (stats_log_data.file)
+        dirac_encoder_set_picture_stats_callback(encoder, WriteStatsRecord,
+                                                 &stats_log_data);
+
 
     if (outimt)
        WriteDiagnosticsHeader ( *outimt, encoder );
@@ -1207,6 +1500,8 @@ int main (int argc, char* argv[])
 
     clock_t start_t, stop_t;
     start_t = clock();
+    const double start_time = dirac::StageClock();
+    double bytes_written = 0.0;
 
     bool go = true;
     do
@@ -1239,6 +1534,13 @@ int main (int argc, char* argv[])
 
                 outfile.write((char *)encoder->enc_buf.buffer,
                               encoder->enc_buf.size);
+                bytes_written += encoder->enc_buf.size;
+                if (outtiming && encoder->enc_pparams.pnum >= 0)
+                {
+                    WriteTimingRecord(*outtiming, timing_json, first_timing,
+                                      encoder->enc_pparams.pnum, encoder->enc_ptimes);
+                    first_timing = false;
+                }
                 break;
 
             case ENC_STATE_BUFFER:
@@ -1246,6 +1548,7 @@ int main (int argc, char* argv[])
             case ENC_STATE_EOS:
                 outfile.write((char *)encoder->enc_buf.buffer,
                 encoder->enc_buf.size);
+                bytes_written += encoder->enc_buf.size;
                 go = false;
                 break;
             case ENC_STATE_INVALID:
@@ -1265,6 +1568,7 @@ int main (int argc, char* argv[])
     } while (go);
 
     stop_t = clock();
+    const double elapsed_time = dirac::StageClock() - start_time;
 
     if ( verbose )
         std::cout << "The resulting bit-rate at "
@@ -1279,6 +1583,16 @@ int main (int argc, char* argv[])
            (double)(stop_t-start_t)/(double)(CLOCKS_PER_SEC*frames_loaded);
         std::cout<<std::endl<<std::endl;
     }
+
+    if ( (verbose || enc_ctx.enc_params.lossless) && bytes_written>0 && elapsed_time>0.0 )
+    {
+        const double pixels = double(frames_loaded)*
+                              encoder->enc_ctx.src_params.width*
+                              encoder->enc_ctx.src_params.height;
+        std::cout << "Compression ratio " << double(frames_loaded)*frame_size/bytes_written
+                  << ":1, throughput " << frames_loaded/elapsed_time << " frames/sec ("
+                  << pixels/(1.0e6*elapsed_time) << " Mpixels/sec)" << std::endl;
+    }
    /********************************************************************/
 
      // close the encoder
@@ -1298,6 +1612,21 @@ int main (int argc, char* argv[])
         outimt->close();
         delete outimt;
      }
+     // close the timing log
+    if (outtiming)
+    {
+        if (timing_json)
+            *outtiming << "\n]" << std::endl;
+        outtiming->close();
+        delete outtiming;
+    }
+    // close the statistics log
+    if (stats_log_data.file)
+    {
+        *stats_log_data.file << "\n]" << std::endl;
+        stats_log_data.file->close();
+        delete stats_log_data.file;
+    }
     // close the pic data file
     ip_pic_ptr.close();
 
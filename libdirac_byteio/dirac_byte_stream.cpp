@@ -45,7 +45,11 @@ using namespace std;
 
 DiracByteStream::DiracByteStream():
 ByteIO(),
-mp_prev_parse_unit(NULL)
+mp_prev_parse_unit(NULL),
+m_max_unit_size(0),
+m_input_ended(false),
+m_units_dropped(0),
+m_bytes_skipped(0)
 {
 }
 
@@ -84,6 +88,23 @@ void DiracByteStream::Reset(ParseUnitByteIO* p_curr_unit, int pos)
     SeekGet(pos, ios_base::beg);
 }
 
+void DiracByteStream::DropUnit(ParseUnitByteIO* p_curr_unit, int pos)
+{
+    // delete the unit - it's invalid
+    delete p_curr_unit;
+    // remove unwanted portion of bytes, leaving the search for the next
+    // potential parse-unit to start after the dropped unit's prefix
+    RemoveRedundantBytes(pos);
+    m_bytes_skipped += pos;
+    ++m_units_dropped;
+}
+
+void DiracByteStream::ResetErrorCounts()
+{
+    m_units_dropped = 0;
+    m_bytes_skipped = 0;
+}
+
 ParseUnitByteIO* DiracByteStream::GetNextParseUnit()
 {
     if(GetSize()==0)
@@ -99,6 +120,11 @@ ParseUnitByteIO* DiracByteStream::GetNextParseUnit()
         mp_prev_parse_unit=NULL;
         if(!GetSize())
             return NULL;
+
+        // Decoding a damaged unit can leave the stream failed, or positioned
+        // past the end of the unit, so search from the start of the next
+        mp_stream->clear();
+        SeekGet(0, ios_base::beg);
     }
 
     ParseUnitByteIO* p_curr_unit=NULL;
@@ -114,9 +140,24 @@ ParseUnitByteIO* DiracByteStream::GetNextParseUnit()
             return NULL;
         }
 
+        // A damaged offset can claim a unit longer than any picture, and
+        // waiting for its data would stall decoding
+        if (m_max_unit_size &&
+            (p_curr_unit->GetNextParseOffset()<0 ||
+             p_curr_unit->GetNextParseOffset()>m_max_unit_size))
+        {
+            DropUnit(p_curr_unit, pos);
+            continue;
+        }
+
         // skip past current unit
         if(!p_curr_unit->CanSkip())
         {
+            if (m_input_ended)
+            {
+                DropUnit(p_curr_unit, pos);
+                continue;
+            }
             Reset(p_curr_unit, pos);
             return NULL;
         }
@@ -129,10 +170,7 @@ ParseUnitByteIO* DiracByteStream::GetNextParseUnit()
         // look to see if next unit validates the current one
         if(!p_curr_unit->IsValid())
         {
-            // delete the unit - it's invalid
-            delete p_curr_unit;
-            // remove unwanted portion of bytes
-            RemoveRedundantBytes(pos);
+            DropUnit(p_curr_unit, pos);
             // look for next potential parse-unit
             continue;
         }
@@ -145,6 +183,7 @@ ParseUnitByteIO* DiracByteStream::GetNextParseUnit()
     {
        //std::cerr << "Size="<<GetSize() << " Un-useful bytes=" << remove_size << std::endl;
         RemoveRedundantBytes(remove_size);
+        m_bytes_skipped += remove_size;
     }
 
      mp_prev_parse_unit=p_curr_unit;
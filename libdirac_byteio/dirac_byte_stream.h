@@ -95,6 +95,36 @@ namespace dirac
         */
         DiracByteStats GetSequenceStats() const;
 
+        /**
+        * Sets the size beyond which a parse-unit is taken to be corrupt
+        *@param size Maximum number of bytes in a parse-unit, or 0 for no limit
+        */
+        void SetMaxUnitSize(int size) { m_max_unit_size = size; }
+
+        /**
+        * Marks the end of the input. A parse-unit that runs past the end of
+        * the data can then never be completed, so is dropped as invalid
+        * rather than waited for
+        */
+        void SetInputEnded() { m_input_ended = true; }
+
+        /**
+        * Gets the number of parse-units dropped as invalid since the counts
+        * were last reset
+        */
+        int GetUnitsDropped() const { return m_units_dropped; }
+
+        /**
+        * Gets the number of bytes discarded in finding valid parse-units
+        * since the counts were last reset
+        */
+        int GetBytesSkipped() const { return m_bytes_skipped; }
+
+        /**
+        * Resets the counts of dropped parse-units and discarded bytes
+        */
+        void ResetErrorCounts();
+
         /**
         * Adds a random access point to the current Dirac byte stream
         *@param p_seqheader_byteio Sequence header data. 
@@ -132,6 +162,8 @@ namespace dirac
 
         void Reset(ParseUnitByteIO* p_curr_unit, int pos);
 
+        void DropUnit(ParseUnitByteIO* p_curr_unit, int pos);
+
         private:
 
         /**
@@ -151,6 +183,26 @@ namespace dirac
         */
         DiracByteStats      m_sequence_stats;
 
+        /**
+        * Maximum size of a parse-unit, or 0 for no limit
+        */
+        int m_max_unit_size;
+
+        /**
+        * True once no more bytes will be added
+        */
+        bool m_input_ended;
+
+        /**
+        * Number of parse-units dropped as invalid
+        */
+        int m_units_dropped;
+
+        /**
+        * Number of bytes discarded in finding valid parse-units
+        */
+        int m_bytes_skipped;
+
     };
 
 } // namespace dirac
@@ -214,6 +214,16 @@ void MvDataByteIO::InputBlockParams()
         olb_params.SetXbsep(ReadUint());
         // Input Ybsep
         olb_params.SetYbsep(ReadUint());
+
+        // blocks must advance and must cover their separation, or the
+        // block counts can't be worked out
+        if (olb_params.Xbsep() <= 0 || olb_params.Ybsep() <= 0 ||
+            olb_params.Xblen() < olb_params.Xbsep() ||
+            olb_params.Yblen() < olb_params.Ybsep())
+            DIRAC_THROW_EXCEPTION(
+                ERR_UNSUPPORTED_STREAM_DATA,
+                "Custom block params out of range",
+                SEVERITY_PICTURE_ERROR);
     }
     else
         SetDefaultBlockParameters (olb_params, p_idx);
@@ -38,6 +38,7 @@
 
 #include <libdirac_byteio/transform_byteio.h>
 #include <libdirac_common/dirac_exception.h>
+#include <algorithm>
 
 using namespace dirac;
 
@@ -137,7 +138,18 @@ void TransformByteIO::Input()
     m_cparams.SetTransformFilter(ReadUint());
 
     // transform depth
-     m_cparams.SetTransformDepth(ReadUint());
+    const unsigned int depth = ReadUint();
+    // there must be at least one level, and the DC band must hold at
+    // least one sample or the padded coefficient arrays become absurdly large
+    if ( depth == 0 || depth > 31 ||
+         (1u << depth) > (unsigned int)std::max( m_cparams.Xl() , m_cparams.Yl() ) )
+    {
+        DIRAC_THROW_EXCEPTION(
+            ERR_UNSUPPORTED_STREAM_DATA,
+            "Transform depth out of range for the picture size",
+            SEVERITY_PICTURE_ERROR);
+    }
+    m_cparams.SetTransformDepth(depth);
 
     // Spatial partition flag
     m_cparams.SetSpatialPartition(ReadBool());
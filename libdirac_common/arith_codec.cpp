@@ -93,37 +93,65 @@ namespace dirac{
         // Set the m_code word stuff
         m_low_code  = 0;
         m_range = 0xFFFF;
-        m_underflow = 0;
+        m_shift_count = 0;
+        m_encode_data.clear();
     }
 
     void ArithCodecBase::FlushEncoder()
     {
          
-         // Do final renormalisation and output
-        while (((m_low_code+m_range-1)^m_low_code)<0x8000 )
+        // Do final renormalisation: shift out bits while low and high agree
+        // in their top bit, or while they straddle the mid-point as
+        // 0x01... and 0x10...
+        while ( ((m_low_code+m_range-1)^m_low_code)<0x8000 ||
+                ( (m_low_code & 0x4000) && !((m_low_code+m_range-1) & 0x4000) ) )
         {
-            m_byteio->WriteBit( m_low_code & 0x8000);
-            for (; m_underflow > 0; m_underflow-- )
-                m_byteio->WriteBit(~m_low_code & 0x8000);
-
             m_low_code  <<= 1;
-            m_low_code   &= 0xFFFF;
             m_range <<= 1;
+            if ( ++m_shift_count == 8 )
+                OutputByte();
         }
-            
-        while ( (m_low_code & 0x4000) && !((m_low_code+m_range-1) & 0x4000) )
+
+        // Terminate with the shortest value in the interval ending in
+        // bit 14 of the window: the mid-point crossing, or a quarter
+        // below it if low lies in the lower quarter
+        unsigned int final_code = (m_low_code+m_range-1) & ~0x7FFF;
+        if ( !(m_low_code & 0x4000) )
+            final_code -= 0x4000;
+
+        // Pad the remaining bits of the window to whole bytes
+        m_low_code = final_code;
+        int num_bits = m_shift_count+2;
+        m_last_byte_bits = num_bits;
+        while ( m_shift_count < 8 )
         {
-            m_underflow += 1;
-            m_low_code  ^= 0x4000;
-            m_low_code  <<= 1;
-            m_low_code   &= 0xFFFF;
-            m_range <<= 1;
+            m_low_code <<= 1;
+            ++m_shift_count;
+        }
+        OutputByte();
+        if ( num_bits > 8 )
+        {
+            m_low_code <<= 8;
+            OutputByte();
+            m_last_byte_bits = num_bits-8;
+        }
+
+        // Write out the data
+        if ( m_byteio->m_current_pos==0 )
+        {
+            m_byteio->mp_stream->write(
+                reinterpret_cast<const char*>( &m_encode_data[0] ),
+                m_encode_data.size() );
+            m_byteio->m_num_bytes += m_encode_data.size();
+        }
+        else
+        {
+            const int num_full_bytes = m_encode_data.size()-1;
+            for ( int i=0; i<num_full_bytes; ++i )
+                m_byteio->WriteNBits( m_encode_data[i], 8 );
+            m_byteio->WriteNBits( m_encode_data[num_full_bytes] >> (8-m_last_byte_bits),
+                                  m_last_byte_bits );
         }
- 
-        m_byteio->WriteBit(m_low_code & 0x4000);
-        while ( m_underflow >= 0 ) {
-            m_byteio->WriteBit(~m_low_code & 0x4000);
-            m_underflow -= 1; }
 
         // byte align
         m_byteio->ByteAlignOutput();
@@ -164,6 +192,7 @@ namespace dirac{
        m_decode_data_ptr[num_bytes+1] = (char)255;
 
        m_data_ptr = m_decode_data_ptr;
+       m_data_end = m_decode_data_ptr + num_bytes + 1;
     }
 
 }// namespace dirac
@@ -129,6 +129,9 @@ namespace dirac
         //! flushes the output of the encoder.
         void FlushEncoder();
 
+        //! Moves the top byte of the encoder register to the output buffer
+        inline void OutputByte();
+
         int ByteCount() const;     
 
         // core decode functions
@@ -181,8 +184,14 @@ namespace dirac
 
         // For encoder only
 
-        //! Number of underflow bits
-        int m_underflow;
+        //! Number of bits accumulated above the 16-bit code window
+        int m_shift_count;
+
+        //! Encoded bytes, written to m_byteio when the encoder is flushed
+        std::vector<unsigned char> m_encode_data;
+
+        //! Number of valid bits in the last byte of m_encode_data
+        int m_last_byte_bits;
 
         //! A pointer to the data for reading in
         char* m_decode_data_ptr;
@@ -190,6 +199,9 @@ namespace dirac
         //! A point to the byte currently being read
         char* m_data_ptr;
 
+        //! The last byte of padding, where reading stops if the data runs out
+        char* m_data_end;
+
         //! The index of the bit of the byte being read
         int m_input_bits_left;
 
@@ -254,6 +266,23 @@ namespace dirac
         return symbol;
     }
 
+    inline void ArithCodecBase::OutputByte()
+    {
+        // A carry out of the completed byte increments the bytes already
+        // output. Any trailing run of 0xFF bytes wraps to zero.
+        if ( m_low_code & 0x1000000 )
+        {
+            std::vector<unsigned char>::iterator it = m_encode_data.end();
+            while ( *(--it) == 0xFF )
+                *it = 0;
+            ++(*it);
+        }
+
+        m_encode_data.push_back( static_cast<unsigned char>(m_low_code>>16) );
+        m_low_code &= 0xFFFF;
+        m_shift_count = 0;
+    }
+
     inline unsigned int ArithCodecBase::DecodeUInt(const int bin1, const int max_bin) {
         const int info_ctx = (max_bin+1);
         int bin = bin1;
@@ -301,31 +330,14 @@ namespace dirac
 
         while ( m_range <= 0x4000 )
         { 
-            if ( ( (m_low_code+m_range-1)^m_low_code)>=0x8000 )
-            {    
-                // Straddle condition
-                // We must have an underflow situation with
-                // low = 0x01... and high = 0x10...
-
-                m_low_code  ^= 0x4000;
-                m_underflow++;
-
-            }
-            else
-            {
-                // Bits agree - output them
-                m_byteio->WriteBit( m_low_code & 0x8000);
-                for (; m_underflow > 0; m_underflow-- )
-                    m_byteio->WriteBit(~m_low_code & 0x8000);
-            }
-
-            // Double low value and range
+            // Double low value and range. Bits shifted out of the 16-bit
+            // window accumulate above it until a whole byte is ready;
+            // a carry out of the window is propagated on output.
             m_low_code  <<= 1;
             m_range <<= 1;
 
-            // keep low to 16 bits - throw out top bit
-            m_low_code   &= 0xFFFF;
-
+            if ( ++m_shift_count == 8 )
+                OutputByte();
          }
     }
 
@@ -414,6 +426,19 @@ namespace dirac
          */ 
         void Decompress(T & out_data, const int num_bytes);
 
+        //! Reads in the bitstream ready for decompressing
+        /*!
+            Reads the number of bytes specified from the bitstream, so that
+            DecompressData() can then be called without further access to
+            the input. Decompress() is equivalent to the two calls in turn.
+            \param    num_bytes    the number of bytes to be read from the
+            bitstream.
+         */
+        void ReadData(const int num_bytes);
+
+        //! Decompresses data read in by ReadData() and writes into the output.
+        void DecompressData(T & out_data);
+
     protected:
 
         //virtual encode-only functions
@@ -452,11 +477,26 @@ namespace dirac
         DoWorkDecode( out_data );
     }
 
+    template<class T>
+    void ArithCodec<T>::ReadData( const int num_bytes )
+    {
+        InitDecoder(num_bytes);
+    }
+
+    template<class T>
+    void ArithCodec<T>::DecompressData( T &out_data )
+    {
+        DoWorkDecode( out_data );
+    }
+
    inline bool ArithCodecBase::InputBit()
     {
         if (m_input_bits_left == 0)
         {
-            m_data_ptr++;
+            // damaged data can ask for more bits than were coded:
+            // keep reading 1s from the padding rather than run off the end
+            if (m_data_ptr < m_data_end)
+                m_data_ptr++;
             m_input_bits_left = 8;
         }
         m_input_bits_left--;
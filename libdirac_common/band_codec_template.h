@@ -134,8 +134,14 @@ inline void GenericBandCodec<EntropyCodec>::CodeVal( CoeffArray& in_data ,
                                 const CoeffType val )
 {
     unsigned int abs_val( std::abs(val) );
-    abs_val <<= 2;
-    abs_val /= m_qf;
+
+    // Quantiser index 0, used for lossless coding, leaves values unchanged
+    const bool quantise( m_qf!=4 );
+    if ( quantise )
+    {
+        abs_val <<= 2;
+        abs_val /= m_qf;
+    }
 
     const int N = abs_val+1;
     int num_follow_zeroes=0;
@@ -156,9 +162,12 @@ inline void GenericBandCodec<EntropyCodec>::CodeVal( CoeffArray& in_data ,
     if ( abs_val )
     {
         // Must code sign bits and reconstruct
-        in_data[ypos][xpos] *= m_qf;
-        in_data[ypos][xpos] += m_offset+2;
-        in_data[ypos][xpos] >>= 2;
+        if ( quantise )
+        {
+            in_data[ypos][xpos] *= m_qf;
+            in_data[ypos][xpos] += m_offset+2;
+            in_data[ypos][xpos] >>= 2;
+        }
 
         if ( val>0 )
         {
@@ -247,7 +256,7 @@ void GenericBandCodec<EntropyCodec>::DecodeCoeffBlock( const CodeBlock& code_blo
         m_last_qf_idx = qf_idx;
     }
 
-    if (qf_idx > (int)dirac_quantiser_lists.MaxQuantIndex())
+    if (qf_idx < 0 || qf_idx > (int)dirac_quantiser_lists.MaxQuantIndex())
     {
         std::ostringstream errstr;
         errstr << "Quantiser index out of range [0.."
@@ -345,9 +354,13 @@ inline void GenericBandCodec<EntropyCodec>::DecodeVal( CoeffArray& out_data , co
 
     if ( out_pixel )
     {
-        out_pixel *= m_qf;
-        out_pixel += m_offset+2;
-        out_pixel >>= 2;
+        // Quantiser index 0, used for lossless coding, leaves values unchanged
+        if ( m_qf!=4 )
+        {
+            out_pixel *= m_qf;
+            out_pixel += m_offset+2;
+            out_pixel >>= 2;
+        }
 
         if ( EntropyCodec::DecodeSymbol( ChooseSignContext(out_data, xpos, ypos)) )
             out_pixel = -out_pixel;
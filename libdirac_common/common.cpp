@@ -384,6 +384,13 @@ void CodecParams::SetCodeBlocks (unsigned int level,
             errstr.str(),
             SEVERITY_PICTURE_ERROR);
     }
+    if (hblocks == 0 || vblocks == 0)
+    {
+        DIRAC_THROW_EXCEPTION(
+            ERR_UNSUPPORTED_STREAM_DATA,
+            "Number of code blocks must be at least 1",
+            SEVERITY_PICTURE_ERROR);
+    }
 
     m_cb[level].SetHorizontalCodeBlocks(hblocks);
     m_cb[level].SetVerticalCodeBlocks(vblocks);
@@ -429,7 +436,9 @@ EncoderParams::EncoderParams(const VideoFormat& video_format,
     CodecParams(video_format, ftype, num_refs, set_defaults),
     m_verbose(false),
     m_loc_decode(true),
+    m_collect_stats(false),
     m_full_search(false),
+    m_me_search(ME_SEARCH_HIERARCHICAL),
     m_x_range_me(32),
     m_y_range_me(32),
     m_ufactor(1.0),
@@ -442,7 +451,13 @@ EncoderParams::EncoderParams(const VideoFormat& video_format,
     m_L1_me_lambda(0.0f),
     m_L2_me_lambda(0.0f),
     m_ent_correct(0),
-    m_target_rate(0)
+    m_target_rate(0),
+    m_rc_pass(0),
+    m_rc_stats_file("dirac_2pass.log"),
+    m_vbv_size(0),
+    m_vbv_delay(0),
+    m_quality_regions_x(1),
+    m_quality_regions_y(1)
 {
     if(set_defaults)
         SetDefaultEncoderParameters(*this);
@@ -522,7 +537,8 @@ DecoderParams::DecoderParams(const VideoFormat& video_format,
                              unsigned int num_refs,
                              bool set_defaults):
     CodecParams(video_format, ftype, num_refs, set_defaults),
-    m_verbose(false)
+    m_verbose(false),
+    m_resilient(false)
 {
 }
 
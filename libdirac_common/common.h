@@ -1301,12 +1301,18 @@ namespace dirac
         //! Returns a flag indicating that we're doing local decoding
         bool LocalDecode() const {return m_loc_decode;}
 
+        //! Returns a flag indicating that per-picture statistics are being reported
+        bool CollectStats() const {return m_collect_stats;}
+
         //! Get whether we're doing lossless coding
         bool Lossless() const {return m_lossless;}
 
         //! Get whether we're doing full-search motion estimation
         bool FullSearch() const {return m_full_search; }
 
+        //! Get the search strategy for pixel-accurate motion estimation
+        MESearchType MESearch() const {return m_me_search; }
+
         //! Get the horizontal search range for full-search motion estimation
         int XRangeME() const {return m_x_range_me;}
 
@@ -1381,6 +1387,24 @@ namespace dirac
         //! Return the Target Bit Rate in kbps
         int TargetRate() {return m_target_rate;}
 
+        //! Return the rate control pass: 0 for single-pass encoding, otherwise 1 or 2
+        int RCPass() const {return m_rc_pass;}
+
+        //! Return the name of the file holding the statistics for two-pass encoding
+        const std::string& RCStatsFile() const {return m_rc_stats_file;}
+
+        //! Return the size of the decoder (VBV) buffer in kbits, or 0 if not constrained
+        int VBVSize() const {return m_vbv_size;}
+
+        //! Return the initial decoder buffer delay in milliseconds, or 0 for the default
+        int VBVDelay() const {return m_vbv_delay;}
+
+        //! Return the number of regions across the picture in which quality is measured, 1 for none
+        int QualityRegionsX() const {return m_quality_regions_x;}
+
+        //! Return the number of regions down the picture in which quality is measured, 1 for none
+        int QualityRegionsY() const {return m_quality_regions_y;}
+
         //! Return true if using Arithmetic coding
         bool UsingAC()  const {return m_using_ac;}
 
@@ -1392,12 +1416,18 @@ namespace dirac
         //! Sets a flag indicating that we're producing a locally decoded o/p
         void SetLocalDecode( const bool decode ){m_loc_decode=decode;}
 
+        //! Sets a flag indicating that per-picture statistics are being reported
+        void SetCollectStats( const bool collect ){m_collect_stats=collect;}
+
         //! Set whether we're doing lossless coding
         void SetLossless(const bool l){m_lossless = l;}
 
         //! Set whether we're doing full-search motion estimation
         void SetFullSearch(const bool fs){m_full_search = fs;}
 
+        //! Set the search strategy for pixel-accurate motion estimation
+        void SetMESearch(const MESearchType ms){m_me_search = ms;}
+
         //! Set whether we're doing combined component motion estimation
         void SetCombinedME(const bool cme){m_combined_me = cme;}
 
@@ -1452,6 +1482,22 @@ namespace dirac
         //! Set the target bit rate
         void SetTargetRate(const int rate){m_target_rate = rate;}
 
+        //! Set the rate control pass: 0 for single-pass, or 1 or 2 for two-pass encoding
+        void SetRCPass(const int pass){m_rc_pass = pass;}
+
+        //! Set the name of the file holding the statistics for two-pass encoding
+        void SetRCStatsFile(const char * fname){ m_rc_stats_file = fname; }
+
+        //! Set the size of the decoder (VBV) buffer in kbits, 0 for none
+        void SetVBVSize(const int size){m_vbv_size = size;}
+
+        //! Set the initial decoder buffer delay in milliseconds
+        void SetVBVDelay(const int delay){m_vbv_delay = delay;}
+
+        //! Set the grid of regions in which quality is measured separately
+        void SetQualityRegions(const int xnum, const int ynum)
+        {m_quality_regions_x = xnum; m_quality_regions_y = ynum;}
+
         //! Set the arithmetic coding flag
         void SetUsingAC(bool using_ac) {m_using_ac = using_ac;}
     private:
@@ -1467,12 +1513,18 @@ namespace dirac
         //! Flag indicating we're doing local decoding
         bool m_loc_decode;
 
+        //! Flag indicating per-picture statistics are being reported
+        bool m_collect_stats;
+
         //! A flag indicating we're doing lossless coding
         bool m_lossless;
 
         //! A flag indicating whether we're doing full-search block matching
         bool m_full_search;
 
+        //! The search strategy used when not doing full-search block matching
+        MESearchType m_me_search;
+
         //! A flag indicating whether we're doing combined component motion estimation
         bool m_combined_me;
 
@@ -1536,6 +1588,24 @@ namespace dirac
         //! Target bit rate
         int m_target_rate;
 
+        //! Rate control pass: 0 for single-pass encoding, otherwise 1 or 2
+        int m_rc_pass;
+
+        //! File holding the first-pass statistics for two-pass encoding
+        std::string m_rc_stats_file;
+
+        //! Decoder (VBV) buffer size in kbits, 0 if not constrained
+        int m_vbv_size;
+
+        //! Initial decoder buffer delay in milliseconds
+        int m_vbv_delay;
+
+        //! Number of regions across the picture in which quality is measured
+        int m_quality_regions_x;
+
+        //! Number of regions down the picture in which quality is measured
+        int m_quality_regions_y;
+
         //! Arithmetic coding flag
         bool m_using_ac;
 
@@ -1557,6 +1627,12 @@ namespace dirac
         //! Sets verbosity on or off
         void SetVerbose(bool v){m_verbose=v;}
 
+        //! Returns true if damaged pictures are concealed rather than stopping decoding
+        bool Resilient() const {return m_resilient;}
+
+        //! Sets concealment of damaged pictures on or off
+        void SetResilient(bool r){m_resilient=r;}
+
             ////////////////////////////////////////////////////////////////////
             //NB: Assume default copy constructor, assignment = and destructor//
             //This means pointers are copied, not the objects they point to.////
@@ -1568,6 +1644,9 @@ namespace dirac
         //! Code/decode with commentary if true
         bool m_verbose;
 
+        //! Conceal damaged pictures if true
+        bool m_resilient;
+
     };
 
     //! A simple bounds checking function, very useful in a number of places
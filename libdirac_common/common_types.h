@@ -80,6 +80,15 @@ typedef enum
     CWM
 } PrefilterType;
 
+/*! Enumerated type that defines the strategies for pixel-accurate motion
+    estimation supported by the encoder. ME_SEARCH_PREDICTIVE is a fast
+    predictive search, for real-time encoding at some loss of quality. */
+typedef enum
+{
+    ME_SEARCH_HIERARCHICAL = 0,
+    ME_SEARCH_PREDICTIVE
+} MESearchType;
+
 static const int NUM_WLT_FILTERS = 8;
 
 /*! Types of picture */
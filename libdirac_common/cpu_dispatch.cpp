@@ -0,0 +1,190 @@
+/* ***** BEGIN LICENSE BLOCK *****
+*
+* $Id$ $Name$
+*
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License
+* Version 1.1 (the "License"); you may not use this file except in compliance
+* with the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License for
+* the specific language governing rights and limitations under the License.
+*
+* The Original Code is BBC Research and Development code.
+*
+* The Initial Developer of the Original Code is the British Broadcasting
+* Corporation.
+* Portions created by the Initial Developer are Copyright (C) 2008.
+* All Rights Reserved.
+*
+* Contributor(s): Thomas Davies (Original Author)
+*
+* Alternatively, the contents of this file may be used under the terms of
+* the GNU General Public License Version 2 (the "GPL"), or the GNU Lesser
+* Public License Version 2.1 (the "LGPL"), in which case the provisions of
+* the GPL or the LGPL are applicable instead of those above. If you wish to
+* allow use of your version of this file only under the terms of the either
+* the GPL or LGPL and not to allow others to use your version of this file
+* under the MPL, indicate your decision by deleting the provisions above
+* and replace them with the notice and other provisions required by the GPL
+* or LGPL. If you do not delete the provisions above, a recipient may use
+* your version of this file under the terms of any one of the MPL, the GPL
+* or the LGPL.
+* ***** END LICENSE BLOCK ***** */
+
+
+
+#include <libdirac_common/cpu_dispatch.h>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_MSC_VER) && ( defined(_M_IX86) || defined(_M_X64) )
+#include <intrin.h>
+#define DIRAC_X86_CPUID
+#elif defined(__GNUC__) && ( defined(__i386__) || defined(__x86_64__) )
+#include <cpuid.h>
+#define DIRAC_X86_CPUID
+#endif
+
+using namespace dirac;
+
+namespace
+{
+    const char* const level_names[NUM_CPU_LEVELS] = { "generic", "mmx", "sse2", "avx2" };
+
+    // The detected level and the limit on it, or -1 if not yet known
+    int detected_level = -1;
+    int level_limit = -1;
+
+    // The highest level whose kernels have been compiled in
+    CpuLevel CompiledCpuLevel()
+    {
+#if defined(HAVE_AVX2)
+        return CPU_LEVEL_AVX2;
+#elif defined(HAVE_SSE2)
+        return CPU_LEVEL_SSE2;
+#elif defined(HAVE_MMX)
+        return CPU_LEVEL_MMX;
+#else
+        return CPU_LEVEL_GENERIC;
+#endif
+    }
+
+#if defined(DIRAC_X86_CPUID)
+    // Reads CPUID leaf and subleaf into regs, in the order eax, ebx, ecx, edx
+    void CpuId( const unsigned int leaf, const unsigned int subleaf, unsigned int regs[4] )
+    {
+#if defined(_MSC_VER)
+        int r[4];
+        __cpuidex( r, leaf, subleaf );
+        for (int i=0; i<4; ++i)
+            regs[i] = r[i];
+#else
+        __cpuid_count( leaf, subleaf, regs[0], regs[1], regs[2], regs[3] );
+#endif
+    }
+
+    // Returns true if the operating system saves the SSE and AVX registers
+    bool OsSavesAvxState()
+    {
+#if defined(_MSC_VER)
+        return ( _xgetbv( 0 ) & 6 ) == 6;
+#else
+        unsigned int eax, edx;
+        // xgetbv, encoded for assemblers that don't know it
+        __asm__ volatile ( ".byte 0x0f, 0x01, 0xd0" : "=a" (eax), "=d" (edx) : "c" (0) );
+        return ( eax & 6 ) == 6;
+#endif
+    }
+
+    CpuLevel QueryCpuLevel()
+    {
+        unsigned int regs[4];
+        CpuId( 0, 0, regs );
+        const unsigned int max_leaf = regs[0];
+        if ( max_leaf<1 )
+            return CPU_LEVEL_GENERIC;
+
+        CpuId( 1, 0, regs );
+        const unsigned int ecx1 = regs[2];
+        const unsigned int edx1 = regs[3];
+
+        if ( !( edx1 & (1u<<23) ) )
+            return CPU_LEVEL_GENERIC;
+        if ( !( edx1 & (1u<<26) ) )
+            return CPU_LEVEL_MMX;
+
+        // AVX2 needs the AVX registers to be enabled by the OS as well
+        // as the instructions being present
+        const bool avx = ( ecx1 & (1u<<27) ) && ( ecx1 & (1u<<28) ) && OsSavesAvxState();
+        if ( avx && max_leaf>=7 )
+        {
+            CpuId( 7, 0, regs );
+            if ( regs[1] & (1u<<5) )
+                return CPU_LEVEL_AVX2;
+        }
+        return CPU_LEVEL_SSE2;
+    }
+#else
+    CpuLevel QueryCpuLevel()
+    {
+        return CPU_LEVEL_GENERIC;
+    }
+#endif
+
+} // namespace
+
+CpuLevel dirac::DetectedCpuLevel()
+{
+    if ( detected_level<0 )
+    {
+        const CpuLevel cpu_level = QueryCpuLevel();
+        const CpuLevel compiled_level = CompiledCpuLevel();
+        detected_level = cpu_level<compiled_level ? cpu_level : compiled_level;
+    }
+    return static_cast<CpuLevel>( detected_level );
+}
+
+CpuLevel dirac::ActiveCpuLevel()
+{
+    if ( level_limit<0 )
+    {
+        CpuLevel env_level = CPU_LEVEL_AVX2;
+        const char* env = std::getenv( "DIRAC_CPU_LEVEL" );
+        if ( env && CpuLevelFromName( env, env_level ) )
+            level_limit = env_level;
+        else
+            level_limit = NUM_CPU_LEVELS-1;
+    }
+
+    const CpuLevel detected = DetectedCpuLevel();
+    return level_limit<detected ? static_cast<CpuLevel>( level_limit ) : detected;
+}
+
+void dirac::SetCpuLevel( const CpuLevel level )
+{
+    level_limit = level;
+}
+
+const char* dirac::CpuLevelName( const CpuLevel level )
+{
+    if ( level<CPU_LEVEL_GENERIC || level>=NUM_CPU_LEVELS )
+        return "unknown";
+    return level_names[level];
+}
+
+bool dirac::CpuLevelFromName( const char* name, CpuLevel& level )
+{
+    for (int i=0; i<NUM_CPU_LEVELS; ++i)
+    {
+        if ( std::strcmp( name, level_names[i] )==0 )
+        {
+            level = static_cast<CpuLevel>( i );
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,106 @@
+/* ***** BEGIN LICENSE BLOCK *****
+*
+* $Id$ $Name$
+*
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License
+* Version 1.1 (the "License"); you may not use this file except in compliance
+* with the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License for
+* the specific language governing rights and limitations under the License.
+*
+* The Original Code is BBC Research and Development code.
+*
+* The Initial Developer of the Original Code is the British Broadcasting
+* Corporation.
+* Portions created by the Initial Developer are Copyright (C) 2008.
+* All Rights Reserved.
+*
+* Contributor(s): Thomas Davies (Original Author)
+*
+* Alternatively, the contents of this file may be used under the terms of
+* the GNU General Public License Version 2 (the "GPL"), or the GNU Lesser
+* Public License Version 2.1 (the "LGPL"), in which case the provisions of
+* the GPL or the LGPL are applicable instead of those above. If you wish to
+* allow use of your version of this file only under the terms of the either
+* the GPL or LGPL and not to allow others to use your version of this file
+* under the MPL, indicate your decision by deleting the provisions above
+* and replace them with the notice and other provisions required by the GPL
+* or LGPL. If you do not delete the provisions above, a recipient may use
+* your version of this file under the terms of any one of the MPL, the GPL
+* or the LGPL.
+* ***** END LICENSE BLOCK ***** */
+
+
+#ifndef _CPU_DISPATCH_H_
+#define _CPU_DISPATCH_H_
+
+//! Marks a function as compiled for AVX2, whatever the global flags
+/*!
+    Kernels for instruction sets beyond the build's baseline are compiled
+    with a target attribute, so that a single binary can carry them and
+    select them at run time. They must only be called when
+    ActiveCpuLevel() is at least the corresponding level.
+*/
+#if defined(HAVE_AVX2) && defined(__GNUC__)
+#define DIRAC_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define DIRAC_TARGET_AVX2
+#endif
+
+namespace dirac
+{
+    //! Instruction set levels for which there are optimised kernels
+    /*!
+        Each level includes all the levels before it, so kernel tables are
+        built by starting with the portable kernels and overlaying the
+        versions for each level up to the active one.
+    */
+    enum CpuLevel
+    {
+        CPU_LEVEL_GENERIC=0,
+        CPU_LEVEL_MMX,
+        CPU_LEVEL_SSE2,
+        CPU_LEVEL_AVX2,
+        NUM_CPU_LEVELS
+    };
+
+    //! Returns the highest level both supported by the processor and compiled in
+    /*!
+        The processor is queried with CPUID on first use and the result
+        cached. Levels whose kernels were not compiled in are never
+        returned.
+    */
+    CpuLevel DetectedCpuLevel();
+
+    //! Returns the level whose kernels should be used
+    /*!
+        This is the detected level, lowered by the DIRAC_CPU_LEVEL
+        environment variable if it is set to the name of a lower level
+        ("generic", "mmx", "sse2" or "avx2"). SetCpuLevel() replaces any
+        limit from the environment.
+        Kernel tables are selected when the objects using them are
+        constructed, so changes affect subsequently created objects only.
+    */
+    CpuLevel ActiveCpuLevel();
+
+    //! Sets a limit on the active level, for testing kernels against each other
+    /*!
+        \param  level  the highest level to use. Levels above the detected
+                       level are reduced to it.
+    */
+    void SetCpuLevel( const CpuLevel level );
+
+    //! Returns the name of a level, as used by DIRAC_CPU_LEVEL
+    const char* CpuLevelName( const CpuLevel level );
+
+    //! Looks up a level by name, returning false if the name is not known
+    bool CpuLevelFromName( const char* name, CpuLevel& level );
+
+} // namespace dirac
+
+#endif
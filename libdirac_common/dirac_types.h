@@ -191,6 +191,51 @@ typedef struct
     void  *id;
 } dirac_framebuf_t;
 
+/*! Processing stages timed by the encoder and decoder */
+typedef enum
+{
+    /*! Pixel-accurate motion estimation */
+    TIMING_PIXEL_ME = 0,
+    /*! Sub-pixel motion vector refinement */
+    TIMING_SUBPEL_ME,
+    /*! Block and superblock mode decision */
+    TIMING_MODE_DECISION,
+    /*! Motion compensation, in either direction */
+    TIMING_MOTION_COMP,
+    /*! Forward wavelet transform */
+    TIMING_DWT,
+    /*! Inverse wavelet transform */
+    TIMING_IDWT,
+    /*! Quantiser selection */
+    TIMING_SELECT_QUANT,
+    /*! Entropy coding of the motion data */
+    TIMING_CODE_MV,
+    /*! Entropy coding of the residue */
+    TIMING_CODE_RESIDUE,
+    /*! Entropy decoding of the motion data */
+    TIMING_DECODE_MV,
+    /*! Entropy decoding of the residue */
+    TIMING_DECODE_RESIDUE,
+    TIMING_NUM_STAGES
+} dirac_timing_stage_t;
+
+/*! Short names of the timing stages, in dirac_timing_stage_t order */
+#define DIRAC_TIMING_STAGE_NAMES \
+    { "pixel_me", "subpel_me", "mode_decision", "motion_comp", "dwt", \
+      "idwt", "select_quant", "code_mv", "code_residue", "decode_mv", \
+      "decode_residue" }
+
+/*! Structure that holds the time spent in each stage of processing a picture.
+    Stages that run concurrently are each timed in full, so the times can add
+    up to more than the elapsed time. */
+typedef struct
+{
+    /*! Wall-clock seconds spent in each stage */
+    double seconds[TIMING_NUM_STAGES];
+    /*! Number of times each stage was run */
+    int calls[TIMING_NUM_STAGES];
+} dirac_stage_times_t;
+
 #ifdef __cplusplus
 }
 #endif
@@ -105,6 +105,7 @@ void MotionCompensator::CompensatePicture(const PicturePredParams &ppp,
 // m_predparams.
 MotionCompensator::MotionCompensator( const PicturePredParams &ppp ):
     m_predparams(ppp),
+    m_kernels( SelectMCKernels( ActiveCpuLevel() ) ),
     luma_or_chroma(true)
 {
     // Allocate for block weights
@@ -467,26 +468,8 @@ void MotionCompensator::CompensateComponent( Picture* pic ,
                 if (end_y > pic_size.y)
                     end_y = pic_size.y;
             }
-#if defined (HAVE_MMX)
-            CompensateComponentAddAndShift_mmx (start_y, end_y, 6, pic_size,
-                                                 pic_data, pic_data_out);
-#else
-            for ( int i = start_y, pic_y = 0; i < end_y; i++, pic_y++)
-            {
-                ValueType *pic_row = pic_data[pic_y];
-                ValueType *out_row = pic_data_out[i];
-
-                for ( int j =0; j < pic_size.x; j++)
-                {
-                    out_row[j] += static_cast<ValueType>( (pic_row[j] + 32) >> 6 );
-                }
-                // Pad the remaining pixels of the row with last truepic pixel val
-                for ( int j = pic_size.x; j < pic_data.LengthX(); j++)
-                {
-                    out_row[j] = out_row[pic_size.x-1];
-                }
-            }
-#endif
+            m_kernels.add_and_shift( start_y, end_y, 6, pic_size,
+                                     pic_data, pic_data_out );
         }
         //Increment the block vertical position
         pos.y += m_bparams.Ybsep();
@@ -587,19 +570,9 @@ void MotionCompensator::CompensateBlock(
     /*
     * Multiply the block by OBMC spatial weights. Return result val1
     */
-    AdjustBlockBySpatialWeights(val1, pos, wt_array);
+    m_kernels.adjust_block(val1, pos, wt_array);
 
-#if !defined (HAVE_MMX)
-    for (int y = 0, py=0; y < val1.LengthY(); ++y, ++py)
-    {
-        for (int x = 0, px=start_pos.x; x < val1.LengthX(); ++x, ++px)
-        {
-            pic_data[py][px] += val1[y][x];
-        }
-    }
-#else
-    AddMCBlock_mmx(ImageCoords(start_pos.x, 0), pic_data, val1);
-#endif
+    m_kernels.add_block(ImageCoords(start_pos.x, 0), pic_data, val1);
 }
 
 void MotionCompensator::DCBlock( TwoDArray<ValueType> &block_data ,
@@ -681,24 +654,6 @@ void MotionCompensator::AdjustBlockByRefWeights (
     }
 }
 
-#if !defined (HAVE_MMX)
-void MotionCompensator::AdjustBlockBySpatialWeights (
-                                       TwoDArray<ValueType>& val_block,
-                                       const ImageCoords &pos,
-                                       const TwoDArray<ValueType> &wt_array)
-{
-    ImageCoords start_pos (std::max(0, pos.x), std::max(0, pos.y));
-    ImageCoords wt_start (start_pos.x - pos.x, start_pos.y - pos.y);
-
-    for (int y = 0, wt_y=wt_start.y; y < val_block.LengthY(); ++y, ++wt_y)
-    {
-        for (int x = 0, wt_x=wt_start.x; x < val_block.LengthX(); ++x, ++wt_x)
-        {
-            val_block[y][x] *= wt_array[wt_y][wt_x];
-        }
-    }
-}
-#endif
 
 void MotionCompensator::CalculateWeights( int xbsep, int ybsep,
                                           TwoDArray<ValueType>* wts_array)
@@ -911,7 +866,6 @@ MotionCompensator_HalfPixel::MotionCompensator_HalfPixel( const PicturePredParam
     MotionCompensator( ppp )
 {}
 
-#if !defined (HAVE_MMX)
 void MotionCompensator_HalfPixel::BlockPixelPred(
                                   TwoDArray<ValueType> &block_data ,
                                   const ImageCoords& pos ,
@@ -919,69 +873,14 @@ void MotionCompensator_HalfPixel::BlockPixelPred(
                                   const PicArray &refup_data ,
                                   const MVector &mv)
 {
-    //Where to start in the upconverted image
-    const ImageCoords start_pos( std::max(pos.x,0) , std::max(pos.y,0) );
-    const ImageCoords ref_start( ( start_pos.x<<1 ) + mv.x ,( start_pos.y<<1 ) + mv.y );
-
-    //An additional stage to make sure the block to be copied does not fall
-    //outsidethe reference image.
-    const int refXlen = refup_data.LengthX();
-    //const int refYlen = refup_data.LengthY();
-    const int trueRefXlen = (pic_size.x << 1) - 1;
-    const int trueRefYlen = (pic_size.y << 1) - 1;
-
-    bool do_bounds_checking = false;
-
-    //Check if there are going to be any problems copying the block from
-    //the upvconverted reference image.
-
-    if( ref_start.x < 0 )
-        do_bounds_checking = true;
-    else if( ref_start.x + ((block_data.LengthX() -1 )<<1 ) >= trueRefXlen )
-        do_bounds_checking = true;
-    if( ref_start.y < 0 )
-        do_bounds_checking = true;
-    else if( ref_start.y + ((block_data.LengthY() - 1 )<<1 ) >= trueRefYlen)
-        do_bounds_checking = true;
-
-    ValueType *block_curr = &block_data[0][0];
-
-    if( !do_bounds_checking )
-    {
-        ValueType *refup_curr = &refup_data[ref_start.y][ref_start.x];
-        const int refup_next( (refXlen - block_data.LengthX())*2 );// go down 2 rows and back up
-
-        for( int y=0; y < block_data.LengthY(); ++y, refup_curr+=refup_next )
-        {
-            for( int x=0; x < block_data.LengthX(); ++x, ++block_curr, refup_curr+=2 )
-            {
-                *block_curr = refup_curr[0];
-            }
-        }
-    }
-    else
-    {
-        // We're doing bounds checking because we'll fall off the edge of the reference otherwise.
-        for( int y=0, ry=ref_start.y, by=BChk(ry,trueRefYlen);
-             y<block_data.LengthY(); ++y, ry+=2 , by=BChk(ry,trueRefYlen))
-        {
-             for( int x=0 , rx=ref_start.x , bx=BChk(rx,trueRefXlen);
-                  x<block_data.LengthX() ;
-                  ++x, ++block_curr, rx+=2 , bx=BChk(rx,trueRefXlen))
-             {
-                 *block_curr =  refup_data[by][bx];
-             }// x
-        }// y
-    }
+    m_kernels.half_pel_pred( block_data , pos , pic_size , refup_data , mv );
 }
-#endif
 
 // Motion Compesation class that provides quarter-pixel precision compensation
 MotionCompensator_QuarterPixel::MotionCompensator_QuarterPixel( const PicturePredParams &ppp ) :
     MotionCompensator( ppp )
 {}
 
-#if !defined (HAVE_MMX)
 void MotionCompensator_QuarterPixel::BlockPixelPred(
                                      TwoDArray<ValueType> &block_data ,
                                      const ImageCoords& pos ,
@@ -989,115 +888,8 @@ void MotionCompensator_QuarterPixel::BlockPixelPred(
                                      const PicArray &refup_data ,
                                      const MVector &mv)
 {
-    // Set up the start point in the reference image by rounding the motion vector
-    // to 1/2 pel accuracy.NB: bit shift rounds negative values DOWN, as required
-    const MVector roundvec( mv.x>>1 , mv.y>>1 );
-
-    //Get the remainder after rounding. NB rmdr values always 0 or 1
-    const MVector rmdr( mv.x & 1 , mv.y & 1 );
-
-    //Where to start in the upconverted image
-    const ImageCoords start_pos( std::max(pos.x,0) , std::max(pos.y,0) );
-    const ImageCoords ref_start( ( start_pos.x<<1 ) + roundvec.x ,( start_pos.y<<1 ) + roundvec.y );
-
-    //An additional stage to make sure the block to be copied does not fall outside
-    //the reference image.
-    const int refXlen = refup_data.LengthX();
-    //const int refYlen = refup_data.LengthY();
-    const int trueRefXlen = (pic_size.x<<1) - 1;
-    const int trueRefYlen = (pic_size.y<<1) - 1;
-
-    ValueType *block_curr = &block_data[0][0];
-
-    bool do_bounds_checking = false;
-    //Check if there are going to be any problems copying the block from
-    //the upvconverted reference image.
-    if( ref_start.x < 0 )
-        do_bounds_checking = true;
-    else if( ref_start.x + (block_data.LengthX()<<1 ) >= trueRefXlen )
-        do_bounds_checking = true;
-    if( ref_start.y < 0 )
-        do_bounds_checking = true;
-    else if( ref_start.y + (block_data.LengthY()<<1 ) >= trueRefYlen )
-        do_bounds_checking = true;
-
-    if( !do_bounds_checking )
-    {
-        ValueType *refup_curr = &refup_data[ref_start.y][ref_start.x];
-        const int refup_next( ( refXlen - block_data.LengthX() )*2 ); //go down 2 rows and back to beginning of block line
-        if( rmdr.x == 0 && rmdr.y == 0 )
-        {
-            for( int y=0; y < block_data.LengthY(); ++y, refup_curr+=refup_next )
-            {
-                for( int x=0; x < block_data.LengthX(); ++x, ++block_curr, refup_curr+=2 )
-                {
-                    *block_curr = refup_curr[0];
-                }
-            }
-        }
-        else if( rmdr.y == 0 )
-        {
-            for( int y=0; y < block_data.LengthY(); ++y, refup_curr+=refup_next )
-            {
-                for( int x=0; x < block_data.LengthX(); ++x, ++block_curr, refup_curr+=2 )
-                {
-                    *block_curr = (refup_curr[0]  +  refup_curr[1]  + 1) >> 1;
-                }
-            }
-        }
-        else if( rmdr.x == 0 )
-        {
-            for( int y=0; y < block_data.LengthY(); ++y, refup_curr+=refup_next )
-            {
-                for( int x=0; x < block_data.LengthX(); ++x, ++block_curr, refup_curr+=2 )
-                {
-                    *block_curr = ( refup_curr[0] + refup_curr[refXlen] + 1 ) >> 1;
-                }
-            }
-        }
-        else
-        {
-            for( int y=0; y < block_data.LengthY(); ++y, refup_curr+=refup_next )
-            {
-                for( int x=0; x < block_data.LengthX(); ++x, ++block_curr, refup_curr+=2 )
-                {
-                    *block_curr = ( refup_curr[0] +  refup_curr[1]  +
-                                      refup_curr[refXlen+0] + 
-                                      refup_curr[refXlen+1]  + 2 ) >> 2;
-                }
-            }
-        }
-    }
-    else
-    {
-        // We're doing bounds checking because we'll fall off the edge of the reference otherwise.
-
-        //weights for doing linear interpolation, calculated from the remainder values
-        const ValueType linear_wts[4] = {  (2 - rmdr.x) * (2 - rmdr.y),    //tl
-                                           rmdr.x * (2 - rmdr.y),          //tr
-                                           (2 - rmdr.x) * rmdr.y,          //bl
-                                           rmdr.x * rmdr.y };              //br
-
-
-       for(int c = 0, uY = ref_start.y,BuY=BChk(uY,trueRefYlen),BuY1=BChk(uY+1,trueRefYlen);
-           c < block_data.LengthY(); ++c, uY += 2,BuY=BChk(uY,trueRefYlen),BuY1=BChk(uY+1,trueRefYlen))
-       {
-           for(int l = 0, uX = ref_start.x,BuX=BChk(uX,trueRefXlen),BuX1=BChk(uX+1,trueRefXlen);
-               l < block_data.LengthX(); ++l, uX += 2,BuX=BChk(uX,trueRefXlen),BuX1=BChk(uX+1,trueRefXlen))
-           {
-
-               block_data[c][l] = ( linear_wts[0] * refup_data[BuY][BuX] +
-                                     linear_wts[1] * refup_data[BuY][BuX1] +
-                                     linear_wts[2] * refup_data[BuY1][BuX] +
-                                     linear_wts[3] * refup_data[BuY1][BuX1] +
-                                     2
-                                   ) >> 2;
-           }//l
-       }//c
-
-    }
+    m_kernels.quarter_pel_pred( block_data , pos , pic_size , refup_data , mv );
 }
-#endif
 
 // Motion Compesation class that provides one eighth-pixel precision
 // compensation
@@ -1237,3 +1029,264 @@ void MotionCompensator_EighthPixel::BlockPixelPred(
     }
 
 }
+
+// Portable kernels, used when there are no vector versions for the active
+// instruction set
+namespace
+{
+    void HalfPelBlockPred(TwoDArray<ValueType> &block_data ,
+                          const ImageCoords& pos ,
+                          const ImageCoords& pic_size ,
+                          const PicArray &refup_data ,
+                          const MVector &mv)
+    {
+        //Where to start in the upconverted image
+        const ImageCoords start_pos( std::max(pos.x,0) , std::max(pos.y,0) );
+        const ImageCoords ref_start( ( start_pos.x<<1 ) + mv.x ,( start_pos.y<<1 ) + mv.y );
+
+        //An additional stage to make sure the block to be copied does not fall
+        //outsidethe reference image.
+        const int refXlen = refup_data.LengthX();
+        //const int refYlen = refup_data.LengthY();
+        const int trueRefXlen = (pic_size.x << 1) - 1;
+        const int trueRefYlen = (pic_size.y << 1) - 1;
+
+        bool do_bounds_checking = false;
+
+        //Check if there are going to be any problems copying the block from
+        //the upvconverted reference image.
+
+        if( ref_start.x < 0 )
+            do_bounds_checking = true;
+        else if( ref_start.x + ((block_data.LengthX() -1 )<<1 ) >= trueRefXlen )
+            do_bounds_checking = true;
+        if( ref_start.y < 0 )
+            do_bounds_checking = true;
+        else if( ref_start.y + ((block_data.LengthY() - 1 )<<1 ) >= trueRefYlen)
+            do_bounds_checking = true;
+
+        ValueType *block_curr = &block_data[0][0];
+
+        if( !do_bounds_checking )
+        {
+            ValueType *refup_curr = &refup_data[ref_start.y][ref_start.x];
+            const int refup_next( (refXlen - block_data.LengthX())*2 );// go down 2 rows and back up
+
+            for( int y=0; y < block_data.LengthY(); ++y, refup_curr+=refup_next )
+            {
+                for( int x=0; x < block_data.LengthX(); ++x, ++block_curr, refup_curr+=2 )
+                {
+                    *block_curr = refup_curr[0];
+                }
+            }
+        }
+        else
+        {
+            // We're doing bounds checking because we'll fall off the edge of the reference otherwise.
+            for( int y=0, ry=ref_start.y, by=BChk(ry,trueRefYlen);
+                 y<block_data.LengthY(); ++y, ry+=2 , by=BChk(ry,trueRefYlen))
+            {
+                 for( int x=0 , rx=ref_start.x , bx=BChk(rx,trueRefXlen);
+                      x<block_data.LengthX() ;
+                      ++x, ++block_curr, rx+=2 , bx=BChk(rx,trueRefXlen))
+                 {
+                     *block_curr =  refup_data[by][bx];
+                 }// x
+            }// y
+        }
+    }
+
+    void QuarterPelBlockPred(TwoDArray<ValueType> &block_data ,
+                             const ImageCoords& pos ,
+                             const ImageCoords& pic_size ,
+                             const PicArray &refup_data ,
+                             const MVector &mv)
+    {
+        // Set up the start point in the reference image by rounding the motion vector
+        // to 1/2 pel accuracy.NB: bit shift rounds negative values DOWN, as required
+        const MVector roundvec( mv.x>>1 , mv.y>>1 );
+
+        //Get the remainder after rounding. NB rmdr values always 0 or 1
+        const MVector rmdr( mv.x & 1 , mv.y & 1 );
+
+        //Where to start in the upconverted image
+        const ImageCoords start_pos( std::max(pos.x,0) , std::max(pos.y,0) );
+        const ImageCoords ref_start( ( start_pos.x<<1 ) + roundvec.x ,( start_pos.y<<1 ) + roundvec.y );
+
+        //An additional stage to make sure the block to be copied does not fall outside
+        //the reference image.
+        const int refXlen = refup_data.LengthX();
+        //const int refYlen = refup_data.LengthY();
+        const int trueRefXlen = (pic_size.x<<1) - 1;
+        const int trueRefYlen = (pic_size.y<<1) - 1;
+
+        ValueType *block_curr = &block_data[0][0];
+
+        bool do_bounds_checking = false;
+        //Check if there are going to be any problems copying the block from
+        //the upvconverted reference image.
+        if( ref_start.x < 0 )
+            do_bounds_checking = true;
+        else if( ref_start.x + (block_data.LengthX()<<1 ) >= trueRefXlen )
+            do_bounds_checking = true;
+        if( ref_start.y < 0 )
+            do_bounds_checking = true;
+        else if( ref_start.y + (block_data.LengthY()<<1 ) >= trueRefYlen )
+            do_bounds_checking = true;
+
+        if( !do_bounds_checking )
+        {
+            ValueType *refup_curr = &refup_data[ref_start.y][ref_start.x];
+            const int refup_next( ( refXlen - block_data.LengthX() )*2 ); //go down 2 rows and back to beginning of block line
+            if( rmdr.x == 0 && rmdr.y == 0 )
+            {
+                for( int y=0; y < block_data.LengthY(); ++y, refup_curr+=refup_next )
+                {
+                    for( int x=0; x < block_data.LengthX(); ++x, ++block_curr, refup_curr+=2 )
+                    {
+                        *block_curr = refup_curr[0];
+                    }
+                }
+            }
+            else if( rmdr.y == 0 )
+            {
+                for( int y=0; y < block_data.LengthY(); ++y, refup_curr+=refup_next )
+                {
+                    for( int x=0; x < block_data.LengthX(); ++x, ++block_curr, refup_curr+=2 )
+                    {
+                        *block_curr = (refup_curr[0]  +  refup_curr[1]  + 1) >> 1;
+                    }
+                }
+            }
+            else if( rmdr.x == 0 )
+            {
+                for( int y=0; y < block_data.LengthY(); ++y, refup_curr+=refup_next )
+                {
+                    for( int x=0; x < block_data.LengthX(); ++x, ++block_curr, refup_curr+=2 )
+                    {
+                        *block_curr = ( refup_curr[0] + refup_curr[refXlen] + 1 ) >> 1;
+                    }
+                }
+            }
+            else
+            {
+                for( int y=0; y < block_data.LengthY(); ++y, refup_curr+=refup_next )
+                {
+                    for( int x=0; x < block_data.LengthX(); ++x, ++block_curr, refup_curr+=2 )
+                    {
+                        *block_curr = ( refup_curr[0] +  refup_curr[1]  +
+                                          refup_curr[refXlen+0] + 
+                                          refup_curr[refXlen+1]  + 2 ) >> 2;
+                    }
+                }
+            }
+        }
+        else
+        {
+            // We're doing bounds checking because we'll fall off the edge of the reference otherwise.
+
+            //weights for doing linear interpolation, calculated from the remainder values
+            const ValueType linear_wts[4] = {  static_cast<ValueType>( (2 - rmdr.x) * (2 - rmdr.y) ),    //tl
+                                               static_cast<ValueType>( rmdr.x * (2 - rmdr.y) ),          //tr
+                                               static_cast<ValueType>( (2 - rmdr.x) * rmdr.y ),          //bl
+                                               static_cast<ValueType>( rmdr.x * rmdr.y ) };              //br
+
+
+           for(int c = 0, uY = ref_start.y,BuY=BChk(uY,trueRefYlen),BuY1=BChk(uY+1,trueRefYlen);
+               c < block_data.LengthY(); ++c, uY += 2,BuY=BChk(uY,trueRefYlen),BuY1=BChk(uY+1,trueRefYlen))
+           {
+               for(int l = 0, uX = ref_start.x,BuX=BChk(uX,trueRefXlen),BuX1=BChk(uX+1,trueRefXlen);
+                   l < block_data.LengthX(); ++l, uX += 2,BuX=BChk(uX,trueRefXlen),BuX1=BChk(uX+1,trueRefXlen))
+               {
+
+                   block_data[c][l] = ( linear_wts[0] * refup_data[BuY][BuX] +
+                                         linear_wts[1] * refup_data[BuY][BuX1] +
+                                         linear_wts[2] * refup_data[BuY1][BuX] +
+                                         linear_wts[3] * refup_data[BuY1][BuX1] +
+                                         2
+                                       ) >> 2;
+               }//l
+           }//c
+
+        }
+    }
+
+    void AdjustBlockBySpatialWeights (TwoDArray<ValueType>& val_block,
+                                      const ImageCoords &pos,
+                                      const TwoDArray<ValueType> &wt_array)
+    {
+        ImageCoords start_pos (std::max(0, pos.x), std::max(0, pos.y));
+        ImageCoords wt_start (start_pos.x - pos.x, start_pos.y - pos.y);
+
+        for (int y = 0, wt_y=wt_start.y; y < val_block.LengthY(); ++y, ++wt_y)
+        {
+            for (int x = 0, wt_x=wt_start.x; x < val_block.LengthX(); ++x, ++wt_x)
+            {
+                val_block[y][x] *= wt_array[wt_y][wt_x];
+            }
+        }
+    }
+
+    void AddMCBlock( const ImageCoords& start_pos,
+                     TwoDArray<ValueType> &comp_strip,
+                     TwoDArray<ValueType>& block_data )
+    {
+        for (int y = 0, py=start_pos.y; y < block_data.LengthY(); ++y, ++py)
+        {
+            for (int x = 0, px=start_pos.x; x < block_data.LengthX(); ++x, ++px)
+            {
+                comp_strip[py][px] += block_data[y][x];
+            }
+        }
+    }
+
+    void CompensateComponentAddAndShift( int start_y, int end_y,
+                                         int weight_bits,
+                                         const ImageCoords& orig_pic_size,
+                                         TwoDArray<ValueType> &comp_data,
+                                         PicArray &pic_data_out )
+    {
+        const int round_val = 1<<(weight_bits-1);
+
+        for ( int i = start_y, pic_y = 0; i < end_y; i++, pic_y++)
+        {
+            ValueType *pic_row = comp_data[pic_y];
+            ValueType *out_row = pic_data_out[i];
+
+            for ( int j =0; j < orig_pic_size.x; j++)
+            {
+                out_row[j] += static_cast<ValueType>( (pic_row[j] + round_val) >> weight_bits );
+            }
+            // Pad the remaining pixels of the row with last truepic pixel val
+            for ( int j = orig_pic_size.x; j < comp_data.LengthX(); j++)
+            {
+                out_row[j] = out_row[orig_pic_size.x-1];
+            }
+        }
+    }
+}
+
+MCKernels dirac::SelectMCKernels( const CpuLevel level )
+{
+    MCKernels kernels;
+    kernels.half_pel_pred = HalfPelBlockPred;
+    kernels.quarter_pel_pred = QuarterPelBlockPred;
+    kernels.adjust_block = AdjustBlockBySpatialWeights;
+    kernels.add_block = AddMCBlock;
+    kernels.add_and_shift = CompensateComponentAddAndShift;
+
+#if defined(HAVE_MMX)
+    if ( level>=CPU_LEVEL_MMX )
+    {
+        kernels.half_pel_pred = HalfPelBlockPred_mmx;
+        kernels.quarter_pel_pred = QuarterPelBlockPred_mmx;
+        kernels.adjust_block = AdjustBlockBySpatialWeights_mmx;
+        kernels.add_block = AddMCBlock_mmx;
+        kernels.add_and_shift = CompensateComponentAddAndShift_mmx;
+    }
+#else
+    (void) level;
+#endif
+
+    return kernels;
+}
@@ -54,12 +54,61 @@
 #include <libdirac_common/upconvert.h>
 #include <libdirac_common/motion.h>
 #include <libdirac_common/picture_buffer.h>
+#include <libdirac_common/cpu_dispatch.h>
 
 namespace dirac
 {
     class PictureBuffer;
     class Picture;
 
+    //! Motion compensation kernels, selected for an instruction set level
+    struct MCKernels
+    {
+        //! Predicts a block from an upconverted reference with a half-pixel accurate vector
+        void (*half_pel_pred)( TwoDArray<ValueType>& block_data ,
+                               const ImageCoords& pos ,
+                               const ImageCoords& orig_pic_size ,
+                               const PicArray& refup_data ,
+                               const MVector& mv );
+
+        //! Predicts a block from an upconverted reference with a quarter-pixel accurate vector
+        void (*quarter_pel_pred)( TwoDArray<ValueType>& block_data ,
+                                  const ImageCoords& pos ,
+                                  const ImageCoords& orig_pic_size ,
+                                  const PicArray& refup_data ,
+                                  const MVector& mv );
+
+        //! Multiplies a predicted block by the part of a spatial weighting matrix it covers
+        /*!
+            pos is the position of the top left corner of the block in the
+            picture, which may be outside it. Only the low 16 bits of the
+            products are kept.
+        */
+        void (*adjust_block)( TwoDArray<ValueType>& val_block ,
+                              const ImageCoords& pos ,
+                              const TwoDArray<ValueType>& wt_array );
+
+        //! Adds a weighted block into a strip of blocks at a given position
+        void (*add_block)( const ImageCoords& start_pos ,
+                           TwoDArray<ValueType>& comp_strip ,
+                           TwoDArray<ValueType>& block_data );
+
+        //! Adds rows of a strip of blocks to a picture, removing the weighting
+        /*!
+            Rows start_y to end_y of the picture are incremented by the
+            rounded strip values shifted down by weight_bits, and padded
+            beyond the true picture width with their last true value.
+        */
+        void (*add_and_shift)( int start_y , int end_y ,
+                               int weight_bits ,
+                               const ImageCoords& orig_pic_size ,
+                               TwoDArray<ValueType>& comp_data ,
+                               PicArray& pic_data_out );
+    };
+
+    //! Returns the motion compensation kernels for an instruction set level
+    MCKernels SelectMCKernels( const CpuLevel level );
+
     //! Abstract Motion compensator class.
     /*!
         Motion compensator class, for doing motion compensation with two
@@ -184,26 +233,15 @@ namespace dirac
         void AdjustBlockByRefWeights (TwoDArray<ValueType>& val1_block,
                                       TwoDArray<ValueType>& val2_block,
                                       PredMode block_mode);
-
-        // Adjust the block value based spatial weighting matrix
-        /*
-        * Adjust the block value based on spatial weighting matrix
-        * val_block - Predicted block
-        * pos       - position of top lef corner of block in picture
-        * wt_array  - spatial weighting matrix
-        *
-        * On return, val_block will contain the spatial weight adjusted block
-        * values
-        */
-        void AdjustBlockBySpatialWeights (TwoDArray<ValueType>& val_block,
-                                          const ImageCoords &pos,
-                                          const TwoDArray<ValueType> &wt_array);
     protected:
         //variables
 
         //! The codec parameters
         PicturePredParams m_predparams;
 
+        //! The kernels for the active instruction set
+        const MCKernels m_kernels;
+
         //! The chroma format
         ChromaFormat m_cformat;
         bool luma_or_chroma;    //true if we're doing luma, false if we're coding chroma
@@ -66,7 +66,7 @@ inline void check_active_columns(
     }
 }
 
-void MotionCompensator_QuarterPixel::BlockPixelPred( 
+void dirac::QuarterPelBlockPred_mmx( 
                                    TwoDArray<ValueType> &block_data , 
                                    const ImageCoords& pos , 
                                    const ImageCoords& orig_pic_size , 
@@ -268,7 +268,7 @@ void MotionCompensator_QuarterPixel::BlockPixelPred(
     }
 }
 
-void MotionCompensator_HalfPixel::BlockPixelPred( 
+void dirac::HalfPelBlockPred_mmx( 
                                    TwoDArray<ValueType> &block_data , 
                                    const ImageCoords& pos , 
                                    const ImageCoords& orig_pic_size , 
@@ -358,7 +358,7 @@ void MotionCompensator_HalfPixel::BlockPixelPred(
     }
 }
 
-void MotionCompensator::AdjustBlockBySpatialWeights (
+void dirac::AdjustBlockBySpatialWeights_mmx (
                                        TwoDArray<ValueType>& val_block,
                                        const ImageCoords &pos,
                                        const TwoDArray<ValueType> &wt_array)
@@ -57,6 +57,22 @@ namespace dirac
                                            PicArray &pic_data_out);
     
     void AddMCBlock_mmx (const ImageCoords& start_pos, TwoDArray<ValueType> &comp_strip, TwoDArray<ValueType>& block_data);
+
+    void HalfPelBlockPred_mmx (TwoDArray<ValueType> &block_data,
+                               const ImageCoords& pos,
+                               const ImageCoords& orig_pic_size,
+                               const PicArray &refup_data,
+                               const MVector &mv);
+
+    void QuarterPelBlockPred_mmx (TwoDArray<ValueType> &block_data,
+                                  const ImageCoords& pos,
+                                  const ImageCoords& orig_pic_size,
+                                  const PicArray &refup_data,
+                                  const MVector &mv);
+
+    void AdjustBlockBySpatialWeights_mmx (TwoDArray<ValueType>& val_block,
+                                          const ImageCoords &pos,
+                                          const TwoDArray<ValueType> &wt_array);
 }
 
 #endif // HAVE_MMX
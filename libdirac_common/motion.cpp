@@ -130,6 +130,9 @@ void MEData::SetLambdaMap( const int num_refs , const float lambda )
     TwoDArray<bool> transition_map1( Mode().LengthY() , Mode().LengthX() );
     TwoDArray<bool> transition_map2( Mode().LengthY() , Mode().LengthX() );
 
+    const MECostType full_lambda = ToMECost( lambda );
+    const MECostType part_lambda = ToMECost( lambda/4.0 );
+
     FindTransitions( transition_map1 , 1 );
 
     if ( num_refs==1 )
@@ -139,11 +142,11 @@ void MEData::SetLambdaMap( const int num_refs , const float lambda )
             for ( int i=0 ; i<m_lambda_map.LengthX() ; i++)
             {
                 if ( transition_map1[j][i] )
-                    m_lambda_map[j][i] = 0.0;
+                    m_lambda_map[j][i] = 0;
                 else
-                    m_lambda_map[j][i] = lambda;
+                    m_lambda_map[j][i] = full_lambda;
                 if ( i<4 || j<4 )
-                    m_lambda_map[j][i] /= 5.0; 
+                    m_lambda_map[j][i] /= 5; 
             }// i
         }// j
     }
@@ -156,21 +159,22 @@ void MEData::SetLambdaMap( const int num_refs , const float lambda )
             for ( int i=0 ; i<m_lambda_map.LengthX() ; i++)
             {
                 if ( transition_map1[j][i] && transition_map2[j][i] )
-                    m_lambda_map[j][i] = 0.0;
+                    m_lambda_map[j][i] = 0;
                 else if (transition_map1[j][i] || transition_map2[j][i] )
-                    m_lambda_map[j][i] = lambda/4.0;
+                    m_lambda_map[j][i] = part_lambda;
                 else
-                    m_lambda_map[j][i] = lambda;
+                    m_lambda_map[j][i] = full_lambda;
 
                 if ( i<4 || j<4 )
-                    m_lambda_map[j][i] /= 5.0; 
+                    m_lambda_map[j][i] /= 5; 
             }// i
         }// j
     }
 
 }
 
-void MEData::SetLambdaMap( const int level , const TwoDArray<float>& l_map , const float wt )
+void MEData::SetLambdaMap( const int level , const TwoDArray<MECostType>& l_map ,
+                           const MECostType wt_num , const MECostType wt_den )
 {
 
     const int factor = 1<<(2-level);
@@ -191,7 +195,7 @@ void MEData::SetLambdaMap( const int level , const TwoDArray<float>& l_map , con
                 for (int p = xstart ; p<xend ; ++p )
                       m_lambda_map[j][i] = std::max( l_map[q][p] , m_lambda_map[j][i] );
 
-           m_lambda_map[j][i] *= wt;
+           m_lambda_map[j][i] = ( m_lambda_map[j][i]*wt_num )/wt_den;
 
         }// i
     }// j
@@ -38,7 +38,9 @@
 * ***** END LICENSE BLOCK ***** */
 
 #include <libdirac_common/common.h>
+#include <libdirac_common/dirac_inttypes.h>
 #include <algorithm>
+#include <climits>
 #ifndef _MOTION_H
 #define _MOTION_H
 
@@ -188,26 +190,59 @@ namespace dirac
     //! An array of float-based motion vectors for doing global motion calcs
     typedef TwoDArray< MotionVector<float> > MvFloatArray;
 
+    //! Type for the Lagrangian costs and lambdas of motion estimation and mode decision
+    /*!
+        Costs and lambdas are held in fixed point, with ME_COST_SHIFT
+        fractional bits, so that the cost calculations are done in integers
+        and give the same results with any compiler or architecture.
+    */
+    typedef int64_t MECostType;
+
+    //! The number of fractional bits in an MECostType
+    const int ME_COST_SHIFT = 8;
+
+    //! A cost greater than any that can arise in motion estimation
+    const MECostType MAX_ME_COST = static_cast<MECostType>( INT_MAX )<<ME_COST_SHIFT;
+
+    //! Convert a (non-negative) real value to a fixed-point cost
+    inline MECostType ToMECost( const double val )
+    {
+        return static_cast<MECostType>( val*( 1<<ME_COST_SHIFT ) + 0.5 );
+    }
+
+    //! Convert an integer SAD to a fixed-point cost
+    inline MECostType SADToMECost( const CalcValueType sad )
+    {
+        return static_cast<MECostType>( sad )<<ME_COST_SHIFT;
+    }
+
+    //! Convert a fixed-point cost to a real value
+    inline double FromMECost( const MECostType cost )
+    {
+        return static_cast<double>( cost )/( 1<<ME_COST_SHIFT );
+    }
+
     //! Class for recording costs derived in motion estimation
     class MvCostData
     {
     public:
         //! Constructor
         MvCostData():
-        SAD(0.0),
-        mvcost(0.0),
-        total(0.0){}
+        SAD(0),
+        mvcost(0),
+        total(0){}
 
-        void SetTotal( const float lambda ){total = SAD + lambda*mvcost;}
+        //! Set the total from the SAD and mvcost, with a fixed-point lambda
+        void SetTotal( const MECostType lambda ){total = SADToMECost( SAD ) + lambda*mvcost;}
 
         //! The Sum of Absolute Differences - easier to compute than Sum-Squared Differences
-        float SAD;
+        CalcValueType SAD;
 
-        //! The (Lagrangian-weighted) motion vector cost - the difference of a motion vector from its neighbouring vectors
-        float mvcost;
+        //! The motion vector cost - the difference of a motion vector from its neighbouring vectors
+        CalcValueType mvcost;
 
-        //! Total=SAD+mvcost
-        float total;
+        //! Total=SAD+lambda*mvcost, in fixed point
+        MECostType total;
     };
 
 
@@ -335,10 +370,10 @@ namespace dirac
         const TwoDArray<MvCostData>& PredCosts(const int ref_id) const { return *( m_pred_costs[ref_id] ); }
 
         //! Get the intra costs
-        TwoDArray<float>& IntraCosts(){ return m_intra_costs; }
+        TwoDArray<MECostType>& IntraCosts(){ return m_intra_costs; }
 
         //! Get the intra costs
-        const TwoDArray<float>& IntraCosts() const { return m_intra_costs; }
+        const TwoDArray<MECostType>& IntraCosts() const { return m_intra_costs; }
 
         //! Get the bipred costs
         TwoDArray<MvCostData>& BiPredCosts(){ return m_bipred_costs; }
@@ -347,10 +382,10 @@ namespace dirac
         const TwoDArray<MvCostData>& BiPredCosts() const { return m_bipred_costs; }
 
         //! Get the SB costs
-        TwoDArray<float>& SBCosts(){ return m_SB_costs; }
+        TwoDArray<MECostType>& SBCosts(){ return m_SB_costs; }
 
         //! Get the SB costs
-        const TwoDArray<float>& SBCosts() const { return m_SB_costs; }
+        const TwoDArray<MECostType>& SBCosts() const { return m_SB_costs; }
 
 	//! Get the proportion of intra blocks
 	float IntraBlockRatio() const {return m_intra_block_ratio; }
@@ -362,10 +397,15 @@ namespace dirac
         void SetLambdaMap( const int num_refs , const float lambda );
 
         //! Set up the lambda map by averaging the lambda map from a lower level 
-        void SetLambdaMap( const int level , const TwoDArray<float>& l_map , const float wt );
+        /*!
+            Set up the lambda map by averaging the lambda map from a lower
+            level, and weighting by wt_num/wt_den
+        */
+        void SetLambdaMap( const int level , const TwoDArray<MECostType>& l_map ,
+                           const MECostType wt_num , const MECostType wt_den );
 
-        //! Get a lambda value for a given block and level
-        const TwoDArray<float>& LambdaMap() const { return m_lambda_map; }
+        //! Get the fixed-point lambda values for each block
+        const TwoDArray<MECostType>& LambdaMap() const { return m_lambda_map; }
 
         //! Get the inliers for each reference
         TwoDArray<int>& GlobalMotionInliers(const int ref_id){ return *( m_inliers[ref_id] ); }
@@ -390,16 +430,16 @@ namespace dirac
         OneDArray< TwoDArray<MvCostData>* > m_pred_costs;
 
         // The costs of predicting each block by DC
-        TwoDArray<float> m_intra_costs;
+        TwoDArray<MECostType> m_intra_costs;
 
         // The costs of predicting each block bidirectionally
         TwoDArray<MvCostData> m_bipred_costs;
 
         // The costs for each macroblock as a whole
-        TwoDArray<float> m_SB_costs;
+        TwoDArray<MECostType> m_SB_costs;
 
         // A map of the lambda values to use
-        TwoDArray<float> m_lambda_map;
+        TwoDArray<MECostType> m_lambda_map;
 
         // Global motion inliers
         OneDArray< TwoDArray<int>* > m_inliers;
@@ -443,6 +483,48 @@ namespace dirac
     //! Return the mean of a set of signed integer values
     int GetSMean(std::vector<int>& values);
 
+    //! Return the median of up to three neighbouring values
+    /*!
+        Returns the median of three values, the rounded mean of two, the
+        value itself if there is one, and zero if there are none. This gives
+        the same result as Median(const std::vector<int>&) without needing
+        a container.
+    */
+    inline int NbrMedian(const int* vals, const int num_vals)
+    {
+        switch (num_vals)
+        {
+        case 3 :
+            return vals[0] + vals[1] + vals[2] -
+                   std::max( std::max( vals[0] , vals[1] ) , vals[2] ) -
+                   std::min( std::min( vals[0] , vals[1] ) , vals[2] );
+        case 2 :
+            return ( vals[0] + vals[1] + 1 )>>1;
+        case 1 :
+            return vals[0];
+        default :
+            return 0;
+        }
+    }
+
+    //! Return the rounded mean of up to three neighbouring values
+    /*!
+        Rounds half-way values up, as GetSMean() and GetUMean() do, and
+        returns zero if there are no values.
+    */
+    inline int NbrMean(const int* vals, const int num_vals)
+    {
+        if ( num_vals==0 )
+            return 0;
+
+        int sum = num_vals>>1;
+        for (int i=0; i<num_vals; ++i)
+            sum += vals[i];
+
+        // Divide rounding towards minus infinity
+        return sum>=0 ? sum/num_vals : -( (num_vals-1-sum)/num_vals );
+    }
+
 } // namespace dirac
 
 #endif
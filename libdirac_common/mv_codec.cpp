@@ -98,15 +98,13 @@ unsigned int SplitModeCodec::Prediction(const TwoDArray<int> & split_data ) cons
 {    
     int result = 0;
     
-    std::vector < unsigned int >  nbrs;
-    
     if (m_sb_xp > 0 && m_sb_yp > 0)
     {
-        nbrs.push_back( split_data[m_sb_yp-1][m_sb_xp] ); 
-        nbrs.push_back( split_data[m_sb_yp-1][m_sb_xp-1] ); 
-        nbrs.push_back( split_data[m_sb_yp][m_sb_xp-1] ); 
+        const int nbrs[3] = { split_data[m_sb_yp-1][m_sb_xp],
+                              split_data[m_sb_yp-1][m_sb_xp-1],
+                              split_data[m_sb_yp][m_sb_xp-1] };
 
-        result = GetUMean(nbrs);     
+        result = NbrMean( nbrs , 3 );
     }
     else if (m_sb_xp > 0 && m_sb_yp == 0)
         result = split_data[m_sb_yp][m_sb_xp-1]; 
@@ -422,7 +420,8 @@ void VectorElementCodec::ResetAll()
 int VectorElementCodec::Prediction(const MvArray& mvarray,
                                   const TwoDArray < PredMode > & preddata) const
 {
-    std::vector <int>  nbrs; 
+    int nbrs[3];
+    int num_nbrs( 0 );
     PredMode pmode;     
     int result( 0 ); 
     
@@ -430,18 +429,17 @@ int VectorElementCodec::Prediction(const MvArray& mvarray,
     {
         pmode = preddata[m_b_yp-1][m_b_xp]; 
         if (pmode & m_ref) 
-            nbrs.push_back(mvarray[m_b_yp-1][m_b_xp][m_hv]); 
+            nbrs[num_nbrs++] = mvarray[m_b_yp-1][m_b_xp][m_hv]; 
         
         pmode = preddata[m_b_yp-1][m_b_xp-1]; 
         if (pmode & m_ref)
-            nbrs.push_back(mvarray[m_b_yp-1][m_b_xp-1][m_hv]); 
+            nbrs[num_nbrs++] = mvarray[m_b_yp-1][m_b_xp-1][m_hv]; 
         
         pmode = preddata[m_b_yp][m_b_xp-1]; 
         if (pmode & m_ref)
-            nbrs.push_back(mvarray[m_b_yp][m_b_xp-1][m_hv]);
+            nbrs[num_nbrs++] = mvarray[m_b_yp][m_b_xp-1][m_hv];
         
-        if (nbrs.size() > 0)
-            result = Median(nbrs); 
+        result = NbrMedian( nbrs , num_nbrs ); 
     }
     else if (m_b_xp > 0 && m_b_yp == 0)
     {
@@ -588,7 +586,8 @@ void DCCodec::ResetAll()
 ValueType DCCodec::Prediction(const TwoDArray < ValueType > & dcdata,
                                     const TwoDArray < PredMode > & preddata) const
 {
-    std::vector < int >  nbrs; 
+    int nbrs[3];
+    int num_nbrs( 0 );
     PredMode pmode;
     ValueType result = 0; 
     
@@ -596,18 +595,17 @@ ValueType DCCodec::Prediction(const TwoDArray < ValueType > & dcdata,
     {
         pmode = preddata[m_b_yp-1][m_b_xp]; 
         if (pmode == INTRA) 
-            nbrs.push_back( (int) dcdata[m_b_yp-1][m_b_xp] ); 
+            nbrs[num_nbrs++] = dcdata[m_b_yp-1][m_b_xp]; 
         
         pmode = preddata[m_b_yp-1][m_b_xp-1]; 
         if (pmode == INTRA)
-            nbrs.push_back((int)dcdata[m_b_yp-1][m_b_xp-1] ); 
+            nbrs[num_nbrs++] = dcdata[m_b_yp-1][m_b_xp-1]; 
         
         pmode = preddata[m_b_yp][m_b_xp-1]; 
         if (pmode == INTRA)        
-            nbrs.push_back( (int) dcdata[m_b_yp][m_b_xp-1] ); 
+            nbrs[num_nbrs++] = dcdata[m_b_yp][m_b_xp-1]; 
         
-        if (nbrs.size() > 0)
-            result = ValueType(GetSMean(nbrs));     
+        result = ValueType( NbrMean( nbrs , num_nbrs ) );     
     }
     else if (m_b_xp > 0 && m_b_yp == 0)
     {
@@ -39,6 +39,7 @@
 
 #include <libdirac_common/picture.h>
 #include <libdirac_common/upconvert.h>
+#include <libdirac_common/cpu_dispatch.h>
 using namespace dirac;
 
 #include <iostream>
@@ -62,7 +63,8 @@ Picture::Picture(const PictureParams& pp):
 }
 
 Picture::Picture( const Picture& cpy ): 
-    m_pparams(cpy.m_pparams)
+    m_pparams(cpy.m_pparams),
+    m_times(cpy.m_times)
 {
 
     //delete data to be overwritten
@@ -91,6 +93,7 @@ Picture& Picture::operator=(const Picture& rhs)
     if ( &rhs != this)
     {
         m_pparams=rhs.m_pparams;
+        m_times=rhs.m_times;
 
         // Delete current data
         ClearData();
@@ -235,6 +238,7 @@ void Picture::ClipComponent(PicArray& pic_data, CompSort cs) const
               (1 << (m_pparams.ChromaDepth()-1) )-1;
 
 #if defined (HAVE_MMX)
+    if ( ActiveCpuLevel()>=CPU_LEVEL_MMX )
     {
         int qcount = count >> 2;
         count = count & 3;
@@ -322,6 +326,7 @@ void Picture::ReconfigPicture(const PictureParams &pp )
 
     PictureParams old_pp = m_pparams;
     m_pparams = pp;
+    m_times.Clear();
 
     // HAve picture dimensions  or Chroma format changed ?
     if (m_pparams.Xl() == old_pp.Xl() && 
@@ -40,6 +40,7 @@
 
 #include <libdirac_common/common.h>
 #include <libdirac_common/wavelet_utils.h>
+#include <libdirac_common/stage_timer.h>
 
 namespace dirac
 {
@@ -111,6 +112,12 @@ namespace dirac
         //! Initialises the wavelet coefficient data arrays;
         void InitWltData( const int transform_depth );
 
+        //! Returns the time spent in each stage of coding or decoding the picture
+        StageTimes& Times(){ return m_times; }
+
+        //! Returns the time spent in each stage of coding or decoding the picture
+        const StageTimes& Times() const { return m_times; }
+
         //! Clip the data to prevent overshoot
         /*!
             Clips the data to lie between 0 and (1<<video_depth)-1 
@@ -132,6 +139,8 @@ namespace dirac
 
         CoeffArray m_wlt_data[3];// the wavelet coefficient data
 
+        StageTimes m_times;// the time spent in each processing stage
+
         //! Initialises the picture once the picture parameters have been set
         virtual void Init();
 
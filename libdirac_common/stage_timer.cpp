@@ -0,0 +1,86 @@
+/* ***** BEGIN LICENSE BLOCK *****
+*
+* $Id$ $Name$
+*
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License
+* Version 1.1 (the "License"); you may not use this file except in compliance
+* with the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License for
+* the specific language governing rights and limitations under the License.
+*
+* The Original Code is BBC Research and Development code.
+*
+* The Initial Developer of the Original Code is the British Broadcasting
+* Corporation.
+* Portions created by the Initial Developer are Copyright (C) 2008.
+* All Rights Reserved.
+*
+* Contributor(s): Thomas Davies (Original Author)
+*
+* Alternatively, the contents of this file may be used under the terms of
+* the GNU General Public License Version 2 (the "GPL"), or the GNU Lesser
+* Public License Version 2.1 (the "LGPL"), in which case the provisions of
+* the GPL or the LGPL are applicable instead of those above. If you wish to
+* allow use of your version of this file only under the terms of the either
+* the GPL or LGPL and not to allow others to use your version of this file
+* under the MPL, indicate your decision by deleting the provisions above
+* and replace them with the notice and other provisions required by the GPL
+* or LGPL. If you do not delete the provisions above, a recipient may use
+* your version of this file under the terms of any one of the MPL, the GPL
+* or the LGPL.
+* ***** END LICENSE BLOCK ***** */
+
+
+#include <libdirac_common/stage_timer.h>
+#include <ctime>
+#if defined(_OPENMP)
+#include <omp.h>
+#elif !defined(_MSC_VER)
+#include <sys/time.h>
+#endif
+using namespace dirac;
+
+double dirac::StageClock()
+{
+#if defined(_OPENMP)
+    return omp_get_wtime();
+#elif defined(_MSC_VER)
+    // clock() measures elapsed time with the Microsoft runtime
+    return double( std::clock() )/CLOCKS_PER_SEC;
+#else
+    timeval tv;
+    gettimeofday( &tv , 0 );
+    return tv.tv_sec + tv.tv_usec*1.0e-6;
+#endif
+}
+
+void StageTimes::Clear()
+{
+    for (int i=0; i<TIMING_NUM_STAGES; ++i)
+    {
+        m_times.seconds[i] = 0.0;
+        m_times.calls[i] = 0;
+    }
+}
+
+void StageTimes::Add( const StageTimes& rhs )
+{
+    for (int i=0; i<TIMING_NUM_STAGES; ++i)
+    {
+        m_times.seconds[i] += rhs.m_times.seconds[i];
+        m_times.calls[i] += rhs.m_times.calls[i];
+    }
+}
+
+double StageTimes::Total() const
+{
+    double total = 0.0;
+    for (int i=0; i<TIMING_NUM_STAGES; ++i)
+        total += m_times.seconds[i];
+    return total;
+}
@@ -0,0 +1,122 @@
+/* ***** BEGIN LICENSE BLOCK *****
+*
+* $Id$ $Name$
+*
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License
+* Version 1.1 (the "License"); you may not use this file except in compliance
+* with the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License for
+* the specific language governing rights and limitations under the License.
+*
+* The Original Code is BBC Research and Development code.
+*
+* The Initial Developer of the Original Code is the British Broadcasting
+* Corporation.
+* Portions created by the Initial Developer are Copyright (C) 2008.
+* All Rights Reserved.
+*
+* Contributor(s): Thomas Davies (Original Author)
+*
+* Alternatively, the contents of this file may be used under the terms of
+* the GNU General Public License Version 2 (the "GPL"), or the GNU Lesser
+* Public License Version 2.1 (the "LGPL"), in which case the provisions of
+* the GPL or the LGPL are applicable instead of those above. If you wish to
+* allow use of your version of this file only under the terms of the either
+* the GPL or LGPL and not to allow others to use your version of this file
+* under the MPL, indicate your decision by deleting the provisions above
+* and replace them with the notice and other provisions required by the GPL
+* or LGPL. If you do not delete the provisions above, a recipient may use
+* your version of this file under the terms of any one of the MPL, the GPL
+* or the LGPL.
+* ***** END LICENSE BLOCK ***** */
+
+
+#ifndef _STAGE_TIMER_H_
+#define _STAGE_TIMER_H_
+
+#include <libdirac_common/dirac_types.h>
+
+namespace dirac
+{
+    //! Returns a wall-clock time in seconds, for timing processing stages
+    double StageClock();
+
+    //! Accumulates the time spent in each processing stage of a picture
+    class StageTimes
+    {
+    public:
+        //! Constructor - all times and counts are zero
+        StageTimes(){ Clear(); }
+
+        //! Constructor - starts from a given set of times and counts
+        explicit StageTimes( const dirac_stage_times_t& times ): m_times( times ){}
+
+        //Class is POD
+        //Use built in copy constructor, assignment and destructor.
+
+        //! Sets all times and counts to zero
+        void Clear();
+
+        //! Adds a run of a stage, taking the given number of seconds
+        void Add( const dirac_timing_stage_t stage, const double seconds )
+        {
+            m_times.seconds[stage] += seconds;
+            ++m_times.calls[stage];
+        }
+
+        //! Adds the times and counts of another set of stages
+        void Add( const StageTimes& rhs );
+
+        //! Returns the total time over all stages
+        double Total() const;
+
+        //! Returns the times and counts
+        const dirac_stage_times_t& Times() const { return m_times; }
+
+    private:
+        dirac_stage_times_t m_times;
+    };
+
+    //! Times a processing stage from construction to destruction
+    /*!
+        The elapsed time is added to a StageTimes object when the timer goes
+        out of scope, so a stage is timed by declaring a timer at its start.
+        Timers must not be shared between threads.
+    */
+    class StageTimer
+    {
+    public:
+        //! Constructor - starts timing
+        /*!
+            \param times  the set of times to add to
+            \param stage  the stage being timed
+        */
+        StageTimer( StageTimes& times, const dirac_timing_stage_t stage ):
+            m_times( times ),
+            m_stage( stage ),
+            m_start( StageClock() )
+        {}
+
+        //! Destructor - adds the elapsed time
+        ~StageTimer(){ m_times.Add( m_stage, StageClock()-m_start ); }
+
+    private:
+        //! Private, bodyless copy constructor: class should not be copied
+        StageTimer( const StageTimer& cpy );
+
+        //! Private, bodyless copy operator=: class should not be assigned
+        StageTimer& operator=( const StageTimer& rhs );
+
+        StageTimes& m_times;
+        const dirac_timing_stage_t m_stage;
+        const double m_start;
+    };
+
+} // namespace dirac
+
+#endif
@@ -39,162 +39,325 @@
 using namespace dirac;
 
 #include <iostream>
+#include <vector>
+#include <cstring>
+
+#if defined(HAVE_SSE2)
+#include <emmintrin.h>
+#endif
+#if defined(HAVE_AVX2)
+#include <immintrin.h>
+#endif
 
 #define MAX(a,b) (((a) > (b)) ? (a) : (b))
 #define MIN(a,b) (((a) < (b)) ? (a) : (b))
 #define CLIP(x,min,max) MAX(MIN(x,max),min)
 
-UpConverter::UpConverter (int min_val, int max_val, int orig_xlen, int orig_ylen) :
-    m_min_val(min_val),
-    m_max_val(max_val),
-    m_orig_xl(orig_xlen),
-    m_orig_yl(orig_ylen)
-{}
-
-//Up-convert by a factor of two.
-void UpConverter::DoUpConverter(const PicArray& pic_data, PicArray& up_data)
+namespace
 {
-
-    m_width_old = std::min (pic_data.LengthX(), m_orig_xl);
-    m_height_old = std::min (pic_data.LengthY(), m_orig_yl);
-    m_width_new = std::min(2*m_width_old, up_data.LengthX());
-    m_height_new = std::min(2*m_height_old, up_data.LengthY());
-
     // Filter params
     const int filter_size = 4;
     const int filter_shift = 5;
-    const short taps[4] = {21,-7,3,-1}; 
-
+    const short taps[filter_size] = {21,-7,3,-1};
 
-    //Variables that will be used by the filter calculations
-    ValueType sum;
-    int ypos(0);
-    
+    // NB: sums are accumulated in ValueType, as they always have been, so
+    // the vector versions use 16-bit arithmetic to give identical results.
 
-    //There are three y loops to cope with the leading edge, middle 
-    //and trailing edge of each column.
-
-    for(int y = 0 ; y < filter_size; ++y , ypos += 2)
+    // Filters samples x onwards of a half-resolution line vertically
+    void ColumnFilterFrom( const ValueType* const* near_lines,
+                           const ValueType* const* far_lines,
+                           ValueType* out_line, int x, const int width,
+                           const int min_val, const int max_val )
     {
-
-        //We are filtering each column but doing it bit by bit.
-        //This means our main loop is in the x direction and
-        //there is a much greater chance the data we need will
-        //be in the cache.
-        for(int x = 0 , xpos = 0; x < m_width_old; x++ , xpos+=2 )
+        //Calculation variable
+        ValueType sum;
+        for( ; x < width; ++x )
         {
-            // Copy a Pixel from the original image in each even position
-            up_data[ypos][xpos] = pic_data[y][x];
-
-            //Work out the next pixel from filtered values.
-            //Excuse the complicated ternary stuff but it sorts out the edge
             sum  = 1 << (filter_shift-1);
-            sum += (pic_data[y][x]              + pic_data[y+1][x]) * taps[0];
-            sum += (pic_data[(y>=1)?(y-1):0][x] + pic_data[y+2][x]) * taps[1];
-            sum += (pic_data[(y>=2)?(y-2):0][x] + pic_data[y+3][x]) * taps[2];
-            sum += (pic_data[(y>=3)?(y-3):0][x] + pic_data[y+4][x]) * taps[3];
+
+            for (int t=0; t<filter_size; ++t)
+                sum += (near_lines[t][x] + far_lines[t][x]) * taps[t];
 
             sum >>= filter_shift;
-            up_data[ypos+1][xpos] = CLIP(sum, m_min_val, m_max_val);
-        }// x, xpos
-
-        // The row loop.
-        RowLoop( up_data , ypos, filter_size, filter_shift, taps );
-    }// y, ypos
-    // This loop is like the last one but it deals with the centre
-    // section of the image and so the ternary operations are dropped
-    // from the filter section.
-    for(int y = filter_size; y < m_height_old - filter_size; ++y , ypos += 2)
+            out_line[x] = CLIP(sum, min_val, max_val);
+        }// x
+    }
+
+    // Upconverts samples x onwards of a padded half-resolution line
+    void RowFilterFrom( const ValueType* line, ValueType* up_line,
+                        int x, const int up_width,
+                        const int min_val, const int max_val )
     {
-        for(int x = 0 , xpos=0; x < m_width_old; x++ , xpos+=2 )
+        //Calculation variable
+        ValueType sum;
+        for( ; 2*x < up_width; ++x )
         {
-            up_data[ypos][xpos] = pic_data[y][x];
+            up_line[2*x] = line[x];
 
             sum  = 1 << (filter_shift-1);
-            
+
             for (int t=0; t<filter_size; ++t)
-                sum += (pic_data[y-t][x]   + pic_data[y+1+t][x]) * taps[t];
+                sum += (line[x-t] + line[x+1+t]) * taps[t];
 
             sum >>= filter_shift;
-            up_data[ypos+1][xpos] = CLIP(sum, m_min_val, m_max_val);
-        }// x,xpos
-        RowLoop( up_data , ypos, filter_size, filter_shift, taps );
-
-    }// y, ypos 
-    // Another similar loop! - this time we are dealing with
-    // the trailing edge so the ternary stuff is back in the
-    // filter calcs but in the second parameter.    
-    for(int y = m_height_old - filter_size; y < m_height_old; ++y , ypos+=2)
+            if ( 2*x+1 < up_width )
+                up_line[2*x+1] = CLIP(sum, min_val, max_val);
+        }// x
+    }
+
+    void ColumnFilter( const ValueType* const* near_lines,
+                       const ValueType* const* far_lines,
+                       ValueType* out_line, const int width,
+                       const int min_val, const int max_val )
     {
-        for(int x = 0 , xpos=0 ; x < m_width_old; x++ , xpos+=2)
-        {
-            up_data[ypos][xpos]=pic_data[y][x];
+        ColumnFilterFrom( near_lines, far_lines, out_line, 0, width, min_val, max_val );
+    }
 
-            sum  = 1 << (filter_shift-1);
-            sum += (pic_data[y][x]     + pic_data[((y+1)<m_height_old)?(y+1):(m_height_old-1)][x]) * taps[0];
-            sum += (pic_data[y - 1][x] + pic_data[((y+2)<m_height_old)?(y+2):(m_height_old-1)][x]) * taps[1];
-            sum += (pic_data[y - 2][x] + pic_data[((y+3)<m_height_old)?(y+3):(m_height_old-1)][x]) * taps[2];
-            sum += (pic_data[y - 3][x] + pic_data[((y+4)<m_height_old)?(y+4):(m_height_old-1)][x]) * taps[3];
+    void RowFilter( const ValueType* line, ValueType* up_line, const int up_width,
+                    const int min_val, const int max_val )
+    {
+        RowFilterFrom( line, up_line, 0, up_width, min_val, max_val );
+    }
 
-            sum >>= filter_shift;
-            up_data[ypos+1][xpos] = CLIP(sum, m_min_val, m_max_val);
-        }//x,xpos
-        RowLoop( up_data , ypos, filter_size, filter_shift, taps );
+#if defined(HAVE_SSE2)
+    // Filters 8 positions from filter_size pairs of samples, and clips
+    inline __m128i FilterPairs( const __m128i* near_vals, const __m128i* far_vals,
+                                const __m128i min_val, const __m128i max_val )
+    {
+        __m128i sum = _mm_set1_epi16( 1 << (filter_shift-1) );
+        for (int t=0; t<filter_size; ++t)
+            sum = _mm_add_epi16( sum, _mm_mullo_epi16( _mm_add_epi16( near_vals[t], far_vals[t] ),
+                                                        _mm_set1_epi16( taps[t] ) ) );
+        sum = _mm_srai_epi16( sum, filter_shift );
+        return _mm_max_epi16( _mm_min_epi16( sum, max_val ), min_val );
+    }
 
-    }//y,ypos
-}
+    void ColumnFilter_sse2( const ValueType* const* near_lines,
+                            const ValueType* const* far_lines,
+                            ValueType* out_line, const int width,
+                            const int min_val, const int max_val )
+    {
+        const __m128i min_vals = _mm_set1_epi16( min_val );
+        const __m128i max_vals = _mm_set1_epi16( max_val );
+        __m128i near_vals[filter_size];
+        __m128i far_vals[filter_size];
+        int x = 0;
+        for( ; x+8 <= width; x+=8 )
+        {
+            for (int t=0; t<filter_size; ++t)
+            {
+                near_vals[t] = _mm_loadu_si128( (const __m128i*)(near_lines[t]+x) );
+                far_vals[t] = _mm_loadu_si128( (const __m128i*)(far_lines[t]+x) );
+            }// t
+            _mm_storeu_si128( (__m128i*)(out_line+x),
+                              FilterPairs( near_vals, far_vals, min_vals, max_vals ) );
+        }// x
 
-void UpConverter::RowLoop(PicArray&up_data, const int row_num, 
-const int filter_size, const int filter_shift, const short taps[4] )
-{
-    const int dble_size( filter_size<<1 );
+        ColumnFilterFrom( near_lines, far_lines, out_line, x, width, min_val, max_val );
+    }
 
-    //Calculation variable
-    ValueType sum;
-    int ypos; 
+    void RowFilter_sse2( const ValueType* line, ValueType* up_line, const int up_width,
+                         const int min_val, const int max_val )
+    {
+        const __m128i min_vals = _mm_set1_epi16( min_val );
+        const __m128i max_vals = _mm_set1_epi16( max_val );
+        __m128i near_vals[filter_size];
+        __m128i far_vals[filter_size];
+        int x = 0;
+        for( ; 2*x+16 <= up_width; x+=8 )
+        {
+            for (int t=0; t<filter_size; ++t)
+            {
+                near_vals[t] = _mm_loadu_si128( (const __m128i*)(line+x-t) );
+                far_vals[t] = _mm_loadu_si128( (const __m128i*)(line+x+1+t) );
+            }// t
+            const __m128i odd_vals = FilterPairs( near_vals, far_vals, min_vals, max_vals );
 
-    //Leading row Edge
-    //Note the factor of two difference as we only want to fill in every other
-    //line as the others have already been created
-    for(int j = 0; j < 2; ++j)
+            _mm_storeu_si128( (__m128i*)(up_line+2*x), _mm_unpacklo_epi16( near_vals[0], odd_vals ) );
+            _mm_storeu_si128( (__m128i*)(up_line+2*x+8), _mm_unpackhi_epi16( near_vals[0], odd_vals ) );
+        }// x
+
+        RowFilterFrom( line, up_line, x, up_width, min_val, max_val );
+    }
+#endif
+
+#if defined(HAVE_AVX2)
+    // Filters 16 positions from filter_size pairs of samples, and clips
+    DIRAC_TARGET_AVX2
+    inline __m256i FilterPairs_avx2( const __m256i* near_vals, const __m256i* far_vals,
+                                     const __m256i min_val, const __m256i max_val )
     {
-        ypos = row_num + j;
+        __m256i sum = _mm256_set1_epi16( 1 << (filter_shift-1) );
+        for (int t=0; t<filter_size; ++t)
+            sum = _mm256_add_epi16( sum, _mm256_mullo_epi16( _mm256_add_epi16( near_vals[t], far_vals[t] ),
+                                                              _mm256_set1_epi16( taps[t] ) ) );
+        sum = _mm256_srai_epi16( sum, filter_shift );
+        return _mm256_max_epi16( _mm256_min_epi16( sum, max_val ), min_val );
+    }
 
-        for(int x = 0; x < dble_size ; x+=2)
+    DIRAC_TARGET_AVX2
+    void ColumnFilter_avx2( const ValueType* const* near_lines,
+                            const ValueType* const* far_lines,
+                            ValueType* out_line, const int width,
+                            const int min_val, const int max_val )
+    {
+        const __m256i min_vals = _mm256_set1_epi16( min_val );
+        const __m256i max_vals = _mm256_set1_epi16( max_val );
+        __m256i near_vals[filter_size];
+        __m256i far_vals[filter_size];
+        int x = 0;
+        for( ; x+16 <= width; x+=16 )
         {
-            sum  = 1 << (filter_shift-1);
-            sum += (up_data[ypos][x]              + up_data[ypos][x+2]) * taps[0];
-            sum += (up_data[ypos][(x>=2)?(x-2):0] + up_data[ypos][x+4]) * taps[1];
-            sum += (up_data[ypos][(x>=4)?(x-4):0] + up_data[ypos][x+6]) * taps[2];
-            sum += (up_data[ypos][(x>=6)?(x-6):0] + up_data[ypos][x+8]) * taps[3];
+            for (int t=0; t<filter_size; ++t)
+            {
+                near_vals[t] = _mm256_loadu_si256( (const __m256i*)(near_lines[t]+x) );
+                far_vals[t] = _mm256_loadu_si256( (const __m256i*)(far_lines[t]+x) );
+            }// t
+            _mm256_storeu_si256( (__m256i*)(out_line+x),
+                                 FilterPairs_avx2( near_vals, far_vals, min_vals, max_vals ) );
+        }// x
 
+        ColumnFilterFrom( near_lines, far_lines, out_line, x, width, min_val, max_val );
+    }
 
-            sum >>= filter_shift;
-            up_data[ypos][x+1] = CLIP(sum, m_min_val, m_max_val);
-        }// x
-        //Middle of row
-        for(int x = dble_size; x<m_width_new-dble_size ; x+=2 )
+    DIRAC_TARGET_AVX2
+    void RowFilter_avx2( const ValueType* line, ValueType* up_line, const int up_width,
+                         const int min_val, const int max_val )
+    {
+        const __m256i min_vals = _mm256_set1_epi16( min_val );
+        const __m256i max_vals = _mm256_set1_epi16( max_val );
+        __m256i near_vals[filter_size];
+        __m256i far_vals[filter_size];
+        int x = 0;
+        for( ; 2*x+32 <= up_width; x+=16 )
         {
-            sum  = 1 << (filter_shift-1);
-    
             for (int t=0; t<filter_size; ++t)
-                sum += (up_data[ypos][x-2*t]   + up_data[ypos][x+2+2*t]) * taps[t];
-
+            {
+                near_vals[t] = _mm256_loadu_si256( (const __m256i*)(line+x-t) );
+                far_vals[t] = _mm256_loadu_si256( (const __m256i*)(line+x+1+t) );
+            }// t
+            const __m256i odd_vals = FilterPairs_avx2( near_vals, far_vals, min_vals, max_vals );
 
-            sum >>= filter_shift;
-            up_data[ypos][x+1] = CLIP(sum, m_min_val, m_max_val);
+            // Interleaving works within 128-bit lanes, so the lanes have
+            // to be swapped over to put the output in order
+            const __m256i lo = _mm256_unpacklo_epi16( near_vals[0], odd_vals );
+            const __m256i hi = _mm256_unpackhi_epi16( near_vals[0], odd_vals );
+            _mm256_storeu_si256( (__m256i*)(up_line+2*x), _mm256_permute2x128_si256( lo, hi, 0x20 ) );
+            _mm256_storeu_si256( (__m256i*)(up_line+2*x+16), _mm256_permute2x128_si256( lo, hi, 0x31 ) );
         }// x
-        //Trailing row edge
-        for(int x = m_width_new - dble_size ; x<m_width_new ; x+=2)
+
+        RowFilterFrom( line, up_line, x, up_width, min_val, max_val );
+    }
+#endif
+
+} // namespace
+
+UpConvertKernels dirac::SelectUpConvertKernels( const CpuLevel level )
+{
+    UpConvertKernels kernels;
+    kernels.column_filter = ColumnFilter;
+    kernels.row_filter = RowFilter;
+
+#if defined(HAVE_SSE2)
+    if ( level>=CPU_LEVEL_SSE2 )
+    {
+        kernels.column_filter = ColumnFilter_sse2;
+        kernels.row_filter = RowFilter_sse2;
+    }
+#endif
+#if defined(HAVE_AVX2)
+    if ( level>=CPU_LEVEL_AVX2 )
+    {
+        kernels.column_filter = ColumnFilter_avx2;
+        kernels.row_filter = RowFilter_avx2;
+    }
+#endif
+#if !defined(HAVE_SSE2) && !defined(HAVE_AVX2)
+    (void) level;
+#endif
+
+    return kernels;
+}
+
+UpConverter::UpConverter (int min_val, int max_val, int orig_xlen, int orig_ylen) :
+    m_min_val(min_val),
+    m_max_val(max_val),
+    m_orig_xl(orig_xlen),
+    m_orig_yl(orig_ylen),
+    m_kernels( SelectUpConvertKernels( ActiveCpuLevel() ) )
+{}
+
+//Up-convert by a factor of two.
+void UpConverter::DoUpConverter(const PicArray& pic_data, PicArray& up_data)
+{
+
+    m_width_old = std::min (pic_data.LengthX(), m_orig_xl);
+    m_height_old = std::min (pic_data.LengthY(), m_orig_yl);
+    m_width_new = std::min(2*m_width_old, up_data.LengthX());
+    m_height_new = std::min(2*m_height_old, up_data.LengthY());
+
+    // Each line of the original makes two lines of the upconverted data: a
+    // copy of the line, and a line filtered vertically from the lines
+    // around it. Each of these is then filtered horizontally to fill in
+    // the odd samples. Lines off the top and bottom of the picture repeat
+    // the edge lines and the half-resolution lines are padded at either
+    // end, so there are no edge cases. Lines are independent, so may be
+    // done in parallel.
+
+#if defined(_OPENMP)
+#pragma omp parallel
+#endif
+    {
+        const int line_length = m_width_old+2*filter_size;
+        std::vector<ValueType> even_buffer( line_length );
+        std::vector<ValueType> odd_buffer( line_length );
+        ValueType* even_line = &even_buffer[filter_size];
+        ValueType* odd_line = &odd_buffer[filter_size];
+        const ValueType* near_lines[filter_size];
+        const ValueType* far_lines[filter_size];
+
+#if defined(_OPENMP)
+#pragma omp for schedule(static)
+#endif
+        for(int y = 0 ; y < m_height_old; ++y)
         {
-            sum  = 1 << (filter_shift-1);
-            sum += (up_data[ypos][x]   + up_data[ypos][(((x+2)<m_width_new)?(x+2):(m_width_new-2))]) * taps[0];
-            sum += (up_data[ypos][x-2] + up_data[ypos][(((x+4)<m_width_new)?(x+4):(m_width_new-2))]) * taps[1];
-            sum += (up_data[ypos][x-4] + up_data[ypos][(((x+6)<m_width_new)?(x+6):(m_width_new-2))]) * taps[2];
-            sum += (up_data[ypos][x-6] + up_data[ypos][(((x+8)<m_width_new)?(x+8):(m_width_new-2))]) * taps[3];
+            for (int t=0; t<filter_size; ++t)
+            {
+                near_lines[t] = pic_data[std::max( y-t, 0 )];
+                far_lines[t] = pic_data[std::min( y+1+t, m_height_old-1 )];
+            }// t
 
-            sum >>= filter_shift;
-            up_data[ypos][x+1] = CLIP(sum, m_min_val, m_max_val);
-        }// x
+            std::memcpy( even_line, pic_data[y], m_width_old*sizeof(ValueType) );
+            ColumnLoop( near_lines, far_lines, odd_line );
+
+            PadLine( even_line );
+            PadLine( odd_line );
+
+            RowLoop( even_line, up_data[2*y] );
+            if ( 2*y+1 < m_height_new )
+                RowLoop( odd_line, up_data[2*y+1] );
+        }// y
     }
 }
+
+void UpConverter::PadLine( ValueType* line ) const
+{
+    for (int t=1; t<=filter_size; ++t)
+    {
+        line[-t] = line[0];
+        line[m_width_old-1+t] = line[m_width_old-1];
+    }// t
+}
+
+void UpConverter::ColumnLoop( const ValueType* const* near_lines,
+                              const ValueType* const* far_lines,
+                              ValueType* out_line ) const
+{
+    m_kernels.column_filter( near_lines, far_lines, out_line, m_width_old, m_min_val, m_max_val );
+}
+
+void UpConverter::RowLoop( const ValueType* line, ValueType* up_line ) const
+{
+    // Copy each sample to the even positions and filter the odd ones
+    m_kernels.row_filter( line, up_line, m_width_new, m_min_val, m_max_val );
+}
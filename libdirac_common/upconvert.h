@@ -39,9 +39,35 @@
 #define _UPCONVERT_H_
 
 #include <libdirac_common/common.h>
+#include <libdirac_common/cpu_dispatch.h>
 
 namespace dirac
 {
+    //! Upconversion filtering kernels, selected for an instruction set level
+    /*!
+        Both kernels clip the filtered values to [min_val, max_val].
+    */
+    struct UpConvertKernels
+    {
+        //! Filters the samples of lines either side of a half-line position vertically
+        /*!
+            near_lines and far_lines hold the lines above and below the
+            position, nearest first, for each filter tap.
+        */
+        void (*column_filter)( const ValueType* const* near_lines ,
+                               const ValueType* const* far_lines ,
+                               ValueType* out_line , const int width ,
+                               const int min_val , const int max_val );
+
+        //! Copies a padded line to the even samples of an upconverted line and filters the odd ones
+        void (*row_filter)( const ValueType* line , ValueType* up_line ,
+                            const int up_width ,
+                            const int min_val , const int max_val );
+    };
+
+    //! Returns the upconversion kernels for an instruction set level
+    UpConvertKernels SelectUpConvertKernels( const CpuLevel level );
+
     //Optimised upconversion class - no array resizes.
     //Uses integer math - no floats!
     //
@@ -66,6 +92,9 @@ namespace dirac
             Upconvert the picture data, where the parameters are
             \param    pic_data   is the original data
             \param    up_data    is the upconverted data
+
+            Interpolated values are clipped to [min_val, max_val] as they are
+            made, so the upconverted data needs no separate clipping pass.
          */
         void DoUpConverter(const PicArray& pic_data, PicArray& up_data);
 
@@ -76,9 +105,16 @@ namespace dirac
         //! Private body-less assignment: class should not be assigned
         UpConverter& operator=(const UpConverter& rhs);
 
-        //! Applies the filter to a row and its successor 
-        void RowLoop(PicArray& up_data, const int row_num,
-        const int filter_size, const int filter_shift, const short taps[4] );
+        //! Pads a half-resolution line by repeating the edge values
+        void PadLine(ValueType* line) const;
+
+        //! Filters vertically between lines to make a half-resolution line
+        void ColumnLoop(const ValueType* const* near_lines,
+                        const ValueType* const* far_lines,
+                        ValueType* out_line) const;
+
+        //! Copies a padded half-resolution line to the even samples of an upconverted line and filters the odd ones
+        void RowLoop(const ValueType* line, ValueType* up_line) const;
 
     private:
         //Variable to keep the loops in check
@@ -91,6 +127,9 @@ namespace dirac
 
         const int m_orig_xl;
         const int m_orig_yl;
+
+        //! The kernels for the active instruction set
+        const UpConvertKernels m_kernels;
     };
 
 } // namespace dirac
@@ -522,21 +522,55 @@ void VHFilter::Interleave( const int xp ,
 
 }
 
-#if !defined(HAVE_MMX)
-void VHFilter::ShiftRowLeft(CoeffType *row, int length, int shift)
+namespace
 {
-    for (int i = 0; i < length; ++i)
-        row[i] <<= shift;
+    // Portable row shifts, used when there are no vector versions for the
+    // active instruction set
+    void ShiftRowLeft(CoeffType *row, int length, int shift)
+    {
+        for (int i = 0; i < length; ++i)
+            row[i] <<= shift;
+    }
+
+    void ShiftRowRight(CoeffType *row, int length, int shift)
+    {
+        const CoeffType halfway( 1<<(shift-1) );
+        for (int i = 0; i < length; ++i)
+            row[i] = ((row[i]+halfway)>>shift);
+    }
 }
 
-void VHFilter::ShiftRowRight(CoeffType *row, int length, int shift)
+WaveletKernels dirac::SelectWaveletKernels( const CpuLevel level )
 {
-    const CoeffType halfway( 1<<(shift-1) );
-    for (int i = 0; i < length; ++i)
-        row[i] = ((row[i]+halfway)>>shift);
-}
+    WaveletKernels kernels;
+    kernels.shift_row_left = ShiftRowLeft;
+    kernels.shift_row_right = ShiftRowRight;
+    kernels.dd9_7_synth = 0;
+    kernels.dd13_7_synth = 0;
+    kernels.legall5_3_split = 0;
+    kernels.legall5_3_synth = 0;
+
+#if defined(HAVE_MMX)
+    if ( level>=CPU_LEVEL_MMX )
+    {
+        kernels.shift_row_left = ShiftRowLeft_mmx;
+        kernels.shift_row_right = ShiftRowRight_mmx;
+        kernels.dd9_7_synth = DD9_7Synth_mmx;
+        kernels.dd13_7_synth = DD13_7Synth_mmx;
+        kernels.legall5_3_split = LEGALL5_3Split_mmx;
+        kernels.legall5_3_synth = LEGALL5_3Synth_mmx;
+    }
+#else
+    (void) level;
 #endif
 
+    return kernels;
+}
+
+VHFilter::VHFilter():
+    m_kernels( SelectWaveletKernels( ActiveCpuLevel() ) )
+{}
+
 void VHFilter::DeInterleave( const int xp ,
                                                const int yp ,
                                                const int xl ,
@@ -799,7 +833,6 @@ void VHFilterDAUB9_7::Synth (const int xp ,
 
 }
 
-#if !defined HAVE_MMX
 // NOTE: MMX version is defined in wavelet_utils_mmx.cpp
 // the corresponding changes are made in wavelet_utils_mmx.cpp as well
 void VHFilterLEGALL5_3::Split(const int xp ,
@@ -808,6 +841,12 @@ void VHFilterLEGALL5_3::Split(const int xp ,
                                           const int yl ,
                                           CoeffArray& coeff_data)
 {
+    if ( m_kernels.legall5_3_split )
+    {
+        m_kernels.legall5_3_split( xp , yp , xl , yl , coeff_data );
+        return;
+    }
+
 
     const int xend=xp+xl;
     const int yend=yp+yl;
@@ -885,6 +924,12 @@ void VHFilterLEGALL5_3::Synth(const int xp ,
                                           const int yl ,
                                           CoeffArray& coeff_data)
 {
+    if ( m_kernels.legall5_3_synth )
+    {
+        m_kernels.legall5_3_synth( xp , yp , xl , yl , coeff_data );
+        return;
+    }
+
     int i,j,k;
 
     const int xend( xp+xl );
@@ -947,7 +992,6 @@ void VHFilterLEGALL5_3::Synth(const int xp ,
     }
 
 }
-#endif
 
 void VHFilterDD9_7::Split(const int xp ,
                                                 const int yp ,
@@ -1041,7 +1085,6 @@ void VHFilterDD9_7::Split(const int xp ,
 
 }
 
-#if !defined(HAVE_MMX)
 // NOTE: MMX version is defined in wavelet_utils_mmx.cpp
 // the corresponding changes are made in wavelet_utils_mmx.cpp as well
 void VHFilterDD9_7::Synth(const int xp ,
@@ -1050,6 +1093,12 @@ void VHFilterDD9_7::Synth(const int xp ,
                                                 const int yl ,
                                                 CoeffArray& coeff_data)
 {
+    if ( m_kernels.dd9_7_synth )
+    {
+        m_kernels.dd9_7_synth( xp , yp , xl , yl , coeff_data );
+        return;
+    }
+
     int i,j;
 
     const int xend( xp+xl );
@@ -1131,7 +1180,6 @@ void VHFilterDD9_7::Synth(const int xp ,
     }// j
 
 }
-#endif
 
 void VHFilterDD13_7::Split(const int xp ,
                                            const int yp ,
@@ -1232,7 +1280,6 @@ void VHFilterDD13_7::Split(const int xp ,
     DeInterleave( xp , yp , xl , yl , coeff_data );
 }
 
-#if !defined(HAVE_MMX)
 // NOTE: MMX version is defined in wavelet_utils_mmx.cpp
 // the corresponding changes are made in wavelet_utils_mmx.cpp as well
 void VHFilterDD13_7::Synth(const int xp ,
@@ -1241,6 +1288,12 @@ void VHFilterDD13_7::Synth(const int xp ,
                                            const int yl ,
                                            CoeffArray& coeff_data)
 {
+    if ( m_kernels.dd13_7_synth )
+    {
+        m_kernels.dd13_7_synth( xp , yp , xl , yl , coeff_data );
+        return;
+    }
+
     int i,j,k;
 
     const int xend( xp+xl );
@@ -1337,7 +1390,6 @@ void VHFilterDD13_7::Synth(const int xp ,
 
     }// j
 }
-#endif
 
 void VHFilterHAAR0::Split(const int xp ,
                                            const int yp ,
@@ -42,6 +42,7 @@
 
 #include <libdirac_common/arrays.h>
 #include <libdirac_common/common.h>
+#include <libdirac_common/cpu_dispatch.h>
 #include <vector>
 #include <cmath>
 #include <iostream>
@@ -314,13 +315,54 @@ namespace dirac
     };
  
     class CoeffArray;   
+
+        //! Wavelet filtering kernels, selected for an instruction set level
+        /*!
+            The filter functions are null where there is no vector version
+            for the level, and the filter's own portable code is used.
+        */
+        struct WaveletKernels
+        {
+            //! Shifts a row of coefficients left, to increase accuracy before analysis
+            void (*shift_row_left)( CoeffType* row, int length, int shift );
+
+            //! Shifts a row of coefficients right with rounding, to counter the shift after synthesis
+            void (*shift_row_right)( CoeffType* row, int length, int shift );
+
+            //! Deslauriers-Dubuc (9,7) synthesis
+            void (*dd9_7_synth)( const int xp, const int yp, const int xl, const int yl, CoeffArray& coeff_data );
+
+            //! Deslauriers-Dubuc (13,7) synthesis
+            void (*dd13_7_synth)( const int xp, const int yp, const int xl, const int yl, CoeffArray& coeff_data );
+
+            //! LeGall (5,3) analysis
+            void (*legall5_3_split)( const int xp, const int yp, const int xl, const int yl, CoeffArray& coeff_data );
+
+            //! LeGall (5,3) synthesis
+            void (*legall5_3_synth)( const int xp, const int yp, const int xl, const int yl, CoeffArray& coeff_data );
+        };
+
+        //! Returns the wavelet filtering kernels for an instruction set level
+        WaveletKernels SelectWaveletKernels( const CpuLevel level );
+
+#if defined(HAVE_MMX)
+        // MMX kernels, defined in wavelet_utils_mmx.cpp
+        void ShiftRowLeft_mmx( CoeffType* row, int length, int shift );
+        void ShiftRowRight_mmx( CoeffType* row, int length, int shift );
+        void DD9_7Synth_mmx( const int xp, const int yp, const int xl, const int yl, CoeffArray& coeff_data );
+        void DD13_7Synth_mmx( const int xp, const int yp, const int xl, const int yl, CoeffArray& coeff_data );
+        void LEGALL5_3Split_mmx( const int xp, const int yp, const int xl, const int yl, CoeffArray& coeff_data );
+        void LEGALL5_3Synth_mmx( const int xp, const int yp, const int xl, const int yl, CoeffArray& coeff_data );
+#endif
+
         //! A virtual parent class to do vertical and horizontal splitting with wavelet filters
         class VHFilter
         {
 
         public:
 
-            VHFilter(){}
+            //! Constructor - selects the kernels for the active instruction set
+            VHFilter();
 
             virtual ~VHFilter(){}
 
@@ -343,10 +385,13 @@ namespace dirac
             inline void DeInterleave( const int xp, const int yp, const int xl, const int yl, CoeffArray& coeff_data );
 
             //! Shift all vals in Row by 'shift' bits to the left to increase accuracy by 'shift' bits. Used in Analysis stage of filter
-            void ShiftRowLeft(CoeffType *row, int length, int shift);
+            void ShiftRowLeft(CoeffType *row, int length, int shift){ m_kernels.shift_row_left( row, length, shift ); }
 
         //! Shift all vals in Row by 'shift' bits to the right to counter the shift in the Analysis stage. This function is used in the Synthesis stage
-            void ShiftRowRight(CoeffType *row, int length, int shift);
+            void ShiftRowRight(CoeffType *row, int length, int shift){ m_kernels.shift_row_right( row, length, shift ); }
+
+            //! The kernels for the active instruction set
+            const WaveletKernels m_kernels;
         };
 
         //! Class to do Daubechies (9,7) filtering operations
@@ -383,10 +428,6 @@ namespace dirac
             int GetShift() const {return 1;}
 
 
-#ifdef HAVE_MMX
-            inline void HorizSynth (int xp, int xl, int ystart, int yend, CoeffArray &coeff_data);
-#endif
-
         };
 
         //! A short filter that's actually close to Daubechies (9,7) but with just two lifting steps
@@ -130,7 +130,7 @@ inline void Interleave_mmx( const int xp ,
 }
 #endif
 
-void VHFilter::ShiftRowLeft(CoeffType *row, int length, int shift)
+void dirac::ShiftRowLeft_mmx(CoeffType *row, int length, int shift)
 {
     int xstop = length/4*4;
     CoeffType *shift_row = row;
@@ -144,7 +144,7 @@ void VHFilter::ShiftRowLeft(CoeffType *row, int length, int shift)
     _mm_empty();
 }
 
-void VHFilter::ShiftRowRight(CoeffType *row, int length, int shift)
+void dirac::ShiftRowRight_mmx(CoeffType *row, int length, int shift)
 {
     CoeffType *shift_row = row;
     int round_val = 1<<(shift-1);
@@ -214,7 +214,7 @@ inline void Interleave_mmx( const int xp ,
     _mm_empty();
 }
 
-void VHFilterDD9_7::Synth(const int xp , 
+void dirac::DD9_7Synth_mmx(const int xp , 
                                                 const int yp , 
                                                 const int xl , 
                                                 const int yl , 
@@ -499,14 +499,14 @@ void VHFilterDD9_7::Synth(const int xp ,
         update.Filter( line_data[xl-1] , line_data[xmid-1] , line_data[xmid-1] , line_data[xmid-2] , line_data[xmid-1] );
         
         // Shift right by one bit to counter the shift in the analysis stage
-        ShiftRowRight(line_data, xl, 1);
+        ShiftRowRight_mmx(line_data, xl, 1);
 
     }// j
     _mm_empty();
     Interleave_mmx( xp , yp , xl ,yl , coeff_data );
 }
 
-void VHFilterDD13_7::Synth(const int xp ,
+void dirac::DD13_7Synth_mmx(const int xp ,
                                            const int yp , 
                                            const int xl ,
                                            const int yl , 
@@ -928,7 +928,7 @@ void VHFilterDD13_7::Synth(const int xp ,
         update.Filter( line_data[xl-1] , line_data[xmid-1] , line_data[xmid-1] , line_data[xmid-2] , line_data[xmid-1] );
 
         // Shift right by one bit to counter the shift in the analysis stage
-        ShiftRowRight(line_data, xl, 1);
+        ShiftRowRight_mmx(line_data, xl, 1);
 
     }// j
 
@@ -1236,7 +1236,7 @@ void VHFilterLEGALL5_3::Synth(const int xp ,
 
 //Attempt 3
 
-inline void VHFilterLEGALL5_3::HorizSynth (int xp, int xl, int ystart, int yend, CoeffArray &coeff_data)
+static void HorizSynth_mmx (int xp, int xl, int ystart, int yend, CoeffArray &coeff_data)
 {
     static const PredictStepShift< 2 > predict;
     static const UpdateStepShift< 1 > update;
@@ -1259,11 +1259,11 @@ inline void VHFilterLEGALL5_3::HorizSynth (int xp, int xl, int ystart, int yend,
         update.Filter( line_data[xl-3] , line_data[xl-2] , line_data[xl-4] );
         update.Filter( line_data[xl-1] , line_data[xl-2] , line_data[xl-2] );
         // Shift right by one bit to counter the shift in the analysis stage
-        ShiftRowRight(line_data, xl, 1);
+        ShiftRowRight_mmx(line_data, xl, 1);
     }
 }
 
-void VHFilterLEGALL5_3::Synth(const int xp ,
+void dirac::LEGALL5_3Synth_mmx(const int xp ,
                                           const int yp , 
                                           const int xl , 
                                           const int yl , 
@@ -1351,7 +1351,7 @@ void VHFilterLEGALL5_3::Synth(const int xp ,
         }// i
         horiz_end = k - 2;
         // Do the horizontal synthesis
-        HorizSynth (xp, xl, horiz_start, horiz_end, coeff_data);
+        HorizSynth_mmx (xp, xl, horiz_start, horiz_end, coeff_data);
         horiz_start = horiz_end + 1;
     }// j
     
@@ -1397,7 +1397,7 @@ void VHFilterLEGALL5_3::Synth(const int xp ,
 
     _mm_empty();
     // Last lines of horizontal synthesis
-    HorizSynth (xp, xl, horiz_start, yend-1, coeff_data);
+    HorizSynth_mmx (xp, xl, horiz_start, yend-1, coeff_data);
 }
 
 
@@ -1473,7 +1473,7 @@ void DeInterleave_mmx( const int xp ,
     _mm_empty();
 }
 
-void VHFilterLEGALL5_3::Split(const int xp , 
+void dirac::LEGALL5_3Split_mmx(const int xp , 
                                           const int yp , 
                                           const int xl , 
                                           const int yl , 
@@ -1508,7 +1508,7 @@ void VHFilterLEGALL5_3::Split(const int xp ,
         // First lifting stage
         line_data = &coeff_data[j][xp];
         // Shift left by one bit to give us more accuracy
-        ShiftRowLeft(line_data, xl, 1);
+        ShiftRowLeft_mmx(line_data, xl, 1);
 
         predict.Filter( line_data[xp+xl2] , line_data[1] , line_data[0] );
         update.Filter( line_data[0] , line_data[xp+xl2] , line_data[xp+xl2] );
@@ -47,10 +47,12 @@
 using namespace dirac;
 
 #include <vector>
+#include <memory>
 
 #include <ctime>
 
 using std::vector;
+using std::auto_ptr;
 
 //Constructor
 CompDecompressor::CompDecompressor( DecoderParams& decp, const PictureParams& pp)
@@ -87,37 +89,36 @@ void CompDecompressor::Decompress(ComponentByteIO* p_component_byteio,
 
         if ( !bands(b).Skipped() ){
             if (m_pparams.UsingAC()){
-                // A pointer to the object(s) we'll be using for coding the bands
-                BandCodec* bdecoder;
+                // The object(s) we'll be using for coding the bands, owned
+                // here so that they're freed if the band data is corrupt
+                auto_ptr<BandCodec> bdecoder;
 
                 if ( b>=bands.Length()-3){
                     if ( m_psort.IsIntra() && b==bands.Length() )
-                        bdecoder=new IntraDCBandCodec(&subband_byteio,
-                                                       TOTAL_COEFF_CTXS ,bands);
+                        bdecoder.reset( new IntraDCBandCodec(&subband_byteio,
+                                                       TOTAL_COEFF_CTXS ,bands) );
                     else
-                        bdecoder=new LFBandCodec(&subband_byteio ,
+                        bdecoder.reset( new LFBandCodec(&subband_byteio ,
                                                  TOTAL_COEFF_CTXS, bands ,
-                                                 b, m_psort.IsIntra());
+                                                 b, m_psort.IsIntra()) );
                 }
                 else
-                    bdecoder=new BandCodec( &subband_byteio , TOTAL_COEFF_CTXS ,
-                                            bands , b, m_psort.IsIntra());
+                    bdecoder.reset( new BandCodec( &subband_byteio , TOTAL_COEFF_CTXS ,
+                                            bands , b, m_psort.IsIntra()) );
 
                 bdecoder->Decompress(coeff_data , subband_byteio.GetBandDataLength());
-                delete bdecoder;
             }
             else{
-                // A pointer to the object(s) we'll be using for coding the bands
-                BandVLC* bdecoder;
+                // The object(s) we'll be using for coding the bands
+                auto_ptr<BandVLC> bdecoder;
 
                    if ( m_psort.IsIntra() && b==bands.Length() )
-                      bdecoder=new IntraDCBandVLC(&subband_byteio, bands);
+                      bdecoder.reset( new IntraDCBandVLC(&subband_byteio, bands) );
                 else
-                    bdecoder=new BandVLC( &subband_byteio , 0, bands ,
-                                          b, m_psort.IsIntra());
+                    bdecoder.reset( new BandVLC( &subband_byteio , 0, bands ,
+                                          b, m_psort.IsIntra()) );
 
                 bdecoder->Decompress(coeff_data , subband_byteio.GetBandDataLength());
-                delete bdecoder;
             }
         }
         else{
@@ -0,0 +1,239 @@
+/* ***** BEGIN LICENSE BLOCK *****
+*
+* $Id$ $Name$
+*
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License
+* Version 1.1 (the "License"); you may not use this file except in compliance
+* with the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License for
+* the specific language governing rights and limitations under the License.
+*
+* The Original Code is BBC Research and Development code.
+*
+* The Initial Developer of the Original Code is the British Broadcasting
+* Corporation.
+* Portions created by the Initial Developer are Copyright (C) 2008.
+* All Rights Reserved.
+*
+* Contributor(s): Anuradha Suraparaju (Original Author)
+*
+* Alternatively, the contents of this file may be used under the terms of
+* the GNU General Public License Version 2 (the "GPL"), or the GNU Lesser
+* Public License Version 2.1 (the "LGPL"), in which case the provisions of
+* the GPL or the LGPL are applicable instead of those above. If you wish to
+* allow use of your version of this file only under the terms of the either
+* the GPL or LGPL and not to allow others to use your version of this file
+* under the MPL, indicate your decision by deleting the provisions above
+* and replace them with the notice and other provisions required by the GPL
+* or LGPL. If you do not delete the provisions above, a recipient may use
+* your version of this file under the terms of any one of the MPL, the GPL
+* or the LGPL.
+* ***** END LICENSE BLOCK ***** */
+
+#include <libdirac_decoder/component_pack.h>
+using namespace dirac;
+
+#if defined(HAVE_SSE2)
+#include <emmintrin.h>
+#endif
+#if defined(HAVE_AVX2)
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    // Writes samples i onwards of a line as bytes, offset by 128 and saturated
+    void PackLine8From( const ValueType* src , unsigned char* dst , int i , const int xl )
+    {
+        for ( ; i<xl ; ++i )
+        {
+            const int val = src[i] + 128;
+            dst[i] = (unsigned char)( val<0 ? 0 : ( val>255 ? 255 : val ) );
+        }// i
+    }
+
+    // Writes samples i onwards of a line as 16-bit little-endian words,
+    // offset by half the range of the given depth and clipped to it
+    void PackLine16From( const ValueType* src , unsigned char* dst ,
+                         int i , const int xl , const unsigned int depth )
+    {
+        const int offset = 1<<(depth-1);
+        const int max_val = (1<<depth)-1;
+        for ( ; i<xl ; ++i )
+        {
+            int val = src[i] + offset;
+            val = val<0 ? 0 : ( val>max_val ? max_val : val );
+            dst[2*i] = (unsigned char)( val & 0xff );
+            dst[2*i+1] = (unsigned char)( val >> 8 );
+        }// i
+    }
+
+    void PackLine8( const ValueType* src , unsigned char* dst , const int xl )
+    {
+        PackLine8From( src , dst , 0 , xl );
+    }
+
+    void PackLine16( const ValueType* src , unsigned char* dst ,
+                     const int xl , const unsigned int depth )
+    {
+        PackLine16From( src , dst , 0 , xl , depth );
+    }
+
+#if defined(HAVE_SSE2)
+    void PackLine8_sse2( const ValueType* src , unsigned char* dst , const int xl )
+    {
+        int i = 0;
+        const __m128i offset = _mm_set1_epi16( 128 );
+        for ( ; i+16<=xl ; i+=16 )
+        {
+            __m128i lo = _mm_loadu_si128( (const __m128i*)(src+i) );
+            __m128i hi = _mm_loadu_si128( (const __m128i*)(src+i+8) );
+            lo = _mm_adds_epi16( lo , offset );
+            hi = _mm_adds_epi16( hi , offset );
+            _mm_storeu_si128( (__m128i*)(dst+i) , _mm_packus_epi16( lo , hi ) );
+        }// i
+        PackLine8From( src , dst , i , xl );
+    }
+
+    void PackLine16_sse2( const ValueType* src , unsigned char* dst ,
+                          const int xl , const unsigned int depth )
+    {
+        int i = 0;
+        // x86 is little-endian, so words can be stored directly
+        if ( depth<16 )
+        {
+            const __m128i off = _mm_set1_epi16( 1<<(depth-1) );
+            const __m128i lower = _mm_setzero_si128();
+            const __m128i upper = _mm_set1_epi16( (1<<depth)-1 );
+            for ( ; i+8<=xl ; i+=8 )
+            {
+                __m128i val = _mm_loadu_si128( (const __m128i*)(src+i) );
+                // Saturating above 32767 is harmless as we clip to max_val
+                val = _mm_adds_epi16( val , off );
+                val = _mm_min_epi16( _mm_max_epi16( val , lower ) , upper );
+                _mm_storeu_si128( (__m128i*)(dst+2*i) , val );
+            }// i
+        }
+        else
+        {
+            // Adding 2^15 maps the whole of ValueType onto [0, 65535]
+            const __m128i sign = _mm_set1_epi16( (short)0x8000 );
+            for ( ; i+8<=xl ; i+=8 )
+            {
+                __m128i val = _mm_loadu_si128( (const __m128i*)(src+i) );
+                _mm_storeu_si128( (__m128i*)(dst+2*i) , _mm_xor_si128( val , sign ) );
+            }// i
+        }
+        PackLine16From( src , dst , i , xl , depth );
+    }
+#endif
+
+#if defined(HAVE_AVX2)
+    DIRAC_TARGET_AVX2
+    void PackLine8_avx2( const ValueType* src , unsigned char* dst , const int xl )
+    {
+        int i = 0;
+        const __m256i offset = _mm256_set1_epi16( 128 );
+        for ( ; i+32<=xl ; i+=32 )
+        {
+            __m256i lo = _mm256_loadu_si256( (const __m256i*)(src+i) );
+            __m256i hi = _mm256_loadu_si256( (const __m256i*)(src+i+16) );
+            lo = _mm256_adds_epi16( lo , offset );
+            hi = _mm256_adds_epi16( hi , offset );
+            // Packing works within 128-bit lanes, so put the quadwords back in order
+            const __m256i packed = _mm256_packus_epi16( lo , hi );
+            _mm256_storeu_si256( (__m256i*)(dst+i) , _mm256_permute4x64_epi64( packed , 0xD8 ) );
+        }// i
+        PackLine8From( src , dst , i , xl );
+    }
+
+    DIRAC_TARGET_AVX2
+    void PackLine16_avx2( const ValueType* src , unsigned char* dst ,
+                          const int xl , const unsigned int depth )
+    {
+        int i = 0;
+        if ( depth<16 )
+        {
+            const __m256i off = _mm256_set1_epi16( 1<<(depth-1) );
+            const __m256i lower = _mm256_setzero_si256();
+            const __m256i upper = _mm256_set1_epi16( (1<<depth)-1 );
+            for ( ; i+16<=xl ; i+=16 )
+            {
+                __m256i val = _mm256_loadu_si256( (const __m256i*)(src+i) );
+                val = _mm256_adds_epi16( val , off );
+                val = _mm256_min_epi16( _mm256_max_epi16( val , lower ) , upper );
+                _mm256_storeu_si256( (__m256i*)(dst+2*i) , val );
+            }// i
+        }
+        else
+        {
+            const __m256i sign = _mm256_set1_epi16( (short)0x8000 );
+            for ( ; i+16<=xl ; i+=16 )
+            {
+                __m256i val = _mm256_loadu_si256( (const __m256i*)(src+i) );
+                _mm256_storeu_si256( (__m256i*)(dst+2*i) , _mm256_xor_si256( val , sign ) );
+            }// i
+        }
+        PackLine16From( src , dst , i , xl , depth );
+    }
+#endif
+}
+
+PackKernels dirac::SelectPackKernels( const CpuLevel level )
+{
+    PackKernels kernels;
+    kernels.pack_line8 = PackLine8;
+    kernels.pack_line16 = PackLine16;
+
+#if defined(HAVE_SSE2)
+    if ( level>=CPU_LEVEL_SSE2 )
+    {
+        kernels.pack_line8 = PackLine8_sse2;
+        kernels.pack_line16 = PackLine16_sse2;
+    }
+#endif
+#if defined(HAVE_AVX2)
+    if ( level>=CPU_LEVEL_AVX2 )
+    {
+        kernels.pack_line8 = PackLine8_avx2;
+        kernels.pack_line16 = PackLine16_avx2;
+    }
+#endif
+#if !defined(HAVE_SSE2) && !defined(HAVE_AVX2)
+    (void) level;
+#endif
+
+    return kernels;
+}
+
+void dirac::PackComponent( const PicArray& pic_data ,
+                           const int xl , const int yl ,
+                           unsigned char* buf , const int line_step ,
+                           const PackFormat format , const unsigned int depth )
+{
+    const PackKernels kernels = SelectPackKernels( ActiveCpuLevel() );
+
+    if ( format == PACK_16BIT_LE )
+    {
+        const unsigned int pack_depth = depth<1 ? 1 : ( depth>16 ? 16 : depth );
+
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(static)
+#endif
+        for ( int j=0 ; j<yl ; ++j )
+            kernels.pack_line16( &pic_data[j][0] , buf + j*line_step , xl , pack_depth );
+    }
+    else
+    {
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(static)
+#endif
+        for ( int j=0 ; j<yl ; ++j )
+            kernels.pack_line8( &pic_data[j][0] , buf + j*line_step , xl );
+    }
+}
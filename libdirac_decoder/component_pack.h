@@ -0,0 +1,101 @@
+/* ***** BEGIN LICENSE BLOCK *****
+*
+* $Id$ $Name$
+*
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License
+* Version 1.1 (the "License"); you may not use this file except in compliance
+* with the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License for
+* the specific language governing rights and limitations under the License.
+*
+* The Original Code is BBC Research and Development code.
+*
+* The Initial Developer of the Original Code is the British Broadcasting
+* Corporation.
+* Portions created by the Initial Developer are Copyright (C) 2008.
+* All Rights Reserved.
+*
+* Contributor(s): Anuradha Suraparaju (Original Author)
+*
+* Alternatively, the contents of this file may be used under the terms of
+* the GNU General Public License Version 2 (the "GPL"), or the GNU Lesser
+* Public License Version 2.1 (the "LGPL"), in which case the provisions of
+* the GPL or the LGPL are applicable instead of those above. If you wish to
+* allow use of your version of this file only under the terms of the either
+* the GPL or LGPL and not to allow others to use your version of this file
+* under the MPL, indicate your decision by deleting the provisions above
+* and replace them with the notice and other provisions required by the GPL
+* or LGPL. If you do not delete the provisions above, a recipient may use
+* your version of this file under the terms of any one of the MPL, the GPL
+* or the LGPL.
+* ***** END LICENSE BLOCK ***** */
+
+#ifndef _COMPONENT_PACK_H_
+#define _COMPONENT_PACK_H_
+
+#include <libdirac_common/common.h>
+#include <libdirac_common/cpu_dispatch.h>
+
+namespace dirac
+{
+    //! Sample formats a decoded component can be packed into
+    enum PackFormat
+    {
+        //! One unsigned byte per sample
+        PACK_8BIT = 0,
+        //! Two bytes per sample, little-endian, holding the coded video depth
+        PACK_16BIT_LE
+    };
+
+    //! Returns the number of bytes each sample occupies in the given format
+    inline int PackSampleBytes( const PackFormat format )
+    {
+        return ( format == PACK_16BIT_LE ) ? 2 : 1;
+    }
+
+    //! The line packing functions used for one CPU level
+    struct PackKernels
+    {
+        //! Packs xl samples as offset, saturated bytes
+        void (*pack_line8)( const ValueType* src , unsigned char* dst , const int xl );
+        //! Packs xl samples as offset, clipped 16-bit little-endian words
+        void (*pack_line16)( const ValueType* src , unsigned char* dst ,
+                             const int xl , const unsigned int depth );
+    };
+
+    //! Returns the fastest line packing functions available at a CPU level
+    PackKernels SelectPackKernels( const CpuLevel level );
+
+    //! Pack a decoded component into a caller-supplied buffer
+    /*!
+        Converts the signed samples in the first yl rows and xl columns of
+        pic_data to unsigned samples and writes them to buf. Rows are written
+        line_step bytes apart, so a field can be interleaved into a frame
+        buffer by passing the address of its first line and twice the frame
+        stride.
+
+        With PACK_8BIT, 128 is added to each sample and the result saturated
+        to [0, 255]. With PACK_16BIT_LE, 2^(depth-1) is added and the result
+        clipped to [0, 2^depth - 1].
+
+        \param  pic_data   the decoded component
+        \param  xl         the number of samples per row to write
+        \param  yl         the number of rows to write
+        \param  buf        the first output line
+        \param  line_step  the distance in bytes between output lines
+        \param  format     the output sample format
+        \param  depth      the video depth in bits, used by PACK_16BIT_LE
+    */
+    void PackComponent( const PicArray& pic_data ,
+                        const int xl , const int yl ,
+                        unsigned char* buf , const int line_step ,
+                        const PackFormat format , const unsigned int depth );
+
+} // namespace dirac
+
+#endif
@@ -54,6 +54,17 @@ typedef enum {
     STATE_INVALID         /* invalid state. Stop further processing */ 
     } DecoderState;
 
+/*
+* Counts of the errors found in a damaged stream
+*/
+typedef struct {
+    int units_dropped;    /* parse units dropped as invalid */
+    int bytes_skipped;    /* bytes discarded in resynchronising on a parse-info prefix */
+    int decode_errors;    /* errors found decoding parse units */
+    int missing_refs;     /* pictures predicted from substitutes for missing references */
+    int concealed;        /* pictures concealed, in whole or part, instead of decoded */
+    } DecoderErrors;
+
 #ifdef __cplusplus
 }
 #endif
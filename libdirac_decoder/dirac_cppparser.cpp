@@ -44,9 +44,15 @@
 #include <libdirac_decoder/seq_decompress.h>
 #include <libdirac_common/picture.h>
 #include <libdirac_byteio/parseunit_byteio.h>
+#include <libdirac_common/dirac_exception.h>
+#include <algorithm>
 #include <sstream>
 using namespace dirac;
 
+// Parse units no longer than this are accepted before a sequence header
+// gives the picture size, when decoding resiliently
+const int MAX_UNIT_SIZE = 1<<24;
+
 
 InputStreamBuffer::InputStreamBuffer()
 {
@@ -142,12 +148,28 @@ InputStreamBuffer::~InputStreamBuffer()
 }
 
 
+namespace
+{
+    void AddErrors(DecoderErrors& sum, const DecoderErrors& errors)
+    {
+        sum.units_dropped += errors.units_dropped;
+        sum.bytes_skipped += errors.bytes_skipped;
+        sum.decode_errors += errors.decode_errors;
+        sum.missing_refs += errors.missing_refs;
+        sum.concealed += errors.concealed;
+    }
+}
+
 DiracParser::DiracParser(bool verbose) :
     m_state(STATE_BUFFER),
     m_next_state(STATE_SEQUENCE),
     m_show_pnum(-1),
     m_decomp(0),
-    m_verbose(verbose)
+    m_verbose(verbose),
+    m_resilient(false),
+    m_input_ended(false),
+    m_stream_errors(),
+    m_total_errors()
 {
 
 
@@ -159,6 +181,14 @@ DiracParser::~DiracParser()
     delete m_decomp;
 }
 
+void DiracParser::SetResilient(bool resilient)
+{
+    m_resilient = resilient;
+    m_dirac_byte_stream.SetMaxUnitSize(resilient ? MAX_UNIT_SIZE : 0);
+    if (m_decomp)
+        m_decomp->GetDecoderParams().SetResilient(resilient);
+}
+
 void DiracParser::SetBuffer (char *start, char *end)
 {
     TEST (end > start);
@@ -182,6 +212,7 @@ DecoderState DiracParser::Parse()
             if(m_decomp->Finished())
             {
                 // if so....delete
+                AddErrors(m_total_errors, m_decomp->GetErrors());
                 delete m_decomp;
                 m_decomp=NULL;
                 m_next_state = STATE_BUFFER;
@@ -196,18 +227,46 @@ DecoderState DiracParser::Parse()
         if(m_next_state!=STATE_SEQUENCE_END)
         {
             p_parse_unit=m_dirac_byte_stream.GetNextParseUnit();
+
+            DecoderErrors errors = DecoderErrors();
+            errors.units_dropped = m_dirac_byte_stream.GetUnitsDropped();
+            errors.bytes_skipped = m_dirac_byte_stream.GetBytesSkipped();
+            m_dirac_byte_stream.ResetErrorCounts();
+            AddErrors(m_stream_errors, errors);
+            AddErrors(m_total_errors, errors);
+
             if(p_parse_unit==NULL)
+            {
+                // Once the input has ended, output the pictures still held
+                if (m_input_ended && m_decomp)
+                {
+                    m_next_state = STATE_SEQUENCE_END;
+                    continue;
+                }
                 return STATE_BUFFER;
+            }
             pu_type=p_parse_unit->GetType();
         }
 
+        try
+        {
+
         switch(pu_type)
         {
         case PU_SEQ_HEADER:
 
             if(!m_decomp)
             {
-                m_decomp = new SequenceDecompressor (*p_parse_unit, m_verbose);
+                m_decomp = new SequenceDecompressor (*p_parse_unit, m_verbose, m_resilient);
+                if (m_resilient)
+                {
+                    // Units longer than twice the samples of a picture, at 16
+                    // bits each, are taken to have damaged offsets
+                    const SourceParams& srcparams = m_decomp->GetSourceParams();
+                    const int num_samples = static_cast<int>(srcparams.Xl()*srcparams.Yl()) +
+                                  2*srcparams.ChromaWidth()*srcparams.ChromaHeight();
+                    m_dirac_byte_stream.SetMaxUnitSize(std::max(1<<20, 4*num_samples));
+                }
                 m_next_state=STATE_BUFFER;
                 return STATE_SEQUENCE;
             }
@@ -252,12 +311,35 @@ DecoderState DiracParser::Parse()
         case PU_LOW_DELAY_PICTURE:
             if (m_verbose)
                 std::cerr << "Low delay picture decoding not yet supported" << std::endl;
+            if (m_resilient)
+            {
+                ++m_stream_errors.units_dropped;
+                ++m_total_errors.units_dropped;
+                break;
+            }
             return STATE_INVALID;
 
         default:
+            // A damaged parse code can be undefined
+            if (m_resilient)
+            {
+                ++m_stream_errors.units_dropped;
+                ++m_total_errors.units_dropped;
+                break;
+            }
             return STATE_INVALID;
         }
 
+        }// try
+        catch (const DiracException&)
+        {
+            // Drop a unit that can't be decoded, and carry on with the next
+            if (!m_resilient)
+                throw;
+            ++m_stream_errors.decode_errors;
+            ++m_total_errors.decode_errors;
+        }
+
     }
 }
 
@@ -285,3 +367,34 @@ const Picture* DiracParser::GetNextPicture() const
 {
     return m_decomp->GetNextPicture();
 }
+
+DecoderErrors DiracParser::GetNextPictureErrors()
+{
+    DecoderErrors errors = m_stream_errors;
+    m_stream_errors = DecoderErrors();
+
+    const Picture* my_picture = m_decomp->GetNextPicture();
+    if (my_picture)
+    {
+        AddErrors(errors,
+                  m_decomp->GetPictureErrors(my_picture->GetPparams().PictureNum()));
+    }
+
+    return errors;
+}
+
+DecoderErrors DiracParser::GetTotalErrors() const
+{
+    // Errors in pictures are held by the sequence until it ends
+    DecoderErrors errors = m_total_errors;
+    if (m_decomp)
+        AddErrors(errors, m_decomp->GetErrors());
+
+    return errors;
+}
+
+void DiracParser::Flush()
+{
+    m_input_ended = true;
+    m_dirac_byte_stream.SetInputEnded();
+}
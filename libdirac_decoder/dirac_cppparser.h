@@ -163,6 +163,40 @@ namespace dirac
         //! Return the coding parameters of the current sequence
         const DecoderParams& GetDecoderParams() const;
 
+        //! Sets whether damaged streams are concealed rather than stopping decoding
+        /*!
+            When resilient, parse units that can't be decoded are dropped
+            and counted, and pictures that are lost or damaged are
+            concealed, so that decoding continues through errors in the
+            stream.
+        */
+        void SetResilient(bool resilient);
+
+        //! Return the errors found decoding the next picture
+        /*!
+            Returns the errors found decoding the picture returned by
+            GetNextPicture, together with those found in the stream since
+            errors were last returned.
+        */
+        DecoderErrors GetNextPictureErrors();
+
+        //! Return the errors found since the parser was created
+        /*!
+            Errors are counted as they are found, including those in
+            pictures that are never displayed.
+        */
+        DecoderErrors GetTotalErrors() const;
+
+        //! Signals that the input has ended
+        /*!
+            Parse then decodes the parse units still buffered, dropping any
+            that run past the end of the data, and returns the pictures still
+            held for display, concealing any lost among them if resilient.
+            It then returns STATE_SEQUENCE_END, as if the stream had ended
+            with an end of sequence unit.
+        */
+        void Flush();
+
     private:
 
     private:
@@ -181,6 +215,17 @@ namespace dirac
         SequenceDecompressor *m_decomp;
         //! verbose flag
         bool m_verbose;
+
+        //! Conceal damaged pictures if true
+        bool m_resilient;
+
+        //! True once no more data will be added
+        bool m_input_ended;
+
+        //! Errors found in the stream, not yet returned
+        DecoderErrors m_stream_errors;
+        //! Errors found in the stream and in sequences already ended
+        DecoderErrors m_total_errors;
         //! Byte Stream Buffer
         DiracByteStream m_dirac_byte_stream;
     };
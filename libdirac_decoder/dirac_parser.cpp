@@ -42,10 +42,7 @@
 #include <libdirac_decoder/dirac_parser.h>
 #include <libdirac_common/dirac_exception.h>
 #include <libdirac_common/picture.h>
-#if defined (HAVE_MMX)
-#include <mmintrin.h>
-
-#endif
+#include <libdirac_decoder/component_pack.h>
 using namespace dirac;
 
 #ifdef __cplusplus
@@ -54,6 +51,9 @@ extern "C" {
 
 extern DllExport dirac_decoder_t *dirac_decoder_init(int verbose)
 {
+    /* Detect the SIMD kernels the CPU supports before any are selected */
+    ActiveCpuLevel();
+
     dirac_decoder_t* decoder = new dirac_decoder_t;
     memset (decoder, 0, sizeof(dirac_decoder_t));
 
@@ -156,137 +156,62 @@ static void set_sequence_params (const  DiracParser * const parser, dirac_decode
     }
 }
 
-static void set_frame_component (const PicArray& pic_data,  const CompSort cs, dirac_decoder_t *decoder)
-{
-    TEST (decoder->fbuf != NULL);
-    int xl, yl;
-
-    unsigned char *buf;
-
-    switch (cs)
-    {
-    case U_COMP:
-        xl = decoder->src_params.chroma_width;
-        yl = decoder->src_params.chroma_height;
-        buf = decoder->fbuf->buf[1];
-        break;
-    case V_COMP:
-        xl = decoder->src_params.chroma_width;
-        yl = decoder->src_params.chroma_height;
-        buf = decoder->fbuf->buf[2];
-        break;
-
-    case Y_COMP:
-    default:
-        xl = decoder->src_params.width;
-        yl = decoder->src_params.height;
-        buf = decoder->fbuf->buf[0];
-        break;
-    }
-
-    TEST (buf != NULL);
-
-#if defined HAVE_MMX
-    int last_idx = (xl>>3)<<3;
-    __m64 tmp = _mm_set_pi16(128, 128, 128, 128);
-    for (int j=0 ; j<yl ;++j)
-    {
-        for (int i=0 ; i<last_idx ; i+=8 )
-        {
-            __m64 pic1 = *(__m64 *)&pic_data[j][i];
-            pic1 = _mm_add_pi16 (pic1, tmp);
-            __m64 pic2 = *(__m64 *)(&pic_data[j][i+4]);
-            pic2 = _mm_add_pi16 (pic2, tmp);
-            __m64 *tmp = (__m64 *)&buf[j*xl+i];
-            *tmp = _mm_packs_pu16 (pic1, pic2);
-        }//i
-    }//j
-    _mm_empty();
-
-    // mop up remaining pixels
-    for (int j=0 ; j<yl ;++j)
-    {
-        for (int i=last_idx ; i<xl ; i++ )
-        {
-            buf[j*xl+i]=(unsigned char) (pic_data[j][i]+128);
-        }//i
-    }//j
-    return;
-#else
-
-    for (int j=0 ; j<yl ;++j)
-    {
-        for (int i=0 ; i<xl ; ++i)
-        {
-            buf[j*xl+i]=(unsigned char) (pic_data[j][i]+128);
-        }//i
-    }//j
-
-#endif
-}
-
-static void set_field_component (const PicArray& pic_data,  const CompSort cs, dirac_decoder_t *decoder, unsigned int pic_num)
+static void set_component (const PicArray& pic_data,  const CompSort cs, 
+                           dirac_decoder_t *decoder, const PictureParams& pparams,
+                           const bool field, const unsigned int pic_num)
 {
     TEST (decoder->fbuf != NULL);
-    int xl, yl;
-
-    unsigned char *buf;
+    int xl, yl, idx;
+    unsigned int depth;
 
     switch (cs)
     {
     case U_COMP:
         xl = decoder->src_params.chroma_width;
         yl = decoder->src_params.chroma_height;
-        buf = decoder->fbuf->buf[1];
+        idx = 1;
+        depth = pparams.ChromaDepth();
         break;
     case V_COMP:
         xl = decoder->src_params.chroma_width;
         yl = decoder->src_params.chroma_height;
-        buf = decoder->fbuf->buf[2];
+        idx = 2;
+        depth = pparams.ChromaDepth();
         break;
 
     case Y_COMP:
     default:
         xl = decoder->src_params.width;
         yl = decoder->src_params.height;
-        buf = decoder->fbuf->buf[0];
+        idx = 0;
+        depth = pparams.LumaDepth();
         break;
     }
 
+    unsigned char *buf = decoder->fbuf->buf[idx];
     TEST (buf != NULL);
 
-    // Seek offset before writing field to store
-    int start = 0;
-    // Seek offset between writing fields to store
-    int skip = 0;
-
-
-    bool top_field = decoder->src_params.topfieldfirst ? (!(pic_num%2)) :
-                    (pic_num%2);
+    const PackFormat format = decoder->output_format == DIRAC_OUTPUT_16BIT_LE ?
+                              PACK_16BIT_LE : PACK_8BIT;
+    int stride = decoder->output_stride[idx];
+    if (stride <= 0)
+        stride = xl * PackSampleBytes(format);
 
-    if (top_field) // i.e. top field
+    if (!field)
     {
-        start = 0;
-        skip = 2 * xl * sizeof(char);
+        PackComponent (pic_data, xl, yl, buf, stride, format, depth);
     }
-    else // else bottom field
+    else
     {
-        start = xl;
-        skip = 2 * xl * sizeof(char);
-    }
-
-    unsigned char *tempc = buf + start;
+        // Interleave the field into the frame buffer, starting on the
+        // first line for the top field and the second for the bottom
+        bool top_field = decoder->src_params.topfieldfirst ? (!(pic_num%2)) :
+                        (pic_num%2);
 
-    int field_yl = yl>>1;
-    int field_xl = xl;
+        if (!top_field)
+            buf += stride;
 
-    for (int j=0 ; j<field_yl ;++j)
-    {
-        for (int i=0 ; i<field_xl ; ++i)
-        {
-            tempc[i] = (unsigned char) (pic_data[j][i]+128);
-        }//I
-        tempc += skip;
+        PackComponent (pic_data, xl, yl>>1, buf, 2*stride, format, depth);
     }
 }
 
@@ -301,24 +226,26 @@ static void set_frame_data (const  DiracParser * const parser, dirac_decoder_t *
 
     if (my_picture)
     {
-        int pic_num = my_picture->GetPparams().PictureNum();
+        const PictureParams& pparams = my_picture->GetPparams();
+        int pic_num = pparams.PictureNum();
+        bool field = parser->GetDecoderParams().FieldCoding();
 
-        if (!parser->GetDecoderParams().FieldCoding())
-        {
-            set_frame_component (my_picture->Data(Y_COMP), Y_COMP, decoder);
-            set_frame_component (my_picture->Data(U_COMP), U_COMP, decoder);
-            set_frame_component (my_picture->Data(V_COMP), V_COMP, decoder);
-        }
-        else
-        {
-            set_field_component (my_picture->Data(Y_COMP), Y_COMP, decoder, pic_num);
-            set_field_component (my_picture->Data(U_COMP), U_COMP, decoder, pic_num);
-            set_field_component (my_picture->Data(V_COMP), V_COMP, decoder, pic_num);
-        }
+        set_component (my_picture->Data(Y_COMP), Y_COMP, decoder, pparams, field, pic_num);
+        set_component (my_picture->Data(U_COMP), U_COMP, decoder, pparams, field, pic_num);
+        set_component (my_picture->Data(V_COMP), V_COMP, decoder, pparams, field, pic_num);
     }
     return;
 }
 
+static void add_errors (dirac_decoder_errors_t *sum, const dirac_decoder_errors_t *errors)
+{
+    sum->units_dropped += errors->units_dropped;
+    sum->bytes_skipped += errors->bytes_skipped;
+    sum->decode_errors += errors->decode_errors;
+    sum->missing_refs += errors->missing_refs;
+    sum->concealed += errors->concealed;
+}
+
 extern DllExport dirac_decoder_state_t dirac_parse (dirac_decoder_t *decoder)
 {
     TEST (decoder != NULL);
@@ -332,6 +259,7 @@ extern DllExport dirac_decoder_state_t dirac_parse (dirac_decoder_t *decoder)
         try
         {
             decoder->state = parser->Parse();
+            decoder->total_errors = parser->GetTotalErrors();
 
             switch (decoder->state)
             {
@@ -354,6 +282,19 @@ extern DllExport dirac_decoder_state_t dirac_parse (dirac_decoder_t *decoder)
                     decoder->frame_num = pic_num;
                     set_frame_data (parser, decoder);
 
+                    // Accumulate the stage times over the fields of a frame
+                    StageTimes frame_times;
+                    if (parser->GetDecoderParams().FieldCoding() && pic_num%2)
+                        frame_times = StageTimes( decoder->frame_times );
+                    frame_times.Add( my_picture->Times() );
+                    decoder->frame_times = frame_times.Times();
+
+                    // and likewise the errors
+                    const dirac_decoder_errors_t errors = parser->GetNextPictureErrors();
+                    if (!parser->GetDecoderParams().FieldCoding() || !(pic_num%2))
+                        memset (&decoder->frame_errors, 0, sizeof(dirac_decoder_errors_t));
+                    add_errors (&decoder->frame_errors, &errors);
+
                     /* A full frame is only available if we're doing
                     * progressive coding or have decoded the second field.
                     * Will only return when a full frame is available
@@ -404,6 +345,33 @@ extern DllExport void dirac_set_buf (dirac_decoder_t *decoder, unsigned char *bu
     decoder->fbuf->id  = id;
 }
 
+extern DllExport void dirac_set_output_format (dirac_decoder_t *decoder, dirac_output_format_t format, const int stride[3])
+{
+    TEST (decoder != NULL);
+
+    decoder->output_format = format;
+    for (int i=0; i<3; ++i)
+        decoder->output_stride[i] = stride ? stride[i] : 0;
+}
+
+extern DllExport void dirac_set_resilient (dirac_decoder_t *decoder, int resilient)
+{
+    TEST (decoder != NULL);
+    TEST (decoder->parser != NULL);
+    DiracParser *parser = static_cast<DiracParser *>(decoder->parser);
+
+    parser->SetResilient(resilient != 0);
+}
+
+extern DllExport void dirac_flush (dirac_decoder_t *decoder)
+{
+    TEST (decoder != NULL);
+    TEST (decoder->parser != NULL);
+    DiracParser *parser = static_cast<DiracParser *>(decoder->parser);
+
+    parser->Flush();
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -72,6 +72,9 @@
          seq_params member of the decoder handle.
          Allocate space for the frame data buffers and pass 
          this to the decoder.
+         Optionally set the sample format and line strides of
+         the buffers.
+         dirac_set_output_format (decoder_handle, format, stride);
          dirac_set_buf (decoder_handle, buf, NULL);
          break;
 
@@ -101,6 +104,18 @@ extern "C" {
 
 typedef DecoderState dirac_decoder_state_t;
 
+typedef DecoderErrors dirac_decoder_errors_t;
+
+/*! Sample formats in which the decoder can write decoded frames */
+typedef enum
+{
+    /*! One unsigned byte per sample (the default) */
+    DIRAC_OUTPUT_8BIT = 0,
+    /*! Two bytes per sample, little-endian, holding the coded video depth
+        (e.g. 10-bit samples in the range 0 to 1023) */
+    DIRAC_OUTPUT_16BIT_LE
+} dirac_output_format_t;
+
 /*! Structure that holds the information returned by the parser */
 typedef struct 
 {
@@ -120,6 +135,22 @@ typedef struct
     int frame_avail;
     /*! verbose output */
     int verbose;
+    /*! sample format of the output buffers. Set using dirac_set_output_format */
+    dirac_output_format_t output_format;
+    /*! distance in bytes between successive lines of the luma and chroma
+        output buffers. Zero means lines are packed with no padding. Set
+        using dirac_set_output_format */
+    int output_stride[3];
+    /*! time spent in each stage of decoding the frame in fbuf, summed
+        over both fields if the sequence is field coded */
+    dirac_stage_times_t frame_times;
+    /*! errors found decoding the frame in fbuf, summed over both fields
+        if the sequence is field coded, together with those found in the
+        stream since the previous frame */
+    dirac_decoder_errors_t frame_errors;
+    /*! errors found since the decoder was initialised, counted as they
+        are found, whether or not the pictures they affect are output */
+    dirac_decoder_errors_t total_errors;
 
 } dirac_decoder_t;
 
@@ -177,6 +208,42 @@ extern DllExport void dirac_buffer (dirac_decoder_t *decoder, unsigned char *sta
 */
 extern DllExport void dirac_set_buf (dirac_decoder_t *decoder, unsigned char *buf[3], void *id);
 
+/*!
+    Set the layout of the output buffers passed to dirac_set_buf. By default
+    the decoder writes 8-bit samples with lines packed with no padding. The
+    layout remains in force until it is next set.
+    \param decoder  Decoder object
+    \param format   Sample format of the output buffers
+    \param stride   Distance in bytes between successive lines of the luma
+                    and chroma buffers, or NULL for packed lines. A zero
+                    entry also means packed lines.
+*/
+extern DllExport void dirac_set_output_format (dirac_decoder_t *decoder, dirac_output_format_t format, const int stride[3]);
+
+/*!
+    Set whether errors in a damaged stream are concealed. By default
+    dirac_parse returns STATE_INVALID when a picture can't be decoded.
+    When resilient, the decoder resynchronises on the next valid parse
+    unit after damaged data, drops units it can't decode, and conceals
+    lost or damaged pictures from the nearest pictures it holds, by motion
+    compensation where the motion data survives or else by repeating
+    them. The errors are counted in frame_errors and total_errors.
+    \param decoder    Decoder object
+    \param resilient  Non-zero to conceal errors
+*/
+extern DllExport void dirac_set_resilient (dirac_decoder_t *decoder, int resilient);
+
+/*!
+    Signal that the input has ended. Subsequent calls to dirac_parse decode
+    the data still buffered, dropping any parse unit cut short, and return
+    the pictures the decoder still holds, with any lost among them concealed
+    if resilient. They then return STATE_SEQUENCE_END, as if the stream had
+    ended with an end of sequence unit. Without this, pictures held for
+    reordering are never returned from a stream that is cut short.
+    \param decoder    Decoder object
+*/
+extern DllExport void dirac_flush (dirac_decoder_t *decoder);
+
 #ifdef __cplusplus
 }
 #endif
@@ -52,12 +52,46 @@
 #include <libdirac_common/dirac_exception.h>
 using namespace dirac;
 
+#include <cstdlib>
 #include <iostream>
 #include <memory>
 
 using std::vector;
 using std::auto_ptr;
 
+namespace
+{
+    //! Owns the motion data decoders, so they are freed however decoding ends
+    class MvDecoderList
+    {
+    public:
+        MvDecoderList(){}
+
+        ~MvDecoderList(){ Clear(); }
+
+        //! The decoders, which are deleted with the list
+        vector<ArithCodec<MvData>*>& Decoders(){ return m_decoders; }
+
+        //! Delete the decoders
+        void Clear()
+        {
+            for (size_t i=0; i<m_decoders.size(); ++i)
+                delete m_decoders[i];
+            m_decoders.clear();
+        }
+
+    private:
+        //! Private, bodyless copy constructor: class should not be copied
+        MvDecoderList( const MvDecoderList& cpy );
+
+        //! Private, bodyless assignment=: class should not be assigned
+        MvDecoderList& operator=( const MvDecoderList& rhs );
+
+    private:
+        vector<ArithCodec<MvData>*> m_decoders;
+    };
+}
+
 PictureDecompressor::PictureDecompressor(DecoderParams& decp, ChromaFormat cf)
 :
 m_decparams(decp),
@@ -75,6 +109,16 @@ bool PictureDecompressor::Decompress(ParseUnitByteIO& parseunit_byteio,
 {
     // get current byte position
     //int start_pos = parseunit_byteio.GetReadBytePosition();
+    m_errors = DecoderErrors();
+
+    // The picture can be concealed if it can't be decoded, once its header
+    // has been read
+    bool header_read = false;
+
+    auto_ptr<MvData> mv_data;
+    MvDecoderList mv_decoder_list;
+    vector<ArithCodec<MvData>*>& mv_decoders = mv_decoder_list.Decoders();
+
     try {
 
     // read picture data
@@ -96,18 +140,34 @@ bool PictureDecompressor::Decompress(ParseUnitByteIO& parseunit_byteio,
         fs.SetNonRef();
 
     m_pparams.SetPicSort(fs);
+    header_read = true;
 
     if (m_pparams.GetReferenceType() == REFERENCE_PICTURE)
         // Now clean the reference pictures from the buffer
         CleanReferencePictures( my_buffer );
 
     // Check if the picture can be decoded
+    std::vector<int> refs = m_pparams.Refs();
     if (m_pparams.PicSort().IsInter()){
-        const std::vector<int>& refs = m_pparams.Refs();
-
         for (unsigned int i = 0; i < refs.size(); ++i)
             if ( !my_buffer.IsPictureAvail(refs[i]) )
-                return false;
+            {
+                if ( !m_decparams.Resilient() )
+                    return false;
+
+                // Predict from the nearest picture to the missing one instead
+                m_errors.missing_refs = 1;
+                refs[i] = NearestPicture( refs[i], my_buffer );
+                if ( refs[i]<0 )
+                {
+                    // With nothing to predict from, the picture can only be
+                    // concealed
+                    PushPicture(my_buffer);
+                    ConcealData(my_buffer.GetPicture(m_pparams.PictureNum()), my_buffer);
+                    m_errors.concealed = 1;
+                    return true;
+                }
+            }
     }
 
     // decode the rest of the picture
@@ -122,11 +182,13 @@ bool PictureDecompressor::Decompress(ParseUnitByteIO& parseunit_byteio,
     }
 
     PictureSort psort = m_pparams.PicSort();
-    auto_ptr<MvData> mv_data;
+    StageTimes times;
 
-    if ( psort.IsInter() )
+    if ( psort.IsInter() ){
         //do all the MV stuff
-        DecompressMVData( mv_data, picture_byteio );
+        StageTimer timer( times, TIMING_DECODE_MV );
+        DecompressMVData( mv_data, picture_byteio, mv_decoders );
+    }
 
     // Read the  transform header
     TransformByteIO transform_byteio(picture_byteio, m_pparams, m_decparams);
@@ -144,41 +206,81 @@ bool PictureDecompressor::Decompress(ParseUnitByteIO& parseunit_byteio,
 
     //Reference to the picture being decoded
     Picture& my_picture = my_buffer.GetPicture(m_pparams.PictureNum());
+    my_picture.Times() = times;
+
+    // Decode the residue and the remaining motion data streams. They are
+    // all independent, so can be decoded concurrently. The residue is the
+    // largest job, so is started first.
+    const int num_jobs = mv_decoders.size()+1;
+    vector<StageTimes> mv_times( num_jobs );
+    DiracException* job_error = 0;
+    bool mv_error = false;
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic,1)
+#endif
+    for (int j=0; j<num_jobs; ++j){
+        try {
+            if (j==0)
+                DecompressResidue( transform_byteio, my_picture );
+            else{
+                StageTimer timer( mv_times[j], TIMING_DECODE_MV );
+                mv_decoders[j-1]->DecompressData( *(mv_data.get()) );
+            }
+        }
+        catch (const DiracException& e) {
+#if defined(_OPENMP)
+#pragma omp critical (picture_decompress_error)
+#endif
+            {
+                if (!job_error)
+                    job_error = new DiracException(e);
+                if (j>0)
+                    mv_error = true;
+            }
+        }
+        catch (...) {
+            // Nothing may escape the parallel region, so any other failure,
+            // such as running out of memory for sizes read from a damaged
+            // stream, is reported as a picture error
+#if defined(_OPENMP)
+#pragma omp critical (picture_decompress_error)
+#endif
+            {
+                if (!job_error)
+                    job_error = new DiracException(ERR_UNSUPPORTED_STREAM_DATA,
+                                                   "Picture data could not be decoded",
+                                                   SEVERITY_PICTURE_ERROR);
+                if (j>0)
+                    mv_error = true;
+            }
+        }
+    }
 
-    if (!m_decparams.ZeroTransform()){
-        //decode components
-        Picture& pic = my_buffer.GetPicture( m_pparams.PictureNum() );
-
-        CompDecompressor my_compdecoder( m_decparams , pic.GetPparams() );
-
-        PicArray* comp_data[3];
-        CoeffArray* coeff_data[3];
-
-        const int depth( m_decparams.TransformDepth() );
-        WaveletTransform wtransform( depth, m_decparams.TransformFilter() );
-
-        pic.InitWltData( depth );
-
-        for (int c=0; c<3; ++c){
-            ComponentByteIO component_byteio((CompSort) c, transform_byteio);
-            comp_data[c] = &pic.Data((CompSort) c);
-            coeff_data[c] = &pic.WltData((CompSort) c);
+    mv_decoder_list.Clear();
 
-            SubbandList& bands = coeff_data[c]->BandList();
+    if (job_error){
+        DiracException e(*job_error);
+        delete job_error;
 
-            bands.Init(depth , coeff_data[c]->LengthX() , coeff_data[c]->LengthY());
-            my_compdecoder.Decompress(&component_byteio, *(coeff_data[c]), bands );
+        // With its motion data intact, a picture can still be predicted
+        if ( !m_decparams.Resilient() || mv_error || psort.IsIntra() )
+            throw e;
+        my_picture.Fill(0);
+        ++m_errors.decode_errors;
+        m_errors.concealed = 1;
+    }
 
-            wtransform.Transform(BACKWARD,*(comp_data[c]), *(coeff_data[c]));
-        }
+    // The vector and DC streams together count as one run of the stage
+    if (num_jobs>1){
+        double mv_seconds = 0.0;
+        for (int j=1; j<num_jobs; ++j)
+            mv_seconds += mv_times[j].Times().seconds[TIMING_DECODE_MV];
+        my_picture.Times().Add( TIMING_DECODE_MV, mv_seconds );
     }
-    else
-        my_picture.Fill(0);
 
     if ( psort.IsInter() ){
         Picture* my_pic = &my_buffer.GetPicture( m_pparams.PictureNum() );
 
-        const std::vector<int>&  refs = m_pparams.Refs();
         Picture* ref_pics[2];
 
         ref_pics[0] = &my_buffer.GetPicture( refs[0] );
@@ -188,6 +290,7 @@ bool PictureDecompressor::Decompress(ParseUnitByteIO& parseunit_byteio,
             ref_pics[1] = ref_pics[0];
 
         //motion compensate to add the data back in if we don't have an I picture
+        StageTimer timer( my_picture.Times(), TIMING_MOTION_COMP );
         MotionCompensator::CompensatePicture( m_decparams.GetPicPredParams() , ADD , *(mv_data.get()) ,
                                             my_pic, ref_pics );
     }
@@ -203,14 +306,73 @@ bool PictureDecompressor::Decompress(ParseUnitByteIO& parseunit_byteio,
 
     }// try
     catch (const DiracException& e) {
-        // skip picture
-        throw e;
+        // skip picture, unless it can be concealed
+        if ( !m_decparams.Resilient() || !header_read )
+            throw e;
+
+        PushPicture(my_buffer);
+        ConcealData(my_buffer.GetPicture(m_pparams.PictureNum()), my_buffer);
+        ++m_errors.decode_errors;
+        m_errors.concealed = 1;
+        return true;
     }
 
      //exit failure
     return false;
 }
 
+void PictureDecompressor::Conceal(const int pnum, PictureBuffer& my_buffer)
+{
+    PictureParams pparams( m_pparams );
+    pparams.SetPictureNum( pnum );
+    pparams.SetPictureType( INTRA_PICTURE );
+    pparams.SetReferenceType( NON_REFERENCE_PICTURE );
+    SetPictureFormat( pparams );
+
+    my_buffer.PushPicture( pparams );
+    ConcealData( my_buffer.GetPicture( pnum ), my_buffer );
+}
+
+int PictureDecompressor::NearestPicture(const int pnum, const PictureBuffer& my_buffer) const
+{
+    const std::vector<int> members = my_buffer.Members();
+    const int field = m_decparams.FieldCoding() ? 1 : 0;
+
+    int nearest = -1;
+    int nearest_cost = 0;
+    for (size_t i=0; i<members.size(); ++i)
+    {
+        const int n = members[i];
+        if (n == pnum)
+            continue;
+
+        const int cost = 4*std::abs( (n>>field) - (pnum>>field) ) +
+                         2*( (n^pnum) & field ) + ( n>pnum ? 1 : 0 );
+        if (nearest<0 || cost<nearest_cost)
+        {
+            nearest = n;
+            nearest_cost = cost;
+        }
+    }// i
+
+    return nearest;
+}
+
+void PictureDecompressor::ConcealData(Picture& my_picture, const PictureBuffer& my_buffer) const
+{
+    const int pnum = NearestPicture( my_picture.GetPparams().PictureNum(), my_buffer );
+
+    if (pnum<0)
+    {
+        my_picture.Fill(0);
+        return;
+    }
+
+    const Picture& picture = my_buffer.GetPicture( pnum );
+    for (int c=0; c<3; ++c)
+        my_picture.Data((CompSort) c) = picture.Data((CompSort) c);
+}
+
 void PictureDecompressor::CleanReferencePictures( PictureBuffer& my_buffer )
 {
     if ( m_decparams.Verbose() )
@@ -253,19 +415,61 @@ void PictureDecompressor::SetMVBlocks()
 
 void PictureDecompressor::PushPicture(PictureBuffer &my_buffer)
 {
-    m_pparams.SetCFormat(m_cformat);
+    SetPictureFormat(m_pparams);
 
-    m_pparams.SetXl(m_decparams.Xl());
-    m_pparams.SetYl(m_decparams.Yl());
+    my_buffer.PushPicture(m_pparams);
+}
+
+void PictureDecompressor::SetPictureFormat(PictureParams& pparams) const
+{
+    pparams.SetCFormat(m_cformat);
 
-    m_pparams.SetLumaDepth(m_decparams.LumaDepth());
-    m_pparams.SetChromaDepth(m_decparams.ChromaDepth());
+    pparams.SetXl(m_decparams.Xl());
+    pparams.SetYl(m_decparams.Yl());
 
-    my_buffer.PushPicture(m_pparams);
+    pparams.SetLumaDepth(m_decparams.LumaDepth());
+    pparams.SetChromaDepth(m_decparams.ChromaDepth());
+}
+
+void PictureDecompressor::DecompressResidue( TransformByteIO& transform_byteio,
+                                             Picture& my_picture )
+{
+    if (!m_decparams.ZeroTransform()){
+        //decode components
+        CompDecompressor my_compdecoder( m_decparams , my_picture.GetPparams() );
+
+        PicArray* comp_data[3];
+        CoeffArray* coeff_data[3];
+
+        const int depth( m_decparams.TransformDepth() );
+        WaveletTransform wtransform( depth, m_decparams.TransformFilter() );
+
+        my_picture.InitWltData( depth );
+
+        for (int c=0; c<3; ++c){
+            ComponentByteIO component_byteio((CompSort) c, transform_byteio);
+            comp_data[c] = &my_picture.Data((CompSort) c);
+            coeff_data[c] = &my_picture.WltData((CompSort) c);
+
+            SubbandList& bands = coeff_data[c]->BandList();
+
+            bands.Init(depth , coeff_data[c]->LengthX() , coeff_data[c]->LengthY());
+            {
+                StageTimer timer( my_picture.Times(), TIMING_DECODE_RESIDUE );
+                my_compdecoder.Decompress(&component_byteio, *(coeff_data[c]), bands );
+            }
+
+            StageTimer timer( my_picture.Times(), TIMING_IDWT );
+            wtransform.Transform(BACKWARD,*(comp_data[c]), *(coeff_data[c]));
+        }
+    }
+    else
+        my_picture.Fill(0);
 }
 
 void PictureDecompressor::DecompressMVData( std::auto_ptr<MvData>& mv_data,
-                                          PictureByteIO& picture_byteio )
+                                          PictureByteIO& picture_byteio,
+                                          vector<ArithCodec<MvData>*>& mv_decoders )
 {
     PicturePredParams& predparams = m_decparams.GetPicPredParams();
     MvDataByteIO mvdata_byteio (picture_byteio, m_pparams, predparams);
@@ -296,21 +500,26 @@ void PictureDecompressor::DecompressMVData( std::auto_ptr<MvData>& mv_data,
     PredModeCodec pmode_decoder( mvdata_byteio.PredModeData()->DataBlock(), TOTAL_MV_CTXS, m_pparams.NumRefs());
     pmode_decoder.Decompress( *(mv_data.get()) , num_bits);
 
+    // The remaining streams only depend on the split and prediction modes.
+    // Read in their data now, as it comes before the residue data, but
+    // leave the decoding to the caller. Once the data has been read the
+    // decoders no longer use the byte streams.
+
     // Read in the MV1 horizontal data header
     mvdata_byteio.MV1HorizData()->Input();
     // Read the MV1 horizontal data
     num_bits = mvdata_byteio.MV1HorizData()->DataBlockSize();
-    VectorElementCodec vdecoder1h( mvdata_byteio.MV1HorizData()->DataBlock(), 1,
-                                   HORIZONTAL, TOTAL_MV_CTXS);
-    vdecoder1h.Decompress( *(mv_data.get()) , num_bits);
+    mv_decoders.push_back( new VectorElementCodec( mvdata_byteio.MV1HorizData()->DataBlock(), 1,
+                                                   HORIZONTAL, TOTAL_MV_CTXS) );
+    mv_decoders.back()->ReadData( num_bits );
 
     // Read in the MV1 vertical data header
     mvdata_byteio.MV1VertData()->Input();
     // Read the MV1 data
     num_bits = mvdata_byteio.MV1VertData()->DataBlockSize();
-    VectorElementCodec vdecoder1v( mvdata_byteio.MV1VertData()->DataBlock(), 1,
-                                   VERTICAL, TOTAL_MV_CTXS);
-    vdecoder1v.Decompress( *(mv_data.get()) , num_bits);
+    mv_decoders.push_back( new VectorElementCodec( mvdata_byteio.MV1VertData()->DataBlock(), 1,
+                                                   VERTICAL, TOTAL_MV_CTXS) );
+    mv_decoders.back()->ReadData( num_bits );
 
     if ( m_pparams.NumRefs()>1 )
     {
@@ -318,39 +527,39 @@ void PictureDecompressor::DecompressMVData( std::auto_ptr<MvData>& mv_data,
         mvdata_byteio.MV2HorizData()->Input();
         // Read the MV2 horizontal data
         num_bits = mvdata_byteio.MV2HorizData()->DataBlockSize();
-        VectorElementCodec vdecoder2h( mvdata_byteio.MV2HorizData()->DataBlock(), 2,
-                                       HORIZONTAL, TOTAL_MV_CTXS);
-        vdecoder2h.Decompress( *(mv_data.get()) , num_bits);
+        mv_decoders.push_back( new VectorElementCodec( mvdata_byteio.MV2HorizData()->DataBlock(), 2,
+                                                       HORIZONTAL, TOTAL_MV_CTXS) );
+        mv_decoders.back()->ReadData( num_bits );
 
         // Read in the MV2 vertical data header
         mvdata_byteio.MV2VertData()->Input();
         // Read the MV2 vertical data
         num_bits = mvdata_byteio.MV2VertData()->DataBlockSize();
-        VectorElementCodec vdecoder2v( mvdata_byteio.MV2VertData()->DataBlock(), 2,
-                                       VERTICAL, TOTAL_MV_CTXS);
-        vdecoder2v.Decompress( *(mv_data.get()) , num_bits);
+        mv_decoders.push_back( new VectorElementCodec( mvdata_byteio.MV2VertData()->DataBlock(), 2,
+                                                       VERTICAL, TOTAL_MV_CTXS) );
+        mv_decoders.back()->ReadData( num_bits );
     }
 
     // Read in the Y DC data header
     mvdata_byteio.YDCData()->Input();
     // Read the Y DC data
     num_bits = mvdata_byteio.YDCData()->DataBlockSize();
-    DCCodec ydc_decoder( mvdata_byteio.YDCData()->DataBlock(), Y_COMP, TOTAL_MV_CTXS);
-    ydc_decoder.Decompress( *(mv_data.get()) , num_bits);
+    mv_decoders.push_back( new DCCodec( mvdata_byteio.YDCData()->DataBlock(), Y_COMP, TOTAL_MV_CTXS) );
+    mv_decoders.back()->ReadData( num_bits );
 
     // Read in the U DC data header
     mvdata_byteio.UDCData()->Input();
     // Read the U DC data
     num_bits = mvdata_byteio.UDCData()->DataBlockSize();
-    DCCodec udc_decoder( mvdata_byteio.YDCData()->DataBlock(), U_COMP, TOTAL_MV_CTXS);
-    udc_decoder.Decompress( *(mv_data.get()) , num_bits);
-
-    // Read in the Y DC data header
-    mvdata_byteio.YDCData()->Input();
-    // Read the Y DC data
-    num_bits = mvdata_byteio.YDCData()->DataBlockSize();
-    DCCodec vdc_decoder( mvdata_byteio.VDCData()->DataBlock(), V_COMP, TOTAL_MV_CTXS);
-    vdc_decoder.Decompress( *(mv_data.get()) , num_bits);
+    mv_decoders.push_back( new DCCodec( mvdata_byteio.UDCData()->DataBlock(), U_COMP, TOTAL_MV_CTXS) );
+    mv_decoders.back()->ReadData( num_bits );
+
+    // Read in the V DC data header
+    mvdata_byteio.VDCData()->Input();
+    // Read the V DC data
+    num_bits = mvdata_byteio.VDCData()->DataBlockSize();
+    mv_decoders.push_back( new DCCodec( mvdata_byteio.VDCData()->DataBlock(), V_COMP, TOTAL_MV_CTXS) );
+    mv_decoders.back()->ReadData( num_bits );
 }
 
 void PictureDecompressor::InitCoeffData( CoeffArray& coeff_data, const int xl, const int yl ){
@@ -47,6 +47,8 @@
 #include <libdirac_common/common.h>
 #include <libdirac_byteio/picture_byteio.h>
 #include <libdirac_byteio/transform_byteio.h>
+#include <libdirac_common/arith_codec.h>
+#include <libdirac_decoder/decoder_types.h>
 
 namespace dirac
 {
@@ -83,6 +85,12 @@ namespace dirac
             of a picture buffer.
             Returns true if able to decode successfully, false otherwise
 
+            If the decoder parameters are resilient, references missing from
+            the buffer are substituted by the nearest pictures, and a
+            picture whose data can't be decoded, or that has nothing to
+            predict from, is concealed rather than an exception being
+            thrown, provided its header could be read.
+
             \param parseunit_byteio Picture info in Dirac-stream format
             \param my_buffer   picture buffer into which the picture is placed
         */
@@ -92,6 +100,19 @@ namespace dirac
         //! Returns the picture parameters of the current picture being decoded
         const PictureParams& GetPicParams() const{ return m_pparams; }
 
+        //! Returns the errors found decoding the current picture
+        const DecoderErrors& GetErrors() const{ return m_errors; }
+
+        //! Conceals a picture lost from the stream
+        /*!
+            Adds a non-reference picture to the buffer, copied from the
+            nearest picture in it or, if it's empty, filled with mid-grey.
+
+            \param pnum        the number of the lost picture
+            \param my_buffer   picture buffer into which the picture is placed
+        */
+        void Conceal(const int pnum, PictureBuffer& my_buffer);
+
     private:
         //! Copy constructor is private and body-less
         /*!
@@ -118,7 +139,18 @@ namespace dirac
                             PictureBuffer& my_buffer,int pnum, CompSort cs);
 
         //! Decodes the motion data
-        void DecompressMVData( std::auto_ptr<MvData>& mv_data, PictureByteIO& picture_byteio );
+        /*!
+            Decodes the superblock splitting and prediction modes. The
+            vector and DC streams depend only on these, so their data is
+            read in and a decoder for each is returned in mv_decoders, to
+            be run while the residue is decoded. The caller owns the
+            decoders.
+        */
+        void DecompressMVData( std::auto_ptr<MvData>& mv_data, PictureByteIO& picture_byteio,
+                               std::vector<ArithCodec<MvData>*>& mv_decoders );
+
+        //! Decodes and inverse transforms the residue data of a picture
+        void DecompressResidue( TransformByteIO& transform_byteio, Picture& my_picture );
          
 
         //! Set the number of superblocks and blocks
@@ -127,6 +159,20 @@ namespace dirac
         //! Add a picture to the picture buffer
         void PushPicture(PictureBuffer &my_buffer);
 
+        //! Sets the dimensions, chroma format and depths of a picture to those of the sequence
+        void SetPictureFormat(PictureParams& pparams) const;
+
+        //! Returns the picture in the buffer nearest to a given one, or -1 if there is none
+        /*!
+            Earlier pictures are preferred to later ones at the same
+            distance and, if fields are coded, fields of the same parity
+            to those of the other parity.
+        */
+        int NearestPicture(const int pnum, const PictureBuffer& my_buffer) const;
+
+        //! Fills a picture with a copy of the nearest other picture in the buffer, or mid-grey
+        void ConcealData(Picture& my_picture, const PictureBuffer& my_buffer) const;
+
         //Member variables    
 
         //! Parameters for the decompression, as provided in constructor
@@ -149,6 +195,9 @@ namespace dirac
 
         //! Current Picture Parameters
         PictureParams m_pparams;
+
+        //! Errors found decoding the current picture
+        DecoderErrors m_errors;
     };
 
 } // namespace dirac
@@ -51,15 +51,23 @@
 #include <libdirac_common/picture_buffer.h>
 #include <libdirac_decoder/picture_decompress.h>
 #include <libdirac_byteio/accessunit_byteio.h>
+#include <libdirac_common/dirac_exception.h>
+#include <cstdlib>
 using namespace dirac;
 
-SequenceDecompressor::SequenceDecompressor(ParseUnitByteIO& parseunit,bool verbosity)
+// When decoding resiliently, a picture further than this from the one
+// being displayed starts display afresh, and references further behind
+// are retired
+const int MAX_PICTURE_GAP = 128;
+
+SequenceDecompressor::SequenceDecompressor(ParseUnitByteIO& parseunit,bool verbosity,bool resilient)
 :
 m_all_done(false),
 m_current_code_pnum(0),
 m_delay(1),
 m_show_pnum(-1),
-m_highest_pnum(0)
+m_highest_pnum(0),
+m_errors()
 {
     // read unit
     NewAccessUnit(parseunit);
@@ -68,6 +76,7 @@ m_highest_pnum(0)
         m_delay = 2;
 
     m_decparams.SetVerbose( verbosity );
+    m_decparams.SetResilient( resilient );
 
     m_pbuffer= new PictureBuffer( );
 
@@ -88,10 +97,35 @@ const PictureParams* SequenceDecompressor::GetNextPictureParams() const
 
 void SequenceDecompressor::NewAccessUnit(ParseUnitByteIO& parseunit_byteio)
 {
-    // read sequence header
-    SequenceHeaderByteIO seqheader_byteio(parseunit_byteio,m_parse_params, m_srcparams, m_decparams);
+    if ( !m_decparams.Resilient() )
+    {
+        // read sequence header
+        SequenceHeaderByteIO seqheader_byteio(parseunit_byteio,m_parse_params, m_srcparams, m_decparams);
+        seqheader_byteio.Input();
+        return;
+    }
+
+    // A damaged header mustn't change the sequence being decoded, so read
+    // it into copies of the parameters and check them first
+    ParseParams parse_params( m_parse_params );
+    SourceParams srcparams( m_srcparams );
+    DecoderParams decparams( m_decparams );
+    SequenceHeaderByteIO seqheader_byteio(parseunit_byteio, parse_params, srcparams, decparams);
     seqheader_byteio.Input();
 
+    if ( decparams.Xl()!=m_decparams.Xl() || decparams.Yl()!=m_decparams.Yl() ||
+         srcparams.CFormat()!=m_srcparams.CFormat() ||
+         decparams.LumaDepth()!=m_decparams.LumaDepth() ||
+         decparams.ChromaDepth()!=m_decparams.ChromaDepth() ||
+         decparams.FieldCoding()!=m_decparams.FieldCoding() )
+        DIRAC_THROW_EXCEPTION(
+            ERR_UNSUPPORTED_STREAM_DATA,
+            "Sequence header doesn't match the sequence being decoded",
+            SEVERITY_ACCESSUNIT_ERROR);
+
+    m_parse_params = parse_params;
+    m_srcparams = srcparams;
+    m_decparams = decparams;
 }
 
 const Picture* SequenceDecompressor::DecompressNextPicture(ParseUnitByteIO* p_parseunit_byteio)
@@ -118,6 +152,7 @@ const Picture* SequenceDecompressor::DecompressNextPicture(ParseUnitByteIO* p_pa
                 std::cout<<(m_show_pnum-1)<<" ";
         }
     }
+    m_pic_errors.erase( m_pic_errors.begin(), m_pic_errors.lower_bound(m_show_pnum) );
 
     bool new_picture_to_display=false;
 
@@ -127,6 +162,17 @@ const Picture* SequenceDecompressor::DecompressNextPicture(ParseUnitByteIO* p_pa
            std::cout<<std::endl<<"Calling picture decompression function";
        new_picture_to_display = m_pdecoder->Decompress(*p_parseunit_byteio,
                                                        *m_pbuffer);
+
+       const DecoderErrors& errors = m_pdecoder->GetErrors();
+       m_errors.decode_errors += errors.decode_errors;
+       m_errors.missing_refs += errors.missing_refs;
+       m_errors.concealed += errors.concealed;
+       if (new_picture_to_display &&
+           (errors.decode_errors || errors.missing_refs || errors.concealed))
+           m_pic_errors[m_pdecoder->GetPicParams().PictureNum()] = errors;
+
+       if (new_picture_to_display && m_decparams.Resilient())
+           ConcealLostPictures();
     }
 
     if (m_show_pnum < 0 && new_picture_to_display == false)
@@ -134,7 +180,8 @@ const Picture* SequenceDecompressor::DecompressNextPicture(ParseUnitByteIO* p_pa
 
     if (m_pbuffer->IsPictureAvail(m_show_pnum+1 ))
         ++m_show_pnum;
-    else if (new_picture_to_display && m_pdecoder->GetPicParams().PicSort().IsNonRef())
+    else if (new_picture_to_display && m_pdecoder->GetPicParams().PicSort().IsNonRef() &&
+             !m_decparams.Resilient())
     {
         // if a decoded future non reference frame is available it implies
         // that some frames have been skipped because of possible truncation
@@ -142,7 +189,10 @@ const Picture* SequenceDecompressor::DecompressNextPicture(ParseUnitByteIO* p_pa
         m_show_pnum =  m_pdecoder->GetPicParams().PictureNum();
     }
 
-    m_highest_pnum = std::max(m_pdecoder->GetPicParams().PictureNum(), m_highest_pnum);
+    // When decoding resiliently, the number of a picture that couldn't be
+    // decoded may be damaged, so isn't relied on
+    if (new_picture_to_display || !m_decparams.Resilient())
+        m_highest_pnum = std::max(m_pdecoder->GetPicParams().PictureNum(), m_highest_pnum);
 
     if (m_pbuffer->IsPictureAvail(m_show_pnum))
         return &m_pbuffer->GetPicture(m_show_pnum);
@@ -158,13 +208,138 @@ const Picture* SequenceDecompressor::GetNextPicture()
         return NULL;
 }
 
+DecoderErrors SequenceDecompressor::GetPictureErrors(const int pnum) const
+{
+    std::map<int, DecoderErrors>::const_iterator it = m_pic_errors.find(pnum);
+    if (it != m_pic_errors.end())
+        return it->second;
+
+    return DecoderErrors();
+}
+
 bool SequenceDecompressor::Finished()
 {
     if (m_show_pnum>=m_highest_pnum)
         return true;
 
     if (!m_pbuffer->IsPictureAvail(m_show_pnum+1 ))
-        ++m_show_pnum;
+    {
+        if (m_decparams.Resilient())
+        {
+            // Lost pictures can only be concealed from pictures decoded,
+            // and pictures too far off must have had damaged numbers
+            if (m_pbuffer->Members().empty() ||
+                m_highest_pnum-m_show_pnum>MAX_PICTURE_GAP)
+                return true;
+            Conceal(m_show_pnum+1);
+        }
+        else
+            ++m_show_pnum;
+    }
 
     return false;
 }
+
+void SequenceDecompressor::ConcealLostPictures()
+{
+    const PictureParams& pparams = m_pdecoder->GetPicParams();
+    const int pnum = pparams.PictureNum();
+
+    // A picture far from the one being displayed starts display afresh, as
+    // on joining a stream or after a long break in reception
+    if (m_show_pnum<0 || std::abs(pnum-m_show_pnum)>MAX_PICTURE_GAP)
+        Restart(pnum);
+
+    // Compare frames, so that the other field of a reference frame isn't
+    // taken as the previous reference
+    const int field = m_decparams.FieldCoding() ? 1 : 0;
+    int lost_before = pnum;
+    if (pparams.PicSort().IsRef())
+    {
+        lost_before = m_show_pnum+1;
+        for (std::set<int>::const_iterator it=m_ref_pnums.begin(); it!=m_ref_pnums.end(); ++it)
+            if (((*it)>>field) < (pnum>>field))
+                lost_before = std::max(lost_before, (*it)+1);
+
+        m_ref_pnums.insert(pnum);
+        if (m_ref_pnums.size()>4)
+            m_ref_pnums.erase(m_ref_pnums.begin());
+    }
+
+    for (int p=m_show_pnum+1; p<lost_before; ++p)
+        if (!m_pbuffer->IsPictureAvail(p))
+            Conceal(p);
+
+    // References are retired by later pictures, so losing those can leave
+    // references in the buffer indefinitely
+    const std::vector<int> members = m_pbuffer->Members();
+    for (size_t i=0; i<members.size(); ++i)
+        if (members[i] < m_show_pnum-MAX_PICTURE_GAP)
+            m_pbuffer->Remove(members[i]);
+}
+
+void SequenceDecompressor::Restart(const int pnum)
+{
+    if (m_decparams.Verbose())
+        std::cout<<std::endl<<"Starting display at picture "<<pnum;
+
+    // Pictures far from the new start will never be displayed or used
+    const std::vector<int> members = m_pbuffer->Members();
+    for (size_t i=0; i<members.size(); ++i)
+        if (std::abs(members[i]-pnum)>MAX_PICTURE_GAP)
+            m_pbuffer->Remove(members[i]);
+
+    std::map<int, DecoderErrors>::iterator it = m_pic_errors.begin();
+    while (it != m_pic_errors.end())
+    {
+        if (std::abs(it->first-pnum)>MAX_PICTURE_GAP)
+            m_pic_errors.erase(it++);
+        else
+            ++it;
+    }
+
+    m_ref_pnums.clear();
+
+    // Display starts with the first field of a frame and, if nothing has
+    // been displayed yet, with the earliest lost reference
+    int first = pnum;
+    bool first_is_ref = false;
+    const PictureParams& pparams = m_pdecoder->GetPicParams();
+    if (m_show_pnum<0 && pparams.PicSort().IsInter())
+        for (size_t i=0; i<pparams.Refs().size(); ++i)
+            if (pparams.Refs()[i]<first && pnum-pparams.Refs()[i]<=MAX_PICTURE_GAP)
+            {
+                first = pparams.Refs()[i];
+                first_is_ref = true;
+            }
+    if (m_decparams.FieldCoding() && (first&1))
+    {
+        first &= ~1;
+        first_is_ref = false;
+    }
+    m_show_pnum = first-1;
+    m_highest_pnum = pnum;
+    if (first!=pnum && !m_pbuffer->IsPictureAvail(first))
+    {
+        Conceal(first);
+
+        // Keep a lost reference for the pictures still to be predicted from it
+        if (first_is_ref)
+        {
+            PictureSort psort;
+            psort.SetIntra();
+            psort.SetRef();
+            m_pbuffer->GetPicture(first).SetPictureSort(psort);
+        }
+    }
+}
+
+void SequenceDecompressor::Conceal(const int pnum)
+{
+    if (m_decparams.Verbose())
+        std::cout<<std::endl<<"Concealing lost picture "<<pnum;
+
+    m_pdecoder->Conceal(pnum, *m_pbuffer);
+    m_pic_errors[pnum].concealed = 1;
+    ++m_errors.concealed;
+}
@@ -50,7 +50,10 @@
 
 #include "libdirac_common/common.h"
 #include "libdirac_byteio/parseunit_byteio.h"
+#include "libdirac_decoder/decoder_types.h"
 #include <iostream>
+#include <map>
+#include <set>
 
 namespace dirac
 {
@@ -71,8 +74,9 @@ namespace dirac
             output detail.
             \param  parseunit   First access-unit of new sequence
             \param  verbosity   when true, increases the amount of information displayed during decompression
+            \param  resilient   when true, damaged or missing pictures are concealed
          */
-        SequenceDecompressor(ParseUnitByteIO& parseunit, bool verbosity);
+        SequenceDecompressor(ParseUnitByteIO& parseunit, bool verbosity, bool resilient=false);
 
         //! Destructor
         /*!
@@ -82,6 +86,9 @@ namespace dirac
 
         //! Marks beginning of a new AccessUnit
         /*!
+            When decoding resiliently, a header that doesn't agree with the
+            picture format of the sequence is rejected with an exception
+            and the parameters are left unchanged.
             \param parseunit_byteio AccessUnit info in Dirac-stream format
         */
         void NewAccessUnit(ParseUnitByteIO& parseunit_byteio);
@@ -107,6 +114,16 @@ namespace dirac
         //! Get the next picture available for display
         const Picture* GetNextPicture();
 
+        //! Returns the errors found decoding a picture
+        DecoderErrors GetPictureErrors(const int pnum) const;
+
+        //! Returns the errors found decoding and concealing pictures so far
+        /*!
+            Errors are counted as they are found, whether or not the
+            pictures they affect are ever displayed.
+        */
+        const DecoderErrors& GetErrors() const { return m_errors; }
+
         //! Get the next picture parameters
         const PictureParams* GetNextPictureParams() const;
         //! Determine if decompression is complete.
@@ -158,6 +175,27 @@ namespace dirac
         */
         SequenceDecompressor& operator=(const SequenceDecompressor& rhs);
 
+        //! Conceals the pictures that the last picture decoded shows are lost
+        /*!
+            Pictures are coded so that every picture before a non-reference
+            picture, and every picture up to the previous reference frame
+            before a reference picture, comes before it in the stream. Any
+            of these not yet decoded have been lost, and are concealed so
+            that display can continue.
+        */
+        void ConcealLostPictures();
+
+        //! Starts display afresh from a picture, as on joining a stream
+        /*!
+            If nothing has been displayed yet, display starts from the
+            earliest reference of the picture, since the references must
+            have been lost.
+        */
+        void Restart(const int pnum);
+
+        //! Conceals a lost picture, recording it in its errors
+        void Conceal(const int pnum);
+
 
         //Member variables
 
@@ -183,6 +221,12 @@ namespace dirac
         PictureDecompressor *m_pdecoder;
         //! Highest picture-num processed - for tracking end-of-sequence
         int m_highest_pnum;
+        //! The most recent reference pictures decoded, for finding lost pictures
+        std::set<int> m_ref_pnums;
+        //! Errors found decoding pictures not yet displayed, by picture number
+        std::map<int, DecoderErrors> m_pic_errors;
+        //! Errors found decoding and concealing pictures since the start
+        DecoderErrors m_errors;
     };
 
 } // namespace dirac
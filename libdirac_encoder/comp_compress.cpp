@@ -65,7 +65,8 @@ CompCompressor::CompCompressor( EncoderParams& encp,const PictureParams& pp)
 ComponentByteIO* CompCompressor::Compress( CoeffArray& coeff_data ,
                                            SubbandList& bands,
                                            CompSort csort,
-                                           const OneDArray<unsigned int>& estimated_bits)
+                                           const OneDArray<unsigned int>& estimated_bits,
+                                           OneDArray<unsigned int>& band_bits)
 {
     // Need to transform, select quantisers for each band,
     // and then compress each component in turn
@@ -82,6 +83,8 @@ ComponentByteIO* CompCompressor::Compress( CoeffArray& coeff_data ,
         // create subband byte io
         SubbandByteIO subband_byteio(bands(b));
 
+        num_band_bytes = 0;
+
         if ( !bands(b).Skipped() )
         {   // If not skipped ...
             if (m_pparams.UsingAC())
@@ -133,6 +136,8 @@ ComponentByteIO* CompCompressor::Compress( CoeffArray& coeff_data ,
             SetToVal( coeff_data , bands(b) , 0 );
         }
 
+        band_bits[b] = 8*num_band_bytes;
+
             // output sub-band data
             p_component_byteio->AddSubband(&subband_byteio);
 
@@ -74,12 +74,14 @@ namespace dirac
             \param  bands           Subbands list
             \param  csort           Chroma format
             \param  estimated_bits  the list of estimated number of bits in each subband
+            \param  band_bits       the list of actual number of bits in each subband (output)
             \return Picture-component in Dirac-bytestream format
         */
         ComponentByteIO* Compress( CoeffArray& coeff_data ,
                                  SubbandList& bands,
                                  CompSort csort,
-                                 const OneDArray<unsigned int>& estimated_bits);
+                                 const OneDArray<unsigned int>& estimated_bits,
+                                 OneDArray<unsigned int>& band_bits);
 
     private:
         //! Copy constructor is private and body-less. This class should not be copied.
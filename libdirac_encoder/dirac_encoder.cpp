@@ -52,6 +52,7 @@
 #include <libdirac_byteio/dirac_byte_stream.h>
 #include <libdirac_common/video_format_defaults.h>
 #include <libdirac_common/dirac_exception.h>
+#include <libdirac_common/cpu_dispatch.h>
 
 using namespace dirac;
 using namespace std;
@@ -93,6 +94,18 @@ void copy_2dArray (const TwoDArray<bool> & in, int *out)
     }// j
 }
 
+void copy_2dArray (const TwoDArray<MECostType> & in, float *out)
+{
+    // Costs are held in fixed point
+    for (int j=0 ; j<in.LengthY() ; ++j)
+    {
+        for (int i=0 ; i<in.LengthX() ; ++i)
+        {
+            *out++ =  float( FromMECost( in[j][i] ) );
+        }// i
+    }// j
+}
+
 void copy_mv ( const MvArray& mv, dirac_mv_t *dmv)
 {
     for (int j=0 ; j<mv.LengthY() ; ++j)
@@ -240,6 +253,10 @@ public:
     // Set the buffer to hold the locally decoded frame
     void SetDecodeBuffer (unsigned char *buffer, int buffer_size);
 
+    // Set the function to call with the statistics of each encoded picture
+    void SetPictureStatsCallback (dirac_picture_stats_callback_t callback,
+                                  void *user_data);
+
     // Return the encoder parameters
     const EncoderParams& GetEncParams() const { return m_encparams; }
 
@@ -270,6 +287,9 @@ private:
     void GetSequenceStats(dirac_encoder_t *encoder,
                           const DiracByteStats& dirac_seq_stats);
 
+    // Pass the detailed picture statistics to the statistics callback
+    void ReportPictureStats(const dirac_encoder_t *encoder);
+
 private:
     // sequence compressor
     SequenceCompressor *m_seqcomp;
@@ -328,6 +348,12 @@ private:
     // sequence
     bool m_eos_signalled;
 
+    // Function to call with the statistics of each encoded picture
+    dirac_picture_stats_callback_t m_stats_callback;
+
+    // User data passed to the statistics callback
+    void *m_stats_user_data;
+
 };
 
 /*
@@ -428,7 +454,9 @@ DiracEncoder::DiracEncoder(const dirac_encoder_context_t *enc_ctx,
        m_gop_bits(0),
     m_gop_count(0),
     m_picture_count(0),
-    m_eos_signalled(false)
+    m_eos_signalled(false),
+    m_stats_callback(NULL),
+    m_stats_user_data(NULL)
 {
     // Setup source parameters
     SetSourceParams (enc_ctx);
@@ -452,6 +480,16 @@ DiracEncoder::DiracEncoder(const dirac_encoder_context_t *enc_ctx,
     }
 }
 
+void DiracEncoder::SetPictureStatsCallback (dirac_picture_stats_callback_t callback,
+                                            void *user_data)
+{
+    m_stats_callback = callback;
+    m_stats_user_data = user_data;
+
+    // The PSNR is only measured if it's needed
+    m_encparams.SetCollectStats(callback != NULL);
+}
+
 void DiracEncoder::SetDecodeBuffer (unsigned char *buffer, int buffer_size)
 {
     m_dec_buf = buffer;
@@ -538,12 +576,71 @@ void DiracEncoder::SetEncoderParams (const dirac_encoder_context_t *enc_ctx)
     m_encparams.SetChromaDepth(chroma_depth);
 
     m_encparams.SetFullSearch(enc_ctx->enc_params.full_search);
+    m_encparams.SetMESearch(enc_ctx->enc_params.me_search);
     m_encparams.SetCombinedME(enc_ctx->enc_params.combined_me);
     m_encparams.SetXRangeME(enc_ctx->enc_params.x_range_me);
     m_encparams.SetYRangeME(enc_ctx->enc_params.y_range_me);
     m_encparams.SetCPD(enc_ctx->enc_params.cpd);
     m_encparams.SetQf(enc_ctx->enc_params.qf);
     m_encparams.SetTargetRate(enc_ctx->enc_params.trate);
+
+    if (enc_ctx->enc_params.rc_pass < 0 || enc_ctx->enc_params.rc_pass > 2)
+    {
+        std::ostringstream errstr;
+
+        errstr << "Rate control pass "
+               << enc_ctx->enc_params.rc_pass
+               << " out of supported range [0-2]";
+        DIRAC_THROW_EXCEPTION(
+            ERR_INVALID_INIT_DATA,
+            errstr.str(),
+            SEVERITY_TERMINATE);
+    }
+    if (enc_ctx->enc_params.rc_pass == 2 && enc_ctx->enc_params.trate == 0)
+    {
+        DIRAC_THROW_EXCEPTION(
+            ERR_INVALID_INIT_DATA,
+            "The second pass of a two-pass encode needs a target bit rate",
+            SEVERITY_TERMINATE);
+    }
+    if (enc_ctx->enc_params.vbv_size < 0 || enc_ctx->enc_params.vbv_delay < 0)
+    {
+        DIRAC_THROW_EXCEPTION(
+            ERR_INVALID_INIT_DATA,
+            "Decoder buffer size and delay must not be negative",
+            SEVERITY_TERMINATE);
+    }
+    if (enc_ctx->enc_params.vbv_size > 0 && enc_ctx->enc_params.trate == 0)
+    {
+        DIRAC_THROW_EXCEPTION(
+            ERR_INVALID_INIT_DATA,
+            "A decoder buffer size needs a target bit rate",
+            SEVERITY_TERMINATE);
+    }
+    if (enc_ctx->enc_params.vbv_size > 0 &&
+        (double)enc_ctx->enc_params.vbv_delay*enc_ctx->enc_params.trate >
+        1000.0*enc_ctx->enc_params.vbv_size)
+    {
+        DIRAC_THROW_EXCEPTION(
+            ERR_INVALID_INIT_DATA,
+            "The decoder buffer delay is too long for the buffer size",
+            SEVERITY_TERMINATE);
+    }
+    if (enc_ctx->enc_params.quality_regions_x < 0 ||
+        enc_ctx->enc_params.quality_regions_y < 0)
+    {
+        DIRAC_THROW_EXCEPTION(
+            ERR_INVALID_INIT_DATA,
+            "The numbers of quality regions must not be negative",
+            SEVERITY_TERMINATE);
+    }
+    m_encparams.SetRCPass(enc_ctx->enc_params.rc_pass);
+    if (enc_ctx->enc_params.rc_stats_file != NULL)
+        m_encparams.SetRCStatsFile(enc_ctx->enc_params.rc_stats_file);
+    m_encparams.SetVBVSize(enc_ctx->enc_params.vbv_size);
+    m_encparams.SetVBVDelay(enc_ctx->enc_params.vbv_delay);
+    m_encparams.SetQualityRegions(std::max(1, enc_ctx->enc_params.quality_regions_x),
+                                  std::max(1, enc_ctx->enc_params.quality_regions_y));
     m_encparams.SetLossless(enc_ctx->enc_params.lossless);
     m_encparams.SetL1Sep(enc_ctx->enc_params.L1_sep);
     m_encparams.SetNumL1(enc_ctx->enc_params.num_L1);
@@ -610,7 +707,8 @@ int DiracEncoder::CompressNextPicture ()
 
     if (mypicture){
         m_enc_picture = m_seqcomp->GetPictureEncoded();
-	if (m_enc_picture->GetPparams().PicSort().IsIntra()==false)
+	if (m_enc_picture->GetPparams().PicSort().IsIntra()==false &&
+	    (m_enc_picture->GetStatus() & DONE_ME_INIT) != 0)
             m_enc_medata = &m_enc_picture->GetMEData();
 	else
 	    m_enc_medata = NULL;
@@ -684,6 +782,49 @@ void DiracEncoder::GetPictureStats(dirac_encoder_t *encoder)
     }
 }
 
+void DiracEncoder::ReportPictureStats (const dirac_encoder_t *encoder)
+{
+    const PictureStats& stats = m_enc_picture->Stats();
+    dirac_enc_picture_stats_t pic_stats;
+
+    pic_stats.pnum = encoder->enc_pparams.pnum;
+    pic_stats.ptype = encoder->enc_pparams.ptype;
+    pic_stats.rtype = encoder->enc_pparams.rtype;
+    pic_stats.qf = stats.QualFactor();
+    pic_stats.bits = encoder->enc_pstats;
+
+    pic_stats.num_bands = std::min( int( stats.Bands(Y_COMP).size() ),
+                                    DIRAC_MAX_SUBBANDS );
+    for (int c=0; c<3; ++c)
+    {
+        const std::vector<PictureStats::BandStats>& bands = stats.Bands( (CompSort) c );
+        for (int b=0; b<pic_stats.num_bands; ++b)
+        {
+            pic_stats.bands[c][b].qindex = bands[b].qindex;
+            pic_stats.bands[c][b].bits = bands[b].bits;
+            pic_stats.bands[c][b].skipped = bands[b].skipped ? 1 : 0;
+        }
+        pic_stats.psnr[c] = stats.PSNR( (CompSort) c );
+        pic_stats.ssim[c] = stats.SSIM( (CompSort) c );
+
+        const std::vector<double>& region_psnr = stats.RegionPSNR( (CompSort) c );
+        const std::vector<double>& region_ssim = stats.RegionSSIM( (CompSort) c );
+        pic_stats.region_psnr[c] = region_psnr.empty() ? NULL : &region_psnr[0];
+        pic_stats.region_ssim[c] = region_ssim.empty() ? NULL : &region_ssim[0];
+    }
+    pic_stats.region_xnum = stats.RegionsX();
+    pic_stats.region_ynum = stats.RegionsY();
+
+    pic_stats.intra_ratio = stats.IntraRatio();
+    pic_stats.mean_sad = stats.MeanSAD();
+    pic_stats.mean_mvcost = stats.MeanMvCost();
+    pic_stats.mean_block_cost = stats.MeanBlockCost();
+    pic_stats.buffer_fill = stats.BufferFill();
+    pic_stats.times = encoder->enc_ptimes;
+
+    m_stats_callback (&pic_stats, m_stats_user_data);
+}
+
 int DiracEncoder::GetEncodedData (dirac_encoder_t *encoder)
 {
     int size = 0;
@@ -708,6 +849,9 @@ int DiracEncoder::GetEncodedData (dirac_encoder_t *encoder)
 
             // Get frame statistics
             GetPictureStats (encoder);
+            encoder->enc_ptimes = m_enc_picture->Times().Times();
+            if (m_stats_callback)
+                ReportPictureStats (encoder);
             if(m_encparams.Verbose() && encoder->enc_ctx.enc_params.picture_coding_mode==1)
             {
                 if (encoder->enc_pparams.pnum%2 == 0)
@@ -734,6 +878,7 @@ int DiracEncoder::GetEncodedData (dirac_encoder_t *encoder)
         {
             // Not picture data
             encoder->enc_pparams.pnum = -1;
+            encoder->enc_ptimes = StageTimes().Times();
         }
         encdata->size = size;
 
@@ -977,6 +1122,14 @@ static void SetEncoderParameters(dirac_encoder_context_t *enc_ctx,
     // Set rate to zero by default, meaning no rate control
     encparams.trate = 0;
 
+    // Single-pass encoding by default
+    encparams.rc_pass = 0;
+    encparams.rc_stats_file = NULL;
+    encparams.vbv_size = 0;
+    encparams.vbv_delay = 0;
+    encparams.quality_regions_x = 0;
+    encparams.quality_regions_y = 0;
+
     // set default block params
     OLBParams default_block_params;
     SetDefaultBlockParameters(default_block_params, video_format);
@@ -992,6 +1145,7 @@ static void SetEncoderParameters(dirac_encoder_context_t *enc_ctx,
     encparams.full_search = 0;
     encparams.x_range_me = 32;
     encparams.y_range_me = 32;
+    encparams.me_search = default_enc_params.MESearch();
 
     // by default, don't use combined component motion estimation
     encparams.combined_me = 0;
@@ -1027,6 +1181,9 @@ extern DllExport void dirac_encoder_context_init ( dirac_encoder_context_t *enc_
 
 extern DllExport dirac_encoder_t *dirac_encoder_init (const dirac_encoder_context_t *enc_ctx, int verbose)
 {
+    /* Detect the SIMD kernels the CPU supports before any are selected */
+    ActiveCpuLevel();
+
     /* Allocate for encoder */
     dirac_encoder_t *encoder = new dirac_encoder_t;
 
@@ -1154,6 +1311,15 @@ extern DllExport void dirac_encoder_end_sequence (dirac_encoder_t *encoder)
 
 }
 
+extern DllExport void dirac_encoder_set_picture_stats_callback (dirac_encoder_t *encoder, dirac_picture_stats_callback_t callback, void *user_data)
+{
+    TEST (encoder != NULL);
+    TEST (encoder->compressor != NULL);
+    DiracEncoder *compressor = (DiracEncoder *)encoder->compressor;
+
+    compressor->SetPictureStatsCallback(callback, user_data);
+}
+
 extern DllExport void dirac_encoder_close (dirac_encoder_t *encoder)
 {
     TEST (encoder != NULL);
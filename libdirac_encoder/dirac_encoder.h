@@ -172,6 +172,10 @@ typedef VideoFormat dirac_encoder_presets_t;
 /*! Enumerated type that defines motion vector precisions supported by the
     encoder.*/
 typedef MVPrecisionType dirac_mvprecision_t;
+
+/*! Enumerated type that defines the pixel-accurate motion estimation
+    search strategies supported by the encoder.*/
+typedef MESearchType dirac_me_search_t;
 /*! Structure that holds the encoder specific parameters */
 typedef struct 
 {
@@ -227,6 +231,29 @@ typedef struct
     unsigned int picture_coding_mode;
     /*! arithmetic coding flag: 0 - vlc coding; 1 - arithmetic coding */
     int using_ac;
+    /*! Motion estimation speed: ME_SEARCH_HIERARCHICAL - hierarchical
+        search; ME_SEARCH_PREDICTIVE - fast predictive search. Ignored if
+        full_search is set */
+    dirac_me_search_t me_search;
+    /*! Rate control pass: 0 - single-pass encoding; 1 - first pass of a
+        two-pass encode, which only gathers statistics; 2 - second pass,
+        which uses them to hit the target bit rate */
+    int rc_pass;
+    /*! Name of the file for the statistics of a two-pass encode. NULL
+        means the default, dirac_2pass.log */
+    const char *rc_stats_file;
+    /*! Size of the decoder buffer in kbits for constant bit-rate coding.
+        0 means no hard constraint on the buffer */
+    int vbv_size;
+    /*! Initial decoder buffer delay in milliseconds. 0 means start
+        decoding when the buffer is 90% full */
+    int vbv_delay;
+    /*! Number of regions across the picture in which the quality is also
+        measured separately. 0 or 1 means whole pictures only */
+    int quality_regions_x;
+    /*! Number of regions down the picture in which the quality is also
+        measured separately. 0 or 1 means whole pictures only */
+    int quality_regions_y;
 } dirac_encparams_t;
 
 /*! Structure that holds the parameters that set up the encoder context */
@@ -364,6 +391,71 @@ typedef struct
     dirac_mv_cost_t *pred_costs[2];
 } dirac_instr_t;
 
+/*! Maximum number of subbands reported per component (transform depth 8) */
+#define DIRAC_MAX_SUBBANDS 25
+
+/*! Structure that holds the statistics about the coding of a subband */
+typedef struct
+{
+    /*! Quantiser index */
+    int qindex;
+    /*! Number of bits used to encode the subband data */
+    unsigned int bits;
+    /*! 1 - subband skipped; 0 - subband coded */
+    int skipped;
+} dirac_band_stats_t;
+
+/*! Structure that holds the detailed statistics about an encoded picture */
+typedef struct
+{
+    /*! Picture number */
+    int pnum;
+    /*! Picture type */
+    dirac_picture_type_t ptype;
+    /*! Reference type */
+    dirac_reference_type_t rtype;
+    /*! Quality factor used to encode the picture */
+    double qf;
+    /*! Number of bits used to encode the picture */
+    dirac_enc_picstats_t bits;
+    /*! Number of subbands in each component - 0 if the residue was skipped */
+    int num_bands;
+    /*! Subbands of the y, u and v components in coding order, DC first */
+    dirac_band_stats_t bands[3][DIRAC_MAX_SUBBANDS];
+    /*! Proportion of blocks coded intra - 1 for intra pictures */
+    double intra_ratio;
+    /*! Mean SAD per block of the motion compensated blocks */
+    double mean_sad;
+    /*! Mean motion vector cost per block of the motion compensated blocks */
+    double mean_mvcost;
+    /*! Mean cost per block of the prediction modes chosen */
+    double mean_block_cost;
+    /*! Decoder buffer occupancy after the picture as a proportion of the
+        buffer size - -1 if the bit rate is not controlled */
+    double buffer_fill;
+    /*! PSNR of the y, u and v components in dB - -1 if not measured */
+    double psnr[3];
+    /*! Mean SSIM over 8x8 windows of the y, u and v components - -1 if
+        not measured */
+    double ssim[3];
+    /*! Number of regions across the picture - 0 if regions not measured */
+    int region_xnum;
+    /*! Number of regions down the picture - 0 if regions not measured */
+    int region_ynum;
+    /*! PSNR of each region of the y, u and v components in raster order -
+        region_ynum*region_xnum, or NULL if regions not measured */
+    const double *region_psnr[3];
+    /*! Mean SSIM of each region of the y, u and v components in raster
+        order - region_ynum*region_xnum, or NULL if regions not measured */
+    const double *region_ssim[3];
+    /*! Time spent in each stage of coding the picture */
+    dirac_stage_times_t times;
+} dirac_enc_picture_stats_t;
+
+/*! Function called with the detailed statistics about each encoded picture.
+    The statistics are only valid for the duration of the call. */
+typedef void (*dirac_picture_stats_callback_t)(const dirac_enc_picture_stats_t *stats, void *user_data);
+
 /*! Structure that holds the information returned by the encoder */
 typedef struct
 {
@@ -385,6 +477,9 @@ typedef struct
     /*! encoded picture stats */
     dirac_enc_picstats_t enc_pstats;
 
+    /*! time spent in each stage of coding the encoded picture */
+    dirac_stage_times_t enc_ptimes;
+
     /*! encoded sequence stats */
     dirac_enc_seqstats_t enc_seqstats;
 
@@ -469,6 +564,17 @@ extern DllExport dirac_encoder_state_t dirac_encoder_output (dirac_encoder_t *en
 */
 extern DllExport void dirac_encoder_end_sequence (dirac_encoder_t *encoder);
 
+/*!
+    Set a function to be called with the detailed statistics about each
+    encoded picture, from dirac_encoder_output when the picture is
+    available. The PSNR and SSIM are measured while a function is set, even
+    if locally decoded frames are not returned.
+    \param   encoder         Encoder Handle
+    \param   callback        Function to call, or NULL for none
+    \param   user_data       Pointer passed to the function
+*/
+extern DllExport void dirac_encoder_set_picture_stats_callback (dirac_encoder_t *encoder, dirac_picture_stats_callback_t callback, void *user_data);
+
 /*!
     Free resources held by encoder
     \param   encoder         Encoder Handle
@@ -37,16 +37,21 @@
 
 #include <libdirac_encoder/enc_picture.h>
 #include <libdirac_common/upconvert.h>
+#include <libdirac_motionest/downconvert.h>
 
 using namespace dirac;
 
 EncPicture::EncPicture( const PictureParams& pp):
     Picture( pp ),
+    m_down_combined( false ),
     m_me_data( NULL ),
     m_status( NO_ENC ),
     m_complexity( 0.0 ),
     m_norm_complexity( 1.0 ),
-    m_pred_bias(0.5)
+    m_pred_bias(0.5),
+    m_la_intra_cost( 0.0 ),
+    m_la_inter_cost( 0.0 ),
+    m_scene_cut( false )
 {
     for (int c=0; c<3; ++c ){
         m_orig_data[c] = new PicArray( m_pic_data[c]->LengthY(), m_pic_data[c]->LengthX() );
@@ -82,10 +87,19 @@ void EncPicture::ClearData(){
         }
     }
 
+    ClearDownData();
+
     if ( m_me_data != NULL )
         delete m_me_data;
 }
 
+void EncPicture::ClearDownData() const
+{
+    for (size_t i=0; i<m_down_data.size(); ++i)
+        delete m_down_data[i];
+    m_down_data.clear();
+}
+
 EncPicture::~EncPicture()
 {
     ClearData();
@@ -109,6 +123,30 @@ void EncPicture::InitMEData( const PicturePredParams& predparams , const int num
         delete m_me_data;
 
     m_me_data=new MEData( predparams, num_refs );
+
+    m_mv_cache.clear();
+}
+
+void EncPicture::CacheMotion( const int ref , const MvArray& mv_array )
+{
+    m_mv_cache[ref] = mv_array;
+}
+
+const MvArray* EncPicture::CachedMotion( const int ref ) const
+{
+    std::map<int, MvArray>::const_iterator it = m_mv_cache.find( ref );
+
+    return ( it != m_mv_cache.end() ) ? &(it->second) : NULL;
+}
+
+std::vector<int> EncPicture::CachedMotionRefs() const
+{
+    std::vector<int> refs;
+    for ( std::map<int, MvArray>::const_iterator it = m_mv_cache.begin() ;
+          it != m_mv_cache.end() ; ++it )
+        refs.push_back( it->first );
+
+    return refs;
 }
 
 const PicArray& EncPicture::DataForME( bool combined_me ) const{
@@ -127,6 +165,32 @@ const PicArray& EncPicture::UpDataForME( bool combined_me ) const{
         return UpOrigData( Y_COMP );
 }
 
+const PicArray& EncPicture::DownDataForME( bool combined_me, const int level ) const{
+
+    if ( level==0 )
+        return DataForME( combined_me );
+
+    if ( combined_me != m_down_combined )
+    {
+        ClearDownData();
+        m_down_combined = combined_me;
+    }
+
+    if ( int(m_down_data.size())<level )
+    {//we have to do the downconversion, one level at a time
+
+        DownConverter mydcon;
+        for (int i=m_down_data.size()+1; i<=level; ++i)
+        {
+            const PicArray& data = DownDataForME( combined_me, i-1 );
+            PicArray* down_data = new PicArray( data.LengthY()/2, data.LengthX()/2 );
+            mydcon.DoDownConvert( data, *down_data );
+            m_down_data.push_back( down_data );
+        }// i
+    }
+
+    return *(m_down_data[level-1]);
+}
 
 const PicArray& EncPicture::UpOrigData(CompSort cs) const
 {
@@ -381,3 +445,103 @@ void EncPicture::DropRef( int rindex ){
         m_me_data->DropRef( rindex );
 
 }
+
+void PictureStats::Clear()
+{
+    m_qf = 0.0;
+
+    ClearBands();
+
+    for (int c=0; c<3; ++c){
+        m_psnr[c] = -1.0;
+        m_ssim[c] = -1.0;
+        m_region_psnr[c].clear();
+        m_region_ssim[c].clear();
+    }
+    m_regions_x = 0;
+    m_regions_y = 0;
+
+    m_has_motion = false;
+    m_intra_ratio = 1.0;
+    m_mean_sad = 0.0;
+    m_mean_mvcost = 0.0;
+    m_mean_block_cost = 0.0;
+
+    m_buffer_fill = -1.0;
+}
+
+void PictureStats::ClearBands()
+{
+    for (int c=0; c<3; ++c)
+        m_bands[c].clear();
+}
+
+void PictureStats::SetBands( const CompSort cs , const SubbandList& bands ,
+                             const OneDArray<unsigned int>& band_bits )
+{
+    std::vector<BandStats>& band_stats = m_bands[cs];
+    band_stats.clear();
+
+    // Bands are coded from DC, the last in the list, to the highest frequency
+    for (int b=bands.Length() ; b>=1 ; --b ){
+        BandStats stats;
+        stats.qindex = bands(b).QuantIndex();
+        stats.bits = band_bits[b];
+        stats.skipped = bands(b).Skipped();
+        band_stats.push_back( stats );
+    }// b
+}
+
+void PictureStats::SetMotionStats( const MEData& me_data )
+{
+    const TwoDArray<PredMode>& modes = me_data.Mode();
+
+    double sad_sum( 0.0 );
+    double mvcost_sum( 0.0 );
+    double cost_sum( 0.0 );
+    int num_inter( 0 );
+
+    for (int j=0 ; j<modes.LengthY() ; ++j){
+        for (int i=0 ; i<modes.LengthX() ; ++i){
+            const MvCostData* costs( NULL );
+            switch ( modes[j][i] ){
+            case REF1_ONLY:
+                costs = &me_data.PredCosts(1)[j][i];
+                break;
+            case REF2_ONLY:
+                costs = &me_data.PredCosts(2)[j][i];
+                break;
+            case REF1AND2:
+                costs = &me_data.BiPredCosts()[j][i];
+                break;
+            default:
+                cost_sum += FromMECost( me_data.IntraCosts()[j][i] );
+            }
+
+            if ( costs!=NULL ){
+                sad_sum += costs->SAD;
+                mvcost_sum += costs->mvcost;
+                cost_sum += FromMECost( costs->total );
+                ++num_inter;
+            }
+        }// i
+    }// j
+
+    const int num_blocks = modes.LengthX()*modes.LengthY();
+
+    m_has_motion = true;
+    m_intra_ratio = me_data.IntraBlockRatio();
+    m_mean_sad = num_inter>0 ? sad_sum/num_inter : 0.0;
+    m_mean_mvcost = num_inter>0 ? mvcost_sum/num_inter : 0.0;
+    m_mean_block_cost = num_blocks>0 ? cost_sum/num_blocks : 0.0;
+}
+
+void PictureStats::SetRegionQuality( const CompSort cs , const int xnum , const int ynum ,
+                                     const std::vector<double>& psnr ,
+                                     const std::vector<double>& ssim )
+{
+    m_regions_x = xnum;
+    m_regions_y = ynum;
+    m_region_psnr[cs] = psnr;
+    m_region_ssim[cs] = ssim;
+}
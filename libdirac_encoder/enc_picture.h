@@ -40,6 +40,7 @@
 
 #include <libdirac_common/picture.h>
 #include <libdirac_common/motion.h>
+#include <map>
 
 
 namespace dirac
@@ -57,10 +58,135 @@ static const unsigned int DONE_IDWT = 0x200;
 static const unsigned int DONE_MC_BACK = 0x400;
 static const unsigned int DONE_SET_PTYPE = 0x800;
 static const unsigned int DONE_PIC_COMPLEXITY = 0x1000;
+static const unsigned int DONE_CUT_INSERT = 0x2000;
 
 static const unsigned int ALL_ENC = 0xFFFFFFFF;
 static const unsigned int NO_ENC = 0;
 
+//! Statistics gathered about a picture as it is coded, for reporting
+class PictureStats
+{
+public:
+    //! The coding of a single subband
+    struct BandStats
+    {
+        //! The quantiser index chosen for the subband
+        int qindex;
+        //! The number of bits used for the subband data
+        unsigned int bits;
+        //! True if the subband was skipped
+        bool skipped;
+    };
+
+    //! Default constructor: nothing measured
+    PictureStats(){ Clear(); }
+
+    //! Resets the statistics, ready for coding a picture
+    void Clear();
+
+    //! Sets the quality factor the picture was coded with
+    void SetQualFactor( const double qf ){ m_qf = qf; }
+
+    //! Returns the quality factor the picture was coded with
+    double QualFactor() const { return m_qf; }
+
+    //! Records the coding of the subbands of a component
+    /*!
+        \param  cs         the component
+        \param  bands      the subbands, with their quantisers chosen
+        \param  band_bits  the bits used for the data of each subband
+    */
+    void SetBands( const CompSort cs , const SubbandList& bands ,
+                   const OneDArray<unsigned int>& band_bits );
+
+    //! Removes the subbands, if the picture's residue is skipped
+    void ClearBands();
+
+    //! Returns the coding of the subbands of a component, in coding order from DC up
+    const std::vector<BandStats>& Bands( const CompSort cs ) const { return m_bands[cs]; }
+
+    //! Summarises the motion data of an inter picture after mode decision
+    void SetMotionStats( const MEData& me_data );
+
+    //! Returns true if the motion data has been summarised
+    bool HasMotionStats() const { return m_has_motion; }
+
+    //! Returns the proportion of blocks coded intra
+    double IntraRatio() const { return m_intra_ratio; }
+
+    //! Returns the mean SAD per block of the motion-compensated blocks
+    double MeanSAD() const { return m_mean_sad; }
+
+    //! Returns the mean motion vector cost per block of the motion-compensated blocks
+    double MeanMvCost() const { return m_mean_mvcost; }
+
+    //! Returns the mean cost per block of the prediction mode chosen
+    double MeanBlockCost() const { return m_mean_block_cost; }
+
+    //! Sets the decoder buffer occupancy after the picture, as a proportion of its size
+    void SetBufferFill( const double fill ){ m_buffer_fill = fill; }
+
+    //! Returns the decoder buffer occupancy, or -1 if there is no rate control
+    double BufferFill() const { return m_buffer_fill; }
+
+    //! Sets the PSNR in dB of the coded component
+    void SetPSNR( const CompSort cs , const double psnr ){ m_psnr[cs] = psnr; }
+
+    //! Returns the PSNR of a component, or -1 if it wasn't measured
+    double PSNR( const CompSort cs ) const { return m_psnr[cs]; }
+
+    //! Sets the mean SSIM of the coded component
+    void SetSSIM( const CompSort cs , const double ssim ){ m_ssim[cs] = ssim; }
+
+    //! Returns the mean SSIM of a component, or -1 if it wasn't measured
+    double SSIM( const CompSort cs ) const { return m_ssim[cs]; }
+
+    //! Sets the quality of the coded component in each of a grid of regions
+    /*!
+        \param  cs    the component
+        \param  xnum  the number of regions across the picture
+        \param  ynum  the number of regions down the picture
+        \param  psnr  the PSNR of each region, in raster order
+        \param  ssim  the mean SSIM of each region, in raster order
+    */
+    void SetRegionQuality( const CompSort cs , const int xnum , const int ynum ,
+                           const std::vector<double>& psnr ,
+                           const std::vector<double>& ssim );
+
+    //! Returns the number of regions across the picture, or 0 if they weren't measured
+    int RegionsX() const { return m_regions_x; }
+
+    //! Returns the number of regions down the picture, or 0 if they weren't measured
+    int RegionsY() const { return m_regions_y; }
+
+    //! Returns the PSNR of each region of a component, in raster order
+    const std::vector<double>& RegionPSNR( const CompSort cs ) const { return m_region_psnr[cs]; }
+
+    //! Returns the mean SSIM of each region of a component, in raster order
+    const std::vector<double>& RegionSSIM( const CompSort cs ) const { return m_region_ssim[cs]; }
+
+private:
+    double m_qf;
+
+    std::vector<BandStats> m_bands[3];
+
+    bool m_has_motion;
+    double m_intra_ratio;
+    double m_mean_sad;
+    double m_mean_mvcost;
+    double m_mean_block_cost;
+
+    double m_buffer_fill;
+
+    double m_psnr[3];
+    double m_ssim[3];
+
+    int m_regions_x;
+    int m_regions_y;
+    std::vector<double> m_region_psnr[3];
+    std::vector<double> m_region_ssim[3];
+};
+
 class EncPicture : public Picture
 {
 public:
@@ -80,6 +206,21 @@ public:
     //! Drops a reference from the motion vector data
     void DropRef( int rindex );
 
+    //! Keeps the pixel-accurate motion vectors to a reference
+    /*!
+        Keeps a copy of the pixel-accurate motion vectors from this picture
+        to the reference picture numbered ref, so that they can be scaled to
+        predict the motion of later pictures. The cache is emptied when the
+        motion estimation data is initialised.
+    */
+    void CacheMotion( const int ref , const MvArray& mv_array );
+
+    //! Returns the cached motion vectors to a reference, or NULL if there are none
+    const MvArray* CachedMotion( const int ref ) const;
+
+    //! Returns the numbers of the references with cached motion vectors
+    std::vector<int> CachedMotionRefs() const;
+
 
     //! Returns a given component of the original data
     const PicArray& OrigData(CompSort c) const { return *m_orig_data[(int) c];}
@@ -96,6 +237,16 @@ public:
     //! Returns a version of the picture data suitable for subpel motion estimation
     const PicArray& UpDataForME(bool combined_me) const;
 
+    //! Returns a down-converted version of the picture data for motion estimation
+    /*!
+        Returns the data for motion estimation down-converted by a factor
+        of 2 to the power level, level 0 being DataForME itself. The
+        hierarchy is built as levels are asked for and then kept, so that
+        pictures used as references by several others are only
+        down-converted once.
+    */
+    const PicArray& DownDataForME(bool combined_me, const int level) const;
+
 
     void UpdateStatus( const unsigned int mask ){ m_status |= mask; }
 
@@ -118,6 +269,25 @@ public:
 
     void SetPredBias( double b ){ m_pred_bias = b; }
 
+    //! Sets the mean intra and inter costs per sample found by the lookahead
+    void SetLookaheadCosts( double intra_cost , double inter_cost )
+    { m_la_intra_cost = intra_cost; m_la_inter_cost = inter_cost; }
+
+    double LookaheadIntraCost() const { return m_la_intra_cost; }
+
+    double LookaheadInterCost() const { return m_la_inter_cost; }
+
+    //! Returns true if the lookahead found a scene cut at this picture
+    bool IsSceneCut() const { return m_scene_cut; }
+
+    void SetSceneCut( bool cut ){ m_scene_cut = cut; }
+
+    //! Returns the statistics gathered as the picture is coded
+    PictureStats& Stats(){ return m_stats; }
+
+    //! Returns the statistics gathered as the picture is coded
+    const PictureStats& Stats() const { return m_stats; }
+
 
 private:
 
@@ -140,6 +310,9 @@ private:
 
     void SetOrigData(const int c);
 
+    //! Deletes the down-converted hierarchy
+    void ClearDownData() const;
+
 private:
 
     PicArray* m_orig_data[3];
@@ -147,14 +320,28 @@ private:
     mutable PicArray* m_filt_data[3];
     mutable PicArray* m_filt_up_data[3];
 
+    //! Down-converted data for ME, level i at m_down_data[i-1]
+    mutable std::vector<PicArray*> m_down_data;
+    //! Whether the down-converted data is made from the combined components
+    mutable bool m_down_combined;
+
     MEData* m_me_data;
 
+    //! Cached pixel-accurate motion vectors, by reference picture number
+    std::map<int, MvArray> m_mv_cache;
+
     unsigned int m_status;
 
     double m_complexity;
     double m_norm_complexity;
 
     double m_pred_bias;
+
+    double m_la_intra_cost;
+    double m_la_inter_cost;
+    bool m_scene_cut;
+
+    PictureStats m_stats;
 };
 
 
@@ -37,6 +37,7 @@
 
 #include <libdirac_encoder/enc_queue.h>
 #include <algorithm>
+#include <cstdlib>
 using namespace dirac;
 
 //Simple constructor for decoder operation
@@ -176,6 +177,52 @@ std::vector<int> EncQueue::Members() const
     return members;
 }
 
+const MvArray* EncQueue::FindCachedMotion( const int pnum , const int ref ,
+                                           int& src_pnum , int& src_ref ) const
+{
+    const MvArray* mv_array = NULL;
+    int best_dist = 0;
+
+    // First look for the motion of other pictures to the same reference
+    for (unsigned int i=0; i<m_pic_data.size(); ++i )
+    {
+        const int qnum = m_pic_data[i]->GetPparams().PictureNum();
+        const MvArray* cached = m_pic_data[i]->CachedMotion( ref );
+
+        if ( qnum != pnum && cached != NULL &&
+             ( mv_array == NULL || std::abs( qnum-pnum ) < best_dist ) )
+        {
+            mv_array = cached;
+            best_dist = std::abs( qnum-pnum );
+            src_pnum = qnum;
+            src_ref = ref;
+        }
+    }// i
+
+    if ( mv_array != NULL )
+        return mv_array;
+
+    // Otherwise use the reference's own motion
+    bool is_present;
+    const EncPicture& ref_pic = GetPicture( ref , is_present );
+    if ( is_present )
+    {
+        const std::vector<int> ref_refs = ref_pic.CachedMotionRefs();
+        for (size_t i=0; i<ref_refs.size(); ++i )
+        {
+            if ( mv_array == NULL || std::abs( ref_refs[i]-ref ) < best_dist )
+            {
+                mv_array = ref_pic.CachedMotion( ref_refs[i] );
+                best_dist = std::abs( ref_refs[i]-ref );
+                src_pnum = ref;
+                src_ref = ref_refs[i];
+            }
+        }// i
+    }
+
+    return mv_array;
+}
+
 void EncQueue::PushPicture( const PictureParams& pp )
 {// Put a new picture onto the top of the stack
 
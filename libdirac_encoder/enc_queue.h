@@ -144,6 +144,22 @@ namespace dirac
         //! Returns a list of member pictures
         std::vector<int> Members() const;
 
+        //! Find cached motion that can predict the motion between two pictures
+        /*!
+            Find the cached pixel-accurate motion vectors best suited to
+            predicting, by scaling, the motion from picture pnum to picture
+            ref. Motion of the picture nearest to pnum that has the same
+            reference is preferred; failing that, the motion of ref itself to
+            its nearest reference is used.
+            \param pnum      the number of the picture being motion estimated
+            \param ref       the number of its reference picture
+            \param src_pnum  set to the number of the picture the vectors belong to
+            \param src_ref   set to the number of the reference the vectors point to
+            \return the vectors, or NULL if there are none
+        */
+        const MvArray* FindCachedMotion( const int pnum , const int ref ,
+                                         int& src_pnum , int& src_ref ) const;
+
 	//! Returns the size of the queue
 	int Size() const { return m_pic_data.size(); }
 
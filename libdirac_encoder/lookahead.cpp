@@ -0,0 +1,134 @@
+/* ***** BEGIN LICENSE BLOCK *****
+*
+* $Id$ $Name$
+*
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License
+* Version 1.1 (the "License"); you may not use this file except in compliance
+* with the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License for
+* the specific language governing rights and limitations under the License.
+*
+* The Original Code is BBC Research and Development code.
+*
+* The Initial Developer of the Original Code is the British Broadcasting
+* Corporation.
+* Portions created by the Initial Developer are Copyright (C) 2008.
+* All Rights Reserved.
+*
+* Contributor(s): Thomas Davies (Original Author)
+*
+* Alternatively, the contents of this file may be used under the terms of
+* the GNU General Public License Version 2 (the "GPL"), or the GNU Lesser
+* Public License Version 2.1 (the "LGPL"), in which case the provisions of
+* the GPL or the LGPL are applicable instead of those above. If you wish to
+* allow use of your version of this file only under the terms of the either
+* the GPL or LGPL and not to allow others to use your version of this file
+* under the MPL, indicate your decision by deleting the provisions above
+* and replace them with the notice and other provisions required by the GPL
+* or LGPL. If you do not delete the provisions above, a recipient may use
+* your version of this file under the terms of any one of the MPL, the GPL
+* or the LGPL.
+* ***** END LICENSE BLOCK ***** */
+
+
+#include <libdirac_encoder/lookahead.h>
+#include <libdirac_motionest/me_utils.h>
+using namespace dirac;
+
+Lookahead::Lookahead( const EncoderParams& encp ):
+    m_encparams( encp ),
+    m_level( 1 ),
+    m_block_size( 8 ),
+    m_search_range( 8 )
+{}
+
+void Lookahead::AnalysePicture( EncQueue& my_buffer , const int pnum )
+{
+    EncPicture& my_picture = my_buffer.GetPicture( pnum );
+    const bool combined_me = m_encparams.CombinedME();
+
+    // The down-converted data is kept in the pictures, so motion estimation
+    // can use it later. It's built on demand, so get it before going parallel.
+    const PicArray& pic_data = my_picture.DownDataForME( combined_me , m_level );
+
+    const int field_factor = m_encparams.FieldCoding() ? 2 : 1;
+    const int ref_num = pnum - field_factor;
+    const bool have_ref = ( ref_num>=0 && my_buffer.IsPictureAvail( ref_num ) );
+
+    const PicArray& ref_data = have_ref ?
+              my_buffer.GetPicture( ref_num ).DownDataForME( combined_me , m_level ) :
+              pic_data;
+
+    // Only whole blocks are analysed
+    const int xnum = pic_data.LengthX()/m_block_size;
+    const int ynum = pic_data.LengthY()/m_block_size;
+
+    double intra_total( 0.0 );
+    double inter_total( 0.0 );
+
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic) reduction(+:intra_total,inter_total)
+#endif
+    for ( int by=0 ; by<ynum ; ++by )
+    {
+        IntraBlockDiff intradiff( pic_data );
+        PelBlockDiff pdiff( ref_data , pic_data );
+
+        // Try the vector of the block to the left first, as it will often
+        // let the search bail out early
+        MVector pred( 0 , 0 );
+
+        for ( int bx=0 ; bx<xnum ; ++bx )
+        {
+            const BlockDiffParams dparams( bx*m_block_size , by*m_block_size ,
+                                           m_block_size , m_block_size );
+            ValueType dc;
+            const CalcValueType intra_cost = intradiff.Diff( dparams , dc );
+            CalcValueType inter_cost = intra_cost;
+
+            if ( have_ref )
+            {
+                MECostType best_cost( MAX_ME_COST );
+                MVector best_mv( pred );
+
+                pdiff.Diff( dparams , pred , best_cost , best_mv );
+                for ( int dy=-m_search_range ; dy<=m_search_range ; ++dy )
+                    for ( int dx=-m_search_range ; dx<=m_search_range ; ++dx )
+                        pdiff.Diff( dparams , MVector( dx , dy ) , best_cost , best_mv );
+
+                inter_cost = static_cast<CalcValueType>( best_cost>>ME_COST_SHIFT );
+                pred = best_mv;
+            }
+
+            intra_total += intra_cost;
+            inter_total += inter_cost;
+        }// bx
+    }// by
+
+    const int num_blocks = xnum*ynum;
+
+    if ( num_blocks==0 )
+        return;
+
+    const double num_samples = double( num_blocks*m_block_size*m_block_size );
+    const double intra_cost = intra_total/num_samples;
+    const double inter_cost = inter_total/num_samples;
+
+    my_picture.SetLookaheadCosts( intra_cost , inter_cost );
+
+    // It's a cut if motion compensation no longer does much better than
+    // intra coding and the inter cost has jumped. The second test stops
+    // noisy, flat pictures, where intra coding is always competitive, from
+    // being taken for cuts.
+    if ( have_ref )
+    {
+        const double prev_inter_cost = my_buffer.GetPicture( ref_num ).LookaheadInterCost();
+        my_picture.SetSceneCut( inter_cost>0.5*intra_cost &&
+                                inter_cost>2.0*prev_inter_cost );
+    }
+}
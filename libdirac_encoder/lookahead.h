@@ -0,0 +1,101 @@
+/* ***** BEGIN LICENSE BLOCK *****
+*
+* $Id$ $Name$
+*
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License
+* Version 1.1 (the "License"); you may not use this file except in compliance
+* with the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License for
+* the specific language governing rights and limitations under the License.
+*
+* The Original Code is BBC Research and Development code.
+*
+* The Initial Developer of the Original Code is the British Broadcasting
+* Corporation.
+* Portions created by the Initial Developer are Copyright (C) 2008.
+* All Rights Reserved.
+*
+* Contributor(s): Thomas Davies (Original Author)
+*
+* Alternatively, the contents of this file may be used under the terms of
+* the GNU General Public License Version 2 (the "GPL"), or the GNU Lesser
+* Public License Version 2.1 (the "LGPL"), in which case the provisions of
+* the GPL or the LGPL are applicable instead of those above. If you wish to
+* allow use of your version of this file only under the terms of the either
+* the GPL or LGPL and not to allow others to use your version of this file
+* under the MPL, indicate your decision by deleting the provisions above
+* and replace them with the notice and other provisions required by the GPL
+* or LGPL. If you do not delete the provisions above, a recipient may use
+* your version of this file under the terms of any one of the MPL, the GPL
+* or the LGPL.
+* ***** END LICENSE BLOCK ***** */
+
+
+#ifndef _LOOKAHEAD_H_
+#define _LOOKAHEAD_H_
+
+#include <libdirac_common/common.h>
+#include <libdirac_encoder/enc_queue.h>
+
+namespace dirac
+{
+    //! Analyses pictures at reduced resolution as they are loaded
+    /*!
+        The lookahead estimates intra and inter costs for each picture as soon
+        as it is loaded, well before it reaches the front of the coding queue.
+        The picture is compared, at a reduced resolution, with the previous
+        picture of the same parity (the previous field, if fields are being
+        coded). Each block is given an intra cost, the SAD from its mean, and
+        an inter cost, the smallest SAD over a small exhaustive search. A
+        picture is marked as a scene cut if its mean inter cost is more than
+        half its mean intra cost and more than twice the mean inter cost of
+        the picture it was compared with, so that its type can be settled
+        before any motion estimation is done.
+    */
+    class Lookahead
+    {
+    public:
+        //! Constructor
+        /*!
+            \param  encp  the encoder parameters
+        */
+        Lookahead( const EncoderParams& encp );
+
+        //! Analyse a picture, which must have its original data set
+        /*!
+            Analyse picture pnum in the buffer, recording its costs and
+            whether it is a scene cut in the picture itself.
+            \param  my_buffer  the buffer of pictures
+            \param  pnum       the number of the picture to analyse
+        */
+        void AnalysePicture( EncQueue& my_buffer , const int pnum );
+
+    private:
+        //! Private, bodyless copy constructor: class should not be copied
+        Lookahead( const Lookahead& cpy );
+
+        //! Private, bodyless assignment=: class should not be assigned
+        Lookahead& operator=( const Lookahead& rhs );
+
+    private:
+        //! The encoder parameters
+        const EncoderParams& m_encparams;
+
+        //! The number of times the data is down-converted by 2 for analysis
+        const int m_level;
+
+        //! The block size used at the reduced resolution
+        const int m_block_size;
+
+        //! The search range used at the reduced resolution
+        const int m_search_range;
+    };
+
+} // namespace dirac
+
+#endif
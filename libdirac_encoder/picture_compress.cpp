@@ -75,6 +75,7 @@ PictureCompressor::~PictureCompressor()
 
 void PictureCompressor::PixelME( EncQueue& my_buffer , int pnum )
 {
+    StageTimer timer( my_buffer.GetPicture(pnum).Times(), TIMING_PIXEL_ME );
     PixelMatcher pix_match( m_encparams );
     pix_match.DoSearch( my_buffer , pnum );
 }
@@ -207,6 +208,7 @@ void PictureCompressor::NormaliseComplexity( EncQueue& my_buffer, int pnum )
 
 void PictureCompressor::SubPixelME( EncQueue& my_buffer , int pnum )
 {
+    StageTimer timer( my_buffer.GetPicture(pnum).Times(), TIMING_SUBPEL_ME );
     const std::vector<int>& refs = my_buffer.GetPicture(pnum).GetPparams().Refs();
     const int num_refs = refs.size();
 
@@ -262,6 +264,7 @@ void PictureCompressor::SubPixelME( EncQueue& my_buffer , int pnum )
 
 void PictureCompressor::ModeDecisionME( EncQueue& my_buffer, int pnum )
 {
+    StageTimer timer( my_buffer.GetPicture(pnum).Times(), TIMING_MODE_DECISION );
     MEData& me_data = my_buffer.GetPicture(pnum).GetMEData();
     PictureParams& pparams = my_buffer.GetPicture(pnum).GetPparams();
     PicturePredParams& predparams = me_data.GetPicPredParams();
@@ -323,6 +326,7 @@ void PictureCompressor::MotionCompensate( EncQueue& my_buffer, int pnum,
                                           AddOrSub dirn )
 {
     EncPicture* my_pic = &my_buffer.GetPicture(pnum);
+    StageTimer timer( my_pic->Times(), TIMING_MOTION_COMP );
     std::vector<int>& my_refs = my_pic->GetPparams().Refs();
     Picture* ref_pics[2];
 
@@ -357,6 +361,7 @@ void PictureCompressor::Prefilter( EncQueue& my_buffer, int pnum )
 void PictureCompressor::DoDWT( EncQueue& my_buffer , int pnum, Direction dirn )
 {
     Picture& my_picture = my_buffer.GetPicture( pnum );
+    StageTimer timer( my_picture.Times(), dirn==FORWARD ? TIMING_DWT : TIMING_IDWT );
     PictureParams& pparams = my_picture.GetPparams();
     const PictureSort& psort = pparams.PicSort();
 
@@ -395,6 +400,9 @@ void PictureCompressor::CodeResidue( EncQueue& my_buffer ,
 
     PictureParams& pparams = my_picture.GetPparams();
 
+    PictureStats& stats = my_picture.Stats();
+    stats.SetQualFactor( m_encparams.Qf() );
+
     if ( !m_skipped ){
         // If not skipped we continue with the coding ...
         if (m_encparams.Verbose() )
@@ -416,6 +424,7 @@ void PictureCompressor::CodeResidue( EncQueue& my_buffer ,
         PicArray* comp_data[3];
         CoeffArray* coeff_data[3];
         OneDArray<unsigned int>* est_bits[3];
+        OneDArray<unsigned int> band_bits( Range( 1, 3*depth+1 ) );
         float lambda[3];
 
         // Construction and definition of objects
@@ -445,11 +454,18 @@ void PictureCompressor::CodeResidue( EncQueue& my_buffer ,
 
             SubbandList& bands = coeff_data[c]->BandList();
             SetupCodeBlocks( bands );
-            SelectQuantisers( *(coeff_data[c]) , bands , lambda[c],
-                 *est_bits[c] , m_encparams.GetCodeBlockMode(), pparams, (CompSort) c );
+            {
+                StageTimer timer( my_picture.Times(), TIMING_SELECT_QUANT );
+                SelectQuantisers( *(coeff_data[c]) , bands , lambda[c],
+                     *est_bits[c] , m_encparams.GetCodeBlockMode(), pparams, (CompSort) c );
+            }
 
-            p_transform_byteio->AddComponent( my_compcoder.Compress(
-                *(coeff_data[c]), bands, (CompSort) c, *est_bits[c] ) );
+            {
+                StageTimer timer( my_picture.Times(), TIMING_CODE_RESIDUE );
+                p_transform_byteio->AddComponent( my_compcoder.Compress(
+                    *(coeff_data[c]), bands, (CompSort) c, *est_bits[c], band_bits ) );
+            }
+            stats.SetBands( (CompSort) c, bands, band_bits );
         }
 
         // Destruction of objects
@@ -457,6 +473,8 @@ void PictureCompressor::CodeResidue( EncQueue& my_buffer ,
             delete est_bits[c];
 
     }//?m_skipped
+    else
+        stats.ClearBands();
 
 }
 
@@ -466,6 +484,7 @@ void PictureCompressor::CodeMVData(EncQueue& my_buffer, int pnum, PictureByteIO*
     // Code the MV data
 
     EncPicture& my_picture = my_buffer.GetPicture(pnum);
+    StageTimer timer( my_picture.Times(), TIMING_CODE_MV );
     PictureParams& pparams = my_picture.GetPparams();
     MvData& mv_data = static_cast<MvData&> (my_picture.GetMEData());
 
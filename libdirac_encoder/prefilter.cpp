@@ -37,6 +37,15 @@
 
 #include<libdirac_encoder/prefilter.h>
 #include<libdirac_common/arrays.h>
+#include <cstring>
+
+#if defined(HAVE_SSE2)
+#include <emmintrin.h>
+#endif
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
 
 using namespace dirac;
 
@@ -47,6 +56,145 @@ void dirac::CWMFilter( Picture& picture, const int strength )
     CWMFilterComponent( picture.Data(V_COMP), strength );
 }
 
+namespace
+{
+    // The centre-weighted median of a 3x3 neighbourhood is the median of the
+    // 9 neighbourhood values with (centre_weight-1) extra copies of the centre
+    // value. If the 9 values are sorted into s[0..8] and m extra copies of
+    // the centre value v are inserted, the element of rank k in the extended
+    // list is med(s[k-m], v, s[k]), taking s[n] as -infinity for n<0 and
+    // +infinity for n>8. This lets us use a fixed sorting network and a
+    // couple of min/max operations in place of a per-pixel sort, giving
+    // exactly the same result as Median().
+
+    //! The ranks needed from the extended list and how to compute them
+    struct CWMRanks
+    {
+        CWMRanks( const int centre_weight )
+        {
+            const int length = centre_weight+8;
+            m_extra = centre_weight-1;
+            m_average = (length%2==0);
+            m_rank[0] = m_average ? (length/2)-1 : (length-1)/2;
+            m_rank[1] = m_average ? length/2 : m_rank[0];
+        }
+
+        int m_extra;
+        bool m_average;
+        int m_rank[2];
+    };
+
+    template <class T>
+    inline void SortPair( T& a, T& b )
+    {
+        const T tmp = std::min( a, b );
+        b = std::max( a, b );
+        a = tmp;
+    }
+
+#if defined(HAVE_SSE2)
+    template <>
+    inline void SortPair<__m128i>( __m128i& a, __m128i& b )
+    {
+        const __m128i tmp = _mm_min_epi16( a, b );
+        b = _mm_max_epi16( a, b );
+        a = tmp;
+    }
+#endif
+
+    // Sort 9 values into ascending order using a 25-comparator network
+    template <class T>
+    inline void Sort9( T* s )
+    {
+        SortPair( s[0], s[3] ); SortPair( s[1], s[7] ); SortPair( s[2], s[5] ); SortPair( s[4], s[8] );
+        SortPair( s[0], s[7] ); SortPair( s[2], s[4] ); SortPair( s[3], s[8] ); SortPair( s[5], s[6] );
+        SortPair( s[0], s[2] ); SortPair( s[1], s[3] ); SortPair( s[4], s[5] ); SortPair( s[7], s[8] );
+        SortPair( s[1], s[4] ); SortPair( s[3], s[6] ); SortPair( s[5], s[7] );
+        SortPair( s[0], s[1] ); SortPair( s[2], s[4] ); SortPair( s[3], s[5] ); SortPair( s[6], s[8] );
+        SortPair( s[2], s[3] ); SortPair( s[4], s[5] ); SortPair( s[6], s[7] );
+        SortPair( s[1], s[2] ); SortPair( s[3], s[4] ); SortPair( s[5], s[6] );
+    }
+
+    inline ValueType CWMRankValue( const ValueType* s, const ValueType centre,
+                                   const int rank, const int extra )
+    {
+        ValueType val = centre;
+        if ( rank<=8 )
+            val = std::min( val, s[rank] );
+        if ( rank-extra>=0 )
+            val = std::max( val, s[rank-extra] );
+        return val;
+    }
+
+    // Filters the pixels [xstart, xend) of a line given the lines above and below
+    void CWMFilterLine( const ValueType* above, const ValueType* line,
+                        const ValueType* below, ValueType* out,
+                        const int xstart, const int xend, const CWMRanks& ranks )
+    {
+        int i = xstart;
+
+#if defined(HAVE_SSE2)
+        const __m128i bias = _mm_set1_epi16( -32768 );
+        for ( ; i+8<=xend; i+=8 )
+        {
+            __m128i s[9];
+            s[0] = _mm_loadu_si128( (const __m128i*)(above+i-1) );
+            s[1] = _mm_loadu_si128( (const __m128i*)(above+i) );
+            s[2] = _mm_loadu_si128( (const __m128i*)(above+i+1) );
+            s[3] = _mm_loadu_si128( (const __m128i*)(line+i-1) );
+            s[4] = _mm_loadu_si128( (const __m128i*)(line+i) );
+            s[5] = _mm_loadu_si128( (const __m128i*)(line+i+1) );
+            s[6] = _mm_loadu_si128( (const __m128i*)(below+i-1) );
+            s[7] = _mm_loadu_si128( (const __m128i*)(below+i) );
+            s[8] = _mm_loadu_si128( (const __m128i*)(below+i+1) );
+            const __m128i centre = s[4];
+
+            Sort9( s );
+
+            __m128i val[2];
+            for ( int r=0; r<2; ++r )
+            {
+                const int rank = ranks.m_rank[r];
+                val[r] = centre;
+                if ( rank<=8 )
+                    val[r] = _mm_min_epi16( val[r], s[rank] );
+                if ( rank-ranks.m_extra>=0 )
+                    val[r] = _mm_max_epi16( val[r], s[rank-ranks.m_extra] );
+            }// r
+
+            if ( ranks.m_average )
+            {
+                // (a+b+1)>>1 on signed values via the unsigned average
+                val[0] = _mm_xor_si128( _mm_avg_epu16( _mm_xor_si128( val[0], bias ),
+                                                       _mm_xor_si128( val[1], bias ) ),
+                                        bias );
+            }
+            _mm_storeu_si128( (__m128i*)(out+i), val[0] );
+        }// i
+#endif
+
+        ValueType s[9];
+        for ( ; i<xend; ++i )
+        {
+            s[0] = above[i-1]; s[1] = above[i]; s[2] = above[i+1];
+            s[3] = line[i-1];  s[4] = line[i];  s[5] = line[i+1];
+            s[6] = below[i-1]; s[7] = below[i]; s[8] = below[i+1];
+
+            Sort9( s );
+
+            const ValueType val0 = CWMRankValue( s, line[i], ranks.m_rank[0], ranks.m_extra );
+            if ( ranks.m_average )
+            {
+                const ValueType val1 = CWMRankValue( s, line[i], ranks.m_rank[1], ranks.m_extra );
+                out[i] = (val0+val1+1)>>1;
+            }
+            else
+                out[i] = val0;
+        }// i
+    }
+
+} // namespace
+
 void dirac::CWMFilterComponent( PicArray& pic_data, const int strength )
 {
     // Do centre-weighted median denoising
@@ -56,29 +204,17 @@ void dirac::CWMFilterComponent( PicArray& pic_data, const int strength )
     const int width( 3 );
     const int offset( (width-1)/2 );
     const int centre_weight = std::max(1, (width*width+1)-strength );
-    const int list_length = centre_weight+(width*width)-1;
-
-    ValueType* val_list = new ValueType[list_length];
+    const CWMRanks ranks( centre_weight );
 
-    for (int j=offset; j<pic_data.LengthY()-offset; ++j){
-        for (int i=offset; i<pic_data.LastX()-offset; ++i){
-            // Make the value list
-            int pos=0;
-            for (; pos<centre_weight-1; ++pos)
-                val_list[pos] = pic_copy[j][i];
+    const int xend = pic_data.LastX()-offset;
 
-            for (int s=-offset; s<=offset; ++s){
-                for (int r=-offset; r<=offset; ++r){
-                    val_list[pos]=pic_copy[j+s][i+r];
-                    pos++;
-                }// r
-            }// s
-
-            pic_data[j][i] = Median( val_list, list_length );
-        }// i
-    }// j
-
-    delete[] val_list;
+    // Lines are independent since we filter from a copy
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(static)
+#endif
+    for (int j=offset; j<pic_data.LengthY()-offset; ++j)
+        CWMFilterLine( pic_copy[j-1], pic_copy[j], pic_copy[j+1], pic_data[j],
+                       offset, xend, ranks );
 }
 
 ValueType dirac::Median( const ValueType* val_list, const int length)
@@ -126,8 +262,189 @@ ValueType dirac::Median( const ValueType* val_list, const int length)
 /*************************************************************/
 
 
-void VFilter( PicArray& pic_data, const OneDArray<int>& filter, const int bits );
-void HFilter( PicArray& pic_data, const OneDArray<int>& filter, const int bits );
+namespace
+{
+    //! A 2D filter tap, applied to the sample at offset (xpos, ypos) from the output
+    struct FilterTap
+    {
+        FilterTap( const int xpos, const int ypos, const int val ):
+            m_xpos( xpos ), m_ypos( ypos ), m_val( val ){}
+
+        int m_xpos;
+        int m_ypos;
+        int m_val;
+    };
+
+    //! A set of filter taps with rounding and output conversion
+    /*!
+        Output sample i of a line is (offset + sum_n tap[n]*src[n][i])>>shift,
+        where src[n] is the source line for tap n already displaced by the tap
+        position. Taps are held in 16 bits so that pairs of them can be
+        applied with a single multiply-add; larger taps are split in two.
+        The result is either clipped to [min_val, max_val] or, if no clip is
+        wanted, truncated to ValueType.
+    */
+    class TapFilter
+    {
+    public:
+        TapFilter( const int shift ):
+            m_shift( shift ),
+            m_clip( false ),
+            m_min_val( 0 ),
+            m_max_val( 0 ),
+            m_max_xoffset( 0 )
+        {}
+
+        void AddTap( const int xpos, const int ypos, int val )
+        {
+            if ( val==0 )
+                return;
+            while ( val>32767 || val<-32767 )
+            {
+                const int part = val>0 ? 32767 : -32767;
+                m_taps.push_back( FilterTap( xpos, ypos, part ) );
+                val -= part;
+            }
+            m_taps.push_back( FilterTap( xpos, ypos, val ) );
+            m_max_xoffset = std::max( m_max_xoffset, std::abs( xpos ) );
+        }
+
+        void SetClip( const ValueType min_val, const ValueType max_val )
+        {
+            m_clip = true;
+            m_min_val = min_val;
+            m_max_val = max_val;
+        }
+
+        int NumTaps() const { return m_taps.size(); }
+
+        const FilterTap& Tap( const int n ) const { return m_taps[n]; }
+
+        //! The furthest horizontal distance of any tap from the output sample
+        int MaxXOffset() const { return m_max_xoffset; }
+
+        //! Filters a line of the given width from a set of displaced source lines
+        void FilterLine( const ValueType* const* src, ValueType* out, const int width ) const;
+
+    private:
+        ValueType Convert( const int val ) const
+        {
+            if ( m_clip )
+                return std::min( int(m_max_val), std::max( int(m_min_val), val ) );
+            return ValueType( val );
+        }
+
+        std::vector<FilterTap> m_taps;
+        int m_shift;
+        bool m_clip;
+        ValueType m_min_val;
+        ValueType m_max_val;
+        int m_max_xoffset;
+    };
+
+    void TapFilter::FilterLine( const ValueType* const* src, ValueType* out,
+                                const int width ) const
+    {
+        const int num_taps = m_taps.size();
+        const int offset = 1<<(m_shift-1);
+        int i = 0;
+
+#if defined(HAVE_SSE2)
+        // Apply taps in pairs: interleave the samples of two source lines
+        // and multiply-add against an interleaved pair of tap values
+        const __m128i zero = _mm_setzero_si128();
+        for ( ; i+8<=width; i+=8 )
+        {
+            __m128i sum_lo = _mm_set1_epi32( offset );
+            __m128i sum_hi = sum_lo;
+            for ( int n=0; n<num_taps; n+=2 )
+            {
+                const __m128i a = _mm_loadu_si128( (const __m128i*)(src[n]+i) );
+                __m128i b = zero;
+                int taps = m_taps[n].m_val & 0xffff;
+                if ( n+1<num_taps )
+                {
+                    b = _mm_loadu_si128( (const __m128i*)(src[n+1]+i) );
+                    taps |= m_taps[n+1].m_val << 16;
+                }
+                const __m128i tap_pair = _mm_set1_epi32( taps );
+                sum_lo = _mm_add_epi32( sum_lo, _mm_madd_epi16( _mm_unpacklo_epi16( a, b ), tap_pair ) );
+                sum_hi = _mm_add_epi32( sum_hi, _mm_madd_epi16( _mm_unpackhi_epi16( a, b ), tap_pair ) );
+            }// n
+
+            sum_lo = _mm_srai_epi32( sum_lo, m_shift );
+            sum_hi = _mm_srai_epi32( sum_hi, m_shift );
+
+            __m128i result;
+            if ( m_clip )
+            {
+                result = _mm_packs_epi32( sum_lo, sum_hi );
+                result = _mm_max_epi16( result, _mm_set1_epi16( m_min_val ) );
+                result = _mm_min_epi16( result, _mm_set1_epi16( m_max_val ) );
+            }
+            else
+            {
+                // Truncate to 16 bits, as the scalar cast does
+                sum_lo = _mm_srai_epi32( _mm_slli_epi32( sum_lo, 16 ), 16 );
+                sum_hi = _mm_srai_epi32( _mm_slli_epi32( sum_hi, 16 ), 16 );
+                result = _mm_packs_epi32( sum_lo, sum_hi );
+            }
+            _mm_storeu_si128( (__m128i*)(out+i), result );
+        }// i
+#endif
+
+        for ( ; i<width; ++i )
+        {
+            int sum = offset;
+            for ( int n=0; n<num_taps; ++n )
+                sum += m_taps[n].m_val * src[n][i];
+            out[i] = Convert( sum>>m_shift );
+        }// i
+    }
+
+    //! Copies a line into a buffer, extending each end by replicating the edge samples
+    void PadLine( const ValueType* line, const int width, const int border,
+                  ValueType* padded )
+    {
+        for ( int i=0; i<border; ++i )
+            padded[i] = line[0];
+        std::memcpy( padded+border, line, width*sizeof(ValueType) );
+        for ( int i=width+border; i<width+2*border; ++i )
+            padded[i] = line[width-1];
+    }
+
+    //! Horizontally filters a line using the taps at ypos=0
+    void HFilterLine( const TapFilter& filter, const ValueType* line,
+                      const int width, ValueType* padded, ValueType* out )
+    {
+        const int border = filter.MaxXOffset();
+        PadLine( line, width, border, padded );
+
+        std::vector<const ValueType*> src( filter.NumTaps() );
+        for ( int n=0; n<filter.NumTaps(); ++n )
+            src[n] = padded + border + filter.Tap(n).m_xpos;
+
+        filter.FilterLine( &src[0], out, width );
+    }
+
+    //! Divides the lines of a component into strips for parallel processing
+    /*!
+        Each strip is at least min_height lines high, and there are no more
+        strips than threads so that as little work as possible is repeated at
+        the strip boundaries.
+    */
+    int NumStrips( const int height, const int min_height )
+    {
+#if defined(_OPENMP)
+        return std::max( 1, std::min( omp_get_max_threads(), height/min_height ) );
+#else
+        (void)height;
+        (void)min_height;
+        return 1;
+#endif
+    }
+
+} // namespace
 
 double sinxoverx( const double val )
 {
@@ -185,219 +502,68 @@ void dirac::LPFilter( PicArray& pic_data, const float qf, const int strength )
     float bw = (std::min( std::max( qf+3.0f-float(strength), 1.0f ), 10.0f ))/10.0;
 
     // filter with 14-bit accuracy
-    OneDArray<int> filter=MakeLPRectFilter(bw, 14);
-
-    HFilter( pic_data, filter, 14 );
-    VFilter( pic_data, filter, 14 );
-
-}
-
-void HFilter( PicArray& pic_data, const OneDArray<int>& filter, const int bits )
-{
-    ValueType* line_data = new ValueType[pic_data.LengthX()];
-    const int offset = (1<<(bits-1));
-
-    int sum;
+    const int bits = 14;
+    OneDArray<int> filter=MakeLPRectFilter(bw, bits);
 
-    for (int j=0; j<pic_data.LengthY(); ++j)
+    // The horizontal and vertical passes, each clipping to 8 bits
+    TapFilter hfilter( bits );
+    TapFilter vfilter( bits );
+    for (int k=filter.First(); k<=filter.Last(); ++k)
     {
-        // Do the first bit
-        for (int i=0; i<filter.Last(); ++i)
-        {
-            sum = offset;
-            for (int k=filter.Last(); k>=filter.First(); --k)
-                sum += filter[k]*pic_data[j][std::max(i-k,0)];
-            sum >>= bits;
-            sum = std::min( 127, std::max( -128, sum) );
-            line_data[i] = ValueType( sum );
-        }// i
-        // Do the middle bit
-        for (int i=filter.Last(); i<=pic_data.LastX()+filter.First(); ++i)
-        {
-            sum = offset;
-            for (int k=filter.Last(); k>=filter.First(); --k)
-                sum += filter[k]*pic_data[j][i-k];
-            sum >>= bits;
-            sum = std::min( 127, std::max( -128, sum) );
-            line_data[i] = ValueType( sum );
-        }// i
-        // Do the last bit
-        for (int i=pic_data.LastX()+filter.First()+1; i<pic_data.LengthX(); ++i)
-        {
-            sum = offset;
-            for (int k=filter.Last(); k>=filter.First(); --k)
-                sum += filter[k]*pic_data[j][std::min(i-k,pic_data.LastX())];
-            sum >>= bits;
-            sum = std::min( 127, std::max( -128, sum) );
-            line_data[i] = ValueType( sum );
-        }// i
-
-        // Copy data back
-
-        for (int i=0; i<pic_data.LengthX(); ++i )
-            pic_data[j][i] = line_data[i];
-
-    }// j
-
-    delete[] line_data;
-}
-
-void VFilter( PicArray& pic_data, const OneDArray<int>& filter, const int bits )
-{
-    PicArray tmp_data( pic_data );
-    const int offset = (1<<(bits-1));
-
-    int sum;
-
-    // Do the first bit
-    for (int j=0; j<filter.Last(); ++j)
-    {
-
-        for (int i=0; i<pic_data.LengthX(); ++i)
-        {
-            sum = offset;
-            for (int k=filter.Last(); k>=filter.First(); --k)
-                sum += filter[k]*pic_data[std::max(j-k,0)][i];
-            sum >>= bits;
-            sum = std::min( 127, std::max( -128, sum) );
-            tmp_data[j][i] = ValueType( sum );
-        }// i
-
-    }// j
-
-    // Do the middle bit
-    for (int j=filter.Last(); j<=pic_data.LastY()+filter.First(); ++j)
+        hfilter.AddTap( -k, 0, filter[k] );
+        vfilter.AddTap( 0, -k, filter[k] );
+    }
+    hfilter.SetClip( -128, 127 );
+    vfilter.SetClip( -128, 127 );
+
+    // The two passes are fused: each strip of lines keeps a window of
+    // horizontally filtered lines which the vertical pass reads from, with
+    // edge lines repeated. A strip only needs filter.Length() lines more
+    // than it outputs, so strips are processed in parallel.
+    const int height = pic_data.LengthY();
+    const int width = pic_data.LengthX();
+    const int num_lines = filter.Length();
+    const int num_strips = NumStrips( height, 4*num_lines );
+
+    PicArray out_data( height, width, pic_data.CSort() );
+
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(static)
+#endif
+    for (int s=0; s<num_strips; ++s)
     {
+        const int ystart = (s*height)/num_strips;
+        const int yend = ((s+1)*height)/num_strips;
 
-        for (int i=0; i<pic_data.LengthX(); ++i)
-        {
-            sum = offset;
-            for (int k=filter.Last(); k>=filter.First(); --k)
-                sum += filter[k]*pic_data[j-k][i];
-            sum >>= bits;
-            sum = std::min( 127, std::max( -128, sum) );
-            tmp_data[j][i] = ValueType( sum );
-        }// i
-
-    }// j
+        // Window of filtered lines, line j stored at j%num_lines
+        TwoDArray<ValueType> hlines( num_lines, width );
+        OneDArray<ValueType> padded( width+2*hfilter.MaxXOffset() );
+        std::vector<const ValueType*> src( vfilter.NumTaps() );
 
-    // Do the last bit
-    for (int j=pic_data.LastY()+filter.First()+1; j<pic_data.LengthY(); ++j)
-    {
+        int next_line = std::max( 0, ystart+filter.First() );
 
-        for (int i=0; i<pic_data.LengthX(); ++i)
+        for (int j=ystart; j<yend; ++j)
         {
-            sum = offset;
-            for (int k=filter.Last(); k>=filter.First(); --k)
-                sum += filter[k]*pic_data[std::min(j-k,pic_data.LastY())][i];
-            sum >>= bits;
-            sum = std::min( 127, std::max( -128, sum) );
-            tmp_data[j][i] = ValueType( sum );
-        }// i
-
-    }// j
-
-    // Copy data across
-    pic_data = tmp_data;
+            // Add the lines which have come into the window
+            const int last_line = std::min( height-1, j+filter.Last() );
+            for ( ; next_line<=last_line; ++next_line)
+                HFilterLine( hfilter, pic_data[next_line], width, &padded[0],
+                             hlines[next_line%num_lines] );
 
+            for (int n=0; n<vfilter.NumTaps(); ++n)
+            {
+                const int ypos = std::min( height-1, std::max( 0, j+vfilter.Tap(n).m_ypos ) );
+                src[n] = hlines[ypos%num_lines];
+            }// n
+            vfilter.FilterLine( &src[0], out_data[j], width );
+        }// j
+    }// s
+
+    pic_data = out_data;
 }
 
 /***************************************************************************/
 
-ValueType DiagFilterBchkD( const PicArray& pic,
-                           const int xpos, const int ypos,
-                           const TwoDArray<int>& filter,
-                           const int shift)
-{
-    // Half the filter length
-    const int len2 = 6;
-
-    const int height = pic.LengthY();
-    const int width = pic.LengthX();
-
-    int uplus, uneg, vplus, vneg;
-    int val = (1<<(shift-1));
-
-    // Do 0 position horizontally
-    val += filter[0][0]*pic[ypos][xpos];
-
-    for (int i=1; i<=len2;++i){
-            uplus = xpos + i;
-            uplus = (uplus>=width ? width-1 : uplus);
-            uneg = xpos - i;
-            uneg = (uneg<0 ? 0 : uneg );
-            val += filter[0][i]*(pic[ypos][uplus]+pic[ypos][uneg] );
-    }
-
-    // Do other positions vertically//
-    //////////////////////////////////
-
-    for (int j=1; j<=len2;++j){
-        vplus = ypos + j;
-        vplus = ( vplus>=height ? height-1 : vplus);
-        vneg = ypos - j;
-        vneg = (vneg<0 ? 0 : vneg );
-
-        // Do 0 position horizontally
-        val += filter[j][0]*(pic[vneg][xpos]+pic[vplus][xpos]);
-        for (int i=1; i<=len2;++i){
-            uplus = xpos + i;
-            uplus = (uplus>=width ? width-1 : uplus);
-            uneg = xpos - i;
-            uneg = (uneg<0 ? 0 : uneg );
-            val += filter[j][i]*(pic[vneg][uplus]+pic[vneg][uneg]+
-                                 pic[vplus][uplus]+pic[vplus][uneg] );
-        }
-    }
-
-    val >>= shift;
-
-    return ValueType(val);
-}
-
-ValueType DiagFilterD( const PicArray& pic,
-                       const int xpos, const int ypos,
-                       const TwoDArray<int>& filter,
-                       const int shift)
-{
-    // Half the filter length
-    const int len2 = 6;
-
-    int uplus, uneg, vplus, vneg;
-    int val = (1<<(shift-1));
-
-    // Do 0 position horizontally
-    val += filter[0][0]*pic[ypos][xpos];
-
-    for (int i=1; i<=len2;++i){
-            uplus = xpos + i;
-            uneg = xpos - i;
-            val += filter[0][i]*(pic[ypos][uplus]+pic[ypos][uneg] );
-    }
-
-    // Do other positions vertically//
-    //////////////////////////////////
-
-    for (int j=1; j<=len2;++j){
-        vplus = ypos + j;
-        vneg = ypos - j;
-
-        // Do 0 position horizontally
-        val += filter[j][0]*(pic[vneg][xpos]+pic[vplus][xpos]);
-        for (int i=1; i<=len2;++i){
-            uplus = xpos + i;
-            uneg = xpos - i;
-            val += filter[j][i]*(pic[vneg][uplus]+pic[vneg][uneg]+
-                                 pic[vplus][uplus]+pic[vplus][uneg] );
-        }
-    }
-
-    val >>= shift;
-
-    return ValueType(val);
-}
-
-
 TwoDArray<int> GetDiagLPFilter( const float bw )
 {
     TwoDArray<int> f( 7, 7 );
@@ -557,32 +723,46 @@ void dirac::DiagFilter( PicArray& pic_data, const float qf, const int strength )
         for (int i=0;i<7; ++i )
             filter[j][i] = ( factor*filter[j][i] + (1<<7) ) >> 8;
 
-
-    PicArray tmp_data( pic_data.LengthY(), pic_data.LengthX(), pic_data.CSort() );
-
+    // Expand the quadrant into the full set of taps
     const int shift = 16;
+    const int len2 = filter.LastX();
+    TapFilter dfilter( shift );
+    for (int s=-len2; s<=len2; ++s)
+        for (int r=-len2; r<=len2; ++r)
+            dfilter.AddTap( r, s, filter[std::abs(s)][std::abs(r)] );
+
+    // Filter from horizontally padded lines, repeating edge lines vertically
+    const int height = pic_data.LengthY();
+    const int width = pic_data.LengthX();
+    const int border = dfilter.MaxXOffset();
+
+    TwoDArray<ValueType> padded( height, width+2*border );
+    for (int j=0; j<height; ++j)
+        PadLine( pic_data[j], width, border, padded[j] );
+
+    PicArray tmp_data( height, width, pic_data.CSort() );
+
+#if defined(_OPENMP)
+#pragma omp parallel
+#endif
+    {
+        std::vector<const ValueType*> src( dfilter.NumTaps() );
 
-    for (int j=0; j<7;++j)
-        for (int i=0; i<pic_data.LengthX();++i)
-            tmp_data[j][i] = DiagFilterBchkD( pic_data, i, j, filter, shift);
-
-    for (int j=7; j<pic_data.LengthY()-7;++j){
-        for (int i=0; i<7;++i)
-            tmp_data[j][i] = DiagFilterBchkD( pic_data, i, j, filter, shift );
-
-        for (int i=7; i<pic_data.LengthX()-7;++i)
-            tmp_data[j][i] = DiagFilterD( pic_data, i, j, filter, shift );
-
-        for (int i=pic_data.LengthX()-7; i<pic_data.LengthX();++i)
-            tmp_data[j][i] = DiagFilterBchkD( pic_data, i, j, filter, shift );
-
+#if defined(_OPENMP)
+#pragma omp for schedule(static)
+#endif
+        for (int j=0; j<height; ++j)
+        {
+            for (int n=0; n<dfilter.NumTaps(); ++n)
+            {
+                const FilterTap& tap = dfilter.Tap(n);
+                const int ypos = std::min( height-1, std::max( 0, j+tap.m_ypos ) );
+                src[n] = padded[ypos] + border + tap.m_xpos;
+            }// n
+            dfilter.FilterLine( &src[0], tmp_data[j], width );
+        }// j
     }
 
-    for (int j=pic_data.LengthY()-7; j<pic_data.LengthY();++j)
-        for (int i=0; i<pic_data.LengthX();++i)
-            tmp_data[j][i] = DiagFilterBchkD( pic_data, i, j, filter, shift );
-
     pic_data = tmp_data;
 
 }
-
@@ -37,10 +37,187 @@
 
 #include <libdirac_encoder/quality_monitor.h>
 #include <libdirac_common/wavelet_utils.h>
+#include <algorithm>
+
+#if defined(HAVE_SSE2)
+#include <emmintrin.h>
+#endif
+
 using namespace dirac;
 
 using std::log10;
 
+namespace
+{
+    // Portable quality kernels, used when there are no vector versions for
+    // the active instruction set
+
+    int64_t simple_clip_sse_row( ValueType* coded , const ValueType* orig , const int length ,
+                                 const ValueType min_val , const ValueType max_val )
+    {
+        int64_t sum( 0 );
+
+        for ( int i=0 ; i<length ; ++i )
+        {
+            coded[i] = std::max( min_val , std::min( max_val , coded[i] ) );
+            const int64_t diff = orig[i] - coded[i];
+            sum += diff*diff;
+        }// i
+
+        return sum;
+    }
+
+    void simple_ssim_sums_4x4( const ValueType* orig , const int orig_stride ,
+                               const ValueType* coded , const int coded_stride ,
+                               const int num_blocks , int64_t* sums )
+    {
+        for ( int b=0 ; b<num_blocks ; ++b , sums+=4 )
+        {
+            sums[0] = sums[1] = sums[2] = sums[3] = 0;
+
+            for ( int j=0 ; j<4 ; ++j )
+            {
+                const ValueType* orig_row = orig + j*orig_stride + 4*b;
+                const ValueType* coded_row = coded + j*coded_stride + 4*b;
+
+                for ( int i=0 ; i<4 ; ++i )
+                {
+                    const int64_t x = orig_row[i];
+                    const int64_t y = coded_row[i];
+                    sums[0] += x;
+                    sums[1] += y;
+                    sums[2] += x*x + y*y;
+                    sums[3] += x*y;
+                }// i
+            }// j
+        }// b
+    }
+
+#if defined(HAVE_SSE2)
+    int64_t clip_sse_row_sse2( ValueType* coded , const ValueType* orig , const int length ,
+                               const ValueType min_val , const ValueType max_val )
+    {
+        // Differences fit in 16 bits for the depths these kernels are used
+        // for, so a multiply-add squares them and adds pairs in 32 bits,
+        // which are widened to accumulate in 64
+        const __m128i vmin = _mm_set1_epi16( min_val );
+        const __m128i vmax = _mm_set1_epi16( max_val );
+        const __m128i zero = _mm_setzero_si128();
+        __m128i acc = _mm_setzero_si128();
+
+        const int length8 = length & ~7;
+        for ( int i=0 ; i<length8 ; i+=8 )
+        {
+            __m128i val = _mm_loadu_si128( (const __m128i*)( coded+i ) );
+            val = _mm_max_epi16( vmin , _mm_min_epi16( vmax , val ) );
+            _mm_storeu_si128( (__m128i*)( coded+i ) , val );
+
+            const __m128i diff = _mm_sub_epi16( _mm_loadu_si128( (const __m128i*)( orig+i ) ) , val );
+            const __m128i sq = _mm_madd_epi16( diff , diff );
+            acc = _mm_add_epi64( acc , _mm_unpacklo_epi32( sq , zero ) );
+            acc = _mm_add_epi64( acc , _mm_unpackhi_epi32( sq , zero ) );
+        }// i
+
+        int64_t lanes[2];
+        _mm_storeu_si128( (__m128i*)lanes , acc );
+
+        return lanes[0] + lanes[1] +
+               simple_clip_sse_row( coded+length8 , orig+length8 , length-length8 ,
+                                    min_val , max_val );
+    }
+
+    void ssim_sums_4x4_sse2( const ValueType* orig , const int orig_stride ,
+                             const ValueType* coded , const int coded_stride ,
+                             const int num_blocks , int64_t* sums )
+    {
+        // Each multiply-add sums pairs of samples across a row of two blocks,
+        // so after four rows each block's sums are in a pair of lanes
+        const __m128i ones = _mm_set1_epi16( 1 );
+        const int num_pairs = num_blocks>>1;
+
+        for ( int p=0 ; p<num_pairs ; ++p , sums+=8 )
+        {
+            __m128i s1 = _mm_setzero_si128();
+            __m128i s2 = _mm_setzero_si128();
+            __m128i ss = _mm_setzero_si128();
+            __m128i s12 = _mm_setzero_si128();
+
+            for ( int j=0 ; j<4 ; ++j )
+            {
+                const __m128i x = _mm_loadu_si128( (const __m128i*)( orig + j*orig_stride + 8*p ) );
+                const __m128i y = _mm_loadu_si128( (const __m128i*)( coded + j*coded_stride + 8*p ) );
+                s1 = _mm_add_epi32( s1 , _mm_madd_epi16( x , ones ) );
+                s2 = _mm_add_epi32( s2 , _mm_madd_epi16( y , ones ) );
+                ss = _mm_add_epi32( ss , _mm_add_epi32( _mm_madd_epi16( x , x ) ,
+                                                        _mm_madd_epi16( y , y ) ) );
+                s12 = _mm_add_epi32( s12 , _mm_madd_epi16( x , y ) );
+            }// j
+
+            int lanes[4][4];
+            _mm_storeu_si128( (__m128i*)lanes[0] , s1 );
+            _mm_storeu_si128( (__m128i*)lanes[1] , s2 );
+            _mm_storeu_si128( (__m128i*)lanes[2] , ss );
+            _mm_storeu_si128( (__m128i*)lanes[3] , s12 );
+
+            for ( int k=0 ; k<4 ; ++k )
+            {
+                sums[k] = lanes[k][0] + lanes[k][1];
+                sums[4+k] = lanes[k][2] + lanes[k][3];
+            }// k
+        }// p
+
+        simple_ssim_sums_4x4( orig + 8*num_pairs , orig_stride ,
+                              coded + 8*num_pairs , coded_stride ,
+                              num_blocks & 1 , sums );
+    }
+#endif
+
+    // The SSIM of an 8x8 window from its sums, with the means offset to
+    // make the data unsigned
+    double SSIMFromSums( const int64_t sums[4] , const double offset ,
+                         const double c1 , const double c2 )
+    {
+        const double mean_x = sums[0]/64.0;
+        const double mean_y = sums[1]/64.0;
+        const double vars = sums[2]/64.0 - mean_x*mean_x - mean_y*mean_y;
+        const double covar = sums[3]/64.0 - mean_x*mean_y;
+        const double mu_x = mean_x + offset;
+        const double mu_y = mean_y + offset;
+
+        return ( ( 2.0*mu_x*mu_y + c1 )*( 2.0*covar + c2 ) ) /
+               ( ( mu_x*mu_x + mu_y*mu_y + c1 )*( vars + c2 ) );
+    }
+
+    // The PSNR from a sum of squared differences, or -1 if there are no samples
+    double PSNRFromSSE( const int64_t sse , const int64_t num_samples , const double max_val )
+    {
+        if ( num_samples==0 )
+            return -1.0;
+
+        return 10.0 * std::log10( max_val*max_val*num_samples / double( sse ) );
+    }
+}
+
+QualityKernels dirac::SelectQualityKernels( const CpuLevel level , const int depth )
+{
+    QualityKernels kernels;
+    kernels.clip_sse_row = simple_clip_sse_row;
+    kernels.ssim_sums_4x4 = simple_ssim_sums_4x4;
+
+#if defined(HAVE_SSE2)
+    if ( level>=CPU_LEVEL_SSE2 && depth<=13 )
+    {
+        kernels.clip_sse_row = clip_sse_row_sse2;
+        kernels.ssim_sums_4x4 = ssim_sums_4x4_sse2;
+    }
+#else
+    (void) level;
+    (void) depth;
+#endif
+
+    return kernels;
+}
+
 QualityMonitor::QualityMonitor(EncoderParams& encp) :
     m_encparams(encp),
     m_mse_averageY(3),
@@ -68,6 +245,12 @@ void QualityMonitor::ResetAll()
     m_totalmse_averageU = 0.0;
     m_totalmse_averageV = 0.0;
     m_allpicture_total = 0;
+
+    for (int c=0; c<3 ; ++c )
+    {
+        m_total_ssim[c] = 0.0;
+        m_ssim_count[c] = 0;
+    }// c
 }
 
 void QualityMonitor::WriteLog()
@@ -87,6 +270,19 @@ void QualityMonitor::WriteLog()
     std::cout.width(5);std::cout.precision(4);
     std::cout<<10*std::log10(UVmax*UVmax/(m_totalmse_averageV/m_allpicture_total))<<std::endl;
 
+    std::cout<<std::endl<<"Overall mean SSIM values";
+    std::cout<<std::endl<<"------------------------";
+    const char* comp_names[3] = { "Y: ", "U: ", "V: " };
+    for (int c=0; c<3; ++c)
+    {
+        std::cout<<std::endl<<comp_names[c];
+        std::cout.width(5);std::cout.precision(4);
+        if ( m_ssim_count[c]>0 )
+            std::cout<<m_total_ssim[c]/m_ssim_count[c]<<std::endl;
+        else
+            std::cout<<"-"<<std::endl;
+    }// c
+
 
     std::cout<<std::endl<<"Mean PSNR values by picture type and component";
     std::cout<<std::endl<<"--------------------------------------------";
@@ -120,65 +316,217 @@ void QualityMonitor::WriteLog()
     std::cout<<std::endl<<"-----------------||---------------------------------------------------";
 }
 
-void QualityMonitor::UpdateModel(const EncPicture& enc_picture )
+void QualityMonitor::UpdateModel( EncPicture& enc_picture )
 {
-    const double Ymax = double( (1<<m_encparams.LumaDepth())-1 );
-    const double UVmax = double( (1<<m_encparams.ChromaDepth())-1 );
-
     const PictureSort& psort = enc_picture.GetPparams().PicSort();
     int idx = psort.IsIntra() ? 0 : (psort.IsRef() ? 1 : 2);
 
-    double fmseY, fmseU, fmseV;
+    ComponentQuality quality[3];
 
-    fmseY = QualityVal( enc_picture.Data(Y_COMP) , enc_picture.OrigData(Y_COMP),
-                            m_encparams.Xl(), m_encparams.Yl());
-    m_mse_averageY[idx] += fmseY;
-    m_totalmse_averageY += fmseY;
+    ClipAndMeasure( enc_picture.Data(Y_COMP) , enc_picture.OrigData(Y_COMP),
+                    m_encparams.Xl(), m_encparams.Yl(),
+                    m_encparams.LumaDepth(), quality[Y_COMP] );
 
-    fmseU = QualityVal( enc_picture.Data(U_COMP) , enc_picture.OrigData(U_COMP),
-                            m_encparams.ChromaXl(),
-                            m_encparams.ChromaYl());
-    m_mse_averageU[idx] += fmseU;
-    m_totalmse_averageU += fmseU;
+    for (int c=U_COMP; c<=V_COMP; ++c)
+        ClipAndMeasure( enc_picture.Data((CompSort) c) , enc_picture.OrigData((CompSort) c),
+                        m_encparams.ChromaXl(), m_encparams.ChromaYl(),
+                        m_encparams.ChromaDepth(), quality[c] );
 
-    fmseV = QualityVal( enc_picture.Data(V_COMP) , enc_picture.OrigData(V_COMP),
-                            m_encparams.ChromaXl(),
-                            m_encparams.ChromaYl());
-    m_mse_averageV[idx] += fmseV;
-    m_totalmse_averageV += fmseV;
+    m_mse_averageY[idx] += quality[Y_COMP].mse;
+    m_totalmse_averageY += quality[Y_COMP].mse;
+    m_mse_averageU[idx] += quality[U_COMP].mse;
+    m_totalmse_averageU += quality[U_COMP].mse;
+    m_mse_averageV[idx] += quality[V_COMP].mse;
+    m_totalmse_averageV += quality[V_COMP].mse;
 
     m_picture_total[idx]++;
     m_allpicture_total++;
 
+    PictureStats& stats = enc_picture.Stats();
+    for (int c=0; c<3; ++c)
+    {
+        stats.SetPSNR( (CompSort) c, quality[c].psnr );
+        stats.SetSSIM( (CompSort) c, quality[c].ssim );
+        if ( quality[c].region_psnr.size()>1 )
+            stats.SetRegionQuality( (CompSort) c, m_encparams.QualityRegionsX(),
+                                    m_encparams.QualityRegionsY(),
+                                    quality[c].region_psnr, quality[c].region_ssim );
+
+        if ( quality[c].ssim>=0.0 )
+        {
+            m_total_ssim[c] += quality[c].ssim;
+            m_ssim_count[c]++;
+        }
+    }// c
+
     if (m_encparams.Verbose() )
     {
         std::cout<<std::endl<< (!m_encparams.FieldCoding() ? "Frame" : "Field");
-        std::cout << " PSNR: Y="<<10.0 * std::log10( Ymax*Ymax / fmseY );
-        std::cout<<", U="<<10.0 * std::log10( UVmax*UVmax / fmseU );
-        std::cout<<", V="<<10.0 * std::log10( UVmax*UVmax / fmseV );
+        std::cout << " PSNR: Y="<<stats.PSNR( Y_COMP );
+        std::cout<<", U="<<stats.PSNR( U_COMP );
+        std::cout<<", V="<<stats.PSNR( V_COMP );
+        std::cout<<std::endl<< (!m_encparams.FieldCoding() ? "Frame" : "Field");
+        std::cout << " SSIM: Y="<<stats.SSIM( Y_COMP );
+        std::cout<<", U="<<stats.SSIM( U_COMP );
+        std::cout<<", V="<<stats.SSIM( V_COMP );
     }
 
 }
 
 
-double QualityMonitor::QualityVal(const PicArray& coded_data,
-                                  const PicArray& orig_data,
-                                  const int xlen, const int ylen)
+void QualityMonitor::ClipAndMeasure( PicArray& coded_data ,
+                                     const PicArray& orig_data,
+                                     const int xlen,
+                                     const int ylen,
+                                     const int depth,
+                                     ComponentQuality& quality ) const
 {
-    long double sum_sq_diff = 0.0;
-    double diff;
-    for ( int j=0;j<ylen; ++j )
+    const QualityKernels kernels = SelectQualityKernels( ActiveCpuLevel() , depth );
+
+    const ValueType min_val = -( 1<<(depth-1) );
+    const ValueType max_val = ( 1<<(depth-1) )-1;
+    const double peak = double( (1<<depth)-1 );
+
+    const int coded_stride = coded_data.LengthX();
+    const int orig_stride = orig_data.LengthX();
+
+    // SSIM is measured over 8x8 windows spaced 4 apart, from the sums of
+    // 4x4 blocks
+    const int xblocks = xlen/4;
+    const int yblocks = ylen/4;
+
+    // Region boundaries lie on block boundaries, bar the last
+    const int xnum = std::max( 1 , m_encparams.QualityRegionsX() );
+    const int ynum = std::max( 1 , m_encparams.QualityRegionsY() );
+    std::vector<int> xbound( xnum+1 ), ybound( ynum+1 );
+    for (int r=0; r<xnum; ++r)
+        xbound[r] = 4*( (r*xblocks)/xnum );
+    xbound[xnum] = xlen;
+    for (int r=0; r<ynum; ++r)
+        ybound[r] = 4*( (r*yblocks)/ynum );
+    ybound[ynum] = ylen;
+
+    // The region row of each strip of 4 rows, and the region column of each block
+    const int num_strips = ( coded_data.LengthY()+3 )/4;
+    const int meas_strips = ( ylen+3 )/4;
+    std::vector<int> strip_region( meas_strips );
+    for (int s=0, r=0; s<meas_strips; ++s)
     {
-        for ( int i=0;i<xlen; ++i )
+        while ( r+1<ynum && 4*s>=ybound[r+1] )
+            ++r;
+        strip_region[s] = r;
+    }// s
+    std::vector<int> block_region( xblocks );
+    for (int b=0, r=0; b<xblocks; ++b)
+    {
+        while ( r+1<xnum && 4*b>=xbound[r+1] )
+            ++r;
+        block_region[b] = r;
+    }// b
+
+    std::vector<int64_t> strip_sse( meas_strips*xnum, 0 );
+    std::vector<int64_t> block_sums( 4*xblocks*yblocks );
+
+    // Clip each strip of rows, measuring the error as we go, then take the
+    // SSIM sums while the strip is still in the cache
+#pragma omp parallel for schedule(static)
+    for (int s=0; s<num_strips; ++s)
+    {
+        const int row_end = std::min( 4*s+4 , coded_data.LengthY() );
+        for (int j=4*s; j<row_end; ++j)
         {
-            diff = orig_data[j][i] - coded_data[j][i];
-            sum_sq_diff += diff*diff;
+            ValueType* coded_row = coded_data[j];
+            int i = 0;
 
-        }// i
-    }// j
+            if ( j<ylen )
+            {
+                const ValueType* orig_row = orig_data[j];
+                for (int r=0; r<xnum; ++r)
+                    strip_sse[s*xnum+r] += kernels.clip_sse_row( coded_row+xbound[r],
+                                                                 orig_row+xbound[r],
+                                                                 xbound[r+1]-xbound[r],
+                                                                 min_val, max_val );
+                i = xlen;
+            }
+
+            // Clip the padding
+            for ( ; i<coded_data.LengthX(); ++i)
+                coded_row[i] = std::max( min_val, std::min( max_val, coded_row[i] ) );
+        }// j
 
+        if ( s<yblocks )
+            kernels.ssim_sums_4x4( orig_data[4*s], orig_stride,
+                                   coded_data[4*s], coded_stride,
+                                   xblocks, &block_sums[4*s*xblocks] );
+    }// s
 
-    sum_sq_diff /= xlen*ylen;
+    // Combine the block sums into windows, by strip
+    const double offset = double( 1<<(depth-1) );
+    const double c1 = ( 0.01*peak )*( 0.01*peak );
+    const double c2 = ( 0.03*peak )*( 0.03*peak );
+    const int win_strips = std::max( 0 , yblocks-1 );
+    std::vector<double> strip_ssim( win_strips*xnum, 0.0 );
+    std::vector<int> region_windows( xnum, 0 );
+    for (int b=0; b+1<xblocks; ++b)
+        region_windows[block_region[b]]++;
 
-    return (double) sum_sq_diff;
+#pragma omp parallel for schedule(static)
+    for (int s=0; s<win_strips; ++s)
+    {
+        for (int b=0; b+1<xblocks; ++b)
+        {
+            const int64_t* top = &block_sums[4*( s*xblocks+b )];
+            const int64_t* bottom = top + 4*xblocks;
+            int64_t sums[4];
+            for (int k=0; k<4; ++k)
+                sums[k] = top[k] + top[4+k] + bottom[k] + bottom[4+k];
+
+            strip_ssim[s*xnum+block_region[b]] += SSIMFromSums( sums, offset, c1, c2 );
+        }// b
+    }// s
+
+    // Total the strips in order, so that the results don't depend on the threading
+    std::vector<int64_t> region_sse( xnum*ynum, 0 );
+    std::vector<double> region_ssim_sum( xnum*ynum, 0.0 );
+    std::vector<int> region_count( xnum*ynum, 0 );
+    int64_t total_sse( 0 );
+    double total_ssim( 0.0 );
+    int total_windows( 0 );
+
+    for (int s=0; s<meas_strips; ++s)
+    {
+        for (int r=0; r<xnum; ++r)
+        {
+            const int region = strip_region[s]*xnum + r;
+            region_sse[region] += strip_sse[s*xnum+r];
+            total_sse += strip_sse[s*xnum+r];
+
+            if ( s<win_strips )
+            {
+                region_ssim_sum[region] += strip_ssim[s*xnum+r];
+                region_count[region] += region_windows[r];
+                total_ssim += strip_ssim[s*xnum+r];
+                total_windows += region_windows[r];
+            }
+        }// r
+    }// s
+
+    quality.mse = double( total_sse )/( double( xlen )*ylen );
+    quality.psnr = PSNRFromSSE( total_sse, int64_t( xlen )*ylen, peak );
+    quality.ssim = total_windows>0 ? total_ssim/total_windows : -1.0;
+
+    quality.region_psnr.resize( xnum*ynum );
+    quality.region_ssim.resize( xnum*ynum );
+    for (int ry=0; ry<ynum; ++ry)
+    {
+        for (int rx=0; rx<xnum; ++rx)
+        {
+            const int region = ry*xnum + rx;
+            const int64_t num_samples = int64_t( xbound[rx+1]-xbound[rx] )*
+                                        ( ybound[ry+1]-ybound[ry] );
+            quality.region_psnr[region] = PSNRFromSSE( region_sse[region], num_samples, peak );
+            quality.region_ssim[region] = region_count[region]>0 ?
+                                          region_ssim_sum[region]/region_count[region] : -1.0;
+        }// rx
+    }// ry
 }
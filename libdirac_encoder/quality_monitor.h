@@ -39,11 +39,44 @@
 #define _QUALITY_MONITOR_H_
 
 #include <libdirac_common/common.h>
+#include <libdirac_common/cpu_dispatch.h>
 #include <libdirac_encoder/enc_picture.h>
 #include <libdirac_common/wavelet_utils.h>
 namespace dirac
 {
 
+    //! Quality measurement kernels, selected for an instruction set level
+    /*!
+        The kernels work on rows of coded data and the original data they
+        approximate. All sums are exact, so every version gives the same
+        results.
+    */
+    struct QualityKernels
+    {
+        //! Clips a row of coded data in place and returns its sum of squared differences from the original
+        int64_t (*clip_sse_row)( ValueType* coded , const ValueType* orig , const int length ,
+                                 const ValueType min_val , const ValueType max_val );
+
+        //! Calculates the SSIM sums of a row of 4x4 blocks
+        /*!
+            For each block, four sums are written to sums in turn: the sum
+            of the original values, the sum of the coded values, the sum of
+            the squares of both and the sum of their products.
+        */
+        void (*ssim_sums_4x4)( const ValueType* orig , const int orig_stride ,
+                               const ValueType* coded , const int coded_stride ,
+                               const int num_blocks , int64_t* sums );
+    };
+
+    //! Returns the quality measurement kernels for an instruction set level
+    /*!
+        \param  level  the instruction set level
+        \param  depth  the bit depth of the data. The vector kernels sum in
+                       32 bits, so the portable ones are returned for depths
+                       above 13.
+    */
+    QualityKernels SelectQualityKernels( const CpuLevel level , const int depth );
+
     //! Class to monitor the quality of pictures and adjust coding parameters appropriately
     class QualityMonitor
     {
@@ -65,12 +98,15 @@ namespace dirac
         //                 and destructor                         //
         ////////////////////////////////////////////////////////////
 
-        //! Update the mse factors, returning true if we need to recode
+        //! Clip a coded picture and measure its quality
         /*!
-            Update the mse factors, returning true if we need to recode
+            Clips the coded picture data to its range, in the same pass as
+            measuring its PSNR and SSIM against the original, overall and
+            in each region. The values are recorded in the picture's
+            statistics and added to the averages for the log.
             \param enc_picture the picture being encoded
         */
-        void UpdateModel(const EncPicture& enc_picture );
+        void UpdateModel( EncPicture& enc_picture );
 
         //! Reset the quality factors (say if there's been a cut)
         void ResetAll();
@@ -79,14 +115,30 @@ namespace dirac
         void WriteLog();
 
     private:
-        //functions
+        //! The quality of a coded component, overall and in each region
+        struct ComponentQuality
+        {
+            //! The mean squared error
+            double mse;
+            //! The PSNR in dB
+            double psnr;
+            //! The mean SSIM, or -1 if the component is too small to measure
+            double ssim;
+            //! The PSNR of each region, in raster order
+            std::vector<double> region_psnr;
+            //! The mean SSIM of each region, in raster order
+            std::vector<double> region_ssim;
+        };
 
+        //functions
 
-        //! Calculate the quality of coded wrt original picture
-        double QualityVal( const PicArray& coded_data , 
-                           const PicArray& orig_data,
-                           const int xlen,
-                           const int ylen);
+        //! Clip a coded component and measure its quality against the original
+        void ClipAndMeasure( PicArray& coded_data ,
+                             const PicArray& orig_data,
+                             const int xlen,
+                             const int ylen,
+                             const int depth,
+                             ComponentQuality& quality ) const;
 
         //member variables//
         ////////////////////
@@ -117,6 +169,12 @@ namespace dirac
 
         //! The number of pictures of each type  
         OneDArray<int> m_picture_total;
+
+        //! The overall totals of the Y, U and V SSIM
+        double m_total_ssim[3];
+
+        //! The number of pictures whose Y, U and V SSIM has been measured
+        int m_ssim_count[3];
     };
 
 } // namespace dirac
@@ -73,13 +73,121 @@ allocation procedure is employed and target bit rates for each sub-group are
 calculated by using the allocated bits to each frame types. The modified version
 of TM5 bit allocation procedure is implemented in Allocate ( , ) function at the
 rate_control.cpp.
+
+If a decoder buffer size is given, a leaky-bucket (VBV) model of the decoder
+buffer is also kept, picture by picture. The buffer fills at the target rate
+and each picture is removed in one go when it is decoded. Before a coded picture
+is output, the sequence compressor checks it against the most bits it can use.
+This is the smaller of what is in the buffer now and what would leave enough
+for the pictures already queued behind it, as projected from the last
+picture of each type. If it is too big, it is recoded with a lower QF, so
+the buffer never underflows and the decoder never stalls.
+
+Two-pass encoding replaces all this with a global allocation. The first pass
+records a complexity C for each picture (FirstPassStats). In the second pass
+the bits for a picture are modelled as
+
+R = A*C*10^(QF/5)
+
+with a model parameter A for each picture type, consistent with the
+relationship above. A single QF is chosen for the rest of the sequence, so
+that the modelled bits for all the pictures still to be coded use up what is
+left of the budget. A is re-estimated from each picture coded and QF
+recalculated, moving by at most 1 per picture.
 */
 
 
 #include <math.h>
+#include <fstream>
+#include <sstream>
 #include <libdirac_encoder/rate_control.h>
+#include <libdirac_common/dirac_exception.h>
 using namespace dirac;
 
+void FirstPassStats::SetPicture( const PictureParams& pparams , const double complexity )
+{
+    const int pnum = pparams.PictureNum();
+
+    if ( pnum>=NumPictures() )
+    {
+        m_type.resize( pnum+1 , -1 );
+        m_complexity.resize( pnum+1 , 0.0 );
+    }
+
+    m_type[pnum] = PictureType( pparams );
+    m_complexity[pnum] = complexity;
+}
+
+FirstPassStats::PicType FirstPassStats::PictureType( const PictureParams& pparams )
+{
+    if ( pparams.PicSort().IsIntra() )
+        return I_PIC;
+    else if ( pparams.IsBPicture() )
+        return L2_PIC;
+    else
+        return L1_PIC;
+}
+
+bool FirstPassStats::Write( const std::string& filename ) const
+{
+    std::ofstream out( filename.c_str() );
+    const char* type_names[NUM_PIC_TYPES] = { "I" , "L1" , "L2" };
+
+    out<<"# Dirac first-pass statistics: picture type complexity"<<std::endl;
+    for ( int pnum=0 ; pnum<NumPictures() ; ++pnum )
+    {
+        if ( m_type[pnum]>=0 )
+            out<<pnum<<" "<<type_names[m_type[pnum]]<<" "<<m_complexity[pnum]<<std::endl;
+    }
+
+    return out.good();
+}
+
+bool FirstPassStats::Read( const std::string& filename )
+{
+    std::ifstream in( filename.c_str() );
+    if ( !in )
+        return false;
+
+    m_type.clear();
+    m_complexity.clear();
+
+    std::string line;
+    while ( std::getline( in , line ) )
+    {
+        if ( line.empty() || line[0]=='#' )
+            continue;
+
+        std::istringstream fields( line );
+        int pnum;
+        std::string type_name;
+        double complexity;
+
+        if ( !( fields>>pnum>>type_name>>complexity ) || pnum<0 || complexity<0.0 )
+            return false;
+
+        int type;
+        if ( type_name=="I" )
+            type = I_PIC;
+        else if ( type_name=="L1" )
+            type = L1_PIC;
+        else if ( type_name=="L2" )
+            type = L2_PIC;
+        else
+            return false;
+
+        if ( pnum>=NumPictures() )
+        {
+            m_type.resize( pnum+1 , -1 );
+            m_complexity.resize( pnum+1 , 0.0 );
+        }
+        m_type[pnum] = type;
+        m_complexity[pnum] = complexity;
+    }
+
+    return NumPictures()>0;
+}
+
 //Default constructor
 FrameComplexity::FrameComplexity():
     m_XI(169784),
@@ -93,16 +201,27 @@ RateController::RateController(int trate, SourceParams& srcp, EncoderParams& enc
     m_I_qf (encp.Qf()),
     m_I_qf_long_term(encp.Qf()),
     m_target_rate(trate),
-    m_buffer_size(5000*trate),// for the moment, set buffer size to 5 seconds
-    m_buffer_bits((m_buffer_size*9)/10),// initial occupancy of 90%
+    // unless a decoder buffer is given, set buffer size to 5 seconds
+    m_buffer_size( encp.VBVSize()>0 ? 1000L*encp.VBVSize() : 5000*trate ),
+    // initial occupancy of 90% unless a delay is given
+    m_buffer_bits( encp.VBVDelay()>0 ? (long int)encp.VBVDelay()*trate : (m_buffer_size*9)/10 ),
     m_encparams(encp),
     m_fcount(encp.L1Sep() ),
     m_intra_only(false),
-    m_L2_complexity_sum(0)
+    m_L2_complexity_sum(0),
+    m_two_pass( encp.RCPass()==2 ),
+    m_bits_left(0.0),
+    m_vbv_size( 1000.0*encp.VBVSize() )
 {
     SetFrameDistribution();
     CalcTotalBits(srcp);
 
+    if (m_two_pass)
+        InitTwoPass(srcp);
+
+    if (VBVEnabled())
+        InitVBV(srcp);
+
     if (m_intra_only)
         m_Iframe_bits = m_total_GOP_bits;
     else
@@ -167,6 +286,13 @@ void RateController::Report()
 {
 
     std::cout<<std::endl;
+    if (m_two_pass)
+    {
+        std::cout<<std::endl<<"Two-pass: "<<m_bits_left<<" bits left, QF = "<<m_qf;
+        std::cout<<std::endl;
+        return;
+    }
+
     std::cout<<std::endl<<"GOP target is "<<m_GOP_target;
     std::cout<<std::endl<<"Allocated frame bits by type: ";
     std::cout<<"I frames - "<<m_Iframe_bits;
@@ -193,6 +319,12 @@ double RateController::ProjectedSubgroupRate()
 }
 void RateController::CalcNextQualFactor(const PictureParams& pparams, int num_bits)
 {
+    if (m_two_pass)
+    {
+        UpdateBuffer( num_bits );
+        CalcTwoPassQualFactor( pparams , num_bits );
+        return;
+    }
 
     // Decrement the subgroup frame counter. This is zero just after the last
     // L2 frame before the next L1 frame i.e. before the start of an L1L2L2
@@ -514,6 +646,10 @@ float RateController::ClipQualityFactor( const float qfac )
 
 void RateController::CalcNextIntraQualFactor()
 {
+    // In the second pass, all pictures use the global QF
+    if (m_two_pass)
+        return;
+
     m_I_qf = (m_I_qf + m_qf)/2.0;
     m_I_qf = ClipQualityFactor( m_I_qf );
     m_encparams.SetQf(m_I_qf);
@@ -525,6 +661,229 @@ void RateController::CalcNextIntraQualFactor()
 
 void RateController::SetCutPictureQualFactor()
 {
+    if (m_two_pass)
+        return;
+
     m_qf = std::min( m_qf , m_I_qf_long_term );
     m_encparams.SetQf( m_qf );
 }
+
+void RateController::InitTwoPass( const SourceParams& sourceparams )
+{
+    const std::string& filename = m_encparams.RCStatsFile();
+
+    if ( !m_pass1_stats.Read( filename ) )
+    {
+        DIRAC_THROW_EXCEPTION(
+            ERR_INVALID_INIT_DATA,
+            "Could not read two-pass statistics from " + filename,
+            SEVERITY_TERMINATE);
+    }
+
+    const int num_pics = m_pass1_stats.NumPictures();
+    m_pic_coded.assign( num_pics , false );
+
+    for ( int t=0 ; t<FirstPassStats::NUM_PIC_TYPES ; ++t )
+    {
+        m_complexity_left[t] = 0.0;
+        m_model_bits[t] = 0.0;
+        m_model_complexity[t] = 0.0;
+    }
+
+    for ( int pnum=0 ; pnum<num_pics ; ++pnum )
+    {
+        if ( m_pass1_stats.Type( pnum )>=0 )
+            m_complexity_left[m_pass1_stats.Type( pnum )] += m_pass1_stats.Complexity( pnum );
+    }
+
+    // The budget for the whole sequence
+    const Rational& frame_rate = sourceparams.FrameRate();
+    const double f_rate = double(frame_rate.m_num)/double(frame_rate.m_denom);
+    const int field_factor = m_encparams.FieldCoding() ? 2 : 1;
+
+    m_bits_left = 1000.0*m_target_rate*double(num_pics)/(field_factor*f_rate);
+
+    if (m_encparams.Verbose())
+    {
+        std::cout<<"Two-pass encoding of "<<num_pics<<" pictures with statistics from ";
+        std::cout<<filename<<std::endl;
+        std::cout<<"Total Allocated Num. of bits = "<<m_bits_left<<std::endl;
+    }
+}
+
+double RateController::TwoPassModel( const int type ) const
+{
+    // Use the nearest type with a model if this one hasn't been coded yet
+    for ( int t=type ; t>=0 ; --t )
+    {
+        if ( m_model_complexity[t]>0.0 )
+            return m_model_bits[t]/m_model_complexity[t];
+    }
+    for ( int t=type+1 ; t<FirstPassStats::NUM_PIC_TYPES ; ++t )
+    {
+        if ( m_model_complexity[t]>0.0 )
+            return m_model_bits[t]/m_model_complexity[t];
+    }
+
+    return 0.0;
+}
+
+void RateController::CalcTwoPassQualFactor( const PictureParams& pparams , const int num_bits )
+{
+    m_bits_left -= num_bits;
+
+    // With field coding, the bits are for both fields of a frame
+    const int last_pnum = pparams.PictureNum();
+    const int first_pnum = m_encparams.FieldCoding() ? last_pnum-1 : last_pnum;
+
+    double complexity( 0.0 );
+    bool same_type( true );
+    const int pic_type = FirstPassStats::PictureType( pparams );
+
+    for ( int pnum=std::max( first_pnum , 0 ) ; pnum<=last_pnum ; ++pnum )
+    {
+        if ( pnum<m_pass1_stats.NumPictures() && !m_pic_coded[pnum] &&
+             m_pass1_stats.Type( pnum )>=0 )
+        {
+            m_pic_coded[pnum] = true;
+            m_complexity_left[m_pass1_stats.Type( pnum )] -= m_pass1_stats.Complexity( pnum );
+            complexity += m_pass1_stats.Complexity( pnum );
+            same_type = same_type && m_pass1_stats.Type( pnum )==pic_type;
+        }
+    }
+
+    // Update the model, unless the picture type has changed since the
+    // first pass, as the complexity is then of the wrong sort
+    if ( same_type && complexity>0.0 )
+    {
+        const double ff = 0.9;
+        m_model_bits[pic_type] = ff*m_model_bits[pic_type] + num_bits;
+        m_model_complexity[pic_type] = ff*m_model_complexity[pic_type] +
+                                       complexity*std::pow( 10.0 , m_encparams.Qf()/5.0 );
+    }
+
+    // The modelled bits for the rest of the sequence at QF 0
+    double model_bits( 0.0 );
+    for ( int t=0 ; t<FirstPassStats::NUM_PIC_TYPES ; ++t )
+    {
+        if ( m_complexity_left[t]>0.0 )
+            model_bits += TwoPassModel( t )*m_complexity_left[t];
+    }
+
+    if ( model_bits<=0.0 )
+        return;
+
+    double new_qf;
+    if ( m_bits_left>0.0 )
+        new_qf = 5.0*std::log10( m_bits_left/model_bits );
+    else
+        new_qf = m_qf-1.0;
+
+    // Move steadily, to keep the quality even
+    m_qf = std::min( std::max( new_qf , m_qf-1.0 ) , m_qf+1.0 );
+    m_qf = ClipQualityFactor( m_qf );
+
+    if (m_encparams.Verbose())
+    {
+        std::cout<<std::endl<<"Two-pass: "<<m_bits_left<<" bits left, ";
+        std::cout<<"QF for the rest of the sequence = "<<new_qf;
+    }
+
+    m_encparams.SetQf( m_qf );
+}
+
+void RateController::InitVBV( const SourceParams& sourceparams )
+{
+    const Rational& frame_rate = sourceparams.FrameRate();
+    const double f_rate = double(frame_rate.m_num)/double(frame_rate.m_denom);
+    const int field_factor = m_encparams.FieldCoding() ? 2 : 1;
+
+    m_vbv_picture_bits = 1000.0*m_target_rate/(field_factor*f_rate);
+    m_vbv_bits = double( m_buffer_bits );
+
+    for ( int t=0 ; t<FirstPassStats::NUM_PIC_TYPES ; ++t )
+        m_vbv_last_bits[t] = 0;
+
+    if (m_encparams.Verbose())
+    {
+        std::cout<<"Decoder buffer size = "<<m_vbv_size<<" bits, initial occupancy = ";
+        std::cout<<m_vbv_bits<<" bits"<<std::endl;
+    }
+}
+
+long int RateController::ProjectedPictureBits( const PictureParams& pparams ) const
+{
+    // Queued pictures are checked in turn when they're coded, so don't
+    // try to guess their QF: just assume they'll be like the last one
+    return m_vbv_last_bits[FirstPassStats::PictureType( pparams )];
+}
+
+long int RateController::VBVMaxPictureBits( const long int num_bits ,
+                                            const std::vector<long int>& pending_bits ) const
+{
+    // The picture must be in the buffer when it's decoded ...
+    double max_bits = m_vbv_bits;
+
+    // ... and leave enough for each of the pictures queued behind it. If
+    // they can't all fit, it need only give up its share, as the others
+    // will be checked in turn
+    double bits_in = m_vbv_bits;
+    double pending_sum = 0.0;
+    for ( size_t k=0 ; k<pending_bits.size() ; ++k )
+    {
+        bits_in += m_vbv_picture_bits;
+        pending_sum += pending_bits[k];
+
+        const double share = bits_in*num_bits/( num_bits+pending_sum );
+        max_bits = std::min( max_bits , std::max( bits_in-pending_sum , share ) );
+    }
+
+    return (long int)( max_bits );
+}
+
+double RateController::VBVRecodeQualFactor( const long int num_bits , const long int max_bits )
+{
+    // Aim a little under the limit, and always come down at least a bit
+    const double target = 0.9*std::max( max_bits , 1L );
+    double qf = m_encparams.Qf() + 5.0*std::log10( target/num_bits );
+
+    qf = std::min( qf , m_encparams.Qf()-0.5 );
+
+    return ClipQualityFactor( qf );
+}
+
+void RateController::UpdateVBV( const PictureParams& pparams , const long int num_bits )
+{
+    m_vbv_last_bits[FirstPassStats::PictureType( pparams )] = num_bits;
+
+    m_vbv_bits -= num_bits;
+
+    if ( m_vbv_bits<0.0 )
+    {
+        // The decoder has to wait for the rest of the picture
+        if (m_encparams.Verbose())
+            std::cout<<std::endl<<"WARNING: decoder buffer underflow of "<<-m_vbv_bits<<" bits";
+        m_vbv_bits = 0.0;
+    }
+
+    m_vbv_bits += m_vbv_picture_bits;
+
+    if ( m_vbv_bits>m_vbv_size )
+    {
+        // The encoder has to stuff bits to keep the rate constant
+        if (m_encparams.Verbose())
+            std::cout<<std::endl<<"Decoder buffer full: "<<m_vbv_bits-m_vbv_size<<" bits of stuffing";
+        m_vbv_bits = m_vbv_size;
+    }
+
+    if (m_encparams.Verbose())
+        std::cout<<std::endl<<"Decoder buffer occupancy = "<<m_vbv_bits*100.0/m_vbv_size<<"%";
+}
+
+double RateController::BufferFill() const
+{
+    if ( VBVEnabled() )
+        return m_vbv_bits/m_vbv_size;
+
+    return double( m_buffer_bits )/double( m_buffer_size );
+}
@@ -46,6 +46,8 @@
 #define _RATE_CONTROL_H_
 
 #include <libdirac_common/common.h>
+#include <string>
+#include <vector>
 
 namespace dirac
 {
@@ -87,6 +89,52 @@ namespace dirac
     };
 
 
+    //! Picture statistics passed from the first pass of a two-pass encode to the second
+    /*!
+        The first pass records the type of each picture and a complexity:
+        the mean cost per sample estimated by the lookahead, intra for I
+        pictures and the lower of intra and inter otherwise. The second
+        pass reads them back to allocate bits over the whole sequence.
+    */
+    class FirstPassStats
+    {
+    public:
+        //! The picture types that rate control distinguishes
+        enum PicType { I_PIC=0 , L1_PIC , L2_PIC , NUM_PIC_TYPES };
+
+        //! Default constructor: no pictures
+        FirstPassStats(){}
+
+        //! Record the type and complexity of a picture
+        void SetPicture( const PictureParams& pparams , const double complexity );
+
+        //! Write the statistics to a file, returning false on failure
+        bool Write( const std::string& filename ) const;
+
+        //! Read the statistics from a file, returning false on failure
+        bool Read( const std::string& filename );
+
+        //! Return the number of pictures, including any not recorded
+        int NumPictures() const { return m_type.size(); }
+
+        //! Return the type of a picture, or -1 if it wasn't recorded
+        int Type( const int pnum ) const { return m_type[pnum]; }
+
+        //! Return the complexity of a picture
+        double Complexity( const int pnum ) const { return m_complexity[pnum]; }
+
+        //! Return the rate control type of a picture
+        static PicType PictureType( const PictureParams& pparams );
+
+    private:
+        //! The picture types, in display order
+        std::vector<int> m_type;
+
+        //! The picture complexities, in display order
+        std::vector<double> m_complexity;
+    };
+
+
     //! A clas for allocation the bits to each and every types of frames in a GOP
     class RateController
     {
@@ -114,6 +162,38 @@ namespace dirac
         //! Report the allocation to picture types
         void Report();
 
+        //! Return true if the decoder buffer is constrained
+        bool VBVEnabled() const {return m_vbv_size>0.0;}
+
+        //! Return the decoder buffer occupancy as a proportion of its size
+        double BufferFill() const;
+
+        //! Return the projected number of bits for a queued picture
+        /*!
+            Projects from the last picture coded of the same type, or returns
+            0 if there hasn't been one yet.
+        */
+        long int ProjectedPictureBits( const PictureParams& pparams ) const;
+
+        //! Return the most bits the next picture can use without the decoder buffer underflowing
+        /*!
+            \param num_bits      the bits the next picture uses as first coded
+            \param pending_bits  the projected bits for the pictures queued
+                                 behind the next one, in coding order
+        */
+        long int VBVMaxPictureBits( const long int num_bits ,
+                                    const std::vector<long int>& pending_bits ) const;
+
+        //! Return a lower quality factor with which to recode a picture that is too big
+        /*!
+            \param num_bits  the bits the picture used
+            \param max_bits  the most bits the picture can use
+        */
+        double VBVRecodeQualFactor( const long int num_bits , const long int max_bits );
+
+        //! Remove a coded picture from the decoder buffer model
+        void UpdateVBV( const PictureParams& pparams , const long int num_bits );
+
 
     private:
 
@@ -142,6 +222,18 @@ namespace dirac
         //! Update the internal decoder buffer model
         void UpdateBuffer( const long int num_bits );
 
+        //! Read the first-pass statistics and set the bit budget for the second pass
+        void InitTwoPass( const SourceParams& sourceparams );
+
+        //! Calculate the quality factor for the rest of the sequence in the second pass
+        void CalcTwoPassQualFactor( const PictureParams& pparams , const int num_bits );
+
+        //! Return the bits per unit of complexity at QF 0 for a picture type
+        double TwoPassModel( const int type ) const;
+
+        //! Set up the decoder buffer model
+        void InitVBV( const SourceParams& sourceparams );
+
 
     private:
 
@@ -214,6 +306,39 @@ namespace dirac
         // Sum of complexity of L2 frames
         int m_L2_complexity_sum;
 
+        //! True if this is the second pass of a two-pass encode
+        const bool m_two_pass;
+
+        //! The statistics from the first pass
+        FirstPassStats m_pass1_stats;
+
+        //! Flags for the pictures coded so far in the second pass
+        std::vector<bool> m_pic_coded;
+
+        //! The bits left for the rest of the sequence
+        double m_bits_left;
+
+        //! The total complexity of the pictures still to code, by type
+        double m_complexity_left[FirstPassStats::NUM_PIC_TYPES];
+
+        //! Decaying sums of coded bits for the rate model, by type
+        double m_model_bits[FirstPassStats::NUM_PIC_TYPES];
+
+        //! Decaying sums of complexity scaled by 10^(QF/5), by type
+        double m_model_complexity[FirstPassStats::NUM_PIC_TYPES];
+
+        //! Decoder buffer size in bits, or 0 if not constrained
+        const double m_vbv_size;
+
+        //! Decoder buffer occupancy when the next picture is removed
+        double m_vbv_bits;
+
+        //! Bits entering the decoder buffer in each picture period
+        double m_vbv_picture_bits;
+
+        //! Bits used by the last picture coded of each type
+        long int m_vbv_last_bits[FirstPassStats::NUM_PIC_TYPES];
+
     };
 
 
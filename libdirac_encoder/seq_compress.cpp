@@ -41,6 +41,7 @@
 
 #include <libdirac_encoder/seq_compress.h>
 #include <libdirac_encoder/prefilter.h>
+#include <libdirac_common/dirac_exception.h>
 
 using namespace dirac;
 
@@ -66,6 +67,7 @@ SequenceCompressor::SequenceCompressor( StreamPicInput* pin ,
     m_delay(1),
     m_qmonitor( m_encparams ),
     m_pcoder( m_encparams ),
+    m_lookahead( m_encparams ),
     m_dirac_byte_stream(dirac_byte_stream),
     m_eos_signalled(false)
 {
@@ -191,6 +193,33 @@ bool SequenceCompressor::CanEncode()
     return false;
 }
 
+bool SequenceCompressor::InsertLookaheadCut( EncPicture& enc_pic )
+{
+    PictureParams& pparams = enc_pic.GetPparams();
+
+    if ( !enc_pic.IsSceneCut() || pparams.PicSort().IsIntra() )
+        return false;
+
+    const int field_factor = m_encparams.FieldCoding() ? 2 : 1;
+
+    if ( m_encparams.L1Sep()>1 &&
+         (pparams.PictureNum() % (field_factor*m_encparams.L1Sep())) == 0)
+        m_gop_start_num = pparams.PictureNum();//restart the GOP
+
+    if ( pparams.PicSort().IsRef() )
+        enc_pic.SetPictureSort( PictureSort::IntraRefPictureSort() );
+    else
+        enc_pic.SetPictureSort( PictureSort::IntraNonRefPictureSort() );
+
+    enc_pic.UpdateStatus( DONE_CUT_INSERT );
+
+    if ( m_encparams.Verbose() )
+        std::cout<<std::endl<<"Cut found by lookahead at picture "
+                 <<pparams.PictureNum()<<" and I-picture inserted!";
+
+    return true;
+}
+
 const EncPicture* SequenceCompressor::CompressNextPicture()
 {
 
@@ -242,12 +271,36 @@ const EncPicture* SequenceCompressor::CompressNextPicture()
                 if ((m_encparams.NumL1() == 0) || pparams.PictureNum() < m_current_display_pnum + m_encparams.L1Sep() ){
                     SetPicTypeAndRefs( pparams );
                     enc_pic.UpdateStatus( DONE_SET_PTYPE );
+                    InsertLookaheadCut( enc_pic );
                 }
             }
         }
 
         /* Do motion estimation and compensation if inter*/
-        bool is_a_cut( false );
+        bool is_a_cut( ( current_pic->GetStatus() & DONE_CUT_INSERT ) != 0 );
+
+        // In the first pass of a two-pass encode, just record the picture
+        // type and the lookahead complexity, without ME or coding
+        if ( m_encparams.RCPass()==1 ){
+            double complexity = current_pic->LookaheadIntraCost();
+            if ( current_pp->PicSort().IsInter() )
+                complexity = std::min( complexity, current_pic->LookaheadInterCost() );
+            m_first_pass_stats.SetPicture( *current_pp, complexity );
+
+            if ( current_pp->PicSort().IsRef()==true )
+                m_enc_pbuffer.SetRetiredPictureNum( m_show_pnum, m_current_display_pnum );
+
+            m_current_code_pnum++;
+
+            CleanBuffers();
+
+            current_pic->SetStatus( ALL_ENC );
+
+            if ( m_enc_pbuffer.GetPicture(m_show_pnum).GetStatus() == ALL_ENC )
+                return &m_enc_pbuffer.GetPicture(m_show_pnum );
+            else
+                return NULL;
+        }
 
         //2. Set up block sizes etc
         SetMotionParameters();
@@ -325,6 +378,7 @@ const EncPicture* SequenceCompressor::CompressNextPicture()
 
                         SetPicTypeAndRefs( pparams );
                         enc_pic.UpdateStatus( DONE_SET_PTYPE );
+                        InsertLookaheadCut( enc_pic );
                     }
                     current_pic->SetStatus( DONE_SET_PTYPE );
 
@@ -337,8 +391,11 @@ const EncPicture* SequenceCompressor::CompressNextPicture()
 
             }while(subgroup_reconfig==true);
 
-            //11. Do cut detection and insert intra pictures
-            if ( current_pic->GetMEData().IntraBlockRatio()>0.3333 ){
+            //11. Do cut detection and insert intra pictures, unless the
+            // lookahead has already made the (new) current picture intra
+            if ( current_pp->PicSort().IsIntra() )
+                is_a_cut = true;
+            else if ( current_pic->GetMEData().IntraBlockRatio()>0.3333 ){
                 is_a_cut = true;
                 if ( m_encparams.L1Sep()>1 &&
                  (m_current_display_pnum % (field_factor*m_encparams.L1Sep())) == 0){
@@ -406,8 +463,11 @@ const EncPicture* SequenceCompressor::CompressNextPicture()
                 std::cout<<std::endl<<std::endl<<"Compressing frame "<<m_current_code_pnum<<", ";
             std::cout<<m_current_display_pnum<<" in display order";
 
-            if (is_a_cut==true || current_pp->PicSort().IsIntra()==false )
+            if ( (current_pic->GetStatus() & DONE_ME_INIT) != 0 )
                 std::cout<<std::endl<<current_pic->GetMEData().IntraBlockRatio()*100.0<<"% of blocks are intra   ";
+            if ( (current_pic->GetStatus() & DONE_CUT_INSERT) != 0 )
+                std::cout<<std::endl<<"Lookahead intra cost "<<current_pic->LookaheadIntraCost()
+                         <<", inter cost "<<current_pic->LookaheadInterCost();
             if (is_a_cut==true)
                 std::cout<<std::endl<<"Cut detected and intra picture inserted.";
 
@@ -430,9 +490,13 @@ const EncPicture* SequenceCompressor::CompressNextPicture()
             }
         }
 
+        current_pic->Stats().Clear();
+
         // 14. Code the motion vectors
-        if ( current_pp->PicSort().IsInter() )
+        if ( current_pp->PicSort().IsInter() ){
             m_pcoder.CodeMVData(m_enc_pbuffer , m_current_display_pnum, p_picture_byteio);
+            current_pic->Stats().SetMotionStats( current_pic->GetMEData() );
+        }
 
         // 15. Do prefiltering on the residue if necessary
         if (m_encparams.Prefilter() != NO_PF )
@@ -446,14 +510,25 @@ const EncPicture* SequenceCompressor::CompressNextPicture()
         // 18. Code the residue
         m_pcoder.CodeResidue(m_enc_pbuffer , m_current_display_pnum, p_picture_byteio);
 
+        // Make sure the picture fits in the decoder buffer
+        const bool vbv_check( m_encparams.TargetRate()!=0 && m_ratecontrol->VBVEnabled() );
+        bool recoded( false );
+        if ( vbv_check ){
+            const double coded_qf( m_encparams.Qf() );
+            p_picture_byteio = VBVRecodePicture( p_picture_byteio );
+            recoded = ( m_encparams.Qf()!=coded_qf );
+        }
+
         const PictureSort& psort = current_pp->PicSort();
 
         /* All coding is done - so output and reconstruct */
 
         m_dirac_byte_stream.AddPicture(p_picture_byteio);
 
-        // 19. Do the inverse DWT if necessary
-        m_pcoder.DoDWT( m_enc_pbuffer, m_current_display_pnum , BACKWARD);
+        // 19. Do the inverse DWT if necessary. Lossless coding reconstructs
+        // the coefficients exactly, so the residue is still in place
+        if ( !m_encparams.Lossless() )
+            m_pcoder.DoDWT( m_enc_pbuffer, m_current_display_pnum , BACKWARD);
 
 
         // 20. Motion compensate back if necessary
@@ -463,16 +538,24 @@ const EncPicture* SequenceCompressor::CompressNextPicture()
         // Reset block sizes for next picture
         m_predparams.SetBlockSizes(*m_basic_olb_params2, m_srcparams.CFormat() );
 
-        // 21. Clip the data to keep it in range
-        current_pic->Clip();
+        // 21. Clip the data to keep it in range, measuring the encoded
+        // picture quality in the same pass if it's wanted
+        if ( m_encparams.LocalDecode() || m_encparams.CollectStats() )
+            m_qmonitor.UpdateModel( *current_pic );
+        else
+            current_pic->Clip();
 
         // Use the results of encoding to update the CBR model
-        if (m_encparams.TargetRate() != 0 )
-        UpdateCBRModel(*current_pic, p_picture_byteio);
+        if ( vbv_check )
+            m_ratecontrol->UpdateVBV( *current_pp , p_picture_byteio->GetSize()*8 );
+        if (m_encparams.TargetRate() != 0 ){
+            UpdateCBRModel(*current_pic, p_picture_byteio);
+            current_pic->Stats().SetBufferFill( m_ratecontrol->BufferFill() );
+        }
 
-        // 22. Measure the encoded picture quality
-        if ( m_encparams.LocalDecode() )
-            m_qmonitor.UpdateModel( *current_pic );
+        // Don't let a recode change the QF for subsequent pictures
+        if ( recoded )
+            m_encparams.SetQf( m_ratecontrol->QualFactor() );
 
         // Increment our position
         m_current_code_pnum++;
@@ -498,6 +581,67 @@ const EncPicture* SequenceCompressor::CompressNextPicture()
 
 
 
+long int SequenceCompressor::VBVMaxPictureBits( const long int num_bits )
+{
+    // Project the bits for the pictures queued behind this one, in coding order
+    std::vector<long int> pending_bits;
+
+    for ( int cnum=m_current_code_pnum+1 ; cnum<=m_last_picture_read ; ++cnum )
+    {
+        const int pnum = CodedToDisplay( cnum );
+
+        if ( pnum==m_current_display_pnum || !m_enc_pbuffer.IsPictureAvail( pnum ) )
+            break;
+
+        pending_bits.push_back( m_ratecontrol->ProjectedPictureBits(
+                                    m_enc_pbuffer.GetPicture( pnum ).GetPparams() ) );
+    }
+
+    return m_ratecontrol->VBVMaxPictureBits( num_bits, pending_bits );
+}
+
+PictureByteIO* SequenceCompressor::VBVRecodePicture( PictureByteIO* p_picture_byteio )
+{
+    PictureParams& pparams = m_enc_pbuffer.GetPicture( m_current_display_pnum ).GetPparams();
+    const long int max_bits = VBVMaxPictureBits( p_picture_byteio->GetSize()*8 );
+
+    for ( int attempt=0 ; attempt<3 ; ++attempt )
+    {
+        const long int num_bits = p_picture_byteio->GetSize()*8;
+
+        if ( num_bits<=max_bits || m_encparams.Qf()<=0.0 )
+            break;
+
+        const double qf = m_ratecontrol->VBVRecodeQualFactor( num_bits, max_bits );
+
+        if ( m_encparams.Verbose() ){
+            std::cout<<std::endl<<num_bits<<" bits would overrun the decoder buffer ("<<max_bits;
+            std::cout<<" available): recoding with QF "<<qf;
+        }
+        m_encparams.SetQf( qf );
+
+        // The residue is still in place, so just code it again
+        delete p_picture_byteio;
+        p_picture_byteio = new PictureByteIO( pparams, m_current_display_pnum );
+        p_picture_byteio->Output();
+
+        if ( pparams.PicSort().IsInter() )
+            m_pcoder.CodeMVData( m_enc_pbuffer , m_current_display_pnum, p_picture_byteio );
+
+        m_pcoder.DoDWT( m_enc_pbuffer, m_current_display_pnum , FORWARD );
+        m_pcoder.CodeResidue( m_enc_pbuffer , m_current_display_pnum, p_picture_byteio );
+    }
+
+    return p_picture_byteio;
+}
+
+bool SequenceCompressor::UsingLookahead() const
+{
+    // Intra-only coding has no cuts to find, and only the first pass of a
+    // two-pass encode needs the complexities
+    return m_encparams.NumL1()!=0 || m_encparams.RCPass()==1;
+}
+
 void SequenceCompressor::CleanBuffers()
 {
     // If we're not at the beginning, clean the buffer
@@ -519,6 +663,26 @@ DiracByteStats SequenceCompressor::EndSequence()
 
     if (m_just_finished)
     {
+        if ( m_encparams.RCPass()==1 )
+        {
+            // The first pass produces no output, so the pictures still in
+            // the queue haven't been flushed out yet
+            int last_code_pnum;
+            do
+            {
+                last_code_pnum = m_current_code_pnum;
+                CompressNextPicture();
+            } while ( m_current_code_pnum!=last_code_pnum );
+
+            if ( !m_first_pass_stats.Write( m_encparams.RCStatsFile() ) )
+            {
+                DIRAC_THROW_EXCEPTION(
+                    ERR_INVALID_INIT_DATA,
+                    "Could not write two-pass statistics to " + m_encparams.RCStatsFile(),
+                    SEVERITY_TERMINATE);
+            }
+        }
+
         seq_stats=m_dirac_byte_stream.EndSequence();
         m_just_finished = false;
         m_all_done = true;
@@ -656,6 +820,9 @@ bool FrameSequenceCompressor::LoadNextFrame()
         return false;
     }
 
+    if ( UsingLookahead() )
+        m_lookahead.AnalysePicture( m_enc_pbuffer, m_last_picture_read+1 );
+
     m_last_picture_read++;
 
     return true;
@@ -732,6 +899,12 @@ bool FieldSequenceCompressor::LoadNextFrame()
         return false;
     }
 
+    if ( UsingLookahead() )
+    {
+        for (int j=pnum; j<=pnum+1; ++j)
+            m_lookahead.AnalysePicture( m_enc_pbuffer, j );
+    }
+
     m_last_picture_read +=2;
 
     return true;
@@ -55,6 +55,7 @@
 #include <libdirac_encoder/quality_monitor.h>
 #include <libdirac_encoder/picture_compress.h>
 #include <libdirac_encoder/rate_control.h>
+#include <libdirac_encoder/lookahead.h>
 
 #include <fstream>
 
@@ -176,6 +177,29 @@ namespace dirac
         //! Returns true if the encoder can encode a picture
         bool CanEncode();
 
+        //! Makes an inter picture intra if the lookahead has found a cut there
+        /*!
+            Makes an inter picture intra if the lookahead has found a cut
+            there, restarting the GOP if it is at an L1 position.
+            \return   true if the picture has been made intra
+        */
+        bool InsertLookaheadCut( EncPicture& enc_pic );
+
+        //! Return true if pictures need to be analysed by the lookahead as they're loaded
+        bool UsingLookahead() const;
+
+        //! Return the most bits the current picture can use without the decoder buffer underflowing
+        long int VBVMaxPictureBits( const long int num_bits );
+
+        //! Recode the current picture with a lower QF if it would make the decoder buffer underflow
+        /*!
+            Recodes the current picture, up to three times, until it fits in
+            the decoder buffer model.
+            \param    p_picture_byteio  the coded picture, which is deleted if it is recoded
+            \return   the coded picture to output
+        */
+        PictureByteIO* VBVRecodePicture( PictureByteIO* p_picture_byteio );
+
         //! Completion flag, returned via the Finished method.
         bool m_all_done;
 
@@ -249,6 +273,12 @@ namespace dirac
         //! A class to hold the picture compressor object
         PictureCompressor m_pcoder;
 
+        //! A class for analysing pictures as they are loaded
+        Lookahead m_lookahead;
+
+        //! The picture statistics gathered in the first pass of a two-pass encode
+        FirstPassStats m_first_pass_stats;
+
         //! Output destination for compressed data in bitstream format
         DiracByteStream& m_dirac_byte_stream;
 
@@ -40,30 +40,137 @@
 using namespace dirac;
 
 #include <cmath>
+#include <algorithm>
 using std::vector;
 
 namespace dirac
 {
 
+namespace
+{
+    // The number of vectors above which duplicates are looked up in the
+    // grid rather than by scanning the buffer
+    const int grid_threshold = 16;
+
+    // Limits on the half-width of the grid. Vectors too big for the largest
+    // grid are rare, and are checked by scanning the buffer.
+    const int min_grid_half = 32;
+    const int max_grid_half = 512;
+
+    // The eight neighbours tested at each stage of sub-pixel refinement
+    const MVector neighbour_offsets[8] = { MVector( -1 , 0 ) , MVector( 1 , 0 ) ,
+                                           MVector( 0 , -1 ) , MVector( 0 , 1 ) ,
+                                           MVector( -1 , -1 ) , MVector( 1 , -1 ) ,
+                                           MVector( -1 , 1 ) , MVector( 1 , 1 ) };
+}
+
+CandidateList::CandidateList():
+    m_num_vects( 0 ),
+    m_grid_half( 0 )
+{}
+
+void CandidateList::NewList()
+{
+    m_list_start.push_back( m_num_vects );
+}
+
+void CandidateList::EndList()
+{
+    // If we've not managed to add any element to the list
+    // remove the list so we don't ever have to check its size
+    if ( m_list_start.back() == m_num_vects )
+        m_list_start.pop_back();
+}
+
+void CandidateList::Truncate( const int list_num )
+{
+    if ( list_num < NumLists() )
+    {
+        m_num_vects = m_list_start[list_num];
+        m_list_start.resize( list_num );
+    }
+}
+
+bool CandidateList::Contains( const MVector& mv ) const
+{
+    if ( m_grid_half>0 && InGrid( mv ) )
+    {
+        const int pos = m_grid[GridPos( mv )];
+        return pos < m_num_vects && m_vects[pos].x == mv.x && m_vects[pos].y == mv.y;
+    }
+
+    for ( int i=0 ; i<m_num_vects ; ++i )
+    {
+        if ( m_vects[i].x == mv.x && m_vects[i].y == mv.y )
+            return true;
+    }// i
+
+    return false;
+}
+
+void CandidateList::MakeGrid( const MVector& mv )
+{
+    int extent = std::max( std::abs( mv.x ) , std::abs( mv.y ) );
+    for ( int i=0 ; i<m_num_vects ; ++i )
+        extent = std::max( extent , std::max( std::abs( m_vects[i].x ) ,
+                                              std::abs( m_vects[i].y ) ) );
+
+    int grid_half = std::max( m_grid_half , min_grid_half );
+    while ( grid_half<extent && grid_half<max_grid_half )
+        grid_half <<= 1;
+
+    if ( grid_half == m_grid_half )
+        return;
+
+    // Stale entries left over from the old layout are harmless, as entries
+    // are always checked against the buffer
+    m_grid_half = grid_half;
+    m_grid.resize( ( 2*m_grid_half + 1 )*( 2*m_grid_half + 1 ) , 0 );
+
+    for ( int i=0 ; i<m_num_vects ; ++i )
+    {
+        if ( InGrid( m_vects[i] ) )
+            m_grid[GridPos( m_vects[i] )] = i;
+    }// i
+}
+
+void CandidateList::AddVect( const MVector& mv )
+{
+    if ( m_grid_half == 0 ? m_num_vects >= grid_threshold :
+                            ( !InGrid( mv ) && m_grid_half < max_grid_half ) )
+        MakeGrid( mv );
+
+    if ( Contains( mv ) )
+        return;
+
+    if ( m_num_vects == static_cast<int>( m_vects.size() ) )
+        m_vects.push_back( mv );
+    else
+        m_vects[m_num_vects] = mv;
+
+    if ( m_grid_half>0 && InGrid( mv ) )
+        m_grid[GridPos( mv )] = m_num_vects;
+
+    ++m_num_vects;
+}
+
 void AddNewVlist( CandidateList& vect_list, const MVector& mv, 
                   const int xr , const int yr , const int step )
 {
       //Creates a new motion vector list in a square region around mv
 
-    vector<MVector> tmp_list;
-    vect_list.push_back(tmp_list);
-    int list_num=vect_list.size()-1;    
+    vect_list.NewList();
 
     MVector tmp_mv( mv );
-    AddVect(vect_list , tmp_mv , list_num );
+    vect_list.AddVect( tmp_mv );
 
     for ( int i=1 ; i<=xr ; ++i )
     {
         tmp_mv.x = mv.x + i*step;
-        AddVect( vect_list , tmp_mv , list_num );
+        vect_list.AddVect( tmp_mv );
 
         tmp_mv.x = mv.x - i*step;        
-        AddVect( vect_list , tmp_mv , list_num );    
+        vect_list.AddVect( tmp_mv );
     }
 
     for ( int j=1 ; j<=yr ; ++j)
@@ -72,38 +179,33 @@ void AddNewVlist( CandidateList& vect_list, const MVector& mv,
         {
             tmp_mv.x = mv.x + i*step;
             tmp_mv.y = mv.y + j*step;
-            AddVect(vect_list,tmp_mv,list_num);
+            vect_list.AddVect( tmp_mv );
 
             tmp_mv.y = mv.y -j*step;
-            AddVect(vect_list,tmp_mv,list_num);            
+            vect_list.AddVect( tmp_mv );
 
         }// i        
     }// j
 
-    // If we've not managed to add any element to the list
-    // remove the list so we don't ever have to check its size
-    if ( vect_list[list_num].size() == 0 )
-        vect_list.erase( vect_list.begin() + list_num );
+    vect_list.EndList();
 }
 
 void AddNewVlist( CandidateList& vect_list , const MVector& mv , const int xr , const int yr)
 {
       // Creates a new motion vector list in a square region around mv
-    
-    vector<MVector> tmp_list;
-    vect_list.push_back(tmp_list);
-    int list_num=vect_list.size()-1;    
+
+    vect_list.NewList();
 
     MVector tmp_mv(mv);
-    AddVect(vect_list,tmp_mv,list_num);
+    vect_list.AddVect( tmp_mv );
 
     for ( int i=1 ; i<=xr ; ++i)
     {
         tmp_mv.x = mv.x + i;
-        AddVect( vect_list , tmp_mv , list_num );
+        vect_list.AddVect( tmp_mv );
 
         tmp_mv.x = mv.x - i;        
-        AddVect( vect_list , tmp_mv , list_num );    
+        vect_list.AddVect( tmp_mv );
     }
 
     for ( int j=1 ; j<=yr ; ++j)
@@ -112,39 +214,34 @@ void AddNewVlist( CandidateList& vect_list , const MVector& mv , const int xr ,
         {
             tmp_mv.x = mv.x + i;
             tmp_mv.y = mv.y + j;
-            AddVect( vect_list , tmp_mv , list_num );
+            vect_list.AddVect( tmp_mv );
 
             tmp_mv.y = mv.y-j;
-            AddVect( vect_list , tmp_mv , list_num );            
+            vect_list.AddVect( tmp_mv );
         }        
     }
 
-    // If we've not managed to add any element to the list
-    // remove the list so we don't ever have to check its size
-    if ( vect_list[list_num].size() == 0 )                 
-        vect_list.erase( vect_list.begin() + list_num );
+    vect_list.EndList();
 }
 
 void AddNewVlistD( CandidateList& vect_list , const MVector& mv , const int xr , const int yr )
 {
       //As above, but using a diamond pattern
 
-    vector<MVector> tmp_list;
-    vect_list.push_back( tmp_list );
+    vect_list.NewList();
 
-    int list_num=vect_list.size()-1;    
     int xlim;
 
     MVector tmp_mv( mv );
-    AddVect( vect_list , tmp_mv , list_num );
+    vect_list.AddVect( tmp_mv );
 
     for ( int i=1 ; i<=xr ; ++i)
     {
         tmp_mv.x = mv.x + i;
-        AddVect( vect_list , tmp_mv , list_num );
+        vect_list.AddVect( tmp_mv );
 
         tmp_mv.x = mv.x - i;        
-        AddVect( vect_list , tmp_mv , list_num );    
+        vect_list.AddVect( tmp_mv );
     }
 
     for ( int j=1 ; j<=yr ; ++j)
@@ -154,42 +251,14 @@ void AddNewVlistD( CandidateList& vect_list , const MVector& mv , const int xr ,
         {
             tmp_mv.x = mv.x + i;
             tmp_mv.y = mv.y + j;
-            AddVect( vect_list , tmp_mv , list_num );
+            vect_list.AddVect( tmp_mv );
 
             tmp_mv.y = mv.y - j;
-            AddVect( vect_list , tmp_mv , list_num );            
+            vect_list.AddVect( tmp_mv );
         }        
     }
 
-    // If we've not managed to add any element to the list
-    // remove the list so we don't ever have to check its size
-    if ( vect_list[list_num].size() == 0 )                
-        vect_list.erase( vect_list.begin() + list_num );
-}
-
-void AddVect(CandidateList& vect_list,const MVector& mv,int list_num)
-{
-
-    bool is_in_list=false;
-    
-    size_t lnum=0;
-    size_t i;    
-
-    while( !is_in_list && lnum<vect_list.size() )
-    {
-        i=0;        
-        while( !is_in_list && i<vect_list[lnum].size())
-        {        
-            if ( vect_list[lnum][i].x == mv.x && vect_list[lnum][i].y == mv.y )    
-                is_in_list=true;        
-            ++i;    
-        }
-        ++lnum;
-    }
-
-    if ( !is_in_list )
-        vect_list[list_num].push_back(mv);
-    
+    vect_list.EndList();
 }
 
 BlockMatcher::BlockMatcher( const PicArray& pic_data , 
@@ -204,6 +273,8 @@ BlockMatcher::BlockMatcher( const PicArray& pic_data ,
     m_cost_array(cost_array),
     m_peldiff( ref_data , pic_data ), //NB: ORDER!!!!!!!!!!!!!!!!!!!!!!!!!!!!
     m_subpeldiff( 3 ),
+    m_pic_sums( 0 ),
+    m_ref_sums( 0 ),
     m_bparams( bparams ),
     m_var_max( (pic_data.LengthX()+pic_data.LengthY() )/216 ),
     m_var_max_up( (pic_data.LengthX()+pic_data.LengthY() )/27 ),
@@ -218,6 +289,20 @@ BlockMatcher::~BlockMatcher()
 {
     for (int i=0; i<3; ++i )
         delete m_subpeldiff[i];
+
+    delete m_pic_sums;
+    delete m_ref_sums;
+}
+
+void BlockMatcher::UseElimination( const int xr , const int yr )
+{
+    delete m_pic_sums;
+    delete m_ref_sums;
+
+    // Allow a little extra room, as the neighbourhood of the spatial
+    // prediction can stray just outside the search range
+    m_pic_sums = new BlockSums( m_pic_data , 0 , 0 );
+    m_ref_sums = new BlockSums( m_ref_data , xr+2 , yr+2 );
 }
 
 
@@ -250,34 +335,124 @@ void BlockMatcher::FindBestMatchPel(const int xpos , const int ypos ,
     //now test against the offsets in the MV list to get the lowest cost//
     //////////////////////////////////////////////////////////////////////     
 
-    float best_cost = m_cost_array[ypos][xpos].total;
+    MECostType best_cost = m_cost_array[ypos][xpos].total;
 
     MVector best_mv = m_mv_array[ypos][xpos];
 
-    for ( size_t lnum=list_start ; lnum<cand_list.size() ; ++lnum)
+    if ( list_start < cand_list.NumLists() )
     {
-        for (size_t i=0 ; i<cand_list[lnum].size() ; ++i)
+        if ( m_ref_sums == 0 || dparams.Xl() <= 0 || dparams.Yl() <= 0 )
+        {
+            for ( int i=cand_list.ListStart( list_start ) ; i<cand_list.Size() ; ++i )
+            {
+                m_peldiff.Diff( dparams , 
+                                cand_list[i] , 
+                                best_cost , 
+                                best_mv);
+            }// i
+        }
+        else
         {
-            m_peldiff.Diff( dparams , 
-                            cand_list[lnum][i] , 
-                            best_cost , 
-                            best_mv);
-        }// i
-    }// num
+            // Successive elimination. For any partition of the block, the
+            // SAD is at least the sum over the parts of the differences
+            // between the picture and reference sums. So a candidate whose
+            // bound is no better than the best cost so far can't be chosen
+            // and needn't be evaluated. Test the whole block first, then
+            // its quadrants.
+            const int xs[3] = { dparams.Xp() , dparams.Xp() + ( dparams.Xl()>>1 ) , dparams.Xend() };
+            const int ys[3] = { dparams.Yp() , dparams.Yp() + ( dparams.Yl()>>1 ) , dparams.Yend() };
+
+            const CalcValueType pic_sum = m_pic_sums->Sum( dparams.Xp() , dparams.Yp() ,
+                                                           dparams.Xl() , dparams.Yl() );
+            CalcValueType pic_part_sums[4];
+            for ( int q=0 ; q<4 ; ++q )
+            {
+                const int qx = q&1, qy = q>>1;
+                pic_part_sums[q] = m_pic_sums->Sum( xs[qx] , ys[qy] ,
+                                                    xs[qx+1]-xs[qx] , ys[qy+1]-ys[qy] );
+            }// q
+
+            for ( int i=cand_list.ListStart( list_start ) ; i<cand_list.Size() ; ++i )
+            {
+                const MVector& mv = cand_list[i];
+
+                if ( m_ref_sums->Covers( dparams.Xp()+mv.x , dparams.Yp()+mv.y ,
+                                         dparams.Xl() , dparams.Yl() ) )
+                {
+                    CalcValueType bound = std::abs( pic_sum -
+                                                    m_ref_sums->Sum( dparams.Xp()+mv.x ,
+                                                                     dparams.Yp()+mv.y ,
+                                                                     dparams.Xl() , dparams.Yl() ) );
+                    if ( SADToMECost( bound ) >= best_cost )
+                        continue;
+
+                    bound = 0;
+                    for ( int q=0 ; q<4 ; ++q )
+                    {
+                        const int qx = q&1, qy = q>>1;
+                        bound += std::abs( pic_part_sums[q] -
+                                           m_ref_sums->Sum( xs[qx]+mv.x , ys[qy]+mv.y ,
+                                                            xs[qx+1]-xs[qx] , ys[qy+1]-ys[qy] ) );
+                    }// q
+                    if ( SADToMECost( bound ) >= best_cost )
+                        continue;
+                }
+
+                m_peldiff.Diff( dparams , mv , best_cost , best_mv );
+            }// i
+        }
+    }
 
     // Write the results in the arrays //
     /////////////////////////////////////
 
     m_mv_array[ypos][xpos] = best_mv;
-    m_cost_array[ypos][xpos].SAD = best_cost;
+    m_cost_array[ypos][xpos].SAD = static_cast<CalcValueType>( best_cost>>ME_COST_SHIFT );
     m_cost_array[ypos][xpos].mvcost = GetVar( mv_prediction , best_mv);
-    m_cost_array[ypos][xpos].SetTotal( 0.0 );
+    m_cost_array[ypos][xpos].SetTotal( 0 );
+}
+
+void BlockMatcher::FindBestMatchPredictive( const int xpos , const int ypos ,
+                                            CandidateList& cand_list,
+                                            const MVector& mv_prediction )
+{
+    // The most diamond steps to take from the best predictor
+    const int max_steps = 16;
+
+    FindBestMatchPel( xpos , ypos , cand_list , mv_prediction , 0 );
+
+    BlockDiffParams dparams;
+    dparams.SetBlockLimits( m_bparams , m_pic_data , xpos , ypos );
+
+    // If the best predictor is good enough, bail out
+    const CalcValueType good_enough = 2*dparams.Xl()*dparams.Yl();
+
+    for ( int step=0 ; step<max_steps ; ++step )
+    {
+        if ( m_cost_array[ypos][xpos].SAD < good_enough )
+            break;
+
+        const MVector centre = m_mv_array[ypos][xpos];
+        const int list_num = cand_list.NumLists();
+
+        AddNewVlistD( cand_list , centre , 1 , 1 );
+
+        // Every neighbour has been tested already
+        if ( cand_list.NumLists() == list_num )
+            break;
+
+        FindBestMatchPel( xpos , ypos , cand_list , mv_prediction , list_num );
+
+        // The centre is the best of its neighbourhood
+        if ( m_mv_array[ypos][xpos].x == centre.x && m_mv_array[ypos][xpos].y == centre.y )
+            break;
+    }// step
 }
 
 void BlockMatcher::FindBestMatchSubp( const int xpos, const int ypos,
                                       const CandidateList& cand_list,
                                       const MVector& mv_prediction,
-                                      const float lambda)
+                                      const MECostType lambda)
 {
 
     BlockDiffParams dparams;
@@ -286,35 +461,26 @@ void BlockMatcher::FindBestMatchSubp( const int xpos, const int ypos,
     //now test against the offsets in the MV list to get the lowest cost//
     //////////////////////////////////////////////////////////////////////    
 
-    // Numbers of the lists to do more searching in
-    vector<int> list_nums; 
-
-    // Costs of the initial vectors in each list
-    OneDArray<float> list_costs( cand_list.size() );
-
     // First test the first in each of the lists to choose which lists to pursue
     MvCostData best_costs( m_cost_array[ypos][xpos] );
-    best_costs.total = 100000000.0f;
+    best_costs.total = MAX_ME_COST;
     MVector best_mv( m_mv_array[ypos][xpos] );
 
     MvCostData cand_costs;
     MVector cand_mv;
 
-    for (size_t list_num=0 ; list_num<cand_list.size() ; ++list_num )
+    for ( int i=0 ; i<cand_list.Size() ; ++i )
     {
-        for (size_t i=0 ; i<cand_list[list_num].size() ; ++i )
-        {
-            cand_mv = cand_list[list_num][i];
-            cand_costs.mvcost = GetVarUp( mv_prediction , cand_mv );
+        cand_mv = cand_list[i];
+        cand_costs.mvcost = GetVarUp( mv_prediction , cand_mv );
 
-            m_subpeldiff[m_precision-1]->Diff( dparams,
-                                               cand_mv ,
-                                               cand_costs.mvcost,
-                                               lambda,
-                                               best_costs ,
-                                               best_mv);
-        }//
-    }// list_num
+        m_subpeldiff[m_precision-1]->Diff( dparams,
+                                           cand_mv ,
+                                           cand_costs.mvcost,
+                                           lambda,
+                                           best_costs ,
+                                           best_mv);
+    }// i
 
 
     // Write the results in the arrays //
@@ -326,7 +492,7 @@ void BlockMatcher::FindBestMatchSubp( const int xpos, const int ypos,
 }
 void BlockMatcher::RefineMatchSubp(const int xpos, const int ypos,
                                    const MVector& mv_prediction,
-                                   const float lambda)
+                                   const MECostType lambda)
 {
 
     BlockDiffParams dparams;
@@ -352,7 +518,7 @@ void BlockMatcher::RefineMatchSubp(const int xpos, const int ypos,
     MvCostData pred_costs;
     pred_costs.mvcost = 0;
     pred_costs.SAD = m_subpeldiff[m_precision-1]->Diff( dparams, mv_prediction);
-    pred_costs.total = pred_costs.SAD;
+    pred_costs.total = SADToMECost( pred_costs.SAD );
 
     if (pred_costs.SAD<2*dparams.Xl()*dparams.Yl() )
     {
@@ -363,92 +529,53 @@ void BlockMatcher::RefineMatchSubp(const int xpos, const int ypos,
 
     // Now, let's see if we can do better than this
 
-    MvCostData cand_costs;
-    MVector cand_mv, old_best_mv;
+    MVector cand_mv;
+    CalcValueType sads[8];
 
     for (int i=1; i<=m_precision; ++i )
     {
         best_mv = best_mv<<1;
         MVector temp_best_mv = best_mv;
 
-        // Do a neighbourhood of best_mv
-
-        // Stage 1 - look at the 4 nearest points
-        cand_mv.x = best_mv.x - 1;
-        cand_mv.y = best_mv.y;
-        m_subpeldiff[i-1]->Diff( dparams, cand_mv ,
-                                 GetVarUp( mv_prediction, 
-                                           cand_mv<<(m_precision-i) ) ,
-                                 lambda , best_costs ,
-                                 temp_best_mv);
-        cand_mv.x = best_mv.x + 1;
-        cand_mv.y = best_mv.y;
-        m_subpeldiff[i-1]->Diff( dparams, cand_mv ,
-                                 GetVarUp( mv_prediction, 
-                                           cand_mv<<(m_precision-i) ) ,
-                                 lambda , best_costs ,
-                                 temp_best_mv);
-        cand_mv.x = best_mv.x;
-        cand_mv.y = best_mv.y - 1;
-        m_subpeldiff[i-1]->Diff( dparams, cand_mv ,
-                                 GetVarUp( mv_prediction, 
-                                           cand_mv<<(m_precision-i) ) ,
-                                 lambda , best_costs ,
-                                 temp_best_mv);
-        cand_mv.x = best_mv.x;
-        cand_mv.y = best_mv.y + 1;
-        m_subpeldiff[i-1]->Diff( dparams, cand_mv ,
-                                 GetVarUp( mv_prediction, 
-                                           cand_mv<<(m_precision-i) ) ,
-                                 lambda , best_costs ,
-                                 temp_best_mv);
-
-        // Stage 2. If we've done better than the original value, 
-        // look at the other two neighbours 
-        if ( temp_best_mv.x != best_mv.x )
+        // Look at the eight neighbours of best_mv, together if we can
+        if ( m_subpeldiff[i-1]->NeighbourDiffs( dparams , best_mv ,
+                                                neighbour_offsets , sads ) )
         {
-            MVector new_best_mv = temp_best_mv;
-            cand_mv.x = new_best_mv.x;
-            cand_mv.y = new_best_mv.y - 1;
-            m_subpeldiff[i-1]->Diff( dparams, cand_mv ,
-                                     GetVarUp( mv_prediction, 
-                                               cand_mv<<(m_precision-i) ) ,
-                                     lambda , best_costs ,
-                                     temp_best_mv);
-
-            cand_mv.x = new_best_mv.x;
-            cand_mv.y = new_best_mv.y + 1;
-            m_subpeldiff[i-1]->Diff( dparams, cand_mv ,
-                                     GetVarUp( mv_prediction, 
-                                               cand_mv<<(m_precision-i) ) ,
-                                     lambda , best_costs ,
-                                     temp_best_mv);
+            for ( int n=0 ; n<8 ; ++n )
+            {
+                cand_mv = best_mv + neighbour_offsets[n];
+                const CalcValueType mvcost = GetVarUp( mv_prediction,
+                                                       cand_mv<<(m_precision-i) );
+                const MECostType total = SADToMECost( sads[n] ) + lambda*mvcost;
+                if ( total<best_costs.total )
+                {
+                    best_costs.SAD = sads[n];
+                    best_costs.mvcost = mvcost;
+                    best_costs.total = total;
+                    temp_best_mv = cand_mv;
+                }
+            }// n
         }
-        else if ( temp_best_mv.y != best_mv.y )
+        else
         {
-            MVector new_best_mv = temp_best_mv;
-            cand_mv.x = new_best_mv.x - 1;
-            cand_mv.y = new_best_mv.y;
-            m_subpeldiff[i-1]->Diff( dparams, cand_mv ,
-                                     GetVarUp( mv_prediction, 
-                                               cand_mv<<(m_precision-i) ) ,
-                                     lambda , best_costs ,
-                                     temp_best_mv);
-
-            cand_mv.x = new_best_mv.x + 1;
-            cand_mv.y = new_best_mv.y;
-            m_subpeldiff[i-1]->Diff( dparams, cand_mv ,
-                                     GetVarUp( mv_prediction, 
-                                               cand_mv<<(m_precision-i) ) ,
-                                     lambda , best_costs ,
-                                     temp_best_mv);
-        } 
+            // The same eight one at a time, so that the vectors chosen
+            // don't depend on the CPU or on the block's position
+            for ( int n=0 ; n<8 ; ++n )
+            {
+                cand_mv = best_mv + neighbour_offsets[n];
+                m_subpeldiff[i-1]->Diff( dparams, cand_mv ,
+                                         GetVarUp( mv_prediction, 
+                                                   cand_mv<<(m_precision-i) ) ,
+                                         lambda , best_costs ,
+                                         temp_best_mv);
+            }// n
+        }
 
         best_mv = temp_best_mv;
 
         // Bail out if we can't do better than 10% worse than the predictor at
         // each stage
-        if ( best_costs.total>1.1*pred_costs.total )
+        if ( 10*best_costs.total>11*pred_costs.total )
         {
             m_mv_array[ypos][xpos] = mv_prediction;
             m_cost_array[ypos][xpos] = pred_costs;
@@ -40,12 +40,101 @@
 
 #include <libdirac_motionest/me_utils.h>
 #include <vector>
+#include <cstdlib>
 //handles the business of finding the best block match
 
 namespace dirac
 {
 
-    typedef std::vector< std::vector< MVector > > CandidateList;
+    //! A set of lists of candidate motion vectors
+    /*!
+        A set of lists of candidate motion vectors. The vectors of all the
+        lists are held in a single flat buffer, each list occupying a
+        contiguous range of it, and the storage is kept when lists are
+        removed so that building the lists for each block does not allocate.
+
+        A vector is only added if it does not already occur in any list.
+        Once there are more than a few vectors, duplicates are found in
+        constant time from a grid indexed by the vector components, which
+        records where in the buffer each vector was stored. A grid entry is
+        only believed if it points inside the buffer at the same vector, so
+        removing lists never requires the grid to be cleared.
+    */
+    class CandidateList
+    {
+    public:
+        //! Default constructor - creates an empty set of lists
+        CandidateList();
+
+        //! Start a new, empty, list at the end of the set
+        void NewList();
+
+        //! Finish the last list, removing it if nothing was added to it
+        void EndList();
+
+        //! Add a vector to the last list, unless it already occurs in a list
+        void AddVect( const MVector& mv );
+
+        //! Remove the lists numbered list_num and above
+        void Truncate( const int list_num );
+
+        //! Remove all the lists
+        void Clear(){ Truncate( 0 ); }
+
+        //! Returns the number of lists
+        int NumLists() const { return m_list_start.size(); }
+
+        //! Returns the total number of vectors in all the lists
+        int Size() const { return m_num_vects; }
+
+        //! Returns the position in the buffer of the first vector of a list
+        int ListStart( const int list_num ) const { return m_list_start[list_num]; }
+
+        //! Returns the position in the buffer after the last vector of a list
+        int ListEnd( const int list_num ) const
+        {
+            return ( list_num+1 < NumLists() ) ? m_list_start[list_num+1] : m_num_vects;
+        }
+
+        //! Returns the vector at a position in the buffer
+        const MVector& operator[]( const int pos ) const { return m_vects[pos]; }
+
+    private:
+        // Returns true if mv is already in the buffer
+        bool Contains( const MVector& mv ) const;
+
+        // Returns true if mv lies within the grid
+        bool InGrid( const MVector& mv ) const
+        {
+            return std::abs( mv.x ) <= m_grid_half && std::abs( mv.y ) <= m_grid_half;
+        }
+
+        // Returns the grid cell for mv, which must lie within the grid
+        int GridPos( const MVector& mv ) const
+        {
+            return ( mv.y + m_grid_half )*( 2*m_grid_half + 1 ) + mv.x + m_grid_half;
+        }
+
+        // (Re)builds the grid so that it covers mv and the buffered vectors
+        void MakeGrid( const MVector& mv );
+
+    private:
+        // The vectors of all the lists
+        std::vector< MVector > m_vects;
+
+        // The number of vectors in use in m_vects
+        int m_num_vects;
+
+        // The start of each list in m_vects
+        std::vector< int > m_list_start;
+
+        // For each vector in the grid, where it was put in m_vects
+        std::vector< int > m_grid;
+
+        // The grid covers components in [-m_grid_half, m_grid_half]. Zero
+        // until there are enough vectors to make a grid worthwhile.
+        int m_grid_half;
+    };
 
     //! Add a new motion vector list of neighbours of a vector to the set of lists
     /*
@@ -74,13 +163,6 @@ namespace dirac
     */
     void AddNewVlistD( CandidateList& vect_list , const MVector& mv , const int xr, const int yr);
 
-    //! Add a motion vector to the set of motion vector lists
-    /*!
-        Add a motion vector to the set of motion vector lists, making sure
-        it's not a duplicate.
-    */
-    void AddVect( CandidateList& vect_list , const MVector& mv , const int list_num);
-
     //!    Get the (absolute) variation between two motion vectors
     /*!
         Return the variation between two motion vectors, computed as the sum
@@ -124,6 +206,17 @@ namespace dirac
 
         ~BlockMatcher();
 
+        //! Use successive elimination to speed up FindBestMatchPel
+        /*!
+            Make tables of block sums of the picture and the reference, so
+            that FindBestMatchPel can skip any candidate whose SAD is bounded
+            below by the best cost found so far. The best match found is
+            unchanged. This is only worthwhile for large, exhaustive searches.
+            \param  xr  the horizontal search range
+            \param  yr  the vertical search range
+        */
+        void UseElimination( const int xr , const int yr );
+
         //! Find the best matching vector from a list of candidates
         /*!
                Find the best matching vector from a list of candidates.
@@ -138,6 +231,22 @@ namespace dirac
                                            const MVector& mv_prediction,
                                            const int list_start);
 
+        //! Find the best matching vector by a predictive search
+        /*!
+               Find the best matching vector by testing a list of predictors
+               and then, unless the best of them is good enough, refining it
+               by a small diamond search until no neighbour does better.
+               Vectors tested in the refinement are added to the candidate
+               list, so none is tested twice.
+               \param  xpos  the horizontal location of the block being matched
+               \param  ypos  the vertical location of the block being matched
+               \param  cand_list  the list of predictors
+               \param  mv_prediction Prediction used for each block used to control the variation in the motion vector field.
+        */
+        void FindBestMatchPredictive( const int xpos , const int ypos ,
+                                      CandidateList& cand_list,
+                                      const MVector& mv_prediction );
+
         //! Find the best matching vector from a list of candidates, to sub-pixel accuracy (TBC: merge with FindBestMatch)
         /*!
                Find the best matching vector from a list of candidates.
@@ -150,11 +259,11 @@ namespace dirac
         void FindBestMatchSubp( const int xpos, const int ypos,
                                 const CandidateList& cand_list,
                                 const MVector& mv_prediction,
-                                const float lambda);
+                                const MECostType lambda);
 
         void RefineMatchSubp(const int xpos, const int ypos,
                              const MVector& mv_prediction,
-                             const float lambda);
+                             const MECostType lambda);
 
         //! Get a measure of the difference between a motion vector and a prediction
         /*!
@@ -191,6 +300,10 @@ namespace dirac
 
         OneDArray<BlockDiffUp* > m_subpeldiff;
 
+        // Block sums for eliminating candidates, if in use
+        BlockSums* m_pic_sums;
+        BlockSums* m_ref_sums;
+
         // The block parameters we're using
         OLBParams m_bparams;
 
@@ -39,166 +39,190 @@
 #include <libdirac_motionest/downconvert.h>
 using namespace dirac;
 
+#if defined(HAVE_SSE2)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+#if defined(HAVE_SSE2)
+    // Multiplies pairs of lines by a tap and adds to the low and high sums
+    inline void AddTapPair( const __m128i a, const __m128i b, const __m128i tap,
+                            __m128i& sum_lo, __m128i& sum_hi )
+    {
+        sum_lo = _mm_add_epi32( sum_lo, _mm_madd_epi16( _mm_unpacklo_epi16( a, b ), tap ) );
+        sum_hi = _mm_add_epi32( sum_hi, _mm_madd_epi16( _mm_unpackhi_epi16( a, b ), tap ) );
+    }
+
+    // Rounds, shifts and truncates the sums to 16 bits
+    inline __m128i RoundAndPack( __m128i sum_lo, __m128i sum_hi, const int shift )
+    {
+        const __m128i round = _mm_set1_epi32( 1<<(shift-1) );
+        sum_lo = _mm_srai_epi32( _mm_add_epi32( sum_lo, round ), shift );
+        sum_hi = _mm_srai_epi32( _mm_add_epi32( sum_hi, round ), shift );
+        sum_lo = _mm_srai_epi32( _mm_slli_epi32( sum_lo, 16 ), 16 );
+        sum_hi = _mm_srai_epi32( _mm_slli_epi32( sum_hi, 16 ), 16 );
+        return _mm_packs_epi32( sum_lo, sum_hi );
+    }
+
+    // Returns the even-numbered samples of 16 consecutive samples
+    inline __m128i EvenSamples( const __m128i a, const __m128i b )
+    {
+        return _mm_packs_epi32( _mm_srai_epi32( _mm_slli_epi32( a, 16 ), 16 ),
+                                _mm_srai_epi32( _mm_slli_epi32( b, 16 ), 16 ) );
+    }
+
+    // Returns the odd-numbered samples of 16 consecutive samples
+    inline __m128i OddSamples( const __m128i a, const __m128i b )
+    {
+        return _mm_packs_epi32( _mm_srai_epi32( a, 16 ), _mm_srai_epi32( b, 16 ) );
+    }
+#endif
+} // namespace
+
 DownConverter::DownConverter()
 {}
 
-
-#if !defined(HAVE_MMX)
 //General function - does some admin and calls the correct function
-//NOTE: The mmx version of this function is defined in downconvert_mmx.cpp
-//Ensusre that changes made in this function are reflected in the mmx version
-//as well.
 void DownConverter::DoDownConvert(const PicArray& old_data, PicArray& new_data)
 {
     //Down-convert by a factor of two.
-    m_row_buffer= new ValueType[old_data.LengthX()];    
-    //Variables that will be used by the filter calculations
-    int sum;
-    int colpos;
 
     // The area of the picture that will be downconverted
-    const int xlen = 2*new_data.LengthX();    
-    const int ylen = 2*new_data.LengthY();    
-
+    const int xlen = 2*new_data.LengthX();
+    const int ylen = 2*new_data.LengthY();
 
-    //There are three y loops to cope with the leading edge, middle 
-    //and trailing edge of each column.
-    colpos=0;
-    for( int y=0; y<Stage_I_Size*2 ; y+=2 , colpos++ )
-    {
-        // We are filtering each column but doing it bit by bit.
-        // This means our main loop is in the x direction and
-        // there is a much greater chance the data we need will
-        // be in the cache.
-
-        for( int x=0 ; x<xlen ; x++ )
-        {            
-            // In down conversion we interpolate every pixel
-            // so there is no copying.
-            // Excuse the complicated ternary stuff but it sorts out the edge
-            sum =  (old_data[y][x] + old_data[y+1][x])*StageI_I;
-            sum += (old_data[((y-1)>=0)?(y-1):0][x] + old_data[y+2][x])*StageI_II;
-            sum += (old_data[((y-2)>=0)?(y-2):0][x] + old_data[y+3][x])*StageI_III;
-            sum += (old_data[((y-3)>=0)?(y-3):0][x] + old_data[y+4][x])*StageI_IV;
-            sum += (old_data[((y-4)>=0)?(y-4):0][x] + old_data[y+5][x])*StageI_V;
-            sum += (old_data[((y-5)>=0)?(y-5):0][x] + old_data[y+6][x])*StageI_VI;
-            sum += 1<<(StageI_Shift-1);//do rounding right
-            m_row_buffer[x] = sum >> StageI_Shift;
-        }// x
-        //Speaking of which - the row loop.
+    // The row buffer is padded at either end so that the row filter needs
+    // no edge cases. It's kept between calls, so only grows.
+    const int buffer_length = xlen + 2*Stage_I_Size;
+    if ( int(m_row_buffer.size())<buffer_length )
+        m_row_buffer.resize( buffer_length );
 
-        RowLoop(colpos,new_data);
-    }// y 
+    const ValueType* lines[2*Stage_I_Size];
 
-    // This loop is like the last one but it deals with the center
-    // section of the image and so the ternary operations are dropped
-    // from the filter section.
-    for( int y=Stage_I_Size*2 ; y<ylen-Stage_I_Size*2 ; y+=2 , colpos++ )
+    for( int y=0, colpos=0 ; y<ylen-1 ; y+=2 , colpos++ )
     {
-        for( int x=0 ; x<xlen ; x++ )
+        // We filter each column a line at a time, so the main loop is in the
+        // x direction and the data we need is more likely to be in the
+        // cache. Lines off the edge of the picture repeat the edge lines.
+        for ( int k=0 ; k<Stage_I_Size ; ++k )
         {
+            lines[2*k] = old_data[std::max( y-k , 0 )];
+            lines[2*k+1] = old_data[std::min( y+1+k , ylen-1 )];
+        }// k
 
-            sum =  (old_data[y][x]   + old_data[y+1][x])*StageI_I;
-            sum += (old_data[y-1][x] + old_data[y+2][x])*StageI_II;
-            sum += (old_data[y-2][x] + old_data[y+3][x])*StageI_III;
-            sum += (old_data[y-3][x] + old_data[y+4][x])*StageI_IV;
-            sum += (old_data[y-4][x] + old_data[y+5][x])*StageI_V;
-            sum += (old_data[y-5][x] + old_data[y+6][x])*StageI_VI;
-            sum += 1<<(StageI_Shift-1);//do rounding right
-            m_row_buffer[x] = sum >> StageI_Shift;
-        }// x
+        ColumnFilter( lines , xlen );
 
-        RowLoop( colpos , new_data );
-    }// y
-
-    // Another similar loop! - this time we are dealing with
-    // the trailing edge so the ternary stuff is back in the
-    // filter calcs but in the second parameter.
-
-    for( int y=ylen-(Stage_I_Size*2) ; y<ylen-1 ; y+=2 , colpos++ )
-    {
-        for( int x=0; x<xlen ; x++ )
+        // Pad the row buffer
+        ValueType* row = &m_row_buffer[Stage_I_Size];
+        for ( int x=1 ; x<=Stage_I_Size ; ++x )
         {
-
-            sum =  (old_data[y][x]   + old_data[((y+1)<ylen)?(y+1):(ylen-1)][x])*StageI_I;
-            sum += (old_data[y-1][x] + old_data[((y+2)<ylen)?(y+2):(ylen-1)][x])*StageI_II;
-            sum += (old_data[y-2][x] + old_data[((y+3)<ylen)?(y+3):(ylen-1)][x])*StageI_III;
-            sum += (old_data[y-3][x] + old_data[((y+4)<ylen)?(y+4):(ylen-1)][x])*StageI_IV;
-            sum += (old_data[y-4][x] + old_data[((y+5)<ylen)?(y+5):(ylen-1)][x])*StageI_V;
-            sum += (old_data[y-5][x] + old_data[((y+6)<ylen)?(y+6):(ylen-1)][x])*StageI_VI;
-
-            // Do rounding right
-            sum += 1<<(StageI_Shift-1);
-            m_row_buffer[x] = sum >> StageI_Shift;
-
+            row[-x] = row[0];
+            row[xlen-1+x] = row[xlen-1];
         }// x
 
         RowLoop( colpos , new_data );
-
-    }//  y
-
-    // Tidy up the data
-    delete[] m_row_buffer;
-
+    }// y
 }
-#endif
-
 
-// The loop over the columns is the same every time so lends itself to isolation
-// as an individual function.
-void DownConverter::RowLoop( const int colpos , PicArray& new_data)
+// Filters a line of the output of the first stage from six pairs of lines,
+// each pair symmetrically placed about it
+void DownConverter::ColumnFilter( const ValueType* const* lines, const int xlen )
 {
+    ValueType* row = &m_row_buffer[Stage_I_Size];
+    int x = 0;
+
+#if defined(HAVE_SSE2)
+    const __m128i taps[Stage_I_Size] = { _mm_set1_epi16( StageI_I ),
+                                         _mm_set1_epi16( StageI_II ),
+                                         _mm_set1_epi16( StageI_III ),
+                                         _mm_set1_epi16( StageI_IV ),
+                                         _mm_set1_epi16( StageI_V ),
+                                         _mm_set1_epi16( StageI_VI ) };
+    for ( ; x+8<=xlen ; x+=8 )
+    {
+        __m128i sum_lo = _mm_setzero_si128();
+        __m128i sum_hi = _mm_setzero_si128();
+        for ( int k=0 ; k<Stage_I_Size ; ++k )
+            AddTapPair( _mm_loadu_si128( (const __m128i*)(lines[2*k]+x) ),
+                        _mm_loadu_si128( (const __m128i*)(lines[2*k+1]+x) ),
+                        taps[k], sum_lo, sum_hi );
+
+        _mm_storeu_si128( (__m128i*)(row+x), RoundAndPack( sum_lo, sum_hi, StageI_Shift ) );
+    }// x
+#endif
 
-     //Calculation variables
     int sum;
-    const int xlen = 2*new_data.LengthX();
-    int linepos=0;    
-
-     // Leading Column Edge
-     // Similar loops to the x case in ByHalf_opto, for explanation look there.
-     // Note the factor of two difference as we only want to fill in every other
-     // line as the others have already been created by the line loops.
-
-    for( int x=0; x<(2*Stage_I_Size) ; x+=2 , linepos++ )
+    for ( ; x<xlen ; ++x )
     {
-        sum =  (m_row_buffer[((x)>=0)?(x):0]     + m_row_buffer[x+1])*StageI_I;
-        sum += (m_row_buffer[((x-1)>=0)?(x-1):0] + m_row_buffer[x+2])*StageI_II;
-        sum += (m_row_buffer[((x-2)>=0)?(x-2):0] + m_row_buffer[x+3])*StageI_III;
-        sum += (m_row_buffer[((x-3)>=0)?(x-3):0] + m_row_buffer[x+4])*StageI_IV;
-        sum += (m_row_buffer[((x-4)>=0)?(x-4):0] + m_row_buffer[x+5])*StageI_V;
-        sum += (m_row_buffer[((x-5)>=0)?(x-5):0] + m_row_buffer[x+6])*StageI_VI;
+        sum =  (lines[0][x]  + lines[1][x])*StageI_I;
+        sum += (lines[2][x]  + lines[3][x])*StageI_II;
+        sum += (lines[4][x]  + lines[5][x])*StageI_III;
+        sum += (lines[6][x]  + lines[7][x])*StageI_IV;
+        sum += (lines[8][x]  + lines[9][x])*StageI_V;
+        sum += (lines[10][x] + lines[11][x])*StageI_VI;
         sum += 1<<(StageI_Shift-1);//do rounding right
+        row[x] = sum >> StageI_Shift;
+    }// x
+}
 
-        new_data[colpos][linepos] = sum >> StageI_Shift;
-
-    }
-     //Middle of column
-    for( int x=(2*Stage_I_Size) ; x<xlen-(2*Stage_I_Size) ; x+=2 , linepos++) 
+// The loop over the columns is the same every time so lends itself to isolation
+// as an individual function.
+void DownConverter::RowLoop( const int colpos , PicArray& new_data)
+{
+    // The row buffer has been padded, so every output sample uses the
+    // same filter. We only want every other sample of the row.
+    const ValueType* row = &m_row_buffer[Stage_I_Size];
+    ValueType* out = new_data[colpos];
+    const int xlen = new_data.LengthX();
+    int linepos = 0;
+
+#if defined(HAVE_SSE2)
+    // Vectorised version: deinterleave the row so each tap is applied to
+    // eight output positions at once. Loads at even offsets e from the
+    // output position supply the samples at offsets e and e+1.
+    const __m128i taps[Stage_I_Size] = { _mm_set1_epi16( StageI_I ),
+                                         _mm_set1_epi16( StageI_II ),
+                                         _mm_set1_epi16( StageI_III ),
+                                         _mm_set1_epi16( StageI_IV ),
+                                         _mm_set1_epi16( StageI_V ),
+                                         _mm_set1_epi16( StageI_VI ) };
+    for ( ; linepos+8<=xlen ; linepos+=8 )
     {
-        sum =  (m_row_buffer[x]   + m_row_buffer[x+1])*StageI_I;
-        sum += (m_row_buffer[x-1] + m_row_buffer[x+2])*StageI_II;
-        sum += (m_row_buffer[x-2] + m_row_buffer[x+3])*StageI_III;
-        sum += (m_row_buffer[x-3] + m_row_buffer[x+4])*StageI_IV;
-        sum += (m_row_buffer[x-4] + m_row_buffer[x+5])*StageI_V;
-        sum += (m_row_buffer[x-5] + m_row_buffer[x+6])*StageI_VI;
-        sum += 1<<(StageI_Shift-1);//do rounding right
-
-        new_data[colpos][linepos] = sum >> StageI_Shift;
+        // samples[n] holds the samples at offset n-Stage_I_Size
+        __m128i samples[2*Stage_I_Size+1];
+        const ValueType* pos = row + 2*linepos;
+        for ( int e=-Stage_I_Size ; e<=Stage_I_Size ; e+=2 )
+        {
+            const __m128i a = _mm_loadu_si128( (const __m128i*)(pos+e) );
+            const __m128i b = _mm_loadu_si128( (const __m128i*)(pos+e+8) );
+            samples[e+Stage_I_Size] = EvenSamples( a, b );
+            if ( e<Stage_I_Size )
+                samples[e+Stage_I_Size+1] = OddSamples( a, b );
+        }// e
+
+        __m128i sum_lo = _mm_setzero_si128();
+        __m128i sum_hi = _mm_setzero_si128();
+        for ( int k=0 ; k<Stage_I_Size ; ++k )
+            AddTapPair( samples[Stage_I_Size-k], samples[Stage_I_Size+1+k],
+                        taps[k], sum_lo, sum_hi );
+
+        _mm_storeu_si128( (__m128i*)(out+linepos), RoundAndPack( sum_lo, sum_hi, StageI_Shift ) );
+    }// linepos
+#endif
 
-    }
-     //Trailing column edge
-    for( int x=xlen-(2*Stage_I_Size) ; x< xlen-1 ; x+=2 , linepos++ )
+    //Calculation variables
+    int sum;
+    for( int x=2*linepos ; linepos<xlen ; x+=2 , linepos++ )
     {
-        sum =  (m_row_buffer[x]   + m_row_buffer[((x+1)<xlen)?(x+1):(xlen-1)])*StageI_I;
-        sum += (m_row_buffer[x-1] + m_row_buffer[((x+2)<xlen)?(x+2):(xlen-1)])*StageI_II;
-        sum += (m_row_buffer[x-2] + m_row_buffer[((x+3)<xlen)?(x+3):(xlen-1)])*StageI_III;
-        sum += (m_row_buffer[x-3] + m_row_buffer[((x+4)<xlen)?(x+4):(xlen-1)])*StageI_IV;
-        sum += (m_row_buffer[x-4] + m_row_buffer[((x+5)<xlen)?(x+5):(xlen-1)])*StageI_V;
-        sum += (m_row_buffer[x-5] + m_row_buffer[((x+6)<xlen)?(x+6):(xlen-1)])*StageI_VI;
+        sum =  (row[x]   + row[x+1])*StageI_I;
+        sum += (row[x-1] + row[x+2])*StageI_II;
+        sum += (row[x-2] + row[x+3])*StageI_III;
+        sum += (row[x-3] + row[x+4])*StageI_IV;
+        sum += (row[x-4] + row[x+5])*StageI_V;
+        sum += (row[x-5] + row[x+6])*StageI_VI;
         sum += 1<<(StageI_Shift-1);//do rounding right
 
-        new_data[colpos][linepos] = sum >> StageI_Shift;
-
-    }
-
+        out[linepos] = sum >> StageI_Shift;
+    }// linepos
 }
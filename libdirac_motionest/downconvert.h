@@ -64,6 +64,10 @@ namespace dirac
             A function to do the actual downconversion. 
             \param    old_data    the picture data to be downconverted
             \param    new_data    the resulting down-converted data. The array must be of the correct size.
+
+            Data outside the picture is taken to repeat the edge values. The
+            same converter may be used for a whole picture hierarchy, as the
+            working buffer is only reallocated when it needs to grow.
          */
         void DoDownConvert(const PicArray& old_data, PicArray& new_data);
 
@@ -73,10 +77,14 @@ namespace dirac
         //Assignment=
         DownConverter& operator=(const DownConverter& rhs);//private, body-less: class should not be assigned
 
-        //Applies the filter to a single column
+        //Applies the filter down the columns to make a single line
+        void ColumnFilter(const ValueType* const* lines, const int xlen );
+
+        //Applies the filter along the line to make a single output line
         void RowLoop(const int colpos , PicArray& new_data );
 
-        ValueType* m_row_buffer;
+        //The output of the column filter, padded at either end
+        std::vector<ValueType> m_row_buffer;
 
         //Define filter parameters
         static const int Stage_I_Size = 6;
@@ -76,16 +76,16 @@ void ModeDecider::DoModeDecn( EncQueue& my_buffer, int pic_num )
     // all SAD costs are normalised to the area corresponding to non-overlapping
     // 16 blocks of size XBLEN*YBLEN.
 
-    m_level_factor[0] = float( 16 * m_predparams->LumaBParams(2).Xblen() * m_predparams->LumaBParams(2).Yblen() )/
-       float( m_predparams->LumaBParams(0).Xblen() * m_predparams->LumaBParams(0).Yblen() );
+    m_level_factor[0] = ( MECostType( 16 * m_predparams->LumaBParams(2).Xblen() * m_predparams->LumaBParams(2).Yblen() )<<ME_COST_SHIFT )/
+       MECostType( m_predparams->LumaBParams(0).Xblen() * m_predparams->LumaBParams(0).Yblen() );
 
-    m_level_factor[1] = float( 4 * m_predparams->LumaBParams(2).Xblen() * m_predparams->LumaBParams(2).Yblen() )/
-       float( m_predparams->LumaBParams(1).Xblen() * m_predparams->LumaBParams(1).Yblen() );
+    m_level_factor[1] = ( MECostType( 4 * m_predparams->LumaBParams(2).Xblen() * m_predparams->LumaBParams(2).Yblen() )<<ME_COST_SHIFT )/
+       MECostType( m_predparams->LumaBParams(1).Xblen() * m_predparams->LumaBParams(1).Yblen() );
 
-    m_level_factor[2] = 1.0f;
+    m_level_factor[2] = ToMECost( 1.0 );
 
     for (int i=0 ; i<=2 ; ++i)
-        m_mode_factor[i] = 80.0*std::pow(0.8 , 2-i);
+        m_mode_factor[i] = ToMECost( 80.0*std::pow(0.8 , 2-i) );
 
      // We've got 'raw' block motion vectors for up to two reference pictures. Now we want
      // to make a decision as to mode. In this initial implementation, this is bottom-up
@@ -122,8 +122,10 @@ void ModeDecider::DoModeDecn( EncQueue& my_buffer, int pic_num )
         m_me_data_set[2] = &my_buffer.GetPicture(pic_num).GetMEData();
 
         // Set up the lambdas to use per block
-        m_me_data_set[0]->SetLambdaMap( 0 , m_me_data_set[2]->LambdaMap() , 1.0/m_level_factor[0] );
-        m_me_data_set[1]->SetLambdaMap( 1 , m_me_data_set[2]->LambdaMap() , 1.0/m_level_factor[1] );
+        m_me_data_set[0]->SetLambdaMap( 0 , m_me_data_set[2]->LambdaMap() ,
+                                        ToMECost( 1.0 ) , m_level_factor[0] );
+        m_me_data_set[1]->SetLambdaMap( 1 , m_me_data_set[2]->LambdaMap() ,
+                                        ToMECost( 1.0 ) , m_level_factor[1] );
 
         // Set up the reference pictures
         m_ref1_updata = &(my_buffer.GetPicture( ref1 ).UpDataForME(m_encparams.CombinedME()) );
@@ -182,7 +184,7 @@ void ModeDecider::DoSBDecn()
 
     // Start with 4x4 modes
     DoLevelDecn(2);
-    float old_best_SB_cost = m_me_data_set[2]->SBCosts()[m_ysb_loc][m_xsb_loc];
+    MECostType old_best_SB_cost = m_me_data_set[2]->SBCosts()[m_ysb_loc][m_xsb_loc];
 
     // Next do 2x2 modes
     DoLevelDecn(1);
@@ -214,7 +216,7 @@ void ModeDecider::DoLevelDecn( int level )
 
     //    Case 1: prediction modes are all different
 
-    float SB_cost = 0.0;
+    MECostType SB_cost = 0;
     for ( int j=ystart ; j<yend ; ++j)
     {
         for (int i=xstart ; i<xend ; ++i)
@@ -296,7 +298,7 @@ void ModeDecider::DoME(const int xpos , const int ypos , const int level)
     CandidateList cand_list;
 
     // The lambda to use for motion estimation
-    const float lambda = me_data.LambdaMap()[ypos][xpos];
+    const MECostType lambda = me_data.LambdaMap()[ypos][xpos];
 
     // The predicting motion vector
     MVector mv_pred;
@@ -325,13 +327,13 @@ void ModeDecider::DoME(const int xpos , const int ypos , const int level)
                               m_predparams->LumaBParams(level) ,
                               m_predparams->MVPrecision(),
                               me_data.Vectors(1) , me_data.PredCosts(1) );
-    me_data.PredCosts(1)[ypos][xpos].total = 100000000.0f;
+    me_data.PredCosts(1)[ypos][xpos].total = MAX_ME_COST;
     my_bmatch1.FindBestMatchSubp( xpos , ypos , cand_list, mv_pred, lambda );
 
     if (num_refs>1)
     {//do the same for the other reference
 
-        cand_list.clear();
+        cand_list.Clear();
 
         for ( int j=0 ; j<2 ; ++j )
             for (int i=0 ; i<2 ; ++i )
@@ -357,7 +359,7 @@ void ModeDecider::DoME(const int xpos , const int ypos , const int level)
                                  m_predparams->LumaBParams(level) ,
                                  m_predparams->MVPrecision(),
                                  me_data.Vectors(2) , me_data.PredCosts(2) );
-        me_data.PredCosts(2)[ypos][xpos].total = 100000000.0f;
+        me_data.PredCosts(2)[ypos][xpos].total = MAX_ME_COST;
         my_bmatch2.FindBestMatchSubp( xpos , ypos , cand_list, mv_pred, lambda );
 
      }
@@ -365,7 +367,7 @@ void ModeDecider::DoME(const int xpos , const int ypos , const int level)
 
 
 
-float ModeDecider::DoUnitDecn(const int xpos , const int ypos , const int level )
+MECostType ModeDecider::DoUnitDecn(const int xpos , const int ypos , const int level )
 {
     // For a given prediction unit (SB, subSB or block) find the best
     // mode, given that the REF1 and REF2 motion estimation has
@@ -377,12 +379,12 @@ float ModeDecider::DoUnitDecn(const int xpos , const int ypos , const int level
 //    const int xblock = xpos<<(2-level);
 //    const int yblock = ypos<<(2-level);
 
-    const float loc_lambda = me_data.LambdaMap()[ypos][xpos];
+    const MECostType loc_lambda = me_data.LambdaMap()[ypos][xpos];
 
-    float unit_cost;
-    float mode_cost(0.0);
-    float min_unit_cost;
-    float best_SAD_value;
+    MECostType unit_cost;
+    MECostType mode_cost(0);
+    MECostType min_unit_cost;
+    CalcValueType best_SAD_value;
 
     BlockDiffParams dparams;
 
@@ -393,7 +395,7 @@ float ModeDecider::DoUnitDecn(const int xpos , const int ypos , const int level
 
 //    mode_cost = ModeCost( xblock , yblock )*m_mode_factor[level];
     me_data.Mode()[ypos][xpos] = REF1_ONLY;
-    me_data.PredCosts(1)[ypos][xpos].total *= m_level_factor[level];
+    me_data.PredCosts(1)[ypos][xpos].total = ( me_data.PredCosts(1)[ypos][xpos].total*m_level_factor[level] )>>ME_COST_SHIFT;
     min_unit_cost = me_data.PredCosts(1)[ypos][xpos].total + mode_cost;
     best_SAD_value = me_data.PredCosts(1)[ypos][xpos].SAD;
 
@@ -403,7 +405,7 @@ float ModeDecider::DoUnitDecn(const int xpos , const int ypos , const int level
        /*************************/
 
 //        mode_cost = ModeCost( xblock , yblock )*m_mode_factor[level];
-        me_data.PredCosts(2)[ypos][xpos].total *= m_level_factor[level];
+        me_data.PredCosts(2)[ypos][xpos].total = ( me_data.PredCosts(2)[ypos][xpos].total*m_level_factor[level] )>>ME_COST_SHIFT;
         unit_cost = me_data.PredCosts(2)[ypos][xpos].total + mode_cost;
         if ( unit_cost<min_unit_cost )
         {
@@ -426,7 +428,7 @@ float ModeDecider::DoUnitDecn(const int xpos , const int ypos , const int level
 
         me_data.BiPredCosts()[ypos][xpos].SetTotal( loc_lambda );
 
-        me_data.BiPredCosts()[ypos][xpos].total *= m_level_factor[level];
+        me_data.BiPredCosts()[ypos][xpos].total = ( me_data.BiPredCosts()[ypos][xpos].total*m_level_factor[level] )>>ME_COST_SHIFT;
         unit_cost = me_data.BiPredCosts()[ypos][xpos].total + mode_cost;
 
         if ( unit_cost<min_unit_cost )
@@ -441,17 +443,19 @@ float ModeDecider::DoUnitDecn(const int xpos , const int ypos , const int level
     // Calculate the cost if we were to code the block as intra //
     /************************************************************/
 
-    if ( level==2 && best_SAD_value> 4.0*m_predparams->LumaBParams( level ).Xblen()*
-                                         m_predparams->LumaBParams( level ).Yblen() )
+    if ( level==2 && best_SAD_value> 4*m_predparams->LumaBParams( level ).Xblen()*
+                                       m_predparams->LumaBParams( level ).Yblen() )
     {
 //        mode_cost = ModeCost( xblock , yblock ) * m_mode_factor[level];
-        me_data.IntraCosts()[ypos][xpos] = m_intradiff->Diff( dparams , me_data.DC( Y_COMP )[ypos][xpos] );
+        me_data.IntraCosts()[ypos][xpos] = SADToMECost( m_intradiff->Diff( dparams , me_data.DC( Y_COMP )[ypos][xpos] ) );
 //        me_data.IntraCosts()[ypos][xpos] += loc_lambda * 
 //                                       GetDCVar( me_data.DC( Y_COMP )[ypos][xpos] , GetDCPred( xblock , yblock ) );
-        me_data.IntraCosts()[ypos][xpos] *= m_level_factor[level];
+        me_data.IntraCosts()[ypos][xpos] = ( me_data.IntraCosts()[ypos][xpos]*m_level_factor[level] )>>ME_COST_SHIFT;
         unit_cost = me_data.IntraCosts()[ypos][xpos] +  mode_cost;
 
-        if ( unit_cost<min_unit_cost && me_data.IntraCosts()[ypos][xpos]<0.85*best_SAD_value)
+        // Only choose intra if it also gives 15% less SAD
+        if ( unit_cost<min_unit_cost &&
+             20*me_data.IntraCosts()[ypos][xpos]<17*SADToMECost( best_SAD_value ) )
         {
             me_data.Mode()[ypos][xpos] = INTRA;
             min_unit_cost = unit_cost;
@@ -478,7 +482,7 @@ ValueType ModeDecider::GetDCPred( int xblock , int yblock )
     return dc_pred;
 }
 
-float ModeDecider::ModeCost(const int xindex , const int yindex)
+MECostType ModeDecider::ModeCost(const int xindex , const int yindex)
 {
     // Computes the variation of the given mode, predmode, from its immediate neighbours
     // First, get a prediction for the mode
@@ -515,9 +519,9 @@ float ModeDecider::ModeCost(const int xindex , const int yindex)
 }
 
 
-float ModeDecider::GetDCVar( const ValueType dc_val , const ValueType dc_pred)
+MECostType ModeDecider::GetDCVar( const ValueType dc_val , const ValueType dc_pred)
 {
-    return 4.0*std::abs( static_cast<float>( dc_val - dc_pred ) );
+    return SADToMECost( 4*std::abs( dc_val - dc_pred ) );
 }
 
 ValueType ModeDecider::GetBlockDC(const PicArray& pic_data,
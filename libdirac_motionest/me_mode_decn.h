@@ -103,19 +103,19 @@ namespace dirac
         void DoLevelDecn( int level );
 
         //! Decide on a mode for a given prediction unit (block, sub-SB or SB)
-        float DoUnitDecn( const int xpos , const int ypos , const int level );
+        MECostType DoUnitDecn( const int xpos , const int ypos , const int level );
 
         //! Do motion estimation for a prediction unit at a given level
         void DoME( const int xpos , const int ypos , const int level );
 
         //! Return a measure of the cost of coding a given mode
-        float ModeCost( const int xindex , const int yindex );
+        MECostType ModeCost( const int xindex , const int yindex );
 
         //! Get a prediction for the dc value of a block
         ValueType GetDCPred( int xblock , int yblock );
 
         //! Get a measure of DC value variance
-        float GetDCVar( const ValueType dc_val , const ValueType dc_pred);
+        MECostType GetDCVar( const ValueType dc_val , const ValueType dc_pred);
 
         //! Go through all the intra blocks and extract the chroma dc values to be coded
         void SetDC( EncQueue& my_buffer, int pic_num);
@@ -139,12 +139,12 @@ namespace dirac
         //! The Lagrangian parameter for motion estimation
         float m_lambda;
 
-        //! Correction factor for comparing SAD costs for different SB splittings
-        OneDArray<float> m_level_factor;
+        //! Fixed-point correction factor for comparing SAD costs for different SB splittings
+        OneDArray<MECostType> m_level_factor;
 
 
-        //! Correction factor for comparing mode costs for different SB splittings
-        OneDArray<float> m_mode_factor;
+        //! Fixed-point correction factor for comparing mode costs for different SB splittings
+        OneDArray<MECostType> m_mode_factor;
 
         //! Motion vector data for each level of splitting
         OneDArray< MEData* > m_me_data_set;
@@ -40,6 +40,7 @@
 using namespace dirac;
 
 #include <iostream>
+#include <algorithm>
 
 using std::vector;
 
@@ -111,42 +112,64 @@ void SubpelRefine::MatchPic(const PicArray& pic_data , const PicArray& refup_dat
     MvArray& mv_array = me_data.Vectors( ref_id );
     TwoDArray<MvCostData>& pred_costs = me_data.PredCosts( ref_id );
 
-    // Provide a block matching object to do the work
-    BlockMatcher my_bmatch( pic_data , refup_data , m_predparams->LumaBParams(2) ,
-                            m_predparams->MVPrecision() , mv_array , pred_costs );
+    // Keep the pixel-accurate vectors, for predicting across the boundaries
+    // between rows of superblocks
+    MvArray pel_mv_array( mv_array.LengthY() , mv_array.LengthX() );
+    pel_mv_array = mv_array;
 
     // Do the work //
     /////////////////
 
-    // Loop over all the blocks, doing the work
+    // Rows of superblocks are done in parallel. Predictions only use
+    // refined vectors from within the same row, and pixel-accurate ones
+    // from the rows above, so the results don't depend on the order in
+    // which the rows are done.
+    const int sb_rows = m_predparams->YNumSB();
+    const int sb_yblocks = m_predparams->YNumBlocks()/std::max( sb_rows , 1 );
+
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (int ysb=0 ; ysb<sb_rows ; ++ysb)
+    {
+        // Provide a block matching object to do the work
+        BlockMatcher my_bmatch( pic_data , refup_data , m_predparams->LumaBParams(2) ,
+                                m_predparams->MVPrecision() , mv_array , pred_costs );
+
+        const int ystart = ysb*sb_yblocks;
+        const int yend = ( ysb==sb_rows-1 ) ? m_predparams->YNumBlocks() : ystart+sb_yblocks;
 
-    for (int yblock=0 ; yblock<m_predparams->YNumBlocks() ; ++yblock){
-        for (int xblock=0 ; xblock<m_predparams->XNumBlocks() ; ++xblock){
-            DoBlock(xblock , yblock , my_bmatch , me_data , ref_id );
-        }// xblock
-    }// yblock
+        for (int yblock=ystart ; yblock<yend ; ++yblock){
+            for (int xblock=0 ; xblock<m_predparams->XNumBlocks() ; ++xblock){
+                DoBlock(xblock , yblock , ystart , my_bmatch , me_data , pel_mv_array , ref_id );
+            }// xblock
+        }// yblock
+    }// ysb
 
 }
 
-void SubpelRefine::DoBlock(const int xblock , const int yblock ,
-                           BlockMatcher& my_bmatch, MEData& me_data , const int ref_id )
+void SubpelRefine::DoBlock(const int xblock , const int yblock , const int ystart ,
+                           BlockMatcher& my_bmatch, MEData& me_data ,
+                           const MvArray& pel_mv_array , const int ref_id )
 {
     // For each block, home into the sub-pixel vector
 
     // Provide aliases for the appropriate motion vector data components
     MvArray& mv_array = me_data.Vectors( ref_id );
 
-    const MVector mv_pred = GetPred( xblock , yblock , mv_array );
-    const float loc_lambda = me_data.LambdaMap()[yblock][xblock];
+    const MVector mv_pred = GetPred( xblock , yblock , ystart , mv_array , pel_mv_array );
+    const MECostType loc_lambda = me_data.LambdaMap()[yblock][xblock];
 
     my_bmatch.RefineMatchSubp( xblock , yblock , mv_pred, loc_lambda );
 }
 
-MVector SubpelRefine::GetPred(int xblock,int yblock,const MvArray& mvarray)
+MVector SubpelRefine::GetPred(int xblock,int yblock,int ystart,const MvArray& mvarray,
+                              const MvArray& pel_mvarray)
 {
     MVector mv_pred;
     ImageCoords n_coords;
     vector<MVector> neighbours;
+    const int precision = m_predparams->MVPrecision();
 
     if (xblock>0 && yblock>0 && xblock<mvarray.LastX())
     {
@@ -155,7 +178,10 @@ MVector SubpelRefine::GetPred(int xblock,int yblock,const MvArray& mvarray)
         {
             n_coords.x = xblock+m_nshift[i].x;
             n_coords.y = yblock+m_nshift[i].y;
-            neighbours.push_back(mvarray[n_coords.y][n_coords.x]);
+            if (n_coords.y>=ystart)
+                neighbours.push_back(mvarray[n_coords.y][n_coords.x]);
+            else
+                neighbours.push_back(pel_mvarray[n_coords.y][n_coords.x]<<precision);
 
         }// i
     }
@@ -165,8 +191,10 @@ MVector SubpelRefine::GetPred(int xblock,int yblock,const MvArray& mvarray)
         {
             n_coords.x = xblock+m_nshift[i].x;
             n_coords.y = yblock+m_nshift[i].y;
-            if (n_coords.x>=0 && n_coords.y>=0 && n_coords.x<mvarray.LengthX() && n_coords.y<mvarray.LengthY())
+            if (n_coords.x>=0 && n_coords.y>=ystart && n_coords.x<mvarray.LengthX() && n_coords.y<mvarray.LengthY())
                 neighbours.push_back(mvarray[n_coords.y][n_coords.x]);
+            else if (n_coords.x>=0 && n_coords.y>=0 && n_coords.x<mvarray.LengthX() && n_coords.y<mvarray.LengthY())
+                neighbours.push_back(pel_mvarray[n_coords.y][n_coords.x]<<precision);
         }// i
     }
 
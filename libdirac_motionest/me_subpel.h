@@ -53,7 +53,8 @@ namespace dirac
         The SubpelRefine class takes pixel-accurate motion vectors and refines
         them to 1/8-pixel accuracy. It uses references upconverted by a factor
         of 2 in each dimension, with the remaining precision gained by doing
-        linear interpolation between values on-the-fly.
+        linear interpolation between values on-the-fly. Rows of superblocks
+        are refined in parallel.
      */
     class SubpelRefine
     {
@@ -87,12 +88,19 @@ namespace dirac
         void MatchPic(const PicArray& pic_data , const PicArray& refup_data , MEData& me_data ,
                                  int ref_id);
 
-        //! Match an individual block
-        void DoBlock( const int xblock , const int yblock ,
-                      BlockMatcher& my_bmatch, MEData& me_data , const int ref_id );
+        //! Match an individual block in a row of superblocks starting at block row ystart
+        void DoBlock( const int xblock , const int yblock , const int ystart ,
+                      BlockMatcher& my_bmatch, MEData& me_data ,
+                      const MvArray& pel_mv_array , const int ref_id );
 
         //! Get a prediction for a block MV from the neighbouring blocks
-        MVector GetPred( int xblock , int yblock , const MvArray& mvarray );
+        /*!
+            Get a prediction for a block MV from the neighbouring blocks,
+            using the pixel-accurate vectors for neighbours above block row
+            ystart, which may not have been refined yet
+        */
+        MVector GetPred( int xblock , int yblock , int ystart ,
+                         const MvArray& mvarray , const MvArray& pel_mvarray );
 
         //member variables
 
@@ -102,9 +110,6 @@ namespace dirac
         //! A local pointer to the encoder params
         const PicturePredParams* m_predparams;
 
-        //! The list of candidate vectors being tested
-        CandidateList m_cand_list;
-
         //! The relative coords of the set of neighbours used to generate MV predictions
         OneDArray<ImageCoords> m_nshift;
 
@@ -43,16 +43,352 @@
 //-------------------------------//
 ///////////////////////////////////
 
-#if defined(HAVE_MMX)
 #include <climits>
-#endif
 #include <libdirac_motionest/me_utils.h>
 #include <libdirac_motionest/me_utils_mmx.h>
 #include <libdirac_common/common.h>
 
+#if defined(HAVE_SSE2)
+#include <emmintrin.h>
+#endif
+
 using namespace dirac;
 
 #include <algorithm>
+
+namespace
+{
+    // Returns the smallest SAD which, added to a fixed-point start cost,
+    // doesn't improve on a best cost, so that the SAD loops can bail out
+    // by comparing integer SADs only
+    CalcValueType SADBound( const MECostType best_cost , const MECostType start_cost )
+    {
+        if ( best_cost <= start_cost )
+            return 0;
+
+        const MECostType bound = ( best_cost - start_cost + ( 1<<ME_COST_SHIFT ) - 1 )>>ME_COST_SHIFT;
+
+        return static_cast<CalcValueType>( std::min( bound , static_cast<MECostType>( INT_MAX ) ) );
+    }
+
+    // Portable block difference kernels, used when there are no vector
+    // versions for the active instruction set
+
+    CalcValueType simple_block_diff( const BlockDiffParams& dparams , const MVector& mv ,
+                                     const PicArray& pic_data , const PicArray& ref_data ,
+                                     const CalcValueType bound )
+    {
+        CalcValueType sum( 0 );
+
+        const ValueType* pic_curr = &pic_data[dparams.Yp()][dparams.Xp()];
+        const int pic_next( pic_data.LengthX() - dparams.Xl() ); // - go down a row and back along
+        const ValueType* ref_curr = &ref_data[dparams.Yp()+mv.y][dparams.Xp()+mv.x];
+        const int ref_next( ref_data.LengthX() - dparams.Xl() );
+
+        for( int y=dparams.Yl(); y>0; --y, pic_curr+=pic_next, ref_curr+=ref_next )
+        {
+            for( int x=dparams.Xl(); x>0; --x, ++pic_curr, ++ref_curr )
+                sum += std::abs( *pic_curr - *ref_curr );
+
+            if ( sum>=bound )
+                return sum;
+        }// y
+
+        return sum;
+    }
+
+    CalcValueType bchk_simple_block_diff( const BlockDiffParams& dparams , const MVector& mv ,
+                                          const PicArray& pic_data , const PicArray& ref_data ,
+                                          const CalcValueType bound )
+    {
+        CalcValueType sum( 0 );
+
+        for ( int j=dparams.Yp() ; j<dparams.Yend() ; ++j )
+        {
+            const ValueType* ref_row = ref_data[BChk( j+mv.y , ref_data.LengthY() )];
+            for( int i=dparams.Xp() ; i<dparams.Xend() ; ++i )
+                sum += std::abs( pic_data[j][i] - ref_row[BChk( i+mv.x , ref_data.LengthX() )] );
+
+            if ( sum>=bound )
+                return sum;
+        }// j
+
+        return sum;
+    }
+
+    CalcValueType simple_intra_block_diff( const BlockDiffParams& dparams ,
+                                           const PicArray& pic_data , ValueType& dc_val )
+    {
+        CalcValueType int_dc( 0 );
+
+        for ( int j=dparams.Yp() ; j<dparams.Yend() ; ++j)
+            for(int i=dparams.Xp(); i<dparams.Xend() ; ++i )
+                int_dc += static_cast<int>( pic_data[j][i] );
+
+        int_dc /= ( dparams.Xl() * dparams.Yl() );
+
+        dc_val = static_cast<ValueType>( int_dc );
+
+        // Now compute the resulting SAD
+        const ValueType dc( dc_val );
+        CalcValueType intra_cost( 0 );
+
+        for (int j=dparams.Yp(); j<dparams.Yend() ; ++j)
+            for( int i=dparams.Xp() ; i<dparams.Xend() ;++i )
+                intra_cost += std::abs( pic_data[j][i] - dc );
+
+        return intra_cost;
+    }
+
+    // The sub-pixel kernels interpolate each prediction from four samples
+    // of the upconverted reference, with the second sample in each
+    // direction being the first one again if the remainder is zero in that
+    // direction. This gives the same results as bilinear interpolation with
+    // weights from the remainder.
+
+    CalcValueType simple_block_diff_up( const PicArray& pic_data , const PicArray& ref_data ,
+                                        const ImageCoords& start_pos , const ImageCoords& end_pos ,
+                                        const ImageCoords& ref_start , const ImageCoords& /*ref_stop*/ ,
+                                        const MVector& rmdr , const CalcValueType bound )
+    {
+        const int xl( end_pos.x - start_pos.x );
+        const int yl( end_pos.y - start_pos.y );
+        const int dx( rmdr.x );
+        const int dy( rmdr.y * ref_data.LengthX() );
+
+        const ValueType* pic_curr = &pic_data[start_pos.y][start_pos.x];
+        const int pic_next( pic_data.LengthX() - xl );// go down a row and back up
+        const ValueType* ref_curr = &ref_data[ref_start.y][ref_start.x];
+        const int ref_next( (ref_data.LengthX() - xl)*2 );// go down 2 rows and back up
+
+        CalcValueType sum( 0 );
+        CalcValueType temp;
+
+        for( int y=yl; y > 0; --y, pic_curr+=pic_next, ref_curr+=ref_next )
+        {
+            for( int x=xl; x > 0; --x, ++pic_curr, ref_curr+=2 )
+            {
+                temp = (    CalcValueType( ref_curr[0] ) +
+                            CalcValueType( ref_curr[dx] ) +
+                            CalcValueType( ref_curr[dy] ) +
+                            CalcValueType( ref_curr[dy+dx] ) +
+                            2
+                        ) >> 2;
+                sum += std::abs( temp - *pic_curr );
+            }// x
+
+            if ( sum>=bound )
+                return sum;
+        }// y
+
+        return sum;
+    }
+
+    void simple_biblock_diff_pic( const PicArray& pic_data , const PicArray& ref_data ,
+                                  TwoDArray<ValueType>& diff ,
+                                  const ImageCoords& start_pos , const ImageCoords& end_pos ,
+                                  const ImageCoords& ref_start , const ImageCoords& /*ref_stop*/ ,
+                                  const MVector& rmdr )
+    {
+        const int xl( end_pos.x - start_pos.x );
+        const int yl( end_pos.y - start_pos.y );
+        const int dx( rmdr.x );
+        const int dy( rmdr.y * ref_data.LengthX() );
+
+        for( int j=0; j<yl; ++j )
+        {
+            const ValueType* pic_curr = &pic_data[start_pos.y+j][start_pos.x];
+            const ValueType* ref_curr = &ref_data[ref_start.y+2*j][ref_start.x];
+            ValueType* diff_curr = diff[j];
+
+            for( int i=0; i<xl; ++i, ref_curr+=2 )
+            {
+                const ValueType temp = (    CalcValueType( ref_curr[0] ) +
+                                            CalcValueType( ref_curr[dx] ) +
+                                            CalcValueType( ref_curr[dy] ) +
+                                            CalcValueType( ref_curr[dy+dx] ) +
+                                            2
+                                        ) >> 2;
+                diff_curr[i] = ( pic_curr[i]<<1 ) - temp;
+            }// i
+        }// j
+    }
+
+    CalcValueType simple_biblock_diff_up( const TwoDArray<ValueType>& diff , const PicArray& ref_data ,
+                                          const ImageCoords& ref_start , const ImageCoords& /*ref_stop*/ ,
+                                          const MVector& rmdr )
+    {
+        const int dx( rmdr.x );
+        const int dy( rmdr.y * ref_data.LengthX() );
+        CalcValueType sum( 0 );
+
+        for( int j=0; j<diff.LengthY(); ++j )
+        {
+            const ValueType* diff_curr = diff[j];
+            const ValueType* ref_curr = &ref_data[ref_start.y+2*j][ref_start.x];
+
+            for( int i=0; i<diff.LengthX(); ++i, ref_curr+=2 )
+            {
+                const ValueType temp = (    CalcValueType( ref_curr[0] ) +
+                                            CalcValueType( ref_curr[dx] ) +
+                                            CalcValueType( ref_curr[dy] ) +
+                                            CalcValueType( ref_curr[dy+dx] ) +
+                                            2
+                                        ) >> 2;
+                sum += std::abs( ( diff_curr[i] - temp )>>1 );
+            }// i
+        }// j
+
+        return sum;
+    }
+
+    bool no_neighbour_diffs( const BlockDiffParams& /*dparams*/ ,
+                             const PicArray& /*pic_data*/ , const PicArray& /*ref_data*/ ,
+                             const int /*rmdr_bits*/ , const MVector& /*centre*/ ,
+                             const MVector /*offsets*/[8] , CalcValueType /*sads*/[8] )
+    {
+        return false;
+    }
+
+#if defined(HAVE_SSE2)
+    bool neighbour_diffs_sse2( const BlockDiffParams& dparams ,
+                               const PicArray& pic_data , const PicArray& ref_data ,
+                               const int rmdr_bits , const MVector& centre ,
+                               const MVector offsets[8] , CalcValueType sads[8] )
+    {
+        if (dparams.Xl() <= 0 || dparams.Yl() <= 0)
+            return false;
+
+        // Every sub-pixel position is a bilinear interpolation of a pair of
+        // samples from each of two rows of the upconverted reference. Samples
+        // for adjacent pixels are two apart, so the pair for each pixel lies
+        // next to each other and a multiply-add does the interpolation of four
+        // pixels at a time.
+        const int scale = 1<<rmdr_bits;
+        const int wt_shift = 2*rmdr_bits;
+        const int rounding = ( 1<<wt_shift )>>1;
+        const int ref_stride = ref_data.LengthX();
+
+        ImageCoords ref_start[8];
+        CalcValueType wts[8][4];
+        __m128i top_wts[8];
+        __m128i bottom_wts[8];
+        __m128i acc[8];
+
+        for ( int n=0 ; n<8 ; ++n )
+        {
+            const MVector mv( centre.x+offsets[n].x , centre.y+offsets[n].y );
+            const MVector rmdr( mv.x & ( scale-1 ) , mv.y & ( scale-1 ) );
+
+            ref_start[n].x = ( dparams.Xp()<<1 ) + ( mv.x>>rmdr_bits );
+            ref_start[n].y = ( dparams.Yp()<<1 ) + ( mv.y>>rmdr_bits );
+
+            if ( ref_start[n].x<0 || ref_start[n].x+( dparams.Xl()<<1 ) > ref_data.LengthX() ||
+                 ref_start[n].y<0 || ref_start[n].y+( dparams.Yl()<<1 ) > ref_data.LengthY() )
+                return false;
+
+            wts[n][0] = ( scale-rmdr.x ) * ( scale-rmdr.y );
+            wts[n][1] = rmdr.x * ( scale-rmdr.y );
+            wts[n][2] = ( scale-rmdr.x ) * rmdr.y;
+            wts[n][3] = rmdr.x * rmdr.y;
+
+            top_wts[n] = _mm_set1_epi32( wts[n][0] | ( wts[n][1]<<16 ) );
+            bottom_wts[n] = _mm_set1_epi32( wts[n][2] | ( wts[n][3]<<16 ) );
+            acc[n] = _mm_setzero_si128();
+            sads[n] = 0;
+        }// n
+
+        const __m128i round = _mm_set1_epi32( rounding );
+        const __m128i shift = _mm_cvtsi32_si128( wt_shift );
+        const int xl4 = dparams.Xl() & ~3;
+
+        for ( int j=0 ; j<dparams.Yl() ; ++j )
+        {
+            const ValueType* pic_row = &pic_data[dparams.Yp()+j][dparams.Xp()];
+
+            const ValueType* ref_rows[8];
+            for ( int n=0 ; n<8 ; ++n )
+                ref_rows[n] = &ref_data[ref_start[n].y+2*j][ref_start[n].x];
+
+            for ( int i=0 ; i<xl4 ; i+=4 )
+            {
+                __m128i pic = _mm_loadl_epi64( (const __m128i*)( pic_row+i ) );
+                pic = _mm_srai_epi32( _mm_unpacklo_epi16( pic , pic ) , 16 );
+
+                for ( int n=0 ; n<8 ; ++n )
+                {
+                    const ValueType* ref = ref_rows[n] + 2*i;
+                    __m128i val = _mm_add_epi32(
+                        _mm_madd_epi16( _mm_loadu_si128( (const __m128i*)ref ) , top_wts[n] ) ,
+                        _mm_madd_epi16( _mm_loadu_si128( (const __m128i*)( ref+ref_stride ) ) , bottom_wts[n] ) );
+                    val = _mm_sra_epi32( _mm_add_epi32( val , round ) , shift );
+
+                    const __m128i diff = _mm_sub_epi32( val , pic );
+                    const __m128i sign = _mm_srai_epi32( diff , 31 );
+                    acc[n] = _mm_add_epi32( acc[n] , _mm_sub_epi32( _mm_xor_si128( diff , sign ) , sign ) );
+                }// n
+            }// i
+
+            for ( int i=xl4 ; i<dparams.Xl() ; ++i )
+            {
+                for ( int n=0 ; n<8 ; ++n )
+                {
+                    const ValueType* ref = ref_rows[n] + 2*i;
+                    const CalcValueType val = ( wts[n][0] * CalcValueType( ref[0] ) +
+                                                wts[n][1] * CalcValueType( ref[1] ) +
+                                                wts[n][2] * CalcValueType( ref[ref_stride] ) +
+                                                wts[n][3] * CalcValueType( ref[ref_stride+1] ) +
+                                                rounding ) >> wt_shift;
+                    sads[n] += std::abs( val - pic_row[i] );
+                }// n
+            }// i
+        }// j
+
+        for ( int n=0 ; n<8 ; ++n )
+        {
+            int lanes[4];
+            _mm_storeu_si128( (__m128i*)lanes , acc[n] );
+            sads[n] += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+        }// n
+
+        return true;
+    }
+#endif
+}
+
+BlockDiffKernels dirac::SelectBlockDiffKernels( const CpuLevel level )
+{
+    BlockDiffKernels kernels;
+    kernels.block_diff = simple_block_diff;
+    kernels.bchk_block_diff = bchk_simple_block_diff;
+    kernels.intra_block_diff = simple_intra_block_diff;
+    kernels.block_diff_up = simple_block_diff_up;
+    kernels.biblock_diff_pic = simple_biblock_diff_pic;
+    kernels.biblock_diff_up = simple_biblock_diff_up;
+    kernels.neighbour_diffs = no_neighbour_diffs;
+
+#if defined(HAVE_MMX)
+    if ( level>=CPU_LEVEL_MMX )
+    {
+        kernels.block_diff = simple_block_diff_mmx_4;
+        kernels.bchk_block_diff = bchk_simple_block_diff_mmx_4;
+        kernels.intra_block_diff = simple_intra_block_diff_mmx_4;
+        kernels.block_diff_up = simple_block_diff_up_mmx_4;
+        kernels.biblock_diff_pic = simple_biblock_diff_pic_mmx_4;
+        kernels.biblock_diff_up = simple_biblock_diff_up_mmx_4;
+    }
+#endif
+#if defined(HAVE_SSE2)
+    if ( level>=CPU_LEVEL_SSE2 )
+        kernels.neighbour_diffs = neighbour_diffs_sse2;
+#endif
+#if !defined(HAVE_MMX) && !defined(HAVE_SSE2)
+    (void) level;
+#endif
+
+    return kernels;
+}
+
 //#define INTRA_HAAR
 
 void BlockDiffParams::SetBlockLimits( const OLBParams& bparams ,
@@ -77,13 +413,39 @@ void BlockDiffParams::SetBlockLimits( const OLBParams& bparams ,
 
 }
 
+BlockSums::BlockSums( const PicArray& data , const int xmargin , const int ymargin ):
+    m_xmargin( xmargin ),
+    m_ymargin( ymargin ),
+    m_xl( data.LengthX() + 2*xmargin ),
+    m_yl( data.LengthY() + 2*ymargin )
+{
+    const int width = m_xl+1;
+    m_sums.assign( width*( m_yl+1 ) , 0 );
+
+    for ( int j=0 ; j<m_yl ; ++j )
+    {
+        const int y = std::min( std::max( j-m_ymargin , 0 ) , data.LastY() );
+        const unsigned int* above = &m_sums[j*width];
+        unsigned int* sums = &m_sums[( j+1 )*width];
+
+        unsigned int row_sum( 0 );
+        for ( int i=0 ; i<m_xl ; ++i )
+        {
+            const int x = std::min( std::max( i-m_xmargin , 0 ) , data.LastX() );
+            row_sum += static_cast<unsigned int>( data[y][x] );
+            sums[i+1] = above[i+1] + row_sum;
+        }// i
+    }// j
+}
+
 // Block difference class functions
 
 // Constructors ...
 
 BlockDiff::BlockDiff(const PicArray& ref,const PicArray& pic) :
     m_pic_data( pic ),
-    m_ref_data( ref )
+    m_ref_data( ref ),
+    m_kernels( SelectBlockDiffKernels( ActiveCpuLevel() ) )
 {}
 
 PelBlockDiff::PelBlockDiff( const PicArray& ref , const PicArray& pic ) :
@@ -91,30 +453,33 @@ PelBlockDiff::PelBlockDiff( const PicArray& ref , const PicArray& pic ) :
 {}
 
 IntraBlockDiff::IntraBlockDiff( const PicArray& pic ) :
-    m_pic_data( pic )
+    m_pic_data( pic ),
+    m_kernels( SelectBlockDiffKernels( ActiveCpuLevel() ) )
 {}
 
 BiBlockDiff::BiBlockDiff( const PicArray& ref1 , const PicArray& ref2 ,
                           const PicArray& pic) :
     m_pic_data( pic ),
     m_ref_data1( ref1 ),
-    m_ref_data2( ref2 )
+    m_ref_data2( ref2 ),
+    m_kernels( SelectBlockDiffKernels( ActiveCpuLevel() ) )
 {}
 
-BlockDiffUp::BlockDiffUp( const PicArray& ref , const PicArray& pic ):
-    BlockDiff( ref , pic )
+BlockDiffUp::BlockDiffUp( const PicArray& ref , const PicArray& pic , const int rmdr_bits ):
+    BlockDiff( ref , pic ),
+    m_rmdr_bits( rmdr_bits )
 {}
 
 BlockDiffHalfPel::BlockDiffHalfPel( const PicArray& ref , const PicArray& pic ) :
-    BlockDiffUp( ref , pic )
+    BlockDiffUp( ref , pic , 0 )
 {}
 
 BlockDiffQuarterPel::BlockDiffQuarterPel( const PicArray& ref , const PicArray& pic ) :
-    BlockDiffUp( ref , pic )
+    BlockDiffUp( ref , pic , 1 )
 {}
 
 BlockDiffEighthPel::BlockDiffEighthPel( const PicArray& ref , const PicArray& pic ) :
-    BlockDiffUp( ref , pic )
+    BlockDiffUp( ref , pic , 2 )
 {}
 
 BiBlockHalfPel::BiBlockHalfPel( const PicArray& ref1 , const PicArray& ref2 ,
@@ -135,15 +500,13 @@ BiBlockEighthPel::BiBlockEighthPel( const PicArray& ref1 , const PicArray& ref2
 
 // Difference functions ...
 
-float PelBlockDiff::Diff( const BlockDiffParams& dparams, const MVector& mv )
+CalcValueType PelBlockDiff::Diff( const BlockDiffParams& dparams, const MVector& mv )
 {
     if (dparams.Xl() <= 0 || dparams.Yl() <= 0)
     {
         return 0;
     }
 
-    CalcValueType sum( 0 );
-
     const ImageCoords ref_start( dparams.Xp()+mv.x , dparams.Yp()+mv.y );
     const ImageCoords ref_stop( dparams.Xend()+mv.x , dparams.Yend()+mv.y );
     
@@ -156,46 +519,14 @@ float PelBlockDiff::Diff( const BlockDiffParams& dparams, const MVector& mv )
         bounds_check = true;
 
     if ( !bounds_check )
-    {
-#if defined(HAVE_MMX)
-        return static_cast<float>(simple_block_diff_mmx_4(dparams, mv, m_pic_data, m_ref_data, INT_MAX));
-#else
-        ValueType diff;    
-        for ( int j=dparams.Yp() ; j<dparams.Yp()+dparams.Yl() ; ++j )
-        { 
-            for(int i=dparams.Xp() ; i< dparams.Xp()+dparams.Xl() ; ++i )
-            {
-                diff = m_pic_data[j][i]-m_ref_data[j+mv.y][i+mv.x];
-                sum += std::abs( diff );
-            }// i
-        }// j
-#endif /* HAVE_MMX */
-    }
+        return m_kernels.block_diff( dparams , mv , m_pic_data , m_ref_data , INT_MAX );
     else
-    {
-#if defined (HAVE_MMX)
-        return static_cast<float>(bchk_simple_block_diff_mmx_4(dparams, mv, m_pic_data, m_ref_data, INT_MAX));
-#else
-        ValueType diff;    
-        for ( int j=dparams.Yp() ; j < dparams.Yp()+dparams.Yl() ; ++j )
-        { 
-            for( int i=dparams.Xp() ; i < dparams.Xp()+dparams.Xl() ; ++i )
-            {
-                diff = m_pic_data[j][i] - m_ref_data[BChk(j+mv.y , m_ref_data.LengthY())][BChk(i+mv.x , m_ref_data.LengthX())];
-                sum += std::abs( diff );
-
-            }// i
-        }// j
-
-#endif /* HAVE_MMX */
-    }
-    
-    return static_cast<float>( sum );
+        return m_kernels.bchk_block_diff( dparams , mv , m_pic_data , m_ref_data , INT_MAX );
 }
 
 void PelBlockDiff::Diff( const BlockDiffParams& dparams, 
                          const MVector& mv,
-                         float& best_sum,
+                         MECostType& best_cost,
                          MVector& best_mv )
 {
     if (dparams.Xl() <= 0 || dparams.Yl() <= 0)
@@ -203,6 +534,8 @@ void PelBlockDiff::Diff( const BlockDiffParams& dparams,
         return;
     }
 
+    // The SAD at which we can't improve on the best cost
+    const CalcValueType bound( SADBound( best_cost , 0 ) );
     CalcValueType sum( 0 );
 
     const ImageCoords ref_start( dparams.Xp()+mv.x , dparams.Yp()+mv.y );
@@ -217,66 +550,14 @@ void PelBlockDiff::Diff( const BlockDiffParams& dparams,
         bounds_check = true;
 
     if ( !bounds_check )
-    {
-#if defined (HAVE_MMX)
-        sum  = simple_block_diff_mmx_4(dparams, mv, m_pic_data, m_ref_data, static_cast<int>(best_sum));
-        if (sum < best_sum)
-        {
-               best_sum = sum;
-               best_mv = mv;
-        }
-        return; 
-#else
-        ValueType diff;    
-        ValueType *pic_curr = &m_pic_data[dparams.Yp()][dparams.Xp()];
-        const int pic_next( m_pic_data.LengthX() - dparams.Xl() ); // - go down a row and back along
-    
-
-        ValueType *ref_curr = &m_ref_data[ref_start.y][ref_start.x];
-
-        for( int y=dparams.Yl(); y>0; --y, pic_curr+=pic_next, ref_curr+=pic_next )
-        {
-            for( int x=dparams.Xl(); x>0; --x, ++pic_curr, ++ref_curr )
-            {
-                diff = (*pic_curr)-(*ref_curr);
-                sum += std::abs( diff );
-            }// x
-
-            if ( sum>=best_sum )
-                return;
-
-        }// y
-#endif /* HAVE_MMX */
-    }
+        sum = m_kernels.block_diff( dparams , mv , m_pic_data , m_ref_data , bound );
     else
-    {
-#if defined (HAVE_MMX)
-           sum = (bchk_simple_block_diff_mmx_4(dparams, mv, m_pic_data, m_ref_data, static_cast<int>(best_sum)));
-        if (sum < best_sum)
-        {
-            best_sum = sum;
-            best_mv = mv;
-        }
-        return;
-#else
-        ValueType diff;    
-        for ( int j=dparams.Yp() ; j<dparams.Yend() ; ++j )
-        { 
-            for( int i=dparams.Xp() ; i<dparams.Xend() ; ++i )
-            {
-                diff = m_pic_data[j][i] - m_ref_data[BChk(j+mv.y , m_ref_data.LengthY())][BChk(i+mv.x , m_ref_data.LengthX())];
-                sum += std::abs( diff );
-
-            }// i
-
-            if ( sum>=best_sum )
-                return;
+        sum = m_kernels.bchk_block_diff( dparams , mv , m_pic_data , m_ref_data , bound );
 
-        }// j
-#endif /* HAVE_MMX */
-    }
+    if ( sum>=bound )
+        return;
 
-    best_sum = sum;
+    best_cost = SADToMECost( sum );
     best_mv = mv;
     
 }
@@ -299,7 +580,7 @@ ValueType IntraBlockDiff::CalcDC( const BlockDiffParams& dparams ){
 }
 
 #ifdef INTRA_HAAR
-float IntraBlockDiff::Diff( const BlockDiffParams& dparams , ValueType& dc_val )
+CalcValueType IntraBlockDiff::Diff( const BlockDiffParams& dparams , ValueType& dc_val )
 {
     if (dparams.Xl() <= 0 || dparams.Yl() <= 0)
     {
@@ -335,12 +616,12 @@ float IntraBlockDiff::Diff( const BlockDiffParams& dparams , ValueType& dc_val )
         }
     }
    
-    return static_cast<float>( intra_cost );
+    return intra_cost;
 }
 
 #else
 
-float IntraBlockDiff::Diff( const BlockDiffParams& dparams , ValueType& dc_val )
+CalcValueType IntraBlockDiff::Diff( const BlockDiffParams& dparams , ValueType& dc_val )
 {
     if (dparams.Xl() <= 0 || dparams.Yl() <= 0)
     {
@@ -349,65 +630,35 @@ float IntraBlockDiff::Diff( const BlockDiffParams& dparams , ValueType& dc_val )
     }
 
      //computes the cost if block is predicted by its dc component
-#if defined(HAVE_MMX)
-    CalcValueType intra_cost =
-            simple_intra_block_diff_mmx_4 (dparams, m_pic_data, dc_val);
+    const CalcValueType intra_cost = m_kernels.intra_block_diff( dparams , m_pic_data , dc_val );
 
 #ifdef DIRAC_DEBUG
-    CalcValueType int_dc( 0 );
-    ValueType non_mmx_dc(0);
+    ValueType generic_dc( 0 );
+    const CalcValueType generic_intra_cost =
+            simple_intra_block_diff( dparams , m_pic_data , generic_dc );
 
-    for ( int j=dparams.Yp() ; j<dparams.Yp()+dparams.Yl() ; ++j)
-        for(int i=dparams.Xp(); i<dparams.Xp()+dparams.Xl() ; ++i )
-            int_dc += static_cast<int>( m_pic_data[j][i] );
-
-    int_dc /= ( dparams.Xl() * dparams.Yl() );
-
-    non_mmx_dc = static_cast<ValueType>( int_dc );
-
-    // Now compute the resulting SAD
-    ValueType dc( non_mmx_dc );
-    CalcValueType non_mmx_intra_cost( 0 );
-
-    for (int j=dparams.Yp(); j<dparams.Yend() ; ++j)
-        for( int i=dparams.Xp() ; i<dparams.Xend() ;++i )
-            non_mmx_intra_cost += std::abs( m_pic_data[j][i] - dc );
-
-    if (non_mmx_dc != dc_val || non_mmx_intra_cost != intra_cost)
+    if (generic_dc != dc_val || generic_intra_cost != intra_cost)
     {
-        std::cerr << "MMX vals: dc=" << dc_val;
+        std::cerr << "Active vals: dc=" << dc_val;
         std::cerr << " cost=" << intra_cost << std::endl;
-        //print_arr (pic_data, width[i%5], height[i%5]);
-        std::cerr << "non-MMX vals: dc=" << non_mmx_dc;
-        std::cerr << " cost=" << non_mmx_intra_cost << std::endl;
+        std::cerr << "Generic vals: dc=" << generic_dc;
+        std::cerr << " cost=" << generic_intra_cost << std::endl;
     }
 #endif
-    return static_cast<float>( intra_cost );
-#else
-    CalcValueType int_dc( 0 );
-
-    for ( int j=dparams.Yp() ; j<dparams.Yp()+dparams.Yl() ; ++j)
-        for(int i=dparams.Xp(); i<dparams.Xp()+dparams.Xl() ; ++i )
-            int_dc += static_cast<int>( m_pic_data[j][i] );
-
-    int_dc /= ( dparams.Xl() * dparams.Yl() );
-
-    dc_val = static_cast<ValueType>( int_dc );
-
-    // Now compute the resulting SAD
-    ValueType dc( dc_val );
-    CalcValueType intra_cost( 0 );
-
-    for (int j=dparams.Yp(); j<dparams.Yend() ; ++j)
-        for( int i=dparams.Xp() ; i<dparams.Xend() ;++i )
-            intra_cost += std::abs( m_pic_data[j][i] - dc );
-   
-    return static_cast<float>( intra_cost );
-#endif //HAVE_MMX
+    return intra_cost;
 }
 #endif
 
-float BlockDiffHalfPel::Diff(  const BlockDiffParams& dparams , 
+bool BlockDiffUp::NeighbourDiffs( const BlockDiffParams& dparams ,
+                                  const MVector& centre ,
+                                  const MVector offsets[8] ,
+                                  CalcValueType sads[8] )
+{
+    return m_kernels.neighbour_diffs( dparams , m_pic_data , m_ref_data , m_rmdr_bits ,
+                                      centre , offsets , sads );
+}
+
+CalcValueType BlockDiffHalfPel::Diff(  const BlockDiffParams& dparams , 
                                       const MVector& mv )
 {
     if (dparams.Xl() <= 0 || dparams.Yl() <= 0)
@@ -427,34 +678,18 @@ float BlockDiffHalfPel::Diff(  const BlockDiffParams& dparams ,
          ref_stop.y >= m_ref_data.LengthY() )
         bounds_check = true;
 
-    float sum( 0 );
+    CalcValueType sum( 0 );
 
     if ( !bounds_check )
     {
-#if defined (HAVE_MMX)
         MVector rmdr(0,0);
         const ImageCoords start_pos(dparams.Xp(), dparams.Yp());
         const ImageCoords end_pos(dparams.Xp() + dparams.Xl(), dparams.Yp() + dparams.Yl());
-        sum = simple_block_diff_up_mmx_4 (m_pic_data, m_ref_data,
-                                        start_pos, end_pos,
-                                        ref_start, ref_stop,
-                                        rmdr,
-                                        sum,
-                                        static_cast<float>(INT_MAX));
-#else
-        ValueType* pic_curr = &m_pic_data[dparams.Yp()][dparams.Xp()];
-        const int pic_next( m_pic_data.LengthX() - dparams.Xl() );// go down a row and back up
-        ValueType *ref_curr = &m_ref_data[ref_start.y][ref_start.x];
-        const int ref_next( (m_ref_data.LengthX() - dparams.Xl())*2 );// go down 2 rows and back up
-
-        for( int y=dparams.Yl(); y > 0; --y, pic_curr+=pic_next, ref_curr+=ref_next )
-        {
-            for( int x=dparams.Xl(); x > 0; --x, ++pic_curr, ref_curr+=2 )
-            {
-                sum += std::abs( *ref_curr - *pic_curr );
-            }// x
-        }// y
-#endif
+        sum = m_kernels.block_diff_up( m_pic_data, m_ref_data,
+                                       start_pos, end_pos,
+                                       ref_start, ref_stop,
+                                       rmdr,
+                                       INT_MAX );
 
     }
     else
@@ -482,8 +717,8 @@ float BlockDiffHalfPel::Diff(  const BlockDiffParams& dparams ,
 
 void BlockDiffHalfPel::Diff( const BlockDiffParams& dparams,
                                    const MVector& mv ,
-                                   const float mvcost,
-                                   const float lambda,
+                                   const CalcValueType mvcost,
+                                   const MECostType lambda,
                                    MvCostData& best_costs ,
                                    MVector& best_mv )
 {
@@ -505,42 +740,22 @@ void BlockDiffHalfPel::Diff( const BlockDiffParams& dparams,
          ref_stop.y >= m_ref_data.LengthY() )
         bounds_check = true;
 
-    const float start_val( mvcost*lambda );
-    float sum( start_val );
+    const MECostType start_val( lambda*mvcost );
+    const CalcValueType bound( SADBound( best_costs.total , start_val ) );
+    CalcValueType sum( 0 );
 
     if ( !bounds_check )
     {
-#if defined (HAVE_MMX)
-        
         const ImageCoords start_pos(dparams.Xp(), dparams.Yp());
         const ImageCoords end_pos(dparams.Xp() + dparams.Xl(), dparams.Yp() + dparams.Yl());
         MVector rmdr(0,0);
-        sum = simple_block_diff_up_mmx_4 (m_pic_data, m_ref_data,
-                                        start_pos, end_pos,
-                                        ref_start, ref_stop,
-                                        rmdr,
-                                        sum,
-                                        best_costs.total);
-        if ( sum>=best_costs.total )
+        sum = m_kernels.block_diff_up( m_pic_data, m_ref_data,
+                                       start_pos, end_pos,
+                                       ref_start, ref_stop,
+                                       rmdr,
+                                       bound );
+        if ( sum>=bound )
             return;
-#else
-           ValueType* pic_curr = &m_pic_data[dparams.Yp()][dparams.Xp()];
-           const int pic_next( m_pic_data.LengthX() - dparams.Xl() );// go down a row and back up
-        ValueType *ref_curr = &m_ref_data[ref_start.y][ref_start.x];
-        const int ref_next( (m_ref_data.LengthX() - dparams.Xl())*2 );// go down 2 rows and back up
-
-        for( int y=dparams.Yl(); y > 0; --y, pic_curr+=pic_next, ref_curr+=ref_next )
-        {
-            for( int x=dparams.Xl(); x > 0; --x, ++pic_curr, ref_curr+=2 )
-            {
-                sum += std::abs( *ref_curr - *pic_curr );
-            }// x
-
-            if ( sum>=best_costs.total )
-                return;
-
-        }// y
-#endif
     }
     else
     {
@@ -558,7 +773,7 @@ void BlockDiffHalfPel::Diff( const BlockDiffParams& dparams,
                  sum += std::abs( m_ref_data[by][bx] -*pic_curr);
              }// x
 
-             if ( sum>=best_costs.total )
+             if ( sum>=bound )
                 return;
 
         }// y
@@ -566,12 +781,12 @@ void BlockDiffHalfPel::Diff( const BlockDiffParams& dparams,
     }
 
     best_mv = mv;
-    best_costs.total = sum;
+    best_costs.total = start_val + SADToMECost( sum );
     best_costs.mvcost = mvcost;
-    best_costs.SAD = sum - start_val;
+    best_costs.SAD = sum;
 }
 
-float BlockDiffQuarterPel::Diff(  const BlockDiffParams& dparams , const MVector& mv )
+CalcValueType BlockDiffQuarterPel::Diff(  const BlockDiffParams& dparams , const MVector& mv )
 {
     if (dparams.Xl() <= 0 || dparams.Yl() <= 0)
     {
@@ -595,89 +810,21 @@ float BlockDiffQuarterPel::Diff(  const BlockDiffParams& dparams , const MVector
          ref_stop.y >= m_ref_data.LengthY() )
         bounds_check = true;
 
-    float sum( 0.0f );
+    CalcValueType sum( 0 );
        CalcValueType temp;
 
 
     if ( !bounds_check )
     {
-#if defined (HAVE_MMX)
         const ImageCoords start_pos(dparams.Xp(), dparams.Yp());
         const ImageCoords end_pos(dparams.Xp() + dparams.Xl(), dparams.Yp() + dparams.Yl());
            
-        sum = simple_block_diff_up_mmx_4 (m_pic_data, m_ref_data,
-                                        start_pos, end_pos,
-                                        ref_start, ref_stop,
-                                        rmdr,
-                                        sum,
-                                        static_cast<float>(INT_MAX));
+        sum = m_kernels.block_diff_up( m_pic_data, m_ref_data,
+                                       start_pos, end_pos,
+                                       ref_start, ref_stop,
+                                       rmdr,
+                                       INT_MAX );
 
-#else
-        ValueType* pic_curr = &m_pic_data[dparams.Yp()][dparams.Xp()];
-        const int pic_next( m_pic_data.LengthX() - dparams.Xl() );// go down a row and back up
-        if( rmdr.x == 0 && rmdr.y == 0 )
-        {
-            ValueType *ref_curr = &m_ref_data[ref_start.y][ref_start.x];
-            const int ref_next( (m_ref_data.LengthX() - dparams.Xl())*2 );// go down 2 rows and back up
-            for( int y=dparams.Yl(); y > 0; --y, pic_curr+=pic_next, ref_curr+=ref_next )
-            {
-                for( int x=dparams.Xl(); x > 0; --x, ++pic_curr, ref_curr+=2 )
-                {
-                    sum += std::abs( *ref_curr - *pic_curr );
-                }// x
-            }// y
-        }
-        else if( rmdr.y == 0 )
-        {
-            ValueType *ref_curr = &m_ref_data[ref_start.y][ref_start.x];
-            const int ref_next( (m_ref_data.LengthX() - dparams.Xl())*2 );// go down 2 rows and back up
-            for( int y=dparams.Yl(); y > 0; --y, pic_curr+=pic_next, ref_curr+=ref_next )
-            {
-                for( int x=dparams.Xl(); x > 0; --x, ++pic_curr, ref_curr+=2 )
-                {
-                    temp = (    CalcValueType( ref_curr[0] ) +
-                                CalcValueType( ref_curr[1] ) +
-                                1
-                            ) >> 1;
-                    sum += std::abs( temp - *pic_curr );
-                }// x
-            }// y
-        }
-        else if( rmdr.x == 0 )
-        {
-            ValueType *ref_curr = &m_ref_data[ref_start.y][ref_start.x];
-            const int ref_next( (m_ref_data.LengthX() - dparams.Xl())*2 );// go down 2 rows and back up
-            for( int y=dparams.Yl(); y > 0; --y, pic_curr+=pic_next, ref_curr+=ref_next )
-            {
-                for( int x=dparams.Xl(); x > 0; --x, ++pic_curr, ref_curr+=2 )
-                {
-                    temp = (    CalcValueType( ref_curr[0] ) +
-                                CalcValueType( ref_curr[m_ref_data.LengthX()] ) +
-                                1
-                            ) >> 1;
-                    sum += std::abs( temp - *pic_curr );
-                }// x
-            }// y
-        }
-        else
-        {
-            ValueType *ref_curr = &m_ref_data[ref_start.y][ref_start.x];
-            const int ref_next( (m_ref_data.LengthX() - dparams.Xl())*2 );// go down 2 rows and back up
-            for( int y=dparams.Yl(); y > 0; --y, pic_curr+=pic_next, ref_curr+=ref_next )
-            {
-                for( int x=dparams.Xl(); x > 0; --x, ++pic_curr, ref_curr+=2 )
-                {
-                    temp = (    CalcValueType( ref_curr[0] ) +
-                                CalcValueType( ref_curr[1] ) +
-                                CalcValueType( ref_curr[m_ref_data.LengthX()+0] ) +
-                                CalcValueType( ref_curr[m_ref_data.LengthX()+1] ) +
-                                2
-                            ) >> 2;
-                    sum += std::abs( temp - *pic_curr );
-                }// x
-            }// y
-        }
-#endif // HAVE_MMX
     }
     else
     {
@@ -717,8 +864,8 @@ float BlockDiffQuarterPel::Diff(  const BlockDiffParams& dparams , const MVector
 
 void BlockDiffQuarterPel::Diff( const BlockDiffParams& dparams,
                                    const MVector& mv ,
-                                   const float mvcost,
-                                   const float lambda,
+                                   const CalcValueType mvcost,
+                                   const MECostType lambda,
                                    MvCostData& best_costs ,
                                    MVector& best_mv)
 {
@@ -746,102 +893,25 @@ void BlockDiffQuarterPel::Diff( const BlockDiffParams& dparams,
          ref_stop.y >= m_ref_data.LengthY() )
         bounds_check = true;
 
-    const float start_val( mvcost*lambda );
-    float sum( start_val );
+    const MECostType start_val( lambda*mvcost );
+    const CalcValueType bound( SADBound( best_costs.total , start_val ) );
+    CalcValueType sum( 0 );
 
     CalcValueType temp;
 
     if ( !bounds_check )
     {
-#if defined (HAVE_MMX)
         const ImageCoords start_pos(dparams.Xp(), dparams.Yp());
         const ImageCoords end_pos(dparams.Xp() + dparams.Xl(), dparams.Yp() + dparams.Yl());
         
-        sum = simple_block_diff_up_mmx_4 (m_pic_data, m_ref_data,
-                                        start_pos, end_pos,
-                                        ref_start, ref_stop,
-                                        rmdr,
-                                        sum,
-                                        best_costs.total);
-
-        if ( sum>=best_costs.total )
-            return;
-#else
-        ValueType* pic_curr = &m_pic_data[dparams.Yp()][dparams.Xp()];
-        const int pic_next( m_pic_data.LengthX() - dparams.Xl() );// go down a row and back up
-        ValueType *ref_curr = &m_ref_data[ref_start.y][ref_start.x];
-        const int ref_next( (m_ref_data.LengthX() - dparams.Xl())*2 );// go down 2 rows and back up
-
-        if( rmdr.x == 0 && rmdr.y == 0 )
-        {
-            for( int y=dparams.Yl(); y > 0; --y, pic_curr+=pic_next, ref_curr+=ref_next )
-            {
-                for( int x=dparams.Xl(); x > 0; --x, ++pic_curr, ref_curr+=2 )
-                {
-                    sum += std::abs( *ref_curr - *pic_curr );
-                }// x
-                
-                if ( sum>=best_costs.total )
-                    return;
-            }// y
-        }
-        else if( rmdr.y == 0 )
-        {
-            for( int y=dparams.Yl(); y > 0; --y, pic_curr+=pic_next, ref_curr+=ref_next )
-            {
-                for( int x=dparams.Xl(); x > 0; --x, ++pic_curr, ref_curr+=2 )
-                {
-                    temp = (    CalcValueType( ref_curr[0] ) +
-                                CalcValueType( ref_curr[1] ) +
-                                1
-                            ) >> 1;
-                    sum += std::abs( temp - *pic_curr );
-                }// x
-                
-                if ( sum>=best_costs.total )
-                    return;
-            }// y
-        }
-        else if( rmdr.x == 0 )
-        {
-            for( int y=dparams.Yl(); y > 0; --y, pic_curr+=pic_next, ref_curr+=ref_next )
-            {
-                for( int x=dparams.Xl(); x > 0; --x, ++pic_curr, ref_curr+=2 )
-                {
-                    temp = (    CalcValueType( ref_curr[0] ) +
-                                CalcValueType( ref_curr[m_ref_data.LengthX()] ) +
-                                1
-                            ) >> 1;
-                    sum += std::abs( temp - *pic_curr );
-                }// x
-                
-                if ( sum>=best_costs.total )
-                    return;
+        sum = m_kernels.block_diff_up( m_pic_data, m_ref_data,
+                                       start_pos, end_pos,
+                                       ref_start, ref_stop,
+                                       rmdr,
+                                       bound );
 
-            }// y
-        }
-        else
-        {
-            for( int y=dparams.Yl(); y > 0; --y, pic_curr+=pic_next, ref_curr+=ref_next )
-            {
-                for( int x=dparams.Xl(); x > 0; --x, ++pic_curr, ref_curr+=2 )
-                {
-                    temp = (    CalcValueType( ref_curr[0] ) +
-                                CalcValueType( ref_curr[1] ) +
-                                CalcValueType( ref_curr[m_ref_data.LengthX()+0] ) +
-                                CalcValueType( ref_curr[m_ref_data.LengthX()+1] ) +
-                                2
-                            ) >> 2;
-                    sum += std::abs( temp - *pic_curr );
-                }// x
-                
-                if ( sum>=best_costs.total )
-                    return;
-
-            }// y
-
-        }
-#endif // HAVE_MMX
+        if ( sum>=bound )
+            return;
     }
     else
     {
@@ -872,7 +942,7 @@ void BlockDiffQuarterPel::Diff( const BlockDiffParams& dparams,
                 sum += std::abs( temp - m_pic_data[y][x] );
             }// x
                 
-            if ( sum>=best_costs.total )
+            if ( sum>=bound )
                 return;
 
         }// y
@@ -882,12 +952,12 @@ void BlockDiffQuarterPel::Diff( const BlockDiffParams& dparams,
     // Since we've got here, we must have beaten the best cost to date
 
     best_mv = mv;
-    best_costs.total = sum;
+    best_costs.total = start_val + SADToMECost( sum );
     best_costs.mvcost = mvcost;
-    best_costs.SAD = sum - start_val;
+    best_costs.SAD = sum;
 }
 
-float BlockDiffEighthPel::Diff(  const BlockDiffParams& dparams , const MVector& mv )
+CalcValueType BlockDiffEighthPel::Diff(  const BlockDiffParams& dparams , const MVector& mv )
 {
     if (dparams.Xl() <= 0 || dparams.Yl() <= 0)
     {
@@ -921,7 +991,7 @@ float BlockDiffEighthPel::Diff(  const BlockDiffParams& dparams , const MVector&
          ref_stop.y >= m_ref_data.LengthY() )
         bounds_check = true;
 
-    float sum( 0.0f );
+    CalcValueType sum( 0 );
 
     CalcValueType temp;
 
@@ -1015,8 +1085,8 @@ float BlockDiffEighthPel::Diff(  const BlockDiffParams& dparams , const MVector&
 
 void BlockDiffEighthPel::Diff( const BlockDiffParams& dparams,
                                    const MVector& mv ,
-                                   const float mvcost,
-                                   const float lambda,
+                                   const CalcValueType mvcost,
+                                   const MECostType lambda,
                                    MvCostData& best_costs ,
                                    MVector& best_mv)
 {
@@ -1052,8 +1122,9 @@ void BlockDiffEighthPel::Diff( const BlockDiffParams& dparams,
          ref_stop.y >= m_ref_data.LengthY() )
         bounds_check = true;
 
-    const float start_val( mvcost*lambda );
-    float sum( start_val );
+    const MECostType start_val( lambda*mvcost );
+    const CalcValueType bound( SADBound( best_costs.total , start_val ) );
+    CalcValueType sum( 0 );
 
     CalcValueType temp;
 
@@ -1071,7 +1142,7 @@ void BlockDiffEighthPel::Diff( const BlockDiffParams& dparams,
                     sum += CalcValueType( std::abs( ref_curr[0] - *pic_curr ) );
                 }// x
                 
-                if ( sum>=best_costs.total )
+                if ( sum>=bound )
                     return;
 
             }// y
@@ -1089,7 +1160,7 @@ void BlockDiffEighthPel::Diff( const BlockDiffParams& dparams,
                     sum += std::abs( temp - *pic_curr );
                 }// x
                 
-                if ( sum>=best_costs.total )
+                if ( sum>=bound )
                     return;
 
             }// y
@@ -1107,7 +1178,7 @@ void BlockDiffEighthPel::Diff( const BlockDiffParams& dparams,
                     sum += std::abs( temp - *pic_curr );
                 }// x
                 
-                if ( sum>=best_costs.total )
+                if ( sum>=bound )
                     return;
 
             }// y
@@ -1127,7 +1198,7 @@ void BlockDiffEighthPel::Diff( const BlockDiffParams& dparams,
                     sum += std::abs( temp - *pic_curr );
                 }// x
                 
-                if ( sum>=best_costs.total )
+                if ( sum>=bound )
                     return;
 
             }// y
@@ -1155,7 +1226,7 @@ void BlockDiffEighthPel::Diff( const BlockDiffParams& dparams,
                 sum += std::abs( temp - m_pic_data[y][x] );
             }// x
                 
-            if ( sum>=best_costs.total )
+            if ( sum>=bound )
                 return;
 
         }// y
@@ -1164,12 +1235,12 @@ void BlockDiffEighthPel::Diff( const BlockDiffParams& dparams,
 
     // If we've got here we must have done better than the best costs so far
     best_mv = mv;
-    best_costs.total = sum;
+    best_costs.total = start_val + SADToMECost( sum );
     best_costs.mvcost = mvcost;
-    best_costs.SAD = sum - start_val;
+    best_costs.SAD = sum;
 }
 
-float BiBlockHalfPel::Diff(  const BlockDiffParams& dparams , 
+CalcValueType BiBlockHalfPel::Diff(  const BlockDiffParams& dparams , 
                              const MVector& mv1 ,
                              const MVector& mv2 )
 {
@@ -1242,7 +1313,7 @@ float BiBlockHalfPel::Diff(  const BlockDiffParams& dparams ,
          ref_stop2.y >= m_ref_data2.LengthY() )
         bounds_check = true;
 
-    float sum( 0 );
+    CalcValueType sum( 0 );
 
     diff_curr = &diff_array[0][0];
     ValueType temp;
@@ -1285,7 +1356,7 @@ float BiBlockHalfPel::Diff(  const BlockDiffParams& dparams ,
 
 }
 
-float BiBlockQuarterPel::Diff(  const BlockDiffParams& dparams , 
+CalcValueType BiBlockQuarterPel::Diff(  const BlockDiffParams& dparams , 
                              const MVector& mv1 ,
                              const MVector& mv2 )
 {
@@ -1329,77 +1400,13 @@ float BiBlockQuarterPel::Diff(  const BlockDiffParams& dparams ,
 
     if ( !bounds_check )
     {
-#if defined (HAVE_MMX)
         const ImageCoords start_pos(dparams.Xp(), dparams.Yp());
         const ImageCoords end_pos(dparams.Xp() + dparams.Xl(), dparams.Yp() + dparams.Yl());
         
-        simple_biblock_diff_pic_mmx_4 (m_pic_data, m_ref_data1, diff_array,
+        m_kernels.biblock_diff_pic( m_pic_data, m_ref_data1, diff_array,
                                     start_pos, end_pos,
                                     ref_start1, ref_stop1,
-                                    rmdr1);
-#else
-        ValueType *ref_curr = &m_ref_data1[ref_start1.y][ref_start1.x];
-        const int ref_next( (m_ref_data1.LengthX() - dparams.Xl())*2 );// go down 2 rows and back up
-
-
-
-        if( rmdr1.x == 0 && rmdr1.y == 0 )
-        {
-            for( int y=dparams.Yl(); y > 0; --y, pic_curr+=pic_next, ref_curr+=ref_next )
-            {
-                for( int x=dparams.Xl(); x > 0; --x, ++pic_curr, ref_curr+=2, ++diff_curr )
-                {
-                    *diff_curr = ( (*pic_curr)<<1 ) - *ref_curr;
-                }// x
-            }// y
-        }
-        else if( rmdr1.y == 0 )
-        {
-            for( int y=dparams.Yl(); y > 0; --y, pic_curr+=pic_next, ref_curr+=ref_next )
-            {
-                for( int x=dparams.Xl(); x > 0; --x, ++pic_curr, ref_curr+=2, ++diff_curr )
-                {
-                    temp = (    CalcValueType( ref_curr[0] ) +
-                                CalcValueType( ref_curr[1] ) +
-                                1
-                            ) >> 1;
-
-                    *diff_curr = ( (*pic_curr)<<1 ) - temp;
-                }// x
-            }// y
-        }
-        else if( rmdr1.x == 0 )
-        {
-            for( int y=dparams.Yl(); y > 0; --y, pic_curr+=pic_next, ref_curr+=ref_next )
-            {
-                for( int x=dparams.Xl(); x > 0; --x, ++pic_curr, ref_curr+=2, ++diff_curr )
-                {
-                    temp = (    CalcValueType( ref_curr[0] ) +
-                                CalcValueType( ref_curr[m_ref_data1.LengthX()] ) +
-                                1
-                            ) >> 1;
-                  *diff_curr = ( (*pic_curr)<<1 ) - temp;
-                }// x
-            }// y
-        }
-        else
-        {
-            for( int y=dparams.Yl(); y > 0; --y, pic_curr+=pic_next, ref_curr+=ref_next )
-            {
-                for( int x=dparams.Xl(); x > 0; --x, ++pic_curr, ref_curr+=2, ++diff_curr )
-                {
-                    temp = (    CalcValueType( ref_curr[0] ) +
-                                CalcValueType( ref_curr[1] ) +
-                                CalcValueType( ref_curr[m_ref_data1.LengthX()+0] ) +
-                                CalcValueType( ref_curr[m_ref_data1.LengthX()+1] ) +
-                                2
-                            ) >> 2;
-                  *diff_curr = ( (*pic_curr)<<1 ) - temp;
-                }// x
-            }// y
-        }
-
-#endif
+                                    rmdr1 );
     }
     else
     {
@@ -1438,78 +1445,16 @@ float BiBlockQuarterPel::Diff(  const BlockDiffParams& dparams ,
          ref_stop2.y >= m_ref_data2.LengthY() )
         bounds_check = true;
 
-    float sum( 0 );
+    CalcValueType sum( 0 );
 
     diff_curr = &diff_array[0][0];
 
     if ( !bounds_check )
     {
-
-
-#if defined (HAVE_MMX)
-            sum = static_cast<float>( simple_biblock_diff_up_mmx_4 (diff_array, 
-                                                m_ref_data2,
-                                                ref_start2, ref_stop2,
-                                                rmdr2) );
-#else
-        ValueType *ref_curr = &m_ref_data2[ref_start2.y][ref_start2.x];
-        const int ref_next( (m_ref_data2.LengthX() - dparams.Xl())*2 );// go down 2 rows and back up
-        if( rmdr2.x == 0 && rmdr2.y == 0 )
-        {
-            for( int y=dparams.Yl(); y > 0; --y, pic_curr+=pic_next, ref_curr+=ref_next )
-            {
-                for( int x=dparams.Xl(); x > 0; --x, ++pic_curr, ref_curr+=2, ++diff_curr )
-                {
-                    sum += std::abs( (*diff_curr - *ref_curr)>>1 );
-                }// x
-            }// y
-        }
-        else if( rmdr2.y == 0 )
-        {
-            for( int y=dparams.Yl(); y > 0; --y, pic_curr+=pic_next, ref_curr+=ref_next )
-            {
-                for( int x=dparams.Xl(); x > 0; --x, ++pic_curr, ref_curr+=2, ++diff_curr )
-                {
-                    temp = (    CalcValueType( ref_curr[0] ) +
-                                CalcValueType( ref_curr[1] ) +
-                                1
-                            ) >> 1;
-
-                    sum += std::abs( (*diff_curr - temp)>>1 );
-                }// x
-            }// y
-        }
-        else if( rmdr2.x == 0 )
-        {
-            for( int y=dparams.Yl(); y > 0; --y, pic_curr+=pic_next, ref_curr+=ref_next )
-            {
-                for( int x=dparams.Xl(); x > 0; --x, ++pic_curr, ref_curr+=2, ++diff_curr )
-                {
-                    temp = (    CalcValueType( ref_curr[0] ) +
-                                CalcValueType( ref_curr[m_ref_data2.LengthX()] ) +
-                                1
-                            ) >> 1;
-                    sum += std::abs( (*diff_curr - temp)>>1 );
-                }// x
-            }// y
-        }
-        else
-        {
-            for( int y=dparams.Yl(); y > 0; --y, pic_curr+=pic_next, ref_curr+=ref_next )
-            {
-                for( int x=dparams.Xl(); x > 0; --x, ++pic_curr, ref_curr+=2, ++diff_curr )
-                {
-                    temp = (    CalcValueType( ref_curr[0] ) +
-                                CalcValueType( ref_curr[1] ) +
-                                CalcValueType( ref_curr[m_ref_data2.LengthX()+0] ) +
-                                CalcValueType( ref_curr[m_ref_data2.LengthX()+1] ) +
-                                2
-                            ) >> 2;
-                    sum += std::abs( (*diff_curr - temp)>>1 );
-                }// x
-            }// y
-        }
-#endif
+        sum = m_kernels.biblock_diff_up( diff_array, 
+                                         m_ref_data2,
+                                         ref_start2, ref_stop2,
+                                         rmdr2 );
     }
     else
     {
@@ -1542,7 +1487,7 @@ float BiBlockQuarterPel::Diff(  const BlockDiffParams& dparams ,
 
 }
 
-float BiBlockEighthPel::Diff(  const BlockDiffParams& dparams , 
+CalcValueType BiBlockEighthPel::Diff(  const BlockDiffParams& dparams , 
                              const MVector& mv1 ,
                              const MVector& mv2 )
 {
@@ -1691,7 +1636,7 @@ float BiBlockEighthPel::Diff(  const BlockDiffParams& dparams ,
          ref_stop2.y >= m_ref_data2.LengthY() )
         bounds_check = true;
 
-    float sum( 0 );
+    CalcValueType sum( 0 );
 
     diff_curr = &diff_array[0][0];
 
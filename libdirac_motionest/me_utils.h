@@ -39,8 +39,10 @@
 #define _ME_UTILS_H_
 
 #include <algorithm>
+#include <vector>
 #include <libdirac_common/motion.h>
 #include <libdirac_common/common.h>
+#include <libdirac_common/cpu_dispatch.h>
 namespace dirac
 {
 
@@ -110,6 +112,109 @@ namespace dirac
         int m_yend;
     };
 
+    //! A table of the sums of the values in rectangles of a picture
+    /*!
+        A summed-area table of a picture component, extended beyond the
+        picture edges by repeating the edge values, as the bounds-checked
+        block differences do. The sum of the values in any rectangle within
+        the extended picture can be read in constant time.
+    */
+    class BlockSums
+    {
+    public:
+        //! Constructor
+        /*!
+            Constructor
+            \param  data     the picture component
+            \param  xmargin  the extension to the left and right of the picture
+            \param  ymargin  the extension above and below the picture
+        */
+        BlockSums( const PicArray& data , const int xmargin , const int ymargin );
+
+        //! Returns true if a rectangle lies within the extended picture
+        bool Covers( const int xp , const int yp , const int xl , const int yl ) const
+        {
+            return xp >= -m_xmargin && yp >= -m_ymargin &&
+                   xp+xl <= m_xl-m_xmargin && yp+yl <= m_yl-m_ymargin;
+        }
+
+        //! Returns the sum of the values in a rectangle, which must be covered
+        CalcValueType Sum( const int xp , const int yp , const int xl , const int yl ) const
+        {
+            const unsigned int* top = &m_sums[( yp+m_ymargin )*( m_xl+1 ) + xp+m_xmargin];
+            const unsigned int* bottom = top + yl*( m_xl+1 );
+
+            return static_cast<CalcValueType>( bottom[xl] - bottom[0] - top[xl] + top[0] );
+        }
+
+    private:
+        // The sums of the values above and to the left of each point. These
+        // are accumulated modulo 2^32, which still gives the exact sum for
+        // any rectangle whose sum fits in a CalcValueType
+        std::vector<unsigned int> m_sums;
+
+        // The extensions on each side of the picture
+        int m_xmargin;
+        int m_ymargin;
+
+        // The dimensions of the extended picture
+        int m_xl;
+        int m_yl;
+    };
+
+    //! Block difference kernels, selected for an instruction set level
+    /*!
+        The kernels calculate SADs between a block of the picture and a
+        block of a reference. Kernels taking a bound may stop as soon as the
+        SAD reaches it, returning a value no less than the bound. Kernels
+        for upconverted references take the remainder of the vector after
+        rounding to half-pixel accuracy, each component of which is 0 or 1,
+        and require the reference block to lie within the reference.
+    */
+    struct BlockDiffKernels
+    {
+        //! SAD against a whole-pixel reference block lying within the reference
+        CalcValueType (*block_diff)( const BlockDiffParams& dparams , const MVector& mv ,
+                                     const PicArray& pic_data , const PicArray& ref_data ,
+                                     const CalcValueType bound );
+
+        //! SAD against a whole-pixel reference block, with reference positions clipped to the reference
+        CalcValueType (*bchk_block_diff)( const BlockDiffParams& dparams , const MVector& mv ,
+                                          const PicArray& pic_data , const PicArray& ref_data ,
+                                          const CalcValueType bound );
+
+        //! SAD against the block's DC value, which is returned in dc_val
+        CalcValueType (*intra_block_diff)( const BlockDiffParams& dparams ,
+                                           const PicArray& pic_data , ValueType& dc_val );
+
+        //! SAD against a block of an upconverted reference
+        CalcValueType (*block_diff_up)( const PicArray& pic_data , const PicArray& ref_data ,
+                                        const ImageCoords& start_pos , const ImageCoords& end_pos ,
+                                        const ImageCoords& ref_start , const ImageCoords& ref_stop ,
+                                        const MVector& rmdr , const CalcValueType bound );
+
+        //! Sets diff to twice the picture block less a prediction from an upconverted reference
+        void (*biblock_diff_pic)( const PicArray& pic_data , const PicArray& ref_data ,
+                                  TwoDArray<ValueType>& diff ,
+                                  const ImageCoords& start_pos , const ImageCoords& end_pos ,
+                                  const ImageCoords& ref_start , const ImageCoords& ref_stop ,
+                                  const MVector& rmdr );
+
+        //! SAD of half the difference between diff and a prediction from an upconverted reference
+        CalcValueType (*biblock_diff_up)( const TwoDArray<ValueType>& diff , const PicArray& ref_data ,
+                                          const ImageCoords& ref_start , const ImageCoords& ref_stop ,
+                                          const MVector& rmdr );
+
+        //! SADs for the eight neighbours of a vector, as for BlockDiffUp::NeighbourDiffs
+        bool (*neighbour_diffs)( const BlockDiffParams& dparams ,
+                                 const PicArray& pic_data , const PicArray& ref_data ,
+                                 const int rmdr_bits , const MVector& centre ,
+                                 const MVector offsets[8] , CalcValueType sads[8] );
+    };
+
+    //! Returns the block difference kernels for an instruction set level
+    BlockDiffKernels SelectBlockDiffKernels( const CpuLevel level );
+
     //////////////////////////////////////////////////
     //----Different difference classes, so that-----//
     //bounds-checking need only be done as necessary//
@@ -136,13 +241,16 @@ namespace dirac
             \param    dparams block parameters
             \param    mv      the motion vector being used 
         */
-        virtual float Diff(  const BlockDiffParams& dparams , const MVector& mv )=0;
+        virtual CalcValueType Diff(  const BlockDiffParams& dparams , const MVector& mv )=0;
 
     protected:
 
         const PicArray& m_pic_data;
         const PicArray& m_ref_data;
 
+        //! The difference kernels for the active instruction set
+        const BlockDiffKernels m_kernels;
+
     private:
         //! Private, bodyless copy-constructor: class should not be copied
         BlockDiff( const BlockDiff& cpy );            
@@ -169,7 +277,7 @@ namespace dirac
             \param    dparams    block parameters
             \param    mv         the motion vector being used 
         */
-        float Diff(  const BlockDiffParams& dparams , const MVector& mv );
+        CalcValueType Diff(  const BlockDiffParams& dparams , const MVector& mv );
 
         //! Do the difference, overwriting the best MV so far if appropriate
         /*!
@@ -177,12 +285,12 @@ namespace dirac
             and bailing out if we do worse
             \param    dparams    block parameters
             \param    mv         the motion vector being used 
-            \param    best_sum   the best SAD value obtain yet
-            \param    best_mv    the MV giving the best SAD value so far    
+            \param    best_cost  the best (fixed-point) cost obtained yet
+            \param    best_mv    the MV giving the best cost so far    
         */
         void Diff(  const BlockDiffParams& dparams ,
                     const MVector& mv ,
-                    float& best_sum , 
+                    MECostType& best_cost , 
                     MVector& best_mv ); 
 
     private:
@@ -211,7 +319,7 @@ namespace dirac
             \param    dparams    block parameters
             \param    dc_val     DC value
         */        
-        float Diff( const BlockDiffParams& dparams , ValueType& dc_val );
+        CalcValueType Diff( const BlockDiffParams& dparams , ValueType& dc_val );
 
         //! Calculate a DC value
 	ValueType CalcDC( const BlockDiffParams& dparams);
@@ -224,6 +332,9 @@ namespace dirac
         IntraBlockDiff& operator=(const IntraBlockDiff& rhs);
 
         const PicArray& m_pic_data;
+
+        //! The difference kernels for the active instruction set
+        const BlockDiffKernels m_kernels;
     };
 
     //! A virtual class for bi-directional differences
@@ -249,13 +360,16 @@ namespace dirac
             \param    mv1     the motion vector being used for reference 1
             \param    mv2     the motion vector being used for reference 2
         */        
-        virtual float Diff(  const BlockDiffParams& dparams , const MVector& mv1 , const MVector& mv2 )=0;
+        virtual CalcValueType Diff(  const BlockDiffParams& dparams , const MVector& mv1 , const MVector& mv2 )=0;
 
     protected:
         const PicArray& m_pic_data;
         const PicArray& m_ref_data1;
         const PicArray& m_ref_data2;
 
+        //! The difference kernels for the active instruction set
+        const BlockDiffKernels m_kernels;
+
     private:
         //! Private, bodyless copy-constructor: class should not be copied
         BiBlockDiff(const BiBlockDiff& cpy);             
@@ -275,10 +389,11 @@ namespace dirac
          //! Constructor, initialising the reference and picture data
          /*
               Constructor, initialising the reference and picture data
-              \param  ref  the reference picture
-              \param  pic  the picture being matched
+              \param  ref        the reference picture
+              \param  pic        the picture being matched
+              \param  rmdr_bits  the bits of vector accuracy beyond half-pixel
          */
-         BlockDiffUp( const PicArray& ref , const PicArray& pic );
+         BlockDiffUp( const PicArray& ref , const PicArray& pic , const int rmdr_bits );
 
          //! Destructor
          virtual ~BlockDiffUp(){}
@@ -289,7 +404,7 @@ namespace dirac
             \param    dparams    block parameters
             \param    mv         the motion vector being used 
         */
-         virtual float Diff(  const BlockDiffParams& dparams , const MVector& mv )=0;
+         virtual CalcValueType Diff(  const BlockDiffParams& dparams , const MVector& mv )=0;
 
         //! Do the actual difference, overwriting the best MV so far if appropriate
         /*!
@@ -298,16 +413,38 @@ namespace dirac
             \param    dparams    block parameters
             \param    mv         the motion vector being used 
             \param    mvcost     the (prediction) cost of the motion vector mv 
-            \param    lambda     the weighting to be given to mvcost
+            \param    lambda     the fixed-point weighting to be given to mvcost
             \param    best_costs the best Lagrangian costs obtained yet
             \param    best_mv    the MV giving the best Lagrangian costs so far    
         */
          virtual void Diff( const BlockDiffParams& dparams,
                             const MVector& mv ,
-                            const float mvcost,
-                            const float lambda,
+                            const CalcValueType mvcost,
+                            const MECostType lambda,
                             MvCostData& best_costs ,
                             MVector& best_mv)=0;
+
+        //! Do the differences for the eight neighbours of a vector in one pass
+        /*!
+            Do the differences for the eight neighbours of a vector in one
+            pass, sharing the picture data between them. Returns false,
+            having done nothing, if the neighbours can't all be done
+            without bounds checking or there is no vectorised code for
+            the active instruction set.
+            \param    dparams    block parameters
+            \param    centre     the vector whose neighbours are being tested
+            \param    offsets    the offsets of the eight neighbours from the centre
+            \param    sads       the SADs of the neighbours
+        */
+        bool NeighbourDiffs( const BlockDiffParams& dparams ,
+                             const MVector& centre ,
+                             const MVector offsets[8] ,
+                             CalcValueType sads[8] );
+
+     protected:
+        //! The bits of vector accuracy beyond half-pixel
+        const int m_rmdr_bits;
+
      private:
          //! Private, bodyless copy-constructor: class should not be copied
          BlockDiffUp(const BlockDiffUp& cpy);
@@ -338,7 +475,7 @@ namespace dirac
             \param    dparams    block parameters
             \param    mv         the motion vector being used 
         */
-        float Diff(  const BlockDiffParams& dparams , const MVector& mv );
+        CalcValueType Diff(  const BlockDiffParams& dparams , const MVector& mv );
 
         //! Do the actual difference, overwriting the best MV so far if appropriate
         /*!
@@ -347,14 +484,14 @@ namespace dirac
             \param    dparams    block parameters
             \param    mv         the motion vector being used 
             \param    mvcost     the (prediction) cost of the motion vector mv 
-            \param    lambda     the weighting to be given to mvcost
+            \param    lambda     the fixed-point weighting to be given to mvcost
             \param    best_costs the best Lagrangian costs obtained yet
             \param    best_mv    the MV giving the best Lagrangian costs so far    
         */
         void Diff( const BlockDiffParams& dparams,
                     const MVector& mv ,
-                    const float mvcost,
-                    const float lambda,
+                    const CalcValueType mvcost,
+                    const MECostType lambda,
                     MvCostData& best_costs ,
                     MVector& best_mv);
 
@@ -388,7 +525,7 @@ namespace dirac
             \param    dparams    block parameters
             \param    mv         the motion vector being used 
         */
-        float Diff(  const BlockDiffParams& dparams , const MVector& mv );
+        CalcValueType Diff(  const BlockDiffParams& dparams , const MVector& mv );
 
         //! Do the actual difference, overwriting the best MV so far if appropriate
         /*!
@@ -397,14 +534,14 @@ namespace dirac
             \param    dparams    block parameters
             \param    mv         the motion vector being used 
             \param    mvcost     the (prediction) cost of the motion vector mv 
-            \param    lambda     the weighting to be given to mvcost
+            \param    lambda     the fixed-point weighting to be given to mvcost
             \param    best_costs the best Lagrangian costs obtained yet
             \param    best_mv    the MV giving the best Lagrangian costs so far    
         */
         void Diff( const BlockDiffParams& dparams,
                    const MVector& mv ,
-                   const float mvcost,
-                   const float lambda,
+                   const CalcValueType mvcost,
+                   const MECostType lambda,
                    MvCostData& best_costs ,
                    MVector& best_mv);
 
@@ -437,7 +574,7 @@ namespace dirac
             \param    dparams    block parameters
             \param    mv         the motion vector being used 
         */
-        float Diff(  const BlockDiffParams& dparams , const MVector& mv );
+        CalcValueType Diff(  const BlockDiffParams& dparams , const MVector& mv );
 
         //! Do the actual difference, overwriting the best MV so far if appropriate
         /*!
@@ -446,14 +583,14 @@ namespace dirac
             \param    dparams    block parameters
             \param    mv         the motion vector being used 
             \param    mvcost     the (prediction) cost of the motion vector mv 
-            \param    lambda     the weighting to be given to mvcost
+            \param    lambda     the fixed-point weighting to be given to mvcost
             \param    best_costs the best Lagrangian costs obtained yet
             \param    best_mv    the MV giving the best Lagrangian costs so far    
         */
         void Diff( const BlockDiffParams& dparams,
                     const MVector& mv ,
-                    const float mvcost,
-                    const float lambda,
+                    const CalcValueType mvcost,
+                    const MECostType lambda,
                     MvCostData& best_costs ,
                     MVector& best_mv);
 
@@ -485,7 +622,7 @@ namespace dirac
             \param    mv1     the motion vector being used for reference 1
             \param    mv2     the motion vector being used for reference 2
         */        
-        float Diff(  const BlockDiffParams& dparams , const MVector& mv1 , const MVector& mv2 );
+        CalcValueType Diff(  const BlockDiffParams& dparams , const MVector& mv1 , const MVector& mv2 );
     private:
         //! Private, bodyless copy-constructor: class should not be copied
         BiBlockHalfPel(const BiBlockHalfPel& cpy);
@@ -514,7 +651,7 @@ namespace dirac
             \param    mv1    the motion vector being used for reference 1
             \param    mv2    the motion vector being used for reference 2
         */        
-        float Diff(  const BlockDiffParams& dparams , const MVector& mv1 , const MVector& mv2 );
+        CalcValueType Diff(  const BlockDiffParams& dparams , const MVector& mv1 , const MVector& mv2 );
 
     private:
         //! Private, bodyless copy-constructor: class should not be copied
@@ -544,7 +681,7 @@ namespace dirac
             \param    mv1     the motion vector being used for reference 1
             \param    mv2     the motion vector being used for reference 2
         */        
-        float Diff(  const BlockDiffParams& dparams , const MVector& mv1 , const MVector& mv2 );
+        CalcValueType Diff(  const BlockDiffParams& dparams , const MVector& mv1 , const MVector& mv2 );
     private:
         //! Private, bodyless copy-constructor: class should not be copied
         BiBlockEighthPel(const BiBlockEighthPel& cpy);
@@ -198,12 +198,11 @@ namespace dirac
     * be invoked only when the reference images start and stop fall
     * withing bounds
     */
-    float simple_block_diff_up_mmx_4(
+    CalcValueType simple_block_diff_up_mmx_4(
             const PicArray& pic_data, const PicArray& ref_data, 
             const ImageCoords& start_pos, const ImageCoords& end_pos, 
             const ImageCoords& ref_start, const ImageCoords& ref_stop,
-            const MVector& rmdr, float cost_so_far, 
-            float best_total_cost_so_far)
+            const MVector& rmdr, CalcValueType best_sum)
     {
         ValueType *pic_curr = &pic_data[start_pos.y][start_pos.x];
         ValueType *ref_curr = &ref_data[ref_start.y][ref_start.x];
@@ -269,15 +268,15 @@ namespace dirac
                 //sum += (u_sum.i[0] + u_sum.i[1] + mop_sum);
                 sum += (u_sum.h[0] + u_sum.h[1] + u_sum.h[2] + u_sum.h[3] + mop_sum);
                 _mm_empty();
-                if ((sum + cost_so_far )>= best_total_cost_so_far)
+                if (sum >= best_sum)
                 {
-                    return best_total_cost_so_far;
+                    return sum;
                 }
             }
             _mm_empty();
-            return sum + cost_so_far;
+            return sum;
 #else
-            float sum = cost_so_far;
+            CalcValueType sum = 0;
             for( int y=0; y < height; ++y, pic_curr+=pic_next, ref_curr+=ref_next )
             {
                 for( int x=0; x < width; ++x, ++pic_curr, ref_curr+=2 )
@@ -285,8 +284,8 @@ namespace dirac
                     sum += std::abs( *ref_curr - *pic_curr );
                 }// x
                 
-                if ( sum>= best_total_cost_so_far)
-                    return best_total_cost_so_far;
+                if ( sum>= best_sum)
+                    return sum;
 
             }// y
             return sum;
@@ -344,13 +343,13 @@ namespace dirac
                 //sum += (u_sum.i[0] + u_sum.i[1] + mop_sum);
                 sum += (u_sum.h[0] + u_sum.h[1] + u_sum.h[2] + u_sum.h[3] + mop_sum);
                 _mm_empty();
-                if ((sum + cost_so_far )>= best_total_cost_so_far)
+                if (sum >= best_sum)
                 {
-                    return best_total_cost_so_far;
+                    return sum;
                 }
             }
             _mm_empty();
-            return sum + cost_so_far;
+            return sum;
 #else
             //std::cerr << "Inmmx routine rmdr.y == 0" << std::endl;
             CalcValueType sum(0);
@@ -365,11 +364,11 @@ namespace dirac
                     sum += std::abs( temp - *pic_curr );
                 }// x
                 
-                if ( (sum+cost_so_far)>=best_total_cost_so_far)
-                    return best_total_cost_so_far;
+                if (sum >= best_sum)
+                    return sum;
 
             }// y
-            return sum+cost_so_far;
+            return sum;
 #endif
         }
         else if( rmdr.x == 0 )
@@ -415,13 +414,13 @@ namespace dirac
                 //sum += (u_sum.i[0] + u_sum.i[1] + mop_sum);
                 sum += (u_sum.h[0] + u_sum.h[1] + u_sum.h[2] + u_sum.h[3] + mop_sum);
                 _mm_empty();
-                if ((sum + cost_so_far )>= best_total_cost_so_far)
+                if (sum >= best_sum)
                 {
-                    return best_total_cost_so_far;
+                    return sum;
                 }
             }
             _mm_empty();
-            return sum + cost_so_far;
+            return sum;
 #else
             CalcValueType sum(0);
             for( int y=0; y < height; ++y, pic_curr+=pic_next, ref_curr+=ref_next )
@@ -432,11 +431,11 @@ namespace dirac
                     sum += std::abs (temp - *pic_curr);
                 }// x
                 
-                if ( (sum+cost_so_far)>=best_total_cost_so_far)
-                    return best_total_cost_so_far;
+                if (sum >= best_sum)
+                    return sum;
 
             }// y
-            return sum+cost_so_far;
+            return sum;
 #endif
         }
         else
@@ -499,13 +498,13 @@ namespace dirac
                 u_sum.m = m_sum;
                 sum += (u_sum.h[0] + u_sum.h[1] + u_sum.h[2] + u_sum.h[3] + mop_sum);
                 _mm_empty();
-                if ((sum + cost_so_far )>= best_total_cost_so_far)
+                if (sum >= best_sum)
                 {
-                    return best_total_cost_so_far;
+                    return sum;
                 }
             }
             _mm_empty();
-            return sum + cost_so_far;
+            return sum;
 #else
             //std::cerr << "Inmmx routine rmdr.y == 0" << std::endl;
             CalcValueType sum(0);
@@ -522,14 +521,14 @@ namespace dirac
                     sum += std::abs( temp - *pic_curr );
                 }// x
                 
-                if ( (sum+cost_so_far)>=best_total_cost_so_far)
-                    return best_total_cost_so_far;
+                if (sum >= best_sum)
+                    return sum;
 
             }// y
-            return sum+cost_so_far;
+            return sum;
 #endif
         }
-    return cost_so_far;
+    return 0;
     }
 
     /* 
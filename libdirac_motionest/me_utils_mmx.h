@@ -56,12 +56,11 @@ namespace dirac
             const PicArray& pic_data, const PicArray& ref_data,
             CalcValueType i_best_sum);
 
-    float simple_block_diff_up_mmx_4(
+    CalcValueType simple_block_diff_up_mmx_4(
             const PicArray& pic_data, const PicArray& ref_data, 
             const ImageCoords& start_pos, const ImageCoords& end_pos, 
             const ImageCoords& ref_start, const ImageCoords& ref_stop,
-            const MVector& rmdr, float cost_so_far, 
-            float best_cost_so_far);
+            const MVector& rmdr, CalcValueType best_sum);
 
 
     void simple_biblock_diff_pic_mmx_4(
@@ -40,7 +40,6 @@
 #include <libdirac_motionest/block_match.h>
 #include <libdirac_common/motion.h>
 #include <libdirac_encoder/enc_queue.h>
-#include <libdirac_motionest/downconvert.h>
 #include <libdirac_motionest/me_mode_decn.h>
 #include <libdirac_motionest/me_subpel.h>
 using namespace dirac;
@@ -87,6 +86,13 @@ void PixelMatcher::DoSearch( EncQueue& my_buffer, int pic_num )
     // Determine the picture sort - this affects the motion estimation Lagrangian parameter
     m_psort = my_buffer.GetPicture(pic_num).GetPparams().PicSort();
 
+    // Get temporal predictors from the motion of pictures already searched
+    if ( m_encparams.FullSearch() == false )
+    {
+        MakeTemporalPredictors( my_buffer , pic_num , ref1 , m_temporal_mvs[0] );
+        MakeTemporalPredictors( my_buffer , pic_num , ref2 , m_temporal_mvs[1] );
+    }
+
 
     if ( m_encparams.FullSearch() == false )
     {
@@ -94,17 +100,26 @@ void PixelMatcher::DoSearch( EncQueue& my_buffer, int pic_num )
         m_depth = ( int) std::min( log(((double) pic_data.LengthX())/12.0)/log(2.0) , 
                                  log(((double) pic_data.LengthY())/12.0)/log(2.0) );
 
+        // If the temporal predictors already predict (nearly) all the blocks
+        // well, large motions have been found, so the deep levels of the
+        // hierarchy can be skipped
+        if ( TemporalPredictorsGood( pic_data , ref1_data , m_temporal_mvs[0] ) &&
+             ( ref1 == ref2 ||
+               TemporalPredictorsGood( pic_data , ref2_data , m_temporal_mvs[1] ) ) )
+            m_depth = std::min( m_depth , 1 );
+
         // These arrays will contain the downconverted picture and MvData hierarchy
-        OneDArray<PicArray*> ref1_down( Range( 1 , m_depth ) );
-        OneDArray<PicArray*> ref2_down( Range( 1 , m_depth ) );
-        OneDArray<PicArray*> pic_down( Range( 1 , m_depth ) );
+        OneDArray<const PicArray*> ref1_down( Range( 1 , m_depth ) );
+        OneDArray<const PicArray*> ref2_down( Range( 1 , m_depth ) );
+        OneDArray<const PicArray*> pic_down( Range( 1 , m_depth ) );
         OneDArray<MEData*> me_data_set( Range( 1 , m_depth ) );
 
-        // Populate the hierarchies
-        MakePicHierarchy( pic_data , pic_down );
-        MakePicHierarchy( ref1_data , ref1_down );
+        // Populate the hierarchies. The pictures keep their down-converted
+        // data, so references are only down-converted once
+        GetPicHierarchy( my_buffer.GetPicture( pic_num ) , pic_down );
+        GetPicHierarchy( my_buffer.GetPicture( ref1 ) , ref1_down );
         if (ref1 != ref2)
-            MakePicHierarchy( ref2_data , ref2_down );
+            GetPicHierarchy( my_buffer.GetPicture( ref2 ) , ref2_down );
 
         MakeMEDataHierarchy( pic_down , me_data_set );
 
@@ -138,10 +153,6 @@ void PixelMatcher::DoSearch( EncQueue& my_buffer, int pic_num )
             MatchPic( pic_data , ref2_data , me_data , *(me_data_set[1]) , 2 );
 
         // Now we're finished, tidy everything up ...
-        TidyPics( pic_down );
-        TidyPics( ref1_down );
-        if (ref1 != ref2)
-            TidyPics( ref2_down );
         TidyMEData( me_data_set );
     }
     else
@@ -154,35 +165,94 @@ void PixelMatcher::DoSearch( EncQueue& my_buffer, int pic_num )
             MatchPic( pic_data , ref2_data , me_data , me_data , 2 );
     }
 
+    // Keep the vectors to predict the motion of later pictures
+    EncPicture& picture = my_buffer.GetPicture( pic_num );
+    picture.CacheMotion( ref1 , picture.GetMEData().Vectors( 1 ) );
+    if ( ref1 != ref2 )
+        picture.CacheMotion( ref2 , picture.GetMEData().Vectors( 2 ) );
 }
 
-void PixelMatcher::MakePicHierarchy(const PicArray& data ,
-                                    OneDArray< PicArray* >& down_data)
+void PixelMatcher::MakeTemporalPredictors( const EncQueue& my_buffer , const int pic_num ,
+                                           const int ref , MvArray& temporal_mvs )
 {
+    temporal_mvs.Resize( 0 , 0 );
 
-    DownConverter mydcon;
+    int src_pnum, src_ref;
+    const MvArray* cached = my_buffer.FindCachedMotion( pic_num , ref , src_pnum , src_ref );
 
-    // Allocate
-    int scale_factor = 1;
-    for (int i=1 ; i<=m_depth;++i)
+    if ( cached == NULL || src_ref == src_pnum )
+        return;
+
+    // Assume the motion is uniform, scaling the vectors by the ratio of
+    // the temporal distances
+    const int tdiff = ref - pic_num;
+    const int src_tdiff = src_ref - src_pnum;
+
+    temporal_mvs.Resize( cached->LengthY() , cached->LengthX() );
+    for ( int j=0 ; j<cached->LengthY() ; ++j )
     {
-        // Dimensions of pic_down[i] will be shrunk by a factor 2**i
-        scale_factor*=2;
-        down_data[i] = new PicArray( data.LengthY()/scale_factor , data.LengthX()/scale_factor);
-    }
+        for ( int i=0 ; i<cached->LengthX() ; ++i )
+        {
+            temporal_mvs[j][i].x = ( (*cached)[j][i].x * tdiff ) / src_tdiff;
+            temporal_mvs[j][i].y = ( (*cached)[j][i].y * tdiff ) / src_tdiff;
+        }// i
+    }// j
+}
+
+bool PixelMatcher::TemporalPredictorsGood( const PicArray& pic_data , const PicArray& ref_data ,
+                                           const MvArray& temporal_mvs ) const
+{
+    if ( temporal_mvs.LengthX() == 0 )
+        return false;
+
+    PelBlockDiff peldiff( ref_data , pic_data );
+    const OLBParams& bparams = m_predparams->LumaBParams(2);
 
-    //do all the downconversions
-    if (m_depth>0)
+    // A block is predicted well if the mean absolute error is within the
+    // sort of noise level a search couldn't improve on
+    const CalcValueType good_sad = bparams.Xblen()*bparams.Yblen()*
+                                   ( 4 << std::max( 0 , int( m_encparams.LumaDepth() ) - 8 ) );
+
+    int num_good = 0;
+    for ( int j=0 ; j<temporal_mvs.LengthY() ; ++j )
     {
-        mydcon.DoDownConvert( data , *(down_data[1]) );
+        for ( int i=0 ; i<temporal_mvs.LengthX() ; ++i )
+        {
+            BlockDiffParams dparams;
+            dparams.SetBlockLimits( bparams , pic_data , i , j );
+            if ( peldiff.Diff( dparams , temporal_mvs[j][i] ) < good_sad )
+                ++num_good;
+        }// i
+    }// j
+
+    return num_good >= 0.9 * temporal_mvs.LengthX() * temporal_mvs.LengthY();
+}
 
-        for (int i=1 ; i<m_depth ; ++i)
-            mydcon.DoDownConvert( *(down_data[i]) , *(down_data[i+1]) );
+MVector PixelMatcher::TemporalPrediction( const int xpos , const int ypos ) const
+{
+    // Take the co-located vector, scaled to this level
+    const MvArray& temporal_mvs = m_temporal_mvs[m_ref_id-1];
+    const int xt = std::min( xpos<<m_level , temporal_mvs.LastX() );
+    const int yt = std::min( ypos<<m_level , temporal_mvs.LastY() );
+
+    MVector temporal_mv = temporal_mvs[yt][xt];
+    temporal_mv.x /= ( 1<<m_level );
+    temporal_mv.y /= ( 1<<m_level );
+
+    return temporal_mv;
+}
 
+void PixelMatcher::GetPicHierarchy(const EncPicture& picture ,
+                                   OneDArray< const PicArray* >& down_data)
+{
+    for (int i=1 ; i<=m_depth;++i)
+    {
+        // Dimensions of pic_down[i] are shrunk by a factor 2**i
+        down_data[i] = &picture.DownDataForME( m_encparams.CombinedME() , i );
     }
 }
 
-void PixelMatcher::MakeMEDataHierarchy(const OneDArray< PicArray*>& down_data,
+void PixelMatcher::MakeMEDataHierarchy(const OneDArray< const PicArray*>& down_data,
                                        OneDArray< MEData* >& me_data_set )
 {
 
@@ -219,15 +289,6 @@ void PixelMatcher::MakeMEDataHierarchy(const OneDArray< PicArray*>& down_data,
 
 }
 
-void PixelMatcher::TidyPics( OneDArray< PicArray*>& down_data )
-{
-    for (int i=1 ; i <= m_depth ; ++i)
-    {
-        delete down_data[i];
-    }// i
-
-}
-
 void PixelMatcher::TidyMEData( OneDArray< MEData*>& me_data_set )
 {
     for (int i=1 ; i <= m_depth ; ++i)
@@ -277,7 +338,7 @@ void PixelMatcher::MatchPic(const PicArray& pic_data , const PicArray& ref_data
         {
             mv_array[y][x].x = 0;
             mv_array[y][x].y = 0;
-            pred_costs[y][x].total = 10000000.0f;
+            pred_costs[y][x].total = MAX_ME_COST;
         }// x
     }// y
 
@@ -286,22 +347,31 @@ void PixelMatcher::MatchPic(const PicArray& pic_data , const PicArray& ref_data
                             m_predparams->LumaBParams(2) , m_predparams->MVPrecision() ,
                             mv_array , pred_costs );
 
+    // An exhaustive search can eliminate most candidates without
+    // evaluating them
+    if ( m_encparams.FullSearch() )
+        my_bmatch.UseElimination( m_xr , m_yr );
+
     // Do the work - loop over all the blocks, finding the best match //
     ////////////////////////////////////////////////////////////////////
 
     /*
     The idea is for each block construct a list of candidate vectors,which will
-    be tested. This list is actually a list of lists, implemented as a C++
-    vector of C++ vectors. This is so that FindBestMatch can shorten the
+    be tested. This list is actually a list of lists, held in a single flat
+    buffer (see CandidateList). This is so that FindBestMatch can shorten the
     search process by looking at the beginning of each sublist and
     discarding that sub-list if it's too far off.
     */
 
+    m_ref_id = ref_id;
+
     // Make a zero-based list that is always used
-    m_cand_list.clear();
+    m_cand_list.Clear();
     MVector zero_mv( 0 , 0 );
 
-    AddNewVlist( m_cand_list , zero_mv , m_xr , m_yr);
+    if ( m_encparams.FullSearch() == true ||
+         m_encparams.MESearch() != ME_SEARCH_PREDICTIVE )
+        AddNewVlist( m_cand_list , zero_mv , m_xr , m_yr);
 
     // Now loop over the blocks and find the best matches.
     // The loop is unrolled because predictions are different at picture edges.
@@ -313,13 +383,13 @@ void PixelMatcher::MatchPic(const PicArray& pic_data , const PicArray& ref_data
     // Set the prediction as the zero vector
     m_mv_prediction = zero_mv;
 
-    DoBlock(0, 0 , guide_array , my_bmatch);
+    DoBlock(0, 0 , mv_array , guide_array , my_bmatch);
 
     // The rest of the first row
     for ( int xpos=1 ; xpos<mv_array.LengthX() ; ++xpos )
     {
         m_mv_prediction = mv_array[0][xpos-1];
-        DoBlock(xpos, 0 , guide_array , my_bmatch);
+        DoBlock(xpos, 0 , mv_array , guide_array , my_bmatch);
     }// xpos
 
     // All the remaining rows except the last
@@ -328,7 +398,7 @@ void PixelMatcher::MatchPic(const PicArray& pic_data , const PicArray& ref_data
 
         // The first element of each row
         m_mv_prediction = mv_array[ypos-1][0];
-        DoBlock(0, ypos , guide_array , my_bmatch );
+        DoBlock(0, ypos , mv_array , guide_array , my_bmatch );
 
          // The middle elements of each row
         for ( int xpos=1 ; xpos<mv_array.LastX() ; ++xpos )
@@ -336,22 +406,30 @@ void PixelMatcher::MatchPic(const PicArray& pic_data , const PicArray& ref_data
             m_mv_prediction = MvMedian( mv_array[ypos][xpos-1],
                                         mv_array[ypos-1][xpos],
                                         mv_array[ypos-1][xpos+1]);
-            DoBlock(xpos, ypos , guide_array , my_bmatch );
+            DoBlock(xpos, ypos , mv_array , guide_array , my_bmatch );
 
         }// xpos
 
          // The last element in each row
         m_mv_prediction = MvMean( mv_array[ypos-1][ mv_array.LastX() ],
                                   mv_array[ypos][ mv_array.LastX()-1 ]);
-        DoBlock(mv_array.LastX() , ypos , guide_array , my_bmatch );
+        DoBlock(mv_array.LastX() , ypos , mv_array , guide_array , my_bmatch );
     }//ypos
 
 }
 
 void PixelMatcher::DoBlock(const int xpos, const int ypos ,
+                           const MvArray& mv_array,
                            const MvArray& guide_array,
                            BlockMatcher& block_match)
 {
+    if ( m_encparams.FullSearch() == false &&
+         m_encparams.MESearch() == ME_SEARCH_PREDICTIVE )
+    {
+        DoBlockPredictive( xpos , ypos , mv_array , guide_array , block_match );
+        return;
+    }
+
     // Find the best match for each block ...
 
     // Use guide from lower down if one exists
@@ -363,6 +441,10 @@ void PixelMatcher::DoBlock(const int xpos, const int ypos ,
 
     }
 
+    // use the temporal prediction, if there is one
+    if ( m_temporal_mvs[m_ref_id-1].LengthX()>0 )
+        AddNewVlist( m_cand_list , TemporalPrediction( xpos , ypos ) , 1 , 1 );
+
     // use the spatial prediction, also, as a guide
     if (m_encparams.FullSearch()==false )
         AddNewVlist( m_cand_list , m_mv_prediction , m_xr , m_yr );
@@ -376,5 +458,46 @@ void PixelMatcher::DoBlock(const int xpos, const int ypos ,
 
     // Reset the lists ready for the next block (don't erase the first sublist as
     // this is a neighbourhood of zero, which we always look at)
-    m_cand_list.erase( m_cand_list.begin()+1 , m_cand_list.end() );
+    m_cand_list.Truncate( 1 );
+}
+
+void PixelMatcher::DoBlockPredictive(const int xpos, const int ypos ,
+                                     const MvArray& mv_array,
+                                     const MvArray& guide_array,
+                                     BlockMatcher& block_match)
+{
+    // Make a list of predictors, one per sublist, so duplicates are dropped
+
+    m_cand_list.Clear();
+
+    // The spatial prediction and the zero vector
+    AddNewVlist( m_cand_list , m_mv_prediction , 0 , 0 );
+    AddNewVlist( m_cand_list , MVector( 0 , 0 ) , 0 , 0 );
+
+    // The neighbouring vectors that have been found already
+    if ( xpos>0 )
+        AddNewVlist( m_cand_list , mv_array[ypos][xpos-1] , 0 , 0 );
+    if ( ypos>0 )
+    {
+        AddNewVlist( m_cand_list , mv_array[ypos-1][xpos] , 0 , 0 );
+        if ( xpos<mv_array.LastX() )
+            AddNewVlist( m_cand_list , mv_array[ypos-1][xpos+1] , 0 , 0 );
+    }
+
+    // The guide from lower down, if one exists
+    if ( m_level<m_depth )
+    {
+        int xdown = BChk(xpos>>1, guide_array.LengthX());
+        int ydown = BChk(ypos>>1, guide_array.LengthY());
+        AddNewVlist( m_cand_list , guide_array[ydown][xdown] * 2 , 0 , 0 );
+    }
+
+    // The temporal prediction from the motion of other pictures
+    if ( m_temporal_mvs[m_ref_id-1].LengthX()>0 )
+        AddNewVlist( m_cand_list , TemporalPrediction( xpos , ypos ) , 0 , 0 );
+
+    // Find the best motion vector //
+    /////////////////////////////////
+
+    block_match.FindBestMatchPredictive( xpos , ypos , m_cand_list, m_mv_prediction );
 }
@@ -50,6 +50,15 @@
 * large motions can be detected easily. The danger is that the motions of
 * small objects can be overlooked.
 *
+* Alternatively, a fast predictive search can be used at each level. This
+* tests only a few predictors - spatial neighbours, the guide vector and
+* a temporal predictor - and then refines the best with a small diamond
+* search.
+*
+* Temporal predictors are made by scaling the motion of pictures searched
+* earlier, which each picture keeps. Where they predict the picture well,
+* the hierarchy is made shallower.
+*
 * *************************************************************************/
 
 #include <libdirac_common/common.h>
@@ -58,6 +67,7 @@
 namespace dirac
 {
     class EncQueue;
+    class EncPicture;
     class MvData;
     class EncoderParams;
     class PicArray;
@@ -123,21 +133,25 @@ namespace dirac
         
         // The mean of the square of the block cost
         double m_cost_mean_sq;
+
+        // The reference being matched (1 or 2)
+        int m_ref_id;
+
+        // For each reference, temporal predictors made by scaling the
+        // cached motion of other pictures. Empty if there are none.
+        MvArray m_temporal_mvs[2];
         
     private:
 
         // Functions
 
-        //! Make down-converted pictures
-        void MakePicHierarchy(const PicArray& data, OneDArray< PicArray* >& down_data);
+        //! Get the down-converted pictures
+        void GetPicHierarchy(const EncPicture& picture, OneDArray< const PicArray* >& down_data);
 
         //! Make a hierarchy of MvData structures
-        void MakeMEDataHierarchy(const OneDArray< PicArray*>& down_data,
+        void MakeMEDataHierarchy(const OneDArray< const PicArray*>& down_data,
                                            OneDArray< MEData* >& me_data_set );
 
-        //! Tidy up the allocations made in building the picture hirearchy
-        void TidyPics( OneDArray< PicArray*>& down_data );
-
         //! Tidy up the allocations made in building the MV data hirearchy
         void TidyMEData( OneDArray< MEData*>& me_data_set );
 
@@ -145,11 +159,29 @@ namespace dirac
         void MatchPic(const PicArray& ref_data , const PicArray& pic_data , MEData& me_data ,
                       const MvData& guide_data, const int ref_id);
 
+        //! Make the temporal predictors for a reference from cached motion
+        void MakeTemporalPredictors( const EncQueue& my_buffer , const int pic_num ,
+                                     const int ref , MvArray& temporal_mvs );
+
+        //! Returns true if the temporal predictors predict nearly all blocks well
+        bool TemporalPredictorsGood( const PicArray& pic_data , const PicArray& ref_data ,
+                                     const MvArray& temporal_mvs ) const;
+
+        //! Returns the temporal prediction for a block at the current level
+        MVector TemporalPrediction( const int xpos , const int ypos ) const;
+
         //! Do a given block
         void DoBlock(const int xpos, const int ypos , 
+                     const MvArray& mv_array,
                      const MvArray& guide_array,
                      BlockMatcher& block_match);
 
+        //! Do a given block using the predictive search
+        void DoBlockPredictive(const int xpos, const int ypos , 
+                               const MvArray& mv_array,
+                               const MvArray& guide_array,
+                               BlockMatcher& block_match);
+
     };
 
 } // namespace dirac
@@ -0,0 +1,613 @@
+/* ***** BEGIN LICENSE BLOCK *****
+*
+* $Id$ $Name$
+*
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License
+* Version 1.1 (the "License"); you may not use this file except in compliance
+* with the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License for
+* the specific language governing rights and limitations under the License.
+*
+* The Original Code is BBC Research and Development code.
+*
+* The Initial Developer of the Original Code is the British Broadcasting
+* Corporation.
+* Portions created by the Initial Developer are Copyright (C) 2008.
+* All Rights Reserved.
+*
+* Contributor(s): Thomas Davies (Original Author)
+*
+* Alternatively, the contents of this file may be used under the terms of
+* the GNU General Public License Version 2 (the "GPL"), or the GNU Lesser
+* Public License Version 2.1 (the "LGPL"), in which case the provisions of
+* the GPL or the LGPL are applicable instead of those above. If you wish to
+* allow use of your version of this file only under the terms of the either
+* the GPL or LGPL and not to allow others to use your version of this file
+* under the MPL, indicate your decision by deleting the provisions above
+* and replace them with the notice and other provisions required by the GPL
+* or LGPL. If you do not delete the provisions above, a recipient may use
+* your version of this file under the terms of any one of the MPL, the GPL
+* or the LGPL.
+* ***** END LICENSE BLOCK ***** */
+
+
+#include "core_suite.h"
+#include "kernels_test.h"
+#include "arrays_test.h"
+#include "test_random.h"
+
+#include <libdirac_common/mot_comp.h>
+#include <libdirac_common/upconvert.h>
+#include <libdirac_common/wavelet_utils.h>
+#include <libdirac_motionest/me_utils.h>
+#include <libdirac_decoder/component_pack.h>
+#include <libdirac_encoder/quality_monitor.h>
+using namespace dirac;
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+//NOTE: ensure that the suite is added to the default registry in
+//cppunit_testsuite.cpp
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION (KernelsTest, coreSuiteName());
+
+namespace
+{
+    // The number of random cases tried for each kernel family
+    const int num_trials = 1000;
+
+    // Sample depths tried, cycled through by trial
+    const int num_depths = 3;
+    const int depths[num_depths] = { 8 , 10 , 12 };
+
+    // Fills an array with values in [lo, hi]
+    template <class T>
+    void randomFill( TwoDArray<T>& data , TestRandom& rnd , const int lo , const int hi )
+    {
+        for (int j=data.FirstY() ; j<=data.LastY() ; ++j)
+            for (int i=data.FirstX() ; i<=data.LastX() ; ++i)
+                data[j][i] = rnd.Range( lo , hi );
+    }
+
+    // Fills an array with signed samples of the given depth
+    template <class T>
+    void randomSamples( TwoDArray<T>& data , TestRandom& rnd , const int depth )
+    {
+        randomFill( data , rnd , -(1<<(depth-1)) , (1<<(depth-1))-1 );
+    }
+
+    // The message given when a level's results differ from the portable ones
+    std::string levelMessage( const char* kernel , const CpuLevel level )
+    {
+        return std::string( kernel ) + " differs from portable code at level " + CpuLevelName( level );
+    }
+
+    // The results of all the block difference classes for one case
+    struct BlockDiffResults
+    {
+        std::vector<CalcValueType> sads;
+        std::vector<MECostType> costs;
+        std::vector<int> best_mvs;
+
+        bool operator==( const BlockDiffResults& rhs ) const
+        {
+            return sads==rhs.sads && costs==rhs.costs && best_mvs==rhs.best_mvs;
+        }
+
+        void AddBest( const MECostType cost , const MVector& mv )
+        {
+            costs.push_back( cost );
+            best_mvs.push_back( mv.x );
+            best_mvs.push_back( mv.y );
+        }
+    };
+
+    // Runs one sub-pixel block difference class over a set of vectors,
+    // recording the plain SADs, the best cost from the bailing-out
+    // version, and the neighbour SADs where the level does them in one go
+    void upDiffs( BlockDiffUp& diff , const BlockDiffParams& dparams ,
+                  const std::vector<MVector>& mvs , BlockDiffResults& results )
+    {
+        MvCostData best_costs;
+        best_costs.total = MAX_ME_COST;
+        MVector best_mv;
+
+        for (size_t k=0 ; k<mvs.size() ; ++k)
+        {
+            results.sads.push_back( diff.Diff( dparams , mvs[k] ) );
+            diff.Diff( dparams , mvs[k] , k , 2 , best_costs , best_mv );
+        }// k
+        results.AddBest( best_costs.total , best_mv );
+
+        // Where the neighbours are done in one go they must give the same
+        // SADs as one at a time, so record any differences
+        const MVector offsets[8] = { MVector(-1,-1) , MVector(0,-1) , MVector(1,-1) ,
+                                     MVector(-1,0) , MVector(1,0) ,
+                                     MVector(-1,1) , MVector(0,1) , MVector(1,1) };
+        CalcValueType sads[8];
+        const bool done = diff.NeighbourDiffs( dparams , mvs[0] , offsets , sads );
+        for (int n=0 ; n<8 ; ++n)
+            results.sads.push_back( done ? sads[n]-diff.Diff( dparams , mvs[0]+offsets[n] ) : 0 );
+    }
+
+    // Runs all the single-reference block difference classes for one case
+    BlockDiffResults blockDiffs( const PicArray& pic , const PicArray& ref ,
+                                 const PicArray& up_ref , const BlockDiffParams& dparams ,
+                                 const std::vector<MVector>& mvs )
+    {
+        BlockDiffResults results;
+
+        PelBlockDiff pel_diff( ref , pic );
+        MECostType best_cost = MAX_ME_COST;
+        MVector best_mv;
+        for (size_t k=0 ; k<mvs.size() ; ++k)
+        {
+            // Whole-pixel vectors are kept small, as in a search
+            const MVector mv( mvs[k].x/4 , mvs[k].y/4 );
+            results.sads.push_back( pel_diff.Diff( dparams , mv ) );
+            pel_diff.Diff( dparams , mv , best_cost , best_mv );
+        }// k
+        results.AddBest( best_cost , best_mv );
+
+        BlockDiffHalfPel half_diff( up_ref , pic );
+        upDiffs( half_diff , dparams , mvs , results );
+        BlockDiffQuarterPel quarter_diff( up_ref , pic );
+        upDiffs( quarter_diff , dparams , mvs , results );
+        BlockDiffEighthPel eighth_diff( up_ref , pic );
+        upDiffs( eighth_diff , dparams , mvs , results );
+
+        return results;
+    }
+
+    // Runs all the bi-directional block difference classes for one case
+    std::vector<CalcValueType> biBlockDiffs( const PicArray& pic , const PicArray& up_ref1 ,
+                                             const PicArray& up_ref2 , const BlockDiffParams& dparams ,
+                                             const std::vector<MVector>& mvs )
+    {
+        std::vector<CalcValueType> sads;
+
+        BiBlockHalfPel half_diff( up_ref1 , up_ref2 , pic );
+        BiBlockQuarterPel quarter_diff( up_ref1 , up_ref2 , pic );
+        BiBlockEighthPel eighth_diff( up_ref1 , up_ref2 , pic );
+        for (size_t k=0 ; k+1<mvs.size() ; ++k)
+        {
+            sads.push_back( half_diff.Diff( dparams , mvs[k] , mvs[k+1] ) );
+            sads.push_back( quarter_diff.Diff( dparams , mvs[k] , mvs[k+1] ) );
+            sads.push_back( eighth_diff.Diff( dparams , mvs[k] , mvs[k+1] ) );
+        }// k
+
+        return sads;
+    }
+
+    // Makes a picture, a whole-pixel reference and an upconverted reference
+    void makeBlockDiffData( TestRandom& rnd , const int depth ,
+                            PicArray& pic , PicArray& ref , PicArray& up_ref )
+    {
+        const int xl = rnd.Range( 24 , 72 );
+        const int yl = rnd.Range( 24 , 56 );
+        pic.Resize( yl , xl );
+        ref.Resize( yl , xl );
+        up_ref.Resize( 2*yl , 2*xl );
+        randomSamples( pic , rnd , depth );
+        randomSamples( ref , rnd , depth );
+        randomSamples( up_ref , rnd , depth );
+    }
+
+    // Chooses a block lying within a picture, of the sizes used in coding
+    BlockDiffParams randomBlock( TestRandom& rnd , const PicArray& pic )
+    {
+        const int xl = rnd.Range( 1 , 20 );
+        const int yl = rnd.Range( 1 , 20 );
+        const int xp = rnd.Range( 0 , pic.LengthX()-xl );
+        const int yp = rnd.Range( 0 , pic.LengthY()-yl );
+        return BlockDiffParams( xp , yp , xl , yl );
+    }
+
+    // Chooses vectors, some of which point off the reference
+    std::vector<MVector> randomVectors( TestRandom& rnd , const int num )
+    {
+        std::vector<MVector> mvs;
+        for (int k=0 ; k<num ; ++k)
+            mvs.push_back( MVector( rnd.Range( -48 , 48 ) , rnd.Range( -48 , 48 ) ) );
+        return mvs;
+    }
+
+    // Predicts a block as MotionCompensator::CompensateBlock does, using
+    // the half- or quarter-pixel prediction kernel
+    TwoDArray<ValueType> predictBlock( const MCKernels& kernels , const bool quarter ,
+                                       const ImageCoords& pos , const ImageCoords& block_size ,
+                                       const ImageCoords& pic_size ,
+                                       const PicArray& up_ref , const MVector& mv )
+    {
+        const ImageCoords start_pos( std::max(pos.x,0) , std::max(pos.y,0) );
+        const ImageCoords end_pos( std::min( pos.x + block_size.x , pic_size.x ) ,
+                                   std::min( pos.y + block_size.y , pic_size.y ) );
+
+        TwoDArray<ValueType> block( end_pos.y-start_pos.y , end_pos.x-start_pos.x , 0 );
+        if ( quarter )
+            kernels.quarter_pel_pred( block , pos , pic_size , up_ref , mv );
+        else
+            kernels.half_pel_pred( block , pos , pic_size , up_ref , mv );
+
+        return block;
+    }
+}
+
+KernelsTest::KernelsTest()
+{
+}
+
+KernelsTest::~KernelsTest()
+{
+}
+
+void KernelsTest::setUp()
+{
+    m_saved_level = ActiveCpuLevel();
+}
+
+void KernelsTest::tearDown()
+{
+    SetCpuLevel( m_saved_level );
+}
+
+void KernelsTest::testBlockDiff()
+{
+    TestRandom rnd( 1 );
+    PicArray pic, ref, up_ref;
+
+    for (int trial=0 ; trial<num_trials ; ++trial)
+    {
+        makeBlockDiffData( rnd , depths[trial%num_depths] , pic , ref , up_ref );
+        const BlockDiffParams dparams( randomBlock( rnd , pic ) );
+        const std::vector<MVector> mvs( randomVectors( rnd , 6 ) );
+
+        SetCpuLevel( CPU_LEVEL_GENERIC );
+        const BlockDiffResults expected( blockDiffs( pic , ref , up_ref , dparams , mvs ) );
+
+        for (int l=CPU_LEVEL_GENERIC+1 ; l<=DetectedCpuLevel() ; ++l)
+        {
+            SetCpuLevel( CpuLevel( l ) );
+            CPPUNIT_ASSERT_MESSAGE( levelMessage( "BlockDiff" , CpuLevel( l ) ) ,
+                                    blockDiffs( pic , ref , up_ref , dparams , mvs ) == expected );
+        }// l
+    }// trial
+}
+
+void KernelsTest::testBiBlockDiff()
+{
+    TestRandom rnd( 2 );
+    PicArray pic, up_ref1, up_ref2;
+
+    for (int trial=0 ; trial<num_trials ; ++trial)
+    {
+        makeBlockDiffData( rnd , depths[trial%num_depths] , pic , up_ref1 , up_ref2 );
+        up_ref1.Resize( up_ref2.LengthY() , up_ref2.LengthX() );
+        randomSamples( up_ref1 , rnd , depths[trial%num_depths] );
+        const BlockDiffParams dparams( randomBlock( rnd , pic ) );
+        const std::vector<MVector> mvs( randomVectors( rnd , 6 ) );
+
+        SetCpuLevel( CPU_LEVEL_GENERIC );
+        const std::vector<CalcValueType> expected( biBlockDiffs( pic , up_ref1 , up_ref2 , dparams , mvs ) );
+
+        for (int l=CPU_LEVEL_GENERIC+1 ; l<=DetectedCpuLevel() ; ++l)
+        {
+            SetCpuLevel( CpuLevel( l ) );
+            CPPUNIT_ASSERT_MESSAGE( levelMessage( "BiBlockDiff" , CpuLevel( l ) ) ,
+                                    biBlockDiffs( pic , up_ref1 , up_ref2 , dparams , mvs ) == expected );
+        }// l
+    }// trial
+}
+
+void KernelsTest::testIntraBlockDiff()
+{
+    TestRandom rnd( 3 );
+    PicArray pic, ref, up_ref;
+
+    for (int trial=0 ; trial<num_trials ; ++trial)
+    {
+        makeBlockDiffData( rnd , depths[trial%num_depths] , pic , ref , up_ref );
+        const BlockDiffParams dparams( randomBlock( rnd , pic ) );
+
+        SetCpuLevel( CPU_LEVEL_GENERIC );
+        ValueType expected_dc;
+        const CalcValueType expected_sad = IntraBlockDiff( pic ).Diff( dparams , expected_dc );
+
+        for (int l=CPU_LEVEL_GENERIC+1 ; l<=DetectedCpuLevel() ; ++l)
+        {
+            SetCpuLevel( CpuLevel( l ) );
+            ValueType dc;
+            const CalcValueType sad = IntraBlockDiff( pic ).Diff( dparams , dc );
+            CPPUNIT_ASSERT_MESSAGE( levelMessage( "IntraBlockDiff" , CpuLevel( l ) ) ,
+                                    sad==expected_sad && dc==expected_dc );
+        }// l
+    }// trial
+}
+
+void KernelsTest::testBlockPred()
+{
+    TestRandom rnd( 4 );
+    const MCKernels generic = SelectMCKernels( CPU_LEVEL_GENERIC );
+
+    for (int trial=0 ; trial<num_trials ; ++trial)
+    {
+        const ImageCoords pic_size( rnd.Range( 16 , 64 ) , rnd.Range( 16 , 48 ) );
+        PicArray up_ref( 2*pic_size.y , 2*pic_size.x );
+        randomSamples( up_ref , rnd , depths[trial%num_depths] );
+
+        // Blocks overlap the picture, but may start above or to the left of it
+        const ImageCoords block_size( rnd.Range( 1 , 24 ) , rnd.Range( 1 , 24 ) );
+        const ImageCoords pos( rnd.Range( 1-block_size.x , pic_size.x-1 ) ,
+                               rnd.Range( 1-block_size.y , pic_size.y-1 ) );
+        const MVector mv( rnd.Range( -64 , 64 ) , rnd.Range( -64 , 64 ) );
+
+        for (int q=0 ; q<2 ; ++q)
+        {
+            const TwoDArray<ValueType> expected( predictBlock( generic , q==1 , pos , block_size ,
+                                                               pic_size , up_ref , mv ) );
+            for (int l=CPU_LEVEL_GENERIC+1 ; l<=DetectedCpuLevel() ; ++l)
+            {
+                const MCKernels kernels = SelectMCKernels( CpuLevel( l ) );
+                CPPUNIT_ASSERT_MESSAGE( levelMessage( q==1 ? "QuarterPelBlockPred" : "HalfPelBlockPred" , CpuLevel( l ) ) ,
+                                        equalArrays( predictBlock( kernels , q==1 , pos , block_size ,
+                                                                   pic_size , up_ref , mv ) , expected ) );
+            }// l
+        }// q
+    }// trial
+}
+
+void KernelsTest::testBlockAdd()
+{
+    TestRandom rnd( 5 );
+    const MCKernels generic = SelectMCKernels( CPU_LEVEL_GENERIC );
+
+    for (int trial=0 ; trial<num_trials ; ++trial)
+    {
+        const ImageCoords pic_size( rnd.Range( 16 , 64 ) , rnd.Range( 24 , 48 ) );
+        const int pad = rnd.Range( 0 , 15 );
+
+        // Weight a block, clipped to the picture, by the part of the
+        // weighting array that it covers. Weights and samples are kept
+        // within the ranges used in coding, so products fit in 16 bits.
+        TwoDArray<ValueType> wt_array( rnd.Range( 1 , 24 ) , rnd.Range( 1 , 24 ) );
+        randomFill( wt_array , rnd , 0 , 64 );
+        const ImageCoords pos( rnd.Range( 1-wt_array.LengthX() , pic_size.x-1 ) , rnd.Range( 1-wt_array.LengthY() , 0 ) );
+        const ImageCoords start_pos( std::max(pos.x,0) , std::max(pos.y,0) );
+        TwoDArray<ValueType> block( std::min( pos.y+wt_array.LengthY() , pic_size.y )-start_pos.y ,
+                                    std::min( pos.x+wt_array.LengthX() , pic_size.x )-start_pos.x );
+        randomSamples( block , rnd , 9 );
+
+        // Add it into a strip of blocks, and add the strip into a picture
+        TwoDArray<ValueType> strip( wt_array.LengthY() , pic_size.x+pad );
+        randomSamples( strip , rnd , 14 );
+        PicArray pic( pic_size.y , pic_size.x+pad );
+        randomSamples( pic , rnd , 10 );
+        const int start_y = rnd.Range( 0 , pic_size.y-strip.LengthY() );
+        const int end_y = start_y + rnd.Range( 0 , strip.LengthY() );
+
+        TwoDArray<ValueType> expected_block( block );
+        TwoDArray<ValueType> expected_strip( strip );
+        PicArray expected_pic( pic );
+        generic.adjust_block( expected_block , pos , wt_array );
+        generic.add_block( ImageCoords( start_pos.x , 0 ) , expected_strip , expected_block );
+        generic.add_and_shift( start_y , end_y , 6 , pic_size , expected_strip , expected_pic );
+
+        for (int l=CPU_LEVEL_GENERIC+1 ; l<=DetectedCpuLevel() ; ++l)
+        {
+            const MCKernels kernels = SelectMCKernels( CpuLevel( l ) );
+            TwoDArray<ValueType> test_block( block );
+            TwoDArray<ValueType> test_strip( strip );
+            PicArray test_pic( pic );
+
+            kernels.adjust_block( test_block , pos , wt_array );
+            CPPUNIT_ASSERT_MESSAGE( levelMessage( "AdjustBlockBySpatialWeights" , CpuLevel( l ) ) ,
+                                    equalArrays( test_block , expected_block ) );
+            kernels.add_block( ImageCoords( start_pos.x , 0 ) , test_strip , test_block );
+            CPPUNIT_ASSERT_MESSAGE( levelMessage( "AddMCBlock" , CpuLevel( l ) ) ,
+                                    equalArrays( test_strip , expected_strip ) );
+            kernels.add_and_shift( start_y , end_y , 6 , pic_size , test_strip , test_pic );
+            CPPUNIT_ASSERT_MESSAGE( levelMessage( "CompensateComponentAddAndShift" , CpuLevel( l ) ) ,
+                                    equalArrays<ValueType>( test_pic , expected_pic ) );
+        }// l
+    }// trial
+}
+
+void KernelsTest::testShiftRows()
+{
+    TestRandom rnd( 6 );
+    const WaveletKernels generic = SelectWaveletKernels( CPU_LEVEL_GENERIC );
+
+    for (int trial=0 ; trial<num_trials ; ++trial)
+    {
+        // Rows of any length, starting anywhere, as after a band is split
+        TwoDArray<CoeffType> row( 1 , rnd.Range( 1 , 80 ) );
+        randomSamples( row , rnd , depths[trial%num_depths]+1 );
+        const int offset = rnd.Range( 0 , row.LengthX()-1 );
+        const int length = row.LengthX()-offset;
+        const int shift = rnd.Range( 1 , 2 );
+
+        TwoDArray<CoeffType> expected_left( row );
+        TwoDArray<CoeffType> expected_right( row );
+        generic.shift_row_left( &expected_left[0][offset] , length , shift );
+        generic.shift_row_right( &expected_right[0][offset] , length , shift );
+
+        for (int l=CPU_LEVEL_GENERIC+1 ; l<=DetectedCpuLevel() ; ++l)
+        {
+            const WaveletKernels kernels = SelectWaveletKernels( CpuLevel( l ) );
+            TwoDArray<CoeffType> left( row );
+            TwoDArray<CoeffType> right( row );
+            kernels.shift_row_left( &left[0][offset] , length , shift );
+            kernels.shift_row_right( &right[0][offset] , length , shift );
+            CPPUNIT_ASSERT_MESSAGE( levelMessage( "ShiftRowLeft" , CpuLevel( l ) ) ,
+                                    equalArrays( left , expected_left ) );
+            CPPUNIT_ASSERT_MESSAGE( levelMessage( "ShiftRowRight" , CpuLevel( l ) ) ,
+                                    equalArrays( right , expected_right ) );
+        }// l
+    }// trial
+}
+
+void KernelsTest::testWaveletTransform()
+{
+    TestRandom rnd( 7 );
+
+    for (int trial=0 ; trial<num_trials/4 ; ++trial)
+    {
+        // Transform depths and dimensions as for luma and chroma components.
+        // The longer filters read beyond bands narrower than 8 samples at
+        // the last level, so smaller pictures aren't valid input.
+        const int depth = rnd.Range( 1 , 4 );
+        const WltFilter filter = static_cast<WltFilter>( trial%NUM_WLT_FILTERS );
+        PicArray pic( rnd.Range( 4 , 12 )<<depth , rnd.Range( 4 , 16 )<<depth );
+        randomSamples( pic , rnd , depths[trial%2] );
+
+        SetCpuLevel( CPU_LEVEL_GENERIC );
+        PicArray expected_pic( pic );
+        CoeffArray expected_coeffs( pic.LengthY() , pic.LengthX() );
+        {
+            WaveletTransform wtransform( depth , filter );
+            wtransform.Transform( FORWARD , expected_pic , expected_coeffs );
+        }
+        CoeffArray coeffs( expected_coeffs );
+        {
+            WaveletTransform wtransform( depth , filter );
+            wtransform.Transform( BACKWARD , expected_pic , coeffs );
+        }
+
+        for (int l=CPU_LEVEL_GENERIC+1 ; l<=DetectedCpuLevel() ; ++l)
+        {
+            SetCpuLevel( CpuLevel( l ) );
+            PicArray test_pic( pic );
+            CoeffArray test_coeffs( pic.LengthY() , pic.LengthX() );
+            WaveletTransform wtransform( depth , filter );
+
+            wtransform.Transform( FORWARD , test_pic , test_coeffs );
+            CPPUNIT_ASSERT_MESSAGE( levelMessage( "Wavelet analysis" , CpuLevel( l ) ) ,
+                                    equalArrays<CoeffType>( test_coeffs , expected_coeffs ) );
+            wtransform.Transform( BACKWARD , test_pic , test_coeffs );
+            CPPUNIT_ASSERT_MESSAGE( levelMessage( "Wavelet synthesis" , CpuLevel( l ) ) ,
+                                    equalArrays<ValueType>( test_pic , expected_pic ) );
+        }// l
+    }// trial
+}
+
+void KernelsTest::testUpConverter()
+{
+    TestRandom rnd( 8 );
+
+    for (int trial=0 ; trial<num_trials/4 ; ++trial)
+    {
+        // Pictures are padded beyond their true size, as in coding
+        const int depth = depths[trial%num_depths];
+        PicArray pic( rnd.Range( 4 , 40 ) , rnd.Range( 4 , 72 ) );
+        randomSamples( pic , rnd , depth );
+        const int orig_xl = pic.LengthX() - rnd.Range( 0 , 3 );
+        const int orig_yl = pic.LengthY() - rnd.Range( 0 , 3 );
+        const int min_val = -(1<<(depth-1));
+        const int max_val = (1<<(depth-1))-1;
+
+        SetCpuLevel( CPU_LEVEL_GENERIC );
+        PicArray expected( 2*pic.LengthY() , 2*pic.LengthX() );
+        expected.Fill( 0 );
+        UpConverter( min_val , max_val , orig_xl , orig_yl ).DoUpConverter( pic , expected );
+
+        for (int l=CPU_LEVEL_GENERIC+1 ; l<=DetectedCpuLevel() ; ++l)
+        {
+            SetCpuLevel( CpuLevel( l ) );
+            PicArray up_pic( 2*pic.LengthY() , 2*pic.LengthX() );
+            up_pic.Fill( 0 );
+            UpConverter( min_val , max_val , orig_xl , orig_yl ).DoUpConverter( pic , up_pic );
+            CPPUNIT_ASSERT_MESSAGE( levelMessage( "UpConverter" , CpuLevel( l ) ) ,
+                                    equalArrays<ValueType>( up_pic , expected ) );
+        }// l
+    }// trial
+}
+
+void KernelsTest::testPackLines()
+{
+    TestRandom rnd( 9 );
+    const PackKernels generic = SelectPackKernels( CPU_LEVEL_GENERIC );
+
+    for (int trial=0 ; trial<num_trials ; ++trial)
+    {
+        // Samples cover the whole of ValueType, to test saturation
+        TwoDArray<ValueType> line( 1 , rnd.Range( 1 , 100 ) );
+        randomFill( line , rnd , -32768 , 32767 );
+        const int offset = rnd.Range( 0 , line.LengthX()-1 );
+        const int xl = line.LengthX()-offset;
+        const unsigned int depth = rnd.Range( 1 , 16 );
+
+        std::vector<unsigned char> expected8( xl );
+        std::vector<unsigned char> expected16( 2*xl );
+        generic.pack_line8( &line[0][offset] , &expected8[0] , xl );
+        generic.pack_line16( &line[0][offset] , &expected16[0] , xl , depth );
+
+        for (int l=CPU_LEVEL_GENERIC+1 ; l<=DetectedCpuLevel() ; ++l)
+        {
+            const PackKernels kernels = SelectPackKernels( CpuLevel( l ) );
+            std::vector<unsigned char> packed8( xl );
+            std::vector<unsigned char> packed16( 2*xl );
+            kernels.pack_line8( &line[0][offset] , &packed8[0] , xl );
+            kernels.pack_line16( &line[0][offset] , &packed16[0] , xl , depth );
+            CPPUNIT_ASSERT_MESSAGE( levelMessage( "PackLine8" , CpuLevel( l ) ) ,
+                                    packed8 == expected8 );
+            CPPUNIT_ASSERT_MESSAGE( levelMessage( "PackLine16" , CpuLevel( l ) ) ,
+                                    packed16 == expected16 );
+        }// l
+    }// trial
+}
+
+void KernelsTest::testQualityKernels()
+{
+    TestRandom rnd( 10 );
+
+    for (int trial=0 ; trial<num_trials ; ++trial)
+    {
+        // Coded values stray beyond the sample range, to test clipping
+        const int depth = depths[trial%num_depths];
+        const int min_val = -(1<<(depth-1));
+        const int max_val = (1<<(depth-1))-1;
+        const int num_blocks = rnd.Range( 1 , 24 );
+        TwoDArray<ValueType> orig( 4 , 4*num_blocks+rnd.Range( 0 , 3 ) );
+        TwoDArray<ValueType> coded( orig.LengthY() , orig.LengthX() );
+        randomFill( orig , rnd , min_val , max_val );
+        randomFill( coded , rnd , 2*min_val , 2*max_val );
+        const QualityKernels generic = SelectQualityKernels( CPU_LEVEL_GENERIC , depth );
+
+        TwoDArray<ValueType> expected_coded( coded );
+        std::vector<int64_t> expected_sse( coded.LengthY() );
+        for (int j=0 ; j<coded.LengthY() ; ++j)
+            expected_sse[j] = generic.clip_sse_row( &expected_coded[j][0] , &orig[j][0] ,
+                                                    coded.LengthX() , min_val , max_val );
+        std::vector<int64_t> expected_sums( 4*num_blocks );
+        generic.ssim_sums_4x4( &orig[0][0] , orig.LengthX() ,
+                               &expected_coded[0][0] , coded.LengthX() ,
+                               num_blocks , &expected_sums[0] );
+
+        for (int l=CPU_LEVEL_GENERIC+1 ; l<=DetectedCpuLevel() ; ++l)
+        {
+            const QualityKernels kernels = SelectQualityKernels( CpuLevel( l ) , depth );
+            TwoDArray<ValueType> test_coded( coded );
+            std::vector<int64_t> sse( coded.LengthY() );
+            for (int j=0 ; j<coded.LengthY() ; ++j)
+                sse[j] = kernels.clip_sse_row( &test_coded[j][0] , &orig[j][0] ,
+                                               coded.LengthX() , min_val , max_val );
+            CPPUNIT_ASSERT_MESSAGE( levelMessage( "ClipSSERow" , CpuLevel( l ) ) ,
+                                    sse == expected_sse );
+            CPPUNIT_ASSERT_MESSAGE( levelMessage( "ClipSSERow" , CpuLevel( l ) ) ,
+                                    equalArrays( test_coded , expected_coded ) );
+
+            std::vector<int64_t> sums( 4*num_blocks );
+            kernels.ssim_sums_4x4( &orig[0][0] , orig.LengthX() ,
+                                   &test_coded[0][0] , coded.LengthX() ,
+                                   num_blocks , &sums[0] );
+            CPPUNIT_ASSERT_MESSAGE( levelMessage( "SSIMSums4x4" , CpuLevel( l ) ) ,
+                                    sums == expected_sums );
+        }// l
+    }// trial
+}
@@ -0,0 +1,88 @@
+/* ***** BEGIN LICENSE BLOCK *****
+*
+* $Id$ $Name$
+*
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License
+* Version 1.1 (the "License"); you may not use this file except in compliance
+* with the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License for
+* the specific language governing rights and limitations under the License.
+*
+* The Original Code is BBC Research and Development code.
+*
+* The Initial Developer of the Original Code is the British Broadcasting
+* Corporation.
+* Portions created by the Initial Developer are Copyright (C) 2008.
+* All Rights Reserved.
+*
+* Contributor(s): Thomas Davies (Original Author)
+*
+* Alternatively, the contents of this file may be used under the terms of
+* the GNU General Public License Version 2 (the "GPL"), or the GNU Lesser
+* Public License Version 2.1 (the "LGPL"), in which case the provisions of
+* the GPL or the LGPL are applicable instead of those above. If you wish to
+* allow use of your version of this file only under the terms of the either
+* the GPL or LGPL and not to allow others to use your version of this file
+* under the MPL, indicate your decision by deleting the provisions above
+* and replace them with the notice and other provisions required by the GPL
+* or LGPL. If you do not delete the provisions above, a recipient may use
+* your version of this file under the terms of any one of the MPL, the GPL
+* or the LGPL.
+* ***** END LICENSE BLOCK ***** */
+
+#ifndef KERNELS_TEST_H
+#define KERNELS_TEST_H
+#include <cppunit/extensions/HelperMacros.h>
+#include <libdirac_common/cpu_dispatch.h>
+
+//! Checks that the kernels selected for each CPU level match the portable ones
+/*!
+    Each test runs the same randomised inputs through the portable code and
+    through the kernels of every level the CPU supports, and requires the
+    results to be identical.
+*/
+class KernelsTest : public CPPUNIT_NS::TestFixture
+{
+  CPPUNIT_TEST_SUITE( KernelsTest );
+  CPPUNIT_TEST( testBlockDiff );
+  CPPUNIT_TEST( testBiBlockDiff );
+  CPPUNIT_TEST( testIntraBlockDiff );
+  CPPUNIT_TEST( testBlockPred );
+  CPPUNIT_TEST( testBlockAdd );
+  CPPUNIT_TEST( testShiftRows );
+  CPPUNIT_TEST( testWaveletTransform );
+  CPPUNIT_TEST( testUpConverter );
+  CPPUNIT_TEST( testPackLines );
+  CPPUNIT_TEST( testQualityKernels );
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  KernelsTest();
+  virtual ~KernelsTest();
+
+  virtual void setUp();
+  virtual void tearDown();
+
+  void testBlockDiff();
+  void testBiBlockDiff();
+  void testIntraBlockDiff();
+  void testBlockPred();
+  void testBlockAdd();
+  void testShiftRows();
+  void testWaveletTransform();
+  void testUpConverter();
+  void testPackLines();
+  void testQualityKernels();
+private:
+  KernelsTest( const KernelsTest &copy );
+  void operator =( const KernelsTest &copy );
+private:
+  // The level in force before the test, restored afterwards
+  dirac::CpuLevel m_saved_level;
+};
+#endif
@@ -0,0 +1,326 @@
+/* ***** BEGIN LICENSE BLOCK *****
+*
+* $Id$ $Name$
+*
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License
+* Version 1.1 (the "License"); you may not use this file except in compliance
+* with the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License for
+* the specific language governing rights and limitations under the License.
+*
+* The Original Code is BBC Research and Development code.
+*
+* The Initial Developer of the Original Code is the British Broadcasting
+* Corporation.
+* Portions created by the Initial Developer are Copyright (C) 2008.
+* All Rights Reserved.
+*
+* Contributor(s): Thomas Davies (Original Author)
+*
+* Alternatively, the contents of this file may be used under the terms of
+* the GNU General Public License Version 2 (the "GPL"), or the GNU Lesser
+* Public License Version 2.1 (the "LGPL"), in which case the provisions of
+* the GPL or the LGPL are applicable instead of those above. If you wish to
+* allow use of your version of this file only under the terms of the either
+* the GPL or LGPL and not to allow others to use your version of this file
+* under the MPL, indicate your decision by deleting the provisions above
+* and replace them with the notice and other provisions required by the GPL
+* or LGPL. If you do not delete the provisions above, a recipient may use
+* your version of this file under the terms of any one of the MPL, the GPL
+* or the LGPL.
+* ***** END LICENSE BLOCK ***** */
+
+
+
+#include "core_suite.h"
+#include "quality_monitor_test.h"
+#include "test_random.h"
+
+#include <libdirac_encoder/quality_monitor.h>
+#include <libdirac_encoder/enc_picture.h>
+using namespace dirac;
+
+#include <cmath>
+#include <vector>
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+//NOTE: ensure that the suite is added to the default registry in
+//cppunit_testsuite.cpp
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION (QualityMonitorTest, coreSuiteName());
+
+namespace
+{
+    // The coded pictures are padded beyond the measured area, as in the
+    // encoder. The measured sizes aren't multiples of the 4x4 SSIM blocks.
+    const int pic_xl = 104;
+    const int pic_yl = 64;
+    const int meas_xl = 102;
+    const int meas_yl = 62;
+
+    const double peak = 255.0;
+
+    EncoderParams makeParams( const int xnum , const int ynum )
+    {
+        EncoderParams encp( VIDEO_FORMAT_CIF , INTRA_PICTURE , 1 , true );
+        encp.SetXl( meas_xl );
+        encp.SetYl( meas_yl );
+        encp.SetChromaXl( meas_xl/2 );
+        encp.SetChromaYl( meas_yl/2 );
+        encp.SetLumaDepth( 8 );
+        encp.SetChromaDepth( 8 );
+        encp.SetQualityRegions( xnum , ynum );
+        return encp;
+    }
+
+    PictureParams makePictureParams()
+    {
+        return PictureParams( format420 , pic_xl , pic_yl , 8 , 8 );
+    }
+
+    // Fills the original with values in [lo, hi] and the coded data with
+    // the original plus an error in [err_lo, err_hi]
+    void makePicture( EncPicture& pic , TestRandom& rnd , const int lo , const int hi ,
+                      const int err_lo , const int err_hi )
+    {
+        for (int c=0 ; c<3 ; ++c)
+        {
+            PicArray& data = pic.Data( (CompSort) c );
+            for (int j=0 ; j<data.LengthY() ; ++j)
+                for (int i=0 ; i<data.LengthX() ; ++i)
+                    data[j][i] = rnd.Range( lo , hi );
+        }// c
+        pic.SetOrigData();
+
+        for (int c=0 ; c<3 ; ++c)
+        {
+            PicArray& data = pic.Data( (CompSort) c );
+            for (int j=0 ; j<data.LengthY() ; ++j)
+                for (int i=0 ; i<data.LengthX() ; ++i)
+                    data[j][i] += rnd.Range( err_lo , err_hi );
+        }// c
+    }
+
+    // The sum of squared differences over part of a component
+    double sse( const EncPicture& pic , const CompSort cs ,
+                const int xbeg , const int xend , const int ybeg , const int yend )
+    {
+        const PicArray& coded = pic.Data( cs );
+        const PicArray& orig = pic.OrigData( cs );
+        double sum = 0.0;
+        for (int j=ybeg ; j<yend ; ++j)
+            for (int i=xbeg ; i<xend ; ++i)
+                sum += double( coded[j][i]-orig[j][i] )*double( coded[j][i]-orig[j][i] );
+        return sum;
+    }
+
+    double psnr( const double sum , const double num_samples )
+    {
+        return 10.0*std::log10( peak*peak*num_samples/sum );
+    }
+
+    // The region boundaries: on 4x4 block boundaries, bar the last
+    std::vector<int> regionBounds( const int len , const int num )
+    {
+        std::vector<int> bounds( num+1 );
+        for (int r=0 ; r<num ; ++r)
+            bounds[r] = 4*( (r*(len/4))/num );
+        bounds[num] = len;
+        return bounds;
+    }
+
+    bool close( const double a , const double b )
+    {
+        return std::fabs( a-b ) <= 1e-9*std::max( 1.0 , std::fabs( b ) );
+    }
+}
+
+QualityMonitorTest::QualityMonitorTest()
+{
+}
+
+QualityMonitorTest::~QualityMonitorTest()
+{
+}
+
+void QualityMonitorTest::setUp()
+{
+}
+
+void QualityMonitorTest::tearDown()
+{
+}
+
+void QualityMonitorTest::testIdentical()
+{
+    TestRandom rnd( 1 );
+    EncoderParams encp( makeParams( 1 , 1 ) );
+    EncPicture pic( makePictureParams() );
+    makePicture( pic , rnd , -128 , 127 , 0 , 0 );
+
+    QualityMonitor monitor( encp );
+    monitor.UpdateModel( pic );
+
+    for (int c=0 ; c<3 ; ++c)
+    {
+        const double p = pic.Stats().PSNR( (CompSort) c );
+        CPPUNIT_ASSERT( p>0.0 && std::isinf( p ) );
+        CPPUNIT_ASSERT( close( pic.Stats().SSIM( (CompSort) c ) , 1.0 ) );
+    }// c
+}
+
+void QualityMonitorTest::testConstantOffset()
+{
+    TestRandom rnd( 2 );
+    EncoderParams encp( makeParams( 1 , 1 ) );
+    EncPicture pic( makePictureParams() );
+    makePicture( pic , rnd , -128 , 124 , 3 , 3 );
+
+    QualityMonitor monitor( encp );
+    monitor.UpdateModel( pic );
+
+    // The structure of the picture is unchanged, so only the luminance
+    // term of SSIM falls below 1
+    for (int c=0 ; c<3 ; ++c)
+    {
+        CPPUNIT_ASSERT( close( pic.Stats().PSNR( (CompSort) c ) , psnr( 9.0 , 1.0 ) ) );
+        const double s = pic.Stats().SSIM( (CompSort) c );
+        CPPUNIT_ASSERT( s>0.99 && s<1.0 );
+    }// c
+}
+
+void QualityMonitorTest::testClipping()
+{
+    TestRandom rnd( 3 );
+    EncoderParams encp( makeParams( 1 , 1 ) );
+    EncPicture pic( makePictureParams() );
+
+    // Originals at the limits of the range, coded data beyond them
+    for (int c=0 ; c<3 ; ++c)
+    {
+        PicArray& data = pic.Data( (CompSort) c );
+        for (int j=0 ; j<data.LengthY() ; ++j)
+            for (int i=0 ; i<data.LengthX() ; ++i)
+                data[j][i] = (j%2==0) ? -128 : 127;
+    }// c
+    pic.SetOrigData();
+
+    for (int c=0 ; c<3 ; ++c)
+    {
+        PicArray& data = pic.Data( (CompSort) c );
+        for (int j=0 ; j<data.LengthY() ; ++j)
+            for (int i=0 ; i<data.LengthX() ; ++i)
+                data[j][i] += (j%2==0) ? -rnd.Range( 1 , 200 ) : rnd.Range( 1 , 200 );
+    }// c
+
+    QualityMonitor monitor( encp );
+    monitor.UpdateModel( pic );
+
+    // All the coded data, padding included, is clipped back to the original
+    for (int c=0 ; c<3 ; ++c)
+    {
+        const PicArray& orig = pic.OrigData( (CompSort) c );
+        const PicArray& data = pic.Data( (CompSort) c );
+        for (int j=0 ; j<data.LengthY() ; ++j)
+            for (int i=0 ; i<data.LengthX() ; ++i)
+                CPPUNIT_ASSERT_EQUAL( orig[j][i] , data[j][i] );
+
+        CPPUNIT_ASSERT( std::isinf( pic.Stats().PSNR( (CompSort) c ) ) );
+    }// c
+}
+
+void QualityMonitorTest::testRegions()
+{
+    // An uneven grid, so the regions differ in size
+    const int xnum = 3;
+    const int ynum = 2;
+
+    TestRandom rnd( 4 );
+    EncoderParams encp( makeParams( xnum , ynum ) );
+    EncPicture pic( makePictureParams() );
+    makePicture( pic , rnd , -100 , 100 , -6 , 6 );
+
+    QualityMonitor monitor( encp );
+    monitor.UpdateModel( pic );
+
+    const PictureStats& stats = pic.Stats();
+    CPPUNIT_ASSERT_EQUAL( xnum , stats.RegionsX() );
+    CPPUNIT_ASSERT_EQUAL( ynum , stats.RegionsY() );
+
+    for (int c=0 ; c<3 ; ++c)
+    {
+        const CompSort cs = (CompSort) c;
+        const int xl = c==0 ? meas_xl : meas_xl/2;
+        const int yl = c==0 ? meas_yl : meas_yl/2;
+        const double total = sse( pic , cs , 0 , xl , 0 , yl );
+        CPPUNIT_ASSERT( close( stats.PSNR( cs ) , psnr( total , double( xl )*yl ) ) );
+
+        const std::vector<int> xbound( regionBounds( xl , xnum ) );
+        const std::vector<int> ybound( regionBounds( yl , ynum ) );
+        const std::vector<double>& region_psnr = stats.RegionPSNR( cs );
+        const std::vector<double>& region_ssim = stats.RegionSSIM( cs );
+        CPPUNIT_ASSERT_EQUAL( size_t( xnum*ynum ) , region_psnr.size() );
+        CPPUNIT_ASSERT_EQUAL( size_t( xnum*ynum ) , region_ssim.size() );
+
+        // Each region's error is its own, and together they make the whole
+        double region_total = 0.0;
+        for (int ry=0 ; ry<ynum ; ++ry)
+            for (int rx=0 ; rx<xnum ; ++rx)
+            {
+                const double num_samples = double( xbound[rx+1]-xbound[rx] )*
+                                           ( ybound[ry+1]-ybound[ry] );
+                const double region_sse = sse( pic , cs , xbound[rx] , xbound[rx+1] ,
+                                               ybound[ry] , ybound[ry+1] );
+                const double p = region_psnr[ry*xnum+rx];
+                CPPUNIT_ASSERT( close( p , psnr( region_sse , num_samples ) ) );
+                region_total += peak*peak*num_samples/std::pow( 10.0 , p/10.0 );
+
+                const double s = region_ssim[ry*xnum+rx];
+                CPPUNIT_ASSERT( s>0.0 && s<1.0 );
+            }
+        CPPUNIT_ASSERT( close( region_total , total ) );
+    }// c
+}
+
+void QualityMonitorTest::testThreading()
+{
+    // The per-strip results are totalled in order, so the measurements
+    // are exactly the same however many threads there are
+    EncoderParams encp( makeParams( 3 , 2 ) );
+    EncPicture pic1( makePictureParams() );
+    EncPicture pic2( makePictureParams() );
+    TestRandom rnd1( 5 );
+    TestRandom rnd2( 5 );
+    makePicture( pic1 , rnd1 , -128 , 127 , -20 , 20 );
+    makePicture( pic2 , rnd2 , -128 , 127 , -20 , 20 );
+
+#if defined(_OPENMP)
+    const int saved_threads = omp_get_max_threads();
+    omp_set_num_threads( 1 );
+#endif
+    QualityMonitor monitor1( encp );
+    monitor1.UpdateModel( pic1 );
+#if defined(_OPENMP)
+    omp_set_num_threads( 4 );
+#endif
+    QualityMonitor monitor2( encp );
+    monitor2.UpdateModel( pic2 );
+#if defined(_OPENMP)
+    omp_set_num_threads( saved_threads );
+#endif
+
+    for (int c=0 ; c<3 ; ++c)
+    {
+        const CompSort cs = (CompSort) c;
+        CPPUNIT_ASSERT( pic1.Stats().PSNR( cs )==pic2.Stats().PSNR( cs ) );
+        CPPUNIT_ASSERT( pic1.Stats().SSIM( cs )==pic2.Stats().SSIM( cs ) );
+        CPPUNIT_ASSERT( pic1.Stats().RegionPSNR( cs )==pic2.Stats().RegionPSNR( cs ) );
+        CPPUNIT_ASSERT( pic1.Stats().RegionSSIM( cs )==pic2.Stats().RegionSSIM( cs ) );
+    }// c
+}
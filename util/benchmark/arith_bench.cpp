@@ -0,0 +1,199 @@
+/* ***** BEGIN LICENSE BLOCK *****
+*
+* $Id$ $Name$
+*
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License
+* Version 1.1 (the "License"); you may not use this file except in compliance
+* with the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License for
+* the specific language governing rights and limitations under the License.
+*
+* The Original Code is BBC Research and Development code.
+*
+* The Initial Developer of the Original Code is the British Broadcasting
+* Corporation.
+* Portions created by the Initial Developer are Copyright (C) 2008.
+* All Rights Reserved.
+*
+* Contributor(s): Thomas Davies (Original Author)
+*
+* Alternatively, the contents of this file may be used under the terms of
+* the GNU General Public License Version 2 (the "GPL"), or the GNU Lesser
+* Public License Version 2.1 (the "LGPL"), in which case the provisions of
+* the GPL or the LGPL are applicable instead of those above. If you wish to
+* allow use of your version of this file only under the terms of the either
+* the GPL or LGPL and not to allow others to use your version of this file
+* under the MPL, indicate your decision by deleting the provisions above
+* and replace them with the notice and other provisions required by the GPL
+* or LGPL. If you do not delete the provisions above, a recipient may use
+* your version of this file under the terms of any one of the MPL, the GPL
+* or the LGPL.
+* ***** END LICENSE BLOCK ***** */
+
+
+// Measures the throughput of the arithmetic coding engine on real subband
+// data: the luma of each input picture is wavelet transformed, quantised
+// and then coded and decoded repeatedly, symbol by symbol.
+
+#include "bench_codec.h"
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+using namespace dirac;
+using namespace std;
+
+namespace
+{
+    double Seconds(const clock_t start)
+    {
+        return double(clock()-start)/CLOCKS_PER_SEC;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 4)
+    {
+        cerr << "Usage: " << argv[0]
+             << " input.yuv width height [num_frames [quant_step [repeats]]]"
+             << endl
+             << "Input is planar 8-bit 4:2:0 video; only the luma is coded."
+             << endl;
+        return EXIT_FAILURE;
+    }
+
+    const int width = atoi(argv[2]);
+    const int height = atoi(argv[3]);
+    const int num_frames = argc > 4 ? atoi(argv[4]) : 1;
+    const int quant_step = argc > 5 ? atoi(argv[5]) : 8;
+    const int repeats = argc > 6 ? atoi(argv[6]) : 10;
+    const int depth = 4;
+
+    if (width <= 0 || height <= 0 || num_frames <= 0 ||
+        quant_step <= 0 || repeats <= 0)
+    {
+        cerr << "Invalid benchmark parameters" << endl;
+        return EXIT_FAILURE;
+    }
+
+    ifstream in(argv[1], ios::in | ios::binary);
+    if (!in)
+    {
+        cerr << "Can't open input file " << argv[1] << endl;
+        return EXIT_FAILURE;
+    }
+
+    // Transform and quantise the luma of each picture
+    const int pad = 1<<depth;
+    const int xl = ((width+pad-1)/pad)*pad;
+    const int yl = ((height+pad-1)/pad)*pad;
+    WaveletTransform wtransform(depth, DD9_7);
+    std::vector<CoeffArray*> pictures;
+    std::vector<unsigned char> line(width);
+    long num_symbols = 0;
+
+    for (int f=0; f<num_frames; ++f)
+    {
+        PicArray pic_data(height, width);
+        for (int j=0; j<height; ++j)
+        {
+            in.read(reinterpret_cast<char*>(&line[0]), width);
+            for (int i=0; i<width; ++i)
+                pic_data[j][i] = ValueType(line[i]) - 128;
+        }
+        in.seekg(width*height/2, ios::cur);
+        if (!in)
+            break;
+
+        CoeffArray* coeff_data = new CoeffArray(yl, xl);
+        wtransform.Transform(FORWARD, pic_data, *coeff_data);
+        for (int j=0; j<yl; ++j)
+        {
+            for (int i=0; i<xl; ++i)
+            {
+                CoeffType& val = (*coeff_data)[j][i];
+                val = CoeffType(val/quant_step);
+                num_symbols += SymbolCount(val);
+            }
+        }
+        pictures.push_back(coeff_data);
+    }
+
+    if (pictures.empty())
+    {
+        cerr << "No complete pictures in " << argv[1] << endl;
+        return EXIT_FAILURE;
+    }
+
+    // Code everything once to get the coded data for decoding
+    std::vector<BenchByteIO*> coded(pictures.size());
+    long num_bytes = 0;
+    for (size_t p=0; p<pictures.size(); ++p)
+    {
+        coded[p] = new BenchByteIO();
+        BenchCodec codec(coded[p]);
+        num_bytes += codec.Compress(*pictures[p]);
+    }
+
+    clock_t start = clock();
+    for (int r=0; r<repeats; ++r)
+    {
+        for (size_t p=0; p<pictures.size(); ++p)
+        {
+            ByteIO byteio;
+            BenchCodec codec(&byteio);
+            codec.Compress(*pictures[p]);
+        }
+    }
+    const double encode_time = Seconds(start);
+
+    bool match = true;
+    start = clock();
+    for (int r=0; r<repeats; ++r)
+    {
+        for (size_t p=0; p<pictures.size(); ++p)
+        {
+            CoeffArray out_data(yl, xl);
+            out_data.BandList() = pictures[p]->BandList();
+            coded[p]->Rewind();
+            ByteIO byteio(*coded[p]);
+            BenchCodec codec(&byteio);
+            codec.Decompress(out_data, coded[p]->GetSize());
+            if (r==0)
+            {
+                for (int j=0; j<yl; ++j)
+                    for (int i=0; i<xl; ++i)
+                        match = match && out_data[j][i]==(*pictures[p])[j][i];
+            }
+        }
+    }
+    const double decode_time = Seconds(start);
+
+    const double total_symbols = double(num_symbols)*repeats;
+    cout << "Pictures: " << pictures.size() << " (" << width << "x" << height
+         << "), quantiser step " << quant_step << endl;
+    cout << "Symbols per pass: " << num_symbols << ", coded bytes: "
+         << num_bytes << " ("
+         << 8.0*num_bytes/num_symbols << " bits/symbol)" << endl;
+    cout << "Encode: " << total_symbols/encode_time/1.0e6
+         << " Msymbols/sec" << endl;
+    cout << "Decode: " << total_symbols/decode_time/1.0e6
+         << " Msymbols/sec" << endl;
+    if (!match)
+        cout << "Decoded data does not match" << endl;
+
+    for (size_t p=0; p<pictures.size(); ++p)
+    {
+        delete pictures[p];
+        delete coded[p];
+    }
+
+    return match ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,126 @@
+/* ***** BEGIN LICENSE BLOCK *****
+*
+* $Id$ $Name$
+*
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License
+* Version 1.1 (the "License"); you may not use this file except in compliance
+* with the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License for
+* the specific language governing rights and limitations under the License.
+*
+* The Original Code is BBC Research and Development code.
+*
+* The Initial Developer of the Original Code is the British Broadcasting
+* Corporation.
+* Portions created by the Initial Developer are Copyright (C) 2008.
+* All Rights Reserved.
+*
+* Contributor(s): Thomas Davies (Original Author)
+*
+* Alternatively, the contents of this file may be used under the terms of
+* the GNU General Public License Version 2 (the "GPL"), or the GNU Lesser
+* Public License Version 2.1 (the "LGPL"), in which case the provisions of
+* the GPL or the LGPL are applicable instead of those above. If you wish to
+* allow use of your version of this file only under the terms of the either
+* the GPL or LGPL and not to allow others to use your version of this file
+* under the MPL, indicate your decision by deleting the provisions above
+* and replace them with the notice and other provisions required by the GPL
+* or LGPL. If you do not delete the provisions above, a recipient may use
+* your version of this file under the terms of any one of the MPL, the GPL
+* or the LGPL.
+* ***** END LICENSE BLOCK ***** */
+
+// A codec for benchmarking the arithmetic coding engine on subband data,
+// shared by the benchmark programs
+
+#ifndef _BENCH_CODEC_H_
+#define _BENCH_CODEC_H_
+
+#include <libdirac_common/arith_codec.h>
+#include <libdirac_common/wavelet_utils.h>
+#include <cstdlib>
+
+namespace dirac
+{
+    // Contexts used by the benchmark codec
+    enum BenchCtxs
+    {
+        BENCH_ZERO_NBR_CTX = 0,    // first bin, no non-zero neighbours
+        BENCH_NONZERO_NBR_CTX,     // first bin, a non-zero neighbour
+        BENCH_BIN2_CTX,
+        BENCH_BIN3_CTX,
+        BENCH_BIN4_CTX,            // last bin context
+        BENCH_INFO_CTX,
+        BENCH_SIGN_CTX,
+        TOTAL_BENCH_CTXS
+    };
+
+    const int BENCH_MAX_BIN = BENCH_BIN4_CTX;
+
+    //! A codec that codes quantised subbands with the same binarisation
+    //! as the band codecs and a simple neighbourhood context
+    class BenchCodec: public ArithCodec<CoeffArray>
+    {
+    public:
+        BenchCodec(ByteIO* p_byteio):
+            ArithCodec<CoeffArray>(p_byteio, TOTAL_BENCH_CTXS){}
+
+    private:
+        static int FirstBin(const CoeffArray& data, const int x, const int y,
+                            const Subband& band)
+        {
+            const bool nbr = ( x>band.Xp() && data[y][x-1]!=0 ) ||
+                             ( y>band.Yp() && data[y-1][x]!=0 );
+            return nbr ? BENCH_NONZERO_NBR_CTX : BENCH_ZERO_NBR_CTX;
+        }
+
+        void DoWorkCode(CoeffArray& in_data)
+        {
+            const SubbandList& bands = in_data.BandList();
+            for (int b=bands.Length(); b>=1; --b)
+            {
+                const Subband& band = bands(b);
+                for (int y=band.Yp(); y<band.Yp()+band.Yl(); ++y)
+                    for (int x=band.Xp(); x<band.Xp()+band.Xl(); ++x)
+                        EncodeSInt(in_data[y][x],
+                                   FirstBin(in_data, x, y, band), BENCH_MAX_BIN);
+            }
+        }
+
+        void DoWorkDecode(CoeffArray& out_data)
+        {
+            const SubbandList& bands = out_data.BandList();
+            for (int b=bands.Length(); b>=1; --b)
+            {
+                const Subband& band = bands(b);
+                for (int y=band.Yp(); y<band.Yp()+band.Yl(); ++y)
+                    for (int x=band.Xp(); x<band.Xp()+band.Xl(); ++x)
+                        out_data[y][x] = DecodeSInt(
+                                   FirstBin(out_data, x, y, band), BENCH_MAX_BIN);
+            }
+        }
+    };
+
+    //! Coded data that can be read back repeatedly
+    class BenchByteIO: public ByteIO
+    {
+    public:
+        void Rewind(){ SeekGet(0, std::ios_base::beg); }
+    };
+
+    // Number of binary symbols coded by EncodeSInt for a value
+    inline long SymbolCount(const int value)
+    {
+        long count = 1;
+        for (unsigned int v=std::abs(value)+1; v>1; v>>=1)
+            count += 2;
+        return count + (value!=0 ? 1 : 0);
+    }
+} // namespace dirac
+
+#endif
@@ -0,0 +1,728 @@
+/* ***** BEGIN LICENSE BLOCK *****
+*
+* $Id$ $Name$
+*
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License
+* Version 1.1 (the "License"); you may not use this file except in compliance
+* with the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License for
+* the specific language governing rights and limitations under the License.
+*
+* The Original Code is BBC Research and Development code.
+*
+* The Initial Developer of the Original Code is the British Broadcasting
+* Corporation.
+* Portions created by the Initial Developer are Copyright (C) 2008.
+* All Rights Reserved.
+*
+* Contributor(s): Thomas Davies (Original Author)
+*
+* Alternatively, the contents of this file may be used under the terms of
+* the GNU General Public License Version 2 (the "GPL"), or the GNU Lesser
+* Public License Version 2.1 (the "LGPL"), in which case the provisions of
+* the GPL or the LGPL are applicable instead of those above. If you wish to
+* allow use of your version of this file only under the terms of the either
+* the GPL or LGPL and not to allow others to use your version of this file
+* under the MPL, indicate your decision by deleting the provisions above
+* and replace them with the notice and other provisions required by the GPL
+* or LGPL. If you do not delete the provisions above, a recipient may use
+* your version of this file under the terms of any one of the MPL, the GPL
+* or the LGPL.
+* ***** END LICENSE BLOCK ***** */
+
+
+// Benchmarks the codec kernels and end-to-end coding on synthetic video
+// generated in-process, so that runs are reproducible without any test
+// material. Each result is written as one line of CSV, or as one JSON
+// object with -json, giving the benchmark, its variant, the picture size,
+// the number of timed runs, the best and mean times per picture and the
+// corresponding throughput. End-to-end coding is timed as a single run.
+// Results from different releases can then be compared mechanically to
+// catch performance regressions.
+
+#include "bench_codec.h"
+#include <libdirac_common/upconvert.h>
+#include <libdirac_common/mot_comp.h>
+#include <libdirac_common/picture.h>
+#include <libdirac_common/stage_timer.h>
+#include <libdirac_motionest/me_utils.h>
+#include <libdirac_motionest/downconvert.h>
+#include <libdirac_encoder/prefilter.h>
+#include <libdirac_encoder/dirac_encoder.h>
+#include <libdirac_decoder/dirac_parser.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+using namespace dirac;
+using namespace std;
+
+namespace
+{
+    struct BenchOptions
+    {
+        int width;             // kernel picture width
+        int height;            // kernel picture height
+        int repeats;           // timed runs of each kernel
+        int frames;            // pictures coded end-to-end
+        float qf;              // end-to-end quality factor
+        bool json;             // JSON output rather than CSV
+        string only;           // run only benchmarks whose names contain this
+        vector<string> sizes;  // end-to-end picture formats
+    };
+
+    //! Writes benchmark results as they are obtained
+    class BenchResults
+    {
+    public:
+        BenchResults(const bool json): m_json(json), m_count(0)
+        {
+            if (m_json)
+                cout << "[";
+            else
+                cout << "benchmark,variant,width,height,runs,best_ms,mean_ms,"
+                     << "fps,mpixels_per_sec" << endl;
+        }
+
+        ~BenchResults()
+        {
+            if (m_json)
+                cout << endl << "]" << endl;
+        }
+
+        //! Writes a result from the times of each run, in seconds per picture
+        void Add(const string& name, const string& variant,
+                 const int xl, const int yl, const vector<double>& times)
+        {
+            const double best = *min_element(times.begin(), times.end());
+            double mean = 0.0;
+            for (size_t i=0; i<times.size(); ++i)
+                mean += times[i];
+            mean /= times.size();
+            const double fps = best>0.0 ? 1.0/best : 0.0;
+            const double mpixels = fps*xl*yl/1.0e6;
+
+            if (m_json)
+            {
+                cout << (m_count ? "," : "") << endl
+                     << "  {\"benchmark\": \"" << name << "\", \"variant\": \""
+                     << variant << "\", \"width\": " << xl << ", \"height\": "
+                     << yl << ", \"runs\": " << times.size() << ", \"best_ms\": "
+                     << 1000.0*best << ", \"mean_ms\": " << 1000.0*mean
+                     << ", \"fps\": " << fps << ", \"mpixels_per_sec\": "
+                     << mpixels << "}";
+            }
+            else
+            {
+                cout << name << "," << variant << "," << xl << "," << yl << ","
+                     << times.size() << "," << 1000.0*best << ","
+                     << 1000.0*mean << "," << fps << "," << mpixels << endl;
+            }
+            ++m_count;
+        }
+
+    private:
+        const bool m_json;
+        int m_count;
+    };
+
+    // The value of a synthetic scene at a point: ramps, a chequerboard of
+    // sharp-edged blocks and low-level noise, moving by (2,1) pixels per
+    // picture so that motion estimation and compensation have work to do
+    int SceneValue(const int x, const int y, const int pnum, const unsigned int seed)
+    {
+        const int xs = x + 2*pnum;
+        const int ys = y + pnum;
+        int val = 48 + ((3*xs + 2*ys) & 127);
+        if ( ((xs>>5) + (ys>>5)) & 1 )
+            val += 64;
+
+        unsigned int noise = (unsigned int)(x)*73856093u ^
+                             (unsigned int)(y)*19349663u ^
+                             (unsigned int)(pnum)*83492791u ^ seed;
+        noise = noise*1103515245u + 12345u;
+        val += int( (noise>>16) & 7 ) - 4;
+
+        return std::max( 0 , std::min( val , 255 ) );
+    }
+
+    // Fills a picture component with the scene, offset to be signed
+    void MakeComponent(PicArray& data, const int pnum, const unsigned int seed)
+    {
+        for (int j=data.FirstY(); j<=data.LastY(); ++j)
+            for (int i=data.FirstX(); i<=data.LastX(); ++i)
+                data[j][i] = ValueType( SceneValue(i, j, pnum, seed) - 128 );
+    }
+
+    // Fills an 8-bit planar 4:2:0 frame buffer with the scene
+    void MakeFrame(unsigned char* buf, const int xl, const int yl, const int pnum)
+    {
+        for (int j=0; j<yl; ++j)
+            for (int i=0; i<xl; ++i)
+                *buf++ = (unsigned char)SceneValue(i, j, pnum, 0);
+        for (int c=1; c<3; ++c)
+            for (int j=0; j<yl/2; ++j)
+                for (int i=0; i<xl/2; ++i)
+                    *buf++ = (unsigned char)SceneValue(i, j, pnum, c);
+    }
+
+    bool Selected(const BenchOptions& opts, const string& name)
+    {
+        return name.find(opts.only) != string::npos;
+    }
+
+    // Keeps kernel results live so that they can't be optimised away
+    volatile CalcValueType result_sink = 0;
+
+    void BenchWavelet(const BenchOptions& opts, BenchResults& results)
+    {
+        const WltFilter filters[] = { DD9_7, LEGALL5_3, DD13_7, HAAR0, HAAR1, DAUB9_7 };
+        const char* names[] = { "DD9_7", "LEGALL5_3", "DD13_7", "HAAR0", "HAAR1", "DAUB9_7" };
+        const int depth = 4;
+        const int pad = 1<<depth;
+        const int xl = ((opts.width+pad-1)/pad)*pad;
+        const int yl = ((opts.height+pad-1)/pad)*pad;
+
+        PicArray pic_data(opts.height, opts.width);
+        PicArray out_data(opts.height, opts.width);
+        MakeComponent(pic_data, 0, 0);
+
+        for (int f=0; f<int(sizeof(filters)/sizeof(filters[0])); ++f)
+        {
+            WaveletTransform wtransform(depth, filters[f]);
+            CoeffArray coeff_data(yl, xl);
+            vector<double> fwd_times, bwd_times;
+
+            // The first run is a warm-up and isn't timed
+            for (int r=0; r<=opts.repeats; ++r)
+            {
+                double start = StageClock();
+                wtransform.Transform(FORWARD, pic_data, coeff_data);
+                const double fwd = StageClock()-start;
+
+                start = StageClock();
+                wtransform.Transform(BACKWARD, out_data, coeff_data);
+                const double bwd = StageClock()-start;
+
+                if (r>0)
+                {
+                    fwd_times.push_back(fwd);
+                    bwd_times.push_back(bwd);
+                }
+            }
+            results.Add("wavelet_forward", names[f], opts.width, opts.height, fwd_times);
+            results.Add("wavelet_backward", names[f], opts.width, opts.height, bwd_times);
+        }
+    }
+
+    // Times the block differences of one matcher for a set of candidate
+    // vectors around a base vector at every 12x12 block position
+    void BenchDiff(const BenchOptions& opts, BenchResults& results,
+                   const string& variant, BlockDiff& diff, const MVector& base)
+    {
+        const int xblen = 12;
+        const int yblen = 12;
+        const int sep = 8;
+        vector<double> times;
+
+        for (int r=0; r<=opts.repeats; ++r)
+        {
+            CalcValueType sum = 0;
+            const double start = StageClock();
+            for (int yp=0; yp+yblen<=opts.height; yp+=sep)
+            {
+                for (int xp=0; xp+xblen<=opts.width; xp+=sep)
+                {
+                    const BlockDiffParams dparams(xp, yp, xblen, yblen);
+                    for (int dy=-1; dy<=1; ++dy)
+                        for (int dx=-1; dx<=1; ++dx)
+                            sum += diff.Diff(dparams, MVector(base.x+dx, base.y+dy));
+                }
+            }
+            if (r>0)
+                times.push_back(StageClock()-start);
+            result_sink += sum;
+        }
+        results.Add("block_diff", variant, opts.width, opts.height, times);
+    }
+
+    void BenchBlockDiffs(const BenchOptions& opts, BenchResults& results)
+    {
+        PicArray ref_data(opts.height, opts.width);
+        PicArray pic_data(opts.height, opts.width);
+        MakeComponent(ref_data, 0, 0);
+        MakeComponent(pic_data, 1, 0);
+
+        PicArray up_data(2*opts.height, 2*opts.width);
+        UpConverter upconv(-128, 127, opts.width, opts.height);
+        upconv.DoUpConverter(ref_data, up_data);
+
+        // The scene moves by (2,1) pixels per picture, so search around
+        // the true motion at each precision
+        PelBlockDiff pel_diff(ref_data, pic_data);
+        BenchDiff(opts, results, "pel", pel_diff, MVector(-2, -1));
+
+        BlockDiffHalfPel half_diff(up_data, pic_data);
+        BenchDiff(opts, results, "half_pel", half_diff, MVector(-4, -2));
+
+        BlockDiffQuarterPel quarter_diff(up_data, pic_data);
+        BenchDiff(opts, results, "quarter_pel", quarter_diff, MVector(-8, -4));
+
+        BlockDiffEighthPel eighth_diff(up_data, pic_data);
+        BenchDiff(opts, results, "eighth_pel", eighth_diff, MVector(-16, -8));
+    }
+
+    void BenchConverters(const BenchOptions& opts, BenchResults& results)
+    {
+        PicArray pic_data(opts.height, opts.width);
+        MakeComponent(pic_data, 0, 0);
+
+        if (Selected(opts, "upconvert"))
+        {
+            PicArray up_data(2*opts.height, 2*opts.width);
+            UpConverter upconv(-128, 127, opts.width, opts.height);
+            vector<double> times;
+            for (int r=0; r<=opts.repeats; ++r)
+            {
+                const double start = StageClock();
+                upconv.DoUpConverter(pic_data, up_data);
+                if (r>0)
+                    times.push_back(StageClock()-start);
+            }
+            results.Add("upconvert", "luma", opts.width, opts.height, times);
+        }
+
+        if (Selected(opts, "downconvert"))
+        {
+            PicArray down_data(opts.height/2, opts.width/2);
+            DownConverter downconv;
+            vector<double> times;
+            for (int r=0; r<=opts.repeats; ++r)
+            {
+                const double start = StageClock();
+                downconv.DoDownConvert(pic_data, down_data);
+                if (r>0)
+                    times.push_back(StageClock()-start);
+            }
+            results.Add("downconvert", "luma", opts.width, opts.height, times);
+        }
+    }
+
+    void BenchMotionComp(const BenchOptions& opts, BenchResults& results)
+    {
+        const char* names[] = { "pel", "half_pel", "quarter_pel", "eighth_pel" };
+        const int xl = opts.width;
+        const int yl = opts.height;
+
+        CodecParams cparams(VIDEO_FORMAT_CUSTOM, INTER_PICTURE, 2, true);
+        PicturePredParams& predparams = cparams.GetPicPredParams();
+        predparams.SetBlockSizes(OLBParams(12, 12, 8, 8), format420);
+        predparams.SetXNumSB( (xl+predparams.LumaBParams(0).Xbsep()-1)/
+                              predparams.LumaBParams(0).Xbsep() );
+        predparams.SetYNumSB( (yl+predparams.LumaBParams(0).Ybsep()-1)/
+                              predparams.LumaBParams(0).Ybsep() );
+        predparams.SetXNumBlocks( 4*predparams.XNumSB() );
+        predparams.SetYNumBlocks( 4*predparams.YNumSB() );
+
+        // A non-reference picture between two reference pictures
+        PictureParams pparams(format420, xl, yl, 8, 8);
+        pparams.SetPicSort(PictureSort::IntraRefPictureSort());
+        pparams.SetPictureNum(0);
+        Picture ref1(pparams);
+        pparams.SetPictureNum(2);
+        Picture ref2(pparams);
+        pparams.SetPicSort(PictureSort::InterNonRefPictureSort());
+        pparams.SetPictureNum(1);
+        pparams.Refs().push_back(0);
+        pparams.Refs().push_back(2);
+        Picture pic(pparams);
+        for (int c=0; c<3; ++c)
+        {
+            MakeComponent(pic.Data(CompSort(c)), 1, c);
+            MakeComponent(ref1.Data(CompSort(c)), 0, c);
+            MakeComponent(ref2.Data(CompSort(c)), 2, c);
+        }
+        Picture* refs[2] = { &ref1, &ref2 };
+
+        for (int prec=0; prec<4; ++prec)
+        {
+            predparams.SetMVPrecision(MVPrecisionType(prec));
+
+            // Vectors near the true motion, with a mix of prediction modes
+            MvData mv_data(predparams, 2);
+            for (int j=0; j<predparams.YNumBlocks(); ++j)
+            {
+                for (int i=0; i<predparams.XNumBlocks(); ++i)
+                {
+                    const unsigned int h = (unsigned int)(i*7 + j*13);
+                    mv_data.Mode()[j][i] = PredMode( REF1_ONLY + h%3 );
+                    mv_data.Vectors(1)[j][i] = MVector( -(2<<prec) + int(h%5) - 2,
+                                                        -(1<<prec) + int(h%3) - 1 );
+                    mv_data.Vectors(2)[j][i] = MVector( (2<<prec) + int(h%3) - 1,
+                                                        (1<<prec) + int(h%5) - 2 );
+                }
+            }
+
+            vector<double> times;
+            for (int r=0; r<=opts.repeats; ++r)
+            {
+                // Time adding the prediction, as the decoder does, then
+                // take it away again to restore the picture
+                const double start = StageClock();
+                MotionCompensator::CompensatePicture(predparams, ADD, mv_data, &pic, refs);
+                if (r>0)
+                    times.push_back(StageClock()-start);
+                MotionCompensator::CompensatePicture(predparams, SUBTRACT, mv_data, &pic, refs);
+            }
+            results.Add("motion_comp", names[prec], xl, yl, times);
+        }
+    }
+
+    void BenchArithCodec(const BenchOptions& opts, BenchResults& results)
+    {
+        const int depth = 4;
+        const int quant_step = 8;
+        const int pad = 1<<depth;
+        const int xl = ((opts.width+pad-1)/pad)*pad;
+        const int yl = ((opts.height+pad-1)/pad)*pad;
+
+        PicArray pic_data(opts.height, opts.width);
+        MakeComponent(pic_data, 0, 0);
+        CoeffArray coeff_data(yl, xl);
+        WaveletTransform wtransform(depth, DD9_7);
+        wtransform.Transform(FORWARD, pic_data, coeff_data);
+        for (int j=0; j<yl; ++j)
+            for (int i=0; i<xl; ++i)
+                coeff_data[j][i] = CoeffType(coeff_data[j][i]/quant_step);
+
+        vector<double> enc_times, dec_times;
+        for (int r=0; r<=opts.repeats; ++r)
+        {
+            BenchByteIO coded;
+            double start = StageClock();
+            {
+                BenchCodec codec(&coded);
+                codec.Compress(coeff_data);
+            }
+            const double enc = StageClock()-start;
+
+            CoeffArray out_data(yl, xl);
+            out_data.BandList() = coeff_data.BandList();
+            coded.Rewind();
+            ByteIO byteio(coded);
+            start = StageClock();
+            {
+                BenchCodec codec(&byteio);
+                codec.Decompress(out_data, coded.GetSize());
+            }
+            const double dec = StageClock()-start;
+
+            if (r>0)
+            {
+                enc_times.push_back(enc);
+                dec_times.push_back(dec);
+            }
+            else
+            {
+                for (int j=0; j<yl; ++j)
+                {
+                    for (int i=0; i<xl; ++i)
+                    {
+                        if (out_data[j][i] != coeff_data[j][i])
+                        {
+                            cerr << "Arithmetic decoding does not match" << endl;
+                            exit(EXIT_FAILURE);
+                        }
+                    }
+                }
+            }
+        }
+        results.Add("arith_codec", "encode", opts.width, opts.height, enc_times);
+        results.Add("arith_codec", "decode", opts.width, opts.height, dec_times);
+    }
+
+    void BenchPrefilters(const BenchOptions& opts, BenchResults& results)
+    {
+        const char* names[] = { "CWM", "RECTLP", "DIAGLP" };
+        const int strength = 5;
+        PicArray pic_data(opts.height, opts.width);
+        MakeComponent(pic_data, 0, 0);
+
+        for (int f=0; f<3; ++f)
+        {
+            vector<double> times;
+            for (int r=0; r<=opts.repeats; ++r)
+            {
+                PicArray work_data(pic_data);
+                const double start = StageClock();
+                if (f==0)
+                    CWMFilterComponent(work_data, strength);
+                else if (f==1)
+                    LPFilter(work_data, opts.qf, strength);
+                else
+                    DiagFilter(work_data, opts.qf, strength);
+                if (r>0)
+                    times.push_back(StageClock()-start);
+            }
+            results.Add("prefilter", names[f], opts.width, opts.height, times);
+        }
+    }
+
+    // Encodes and then decodes a synthetic sequence in one of the standard
+    // formats, timing the whole of each
+    void BenchEndToEnd(const BenchOptions& opts, BenchResults& results,
+                       const string& size)
+    {
+        dirac_encoder_presets_t preset;
+        if (size=="1080p")
+            preset = VIDEO_FORMAT_HD_1080P50;
+        else if (size=="4k")
+            preset = VIDEO_FORMAT_UHDTV_4K50;
+        else if (size=="720p")
+            preset = VIDEO_FORMAT_HD_720P50;
+        else if (size=="sd")
+            preset = VIDEO_FORMAT_SD_576I50;
+        else
+        {
+            cerr << "Unknown end-to-end size " << size << endl;
+            exit(EXIT_FAILURE);
+        }
+
+        dirac_encoder_context_t enc_ctx;
+        dirac_encoder_context_init(&enc_ctx, preset);
+        enc_ctx.src_params.chroma = format420;
+        enc_ctx.src_params.source_sampling = 0;
+        enc_ctx.enc_params.qf = opts.qf;
+        enc_ctx.enc_params.picture_coding_mode = 0;
+        enc_ctx.decode_flag = 0;
+        enc_ctx.instr_flag = 0;
+
+        const int xl = enc_ctx.src_params.width;
+        const int yl = enc_ctx.src_params.height;
+        const int frame_size = xl*yl + 2*(xl/2)*(yl/2);
+
+        vector<unsigned char> frame_buf(frame_size);
+        vector<unsigned char> coded;
+        vector<unsigned char> out_buf(frame_size+(1<<20));
+
+        dirac_encoder_t* encoder = dirac_encoder_init(&enc_ctx, 0);
+        if (!encoder)
+        {
+            cerr << "Can't initialise the encoder for " << size << endl;
+            exit(EXIT_FAILURE);
+        }
+
+        // Pictures are generated before they're loaded, outside the timing
+        double enc_time = 0.0;
+        int frames_loaded = 0;
+        bool go = true;
+        while (go)
+        {
+            double start;
+            if (frames_loaded < opts.frames)
+            {
+                MakeFrame(&frame_buf[0], xl, yl, frames_loaded);
+                start = StageClock();
+                if (dirac_encoder_load(encoder, &frame_buf[0], frame_size) < 0)
+                {
+                    cerr << "Encoder error for " << size << endl;
+                    exit(EXIT_FAILURE);
+                }
+                ++frames_loaded;
+            }
+            else
+            {
+                start = StageClock();
+                dirac_encoder_end_sequence(encoder);
+            }
+
+            dirac_encoder_state_t state;
+            do
+            {
+                encoder->enc_buf.buffer = &out_buf[0];
+                encoder->enc_buf.size = out_buf.size();
+                state = dirac_encoder_output(encoder);
+                if (state==ENC_STATE_AVAIL || state==ENC_STATE_EOS)
+                    coded.insert(coded.end(), encoder->enc_buf.buffer,
+                                 encoder->enc_buf.buffer+encoder->enc_buf.size);
+                if (state==ENC_STATE_EOS)
+                    go = false;
+                else if (state==ENC_STATE_INVALID)
+                {
+                    cerr << "Encoder error for " << size << endl;
+                    exit(EXIT_FAILURE);
+                }
+            } while (state==ENC_STATE_AVAIL);
+            enc_time += StageClock()-start;
+        }
+        dirac_encoder_close(encoder);
+
+        // Decode the coded stream from memory
+        dirac_decoder_t* decoder = dirac_decoder_init(0);
+        unsigned char* buf[3] = { NULL, NULL, NULL };
+        int frames_decoded = 0;
+        bool fed = false;
+        const double start = StageClock();
+        go = true;
+        while (go)
+        {
+            switch (dirac_parse(decoder))
+            {
+            case STATE_BUFFER:
+                if (fed || coded.empty())
+                    go = false;
+                else
+                {
+                    dirac_buffer(decoder, &coded[0], &coded[0]+coded.size());
+                    fed = true;
+                }
+                break;
+            case STATE_SEQUENCE:
+                for (int c=0; c<3; ++c)
+                {
+                    delete [] buf[c];
+                    buf[c] = new unsigned char[c==0 ?
+                        decoder->src_params.width*decoder->src_params.height :
+                        decoder->src_params.chroma_width*decoder->src_params.chroma_height];
+                }
+                dirac_set_buf(decoder, buf, NULL);
+                break;
+            case STATE_PICTURE_AVAIL:
+                ++frames_decoded;
+                break;
+            case STATE_SEQUENCE_END:
+                go = false;
+                break;
+            case STATE_INVALID:
+                cerr << "Decoder error for " << size << endl;
+                exit(EXIT_FAILURE);
+            default:
+                break;
+            }
+        }
+        const double dec_time = StageClock()-start;
+        dirac_decoder_close(decoder);
+        for (int c=0; c<3; ++c)
+            delete [] buf[c];
+
+        if (frames_loaded==0 || frames_decoded!=frames_loaded)
+        {
+            cerr << "Decoded " << frames_decoded << " of " << frames_loaded
+                 << " pictures for " << size << endl;
+            exit(EXIT_FAILURE);
+        }
+
+        // Pictures aren't timed individually, since the encoder holds them
+        // back, so each end-to-end benchmark is a single run timed over the
+        // whole sequence
+        results.Add("encode", size, xl, yl,
+                    vector<double>(1, enc_time/frames_loaded));
+        results.Add("decode", size, xl, yl,
+                    vector<double>(1, dec_time/frames_decoded));
+    }
+
+    void DisplayHelp(const char* name)
+    {
+        cout << "Usage: " << name << " [options]" << endl;
+        cout << "\nName              Type    Default Value Description";
+        cout << "\n====              ====    ============= ===========                                       ";
+        cout << "\nwidth             ulong   1920          Kernel picture width";
+        cout << "\nheight            ulong   1080          Kernel picture height";
+        cout << "\nrepeats           ulong   10            Timed runs of each kernel, after one warm-up run";
+        cout << "\nframes            ulong   5             Pictures coded in each end-to-end benchmark";
+        cout << "\nqf                float   7.0F          End-to-end quality factor, also used by the prefilters";
+        cout << "\nsizes             string  1080p,4k      End-to-end formats (sd 720p 1080p 4k), or none";
+        cout << "\nonly              string  [ all ]       Run only the benchmarks whose names contain this";
+        cout << "\njson              bool    false         Write JSON rather than CSV";
+        cout << "\nh|help            bool    false         Display help message";
+        cout << "\n\nBenchmarks: wavelet_forward wavelet_backward block_diff upconvert downconvert";
+        cout << "\n            motion_comp arith_codec prefilter encode decode";
+        cout << endl;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    BenchOptions opts;
+    opts.width = 1920;
+    opts.height = 1080;
+    opts.repeats = 10;
+    opts.frames = 5;
+    opts.qf = 7.0f;
+    opts.json = false;
+    string sizes = "1080p,4k";
+
+    for (int i=1; i<argc; ++i)
+    {
+        const bool has_value = i+1<argc;
+        if ( strcmp(argv[i], "-width")==0 && has_value )
+            opts.width = atoi(argv[++i]);
+        else if ( strcmp(argv[i], "-height")==0 && has_value )
+            opts.height = atoi(argv[++i]);
+        else if ( strcmp(argv[i], "-repeats")==0 && has_value )
+            opts.repeats = atoi(argv[++i]);
+        else if ( strcmp(argv[i], "-frames")==0 && has_value )
+            opts.frames = atoi(argv[++i]);
+        else if ( strcmp(argv[i], "-qf")==0 && has_value )
+            opts.qf = float(atof(argv[++i]));
+        else if ( strcmp(argv[i], "-sizes")==0 && has_value )
+            sizes = argv[++i];
+        else if ( strcmp(argv[i], "-only")==0 && has_value )
+            opts.only = argv[++i];
+        else if ( strcmp(argv[i], "-json")==0 )
+            opts.json = true;
+        else
+        {
+            DisplayHelp(argv[0]);
+            return strcmp(argv[i], "-h")==0 || strcmp(argv[i], "-help")==0 ?
+                   EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if (opts.width < 32 || opts.height < 32 || opts.repeats <= 0 || opts.frames <= 0)
+    {
+        cerr << "Invalid benchmark parameters" << endl;
+        return EXIT_FAILURE;
+    }
+
+    if (sizes != "none")
+    {
+        for (size_t pos=0; pos<=sizes.length(); )
+        {
+            size_t end = sizes.find(',', pos);
+            if (end == string::npos)
+                end = sizes.length();
+            if (end > pos)
+                opts.sizes.push_back(sizes.substr(pos, end-pos));
+            pos = end+1;
+        }
+    }
+
+    BenchResults results(opts.json);
+
+    if (Selected(opts, "wavelet_forward") || Selected(opts, "wavelet_backward"))
+        BenchWavelet(opts, results);
+    if (Selected(opts, "block_diff"))
+        BenchBlockDiffs(opts, results);
+    BenchConverters(opts, results);
+    if (Selected(opts, "motion_comp"))
+        BenchMotionComp(opts, results);
+    if (Selected(opts, "arith_codec"))
+        BenchArithCodec(opts, results);
+    if (Selected(opts, "prefilter"))
+        BenchPrefilters(opts, results);
+    if (Selected(opts, "encode") || Selected(opts, "decode"))
+    {
+        for (size_t s=0; s<opts.sizes.size(); ++s)
+            BenchEndToEnd(opts, results, opts.sizes[s]);
+    }
+
+    return EXIT_SUCCESS;
+}